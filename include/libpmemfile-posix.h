@@ -40,6 +40,7 @@
 #ifndef LIBPMEMFILE_POSIX_H
 #define LIBPMEMFILE_POSIX_H 1
 
+#include <stdint.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/uio.h>
@@ -161,6 +162,13 @@
 #define PMEMFILE_FALLOC_FL_ZERO_RANGE      0x10
 #define PMEMFILE_FALLOC_FL_INSERT_RANGE    0x20
 
+#define PMEMFILE_POSIX_FADV_NORMAL     0
+#define PMEMFILE_POSIX_FADV_RANDOM     1
+#define PMEMFILE_POSIX_FADV_SEQUENTIAL 2
+#define PMEMFILE_POSIX_FADV_WILLNEED   3
+#define PMEMFILE_POSIX_FADV_DONTNEED   4
+#define PMEMFILE_POSIX_FADV_NOREUSE    5
+
 #define PMEMFILE_FD_CLOEXEC 1
 
 #define PMEMFILE_RENAME_NOREPLACE	(1 << 0)
@@ -225,6 +233,25 @@ unsigned pmemfile_pool_root_count(PMEMfilepool *);
 PMEMfilepool *pmemfile_pool_create(const char *pathname, size_t poolsize,
 		pmemfile_mode_t mode);
 
+/* 512 byte inodes instead of 4 KiB, with all dirents stored out of line */
+#define PMEMFILE_POOL_COMPACT_INODES (1 << 0)
+
+PMEMfilepool *pmemfile_pool_xcreate(const char *pathname, size_t poolsize,
+		pmemfile_mode_t mode, uint64_t flags);
+
+#define PMEMFILE_MAX_BLOCK_CLASSES 7
+
+/* data blocks of 'size' bytes, carved 'units_per_block' at a time */
+struct pmemfile_block_class {
+	size_t size;
+	unsigned units_per_block;
+};
+
+/* classes are recorded in the pool, NULL means defaults of the process */
+PMEMfilepool *pmemfile_pool_xcreate_classes(const char *pathname,
+		size_t poolsize, pmemfile_mode_t mode, uint64_t flags,
+		const struct pmemfile_block_class *classes, unsigned nclasses);
+
 PMEMfilepool *pmemfile_pool_open(const char *pathname);
 void pmemfile_pool_close(PMEMfilepool *pfp);
 void pmemfile_pool_set_device(PMEMfilepool *pfp, pmemfile_dev_t dev);
@@ -271,6 +298,24 @@ pmemfile_ssize_t pmemfile_writev(PMEMfilepool *, PMEMfile *file,
 pmemfile_ssize_t pmemfile_pwritev(PMEMfilepool *, PMEMfile *file,
 	const pmemfile_iovec_t *iov, int iovcnt, pmemfile_off_t offset);
 
+#define PMEMFILE_RWF_HIPRI	0x00000001
+#define PMEMFILE_RWF_DSYNC	0x00000002
+#define PMEMFILE_RWF_SYNC	0x00000004
+#define PMEMFILE_RWF_NOWAIT	0x00000008
+#define PMEMFILE_RWF_APPEND	0x00000010
+
+/*
+ * Not in POSIX:
+ * Linux specific preadv2/pwritev2 equivalents. Offset -1 means the current
+ * file position is used and updated.
+ */
+pmemfile_ssize_t pmemfile_preadv2(PMEMfilepool *, PMEMfile *file,
+	const pmemfile_iovec_t *iov, int iovcnt, pmemfile_off_t offset,
+	int flags);
+pmemfile_ssize_t pmemfile_pwritev2(PMEMfilepool *, PMEMfile *file,
+	const pmemfile_iovec_t *iov, int iovcnt, pmemfile_off_t offset,
+	int flags);
+
 pmemfile_off_t pmemfile_lseek(PMEMfilepool *pfp, PMEMfile *file,
 		pmemfile_off_t offset, int whence);
 
@@ -374,6 +419,38 @@ struct pmemfile_stats {
 	unsigned blocks;
 };
 void pmemfile_stats(PMEMfilepool *pfp, struct pmemfile_stats *stats);
+
+/*
+ * Not in POSIX:
+ * Runtime state of the pool in this process, cheap to query. New fields are
+ * only appended, callers pass sizeof of the structure they were built with.
+ */
+#define PMEMFILE_MAX_ARENAS 16
+
+struct pmemfile_runtime_stats {
+	/* pmemobj arenas created for the pool (PMEMFILE_ARENAS) */
+	unsigned arenas;
+	/* bytes allocated from each of them */
+	uint64_t arena_size[PMEMFILE_MAX_ARENAS];
+
+	/*
+	 * Inodes and lists of inodes orphaned by previous runs of the pool,
+	 * still waiting to be freed in background.
+	 */
+	unsigned orphans;
+	/* time it took to open the pool, in nanoseconds */
+	uint64_t open_ns;
+
+	/* preallocated transaction log buffers of the pool */
+	unsigned tx_logs;
+	/* how many of them are used by running transactions */
+	unsigned tx_logs_busy;
+	/* transactions which got one of them since the pool was opened */
+	uint64_t tx_logs_attached;
+};
+int pmemfile_runtime_stats(PMEMfilepool *pfp,
+		struct pmemfile_runtime_stats *stats, size_t size);
+
 int pmemfile_statfs(PMEMfilepool *pfp, pmemfile_statfs_t *buf);
 
 int pmemfile_truncate(PMEMfilepool *, const char *path, pmemfile_off_t length);
@@ -390,6 +467,13 @@ int pmemfile_fallocate(PMEMfilepool *, PMEMfile *file, int mode,
 int pmemfile_posix_fallocate(PMEMfilepool *pfp, PMEMfile *file,
 		pmemfile_off_t offset, pmemfile_off_t length);
 
+/*
+ * Unlike posix_fadvise, pmemfile_fadvise returns -1 and sets errno
+ * on failure.
+ */
+int pmemfile_fadvise(PMEMfilepool *pfp, PMEMfile *file, pmemfile_off_t offset,
+		pmemfile_off_t len, int advice);
+
 char *pmemfile_get_dir_path(PMEMfilepool *pfp, PMEMfile *dir, char *buf,
 		size_t size);
 
@@ -409,6 +493,74 @@ const char *pmemfile_errormsg(void);
 int pmemfile_pool_resume(PMEMfilepool *pfp, const char *pathname);
 int pmemfile_pool_suspend(PMEMfilepool *pfp);
 
+/*
+ * Asynchronous I/O.
+ *
+ * Requests are copied into the submission ring of a context by
+ * pmemfile_aio_submit and executed by the worker threads of the pool.
+ * Results are posted to the completion ring, from where they can be
+ * collected by pmemfile_aio_reap. Every posted completion increments
+ * the eventfd counter returned by pmemfile_aio_eventfd, so the context
+ * can be polled together with other file descriptors.
+ *
+ * All contexts must be destroyed before the pool is closed.
+ */
+typedef struct pmemfile_aio_ctx PMEMfileaioctx;
+
+#define PMEMFILE_AIO_OP_READ		0
+#define PMEMFILE_AIO_OP_WRITE		1
+#define PMEMFILE_AIO_OP_FSYNC		2
+#define PMEMFILE_AIO_OP_FALLOCATE	3
+
+struct pmemfile_aio_sqe {
+	uint32_t opcode;
+	int mode;		/* fallocate mode */
+	PMEMfile *file;
+	void *buf;		/* read / write buffer */
+	size_t len;
+	pmemfile_off_t offset;
+	uint64_t user_data;	/* copied to the completion */
+};
+
+struct pmemfile_aio_cqe {
+	uint64_t user_data;
+	pmemfile_ssize_t res;	/* result of the operation or -errno */
+};
+
+PMEMfileaioctx *pmemfile_aio_setup(PMEMfilepool *pfp, unsigned entries);
+int pmemfile_aio_submit(PMEMfileaioctx *ctx,
+		const struct pmemfile_aio_sqe *sqes, unsigned nr);
+int pmemfile_aio_reap(PMEMfileaioctx *ctx, struct pmemfile_aio_cqe *cqes,
+		unsigned min_nr, unsigned max_nr);
+int pmemfile_aio_eventfd(PMEMfileaioctx *ctx);
+void pmemfile_aio_destroy(PMEMfileaioctx *ctx);
+
+/*
+ * Batches of metadata operations.
+ *
+ * Operations queued in a batch are applied in order, in a single
+ * transaction, by pmemfile_batch_commit - either all of them take effect or
+ * none does. Parent directories of queued paths must exist at commit time
+ * or be created by an earlier pmemfile_batch_mkdir of the same batch.
+ * Unlink and rename work only on non-directories which exist when the batch
+ * is committed.
+ *
+ * pmemfile_batch_commit and pmemfile_batch_abort free the batch.
+ * A batch must not be used by more than one thread at the same time.
+ */
+typedef struct pmemfile_batch PMEMfilebatch;
+
+PMEMfilebatch *pmemfile_batch_begin(PMEMfilepool *pfp);
+int pmemfile_batch_create(PMEMfilebatch *batch, const char *path,
+		pmemfile_mode_t mode);
+int pmemfile_batch_mkdir(PMEMfilebatch *batch, const char *path,
+		pmemfile_mode_t mode);
+int pmemfile_batch_unlink(PMEMfilebatch *batch, const char *path);
+int pmemfile_batch_rename(PMEMfilebatch *batch, const char *old_path,
+		const char *new_path);
+int pmemfile_batch_commit(PMEMfilebatch *batch, int *errors);
+void pmemfile_batch_abort(PMEMfilebatch *batch);
+
 #include "libpmemfile-posix-stubs.h"
 
 #ifdef __cplusplus
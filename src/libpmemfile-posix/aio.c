@@ -0,0 +1,719 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * aio.c -- asynchronous I/O
+ *
+ * Every context has a submission ring, which is filled by the application,
+ * and a completion ring, which is filled by workers. All contexts of a pool
+ * are served by the same set of worker threads, created on first
+ * pmemfile_aio_setup. A context is processed by at most one worker at
+ * a time, so requests from one context are executed in submission order.
+ * Workers are stopped while the pool is suspended. Suspend first pauses
+ * them, so that it can still back out, and resume starts them paused, so
+ * that a failure to create threads happens before the pool is committed to.
+ *
+ * Workers take requests in batches and post all completions of a batch at
+ * once (with one eventfd write). Writes are persistent when pmemfile_pwrite
+ * returns, so fsync requests only have to wait for the requests submitted
+ * before them - all fsyncs in a batch share a single drain.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "aio.h"
+#include "alloc.h"
+#include "libpmemfile-posix.h"
+#include "os_thread.h"
+#include "out.h"
+#include "pool.h"
+#include "utils.h"
+
+#define AIO_DEFAULT_WORKERS 2
+#define AIO_MAX_WORKERS 64
+#define AIO_MAX_ENTRIES 4096
+#define AIO_BATCH 32
+
+struct pmemfile_aio_ctx {
+	PMEMfilepool *pfp;
+	struct pmemfile_aio_workers *workers;
+
+	/* submission ring */
+	struct pmemfile_aio_sqe *sq;
+	unsigned sq_mask;
+	unsigned sq_head;
+	unsigned sq_tail;
+
+	/* completion ring */
+	struct pmemfile_aio_cqe *cq;
+	unsigned cq_entries;
+	unsigned cq_head;
+	unsigned cq_tail;
+
+	/* number of submitted requests whose completions were not reaped */
+	unsigned inflight;
+
+	/* context is being processed by one of the workers */
+	bool busy;
+
+	/* context is on the ready list */
+	bool queued;
+	struct pmemfile_aio_ctx *next_ready;
+
+	/* signalled when new completions are posted */
+	os_cond_t cq_cond;
+
+	int eventfd;
+};
+
+struct pmemfile_aio_workers {
+	/* protects all fields of workers and all contexts using them */
+	os_mutex_t lock;
+
+	/* signalled when there's a new ready context or workers should stop */
+	os_cond_t work_cond;
+
+	/* contexts with pending submissions, which are not processed yet */
+	struct pmemfile_aio_ctx *ready_head;
+	struct pmemfile_aio_ctx *ready_tail;
+
+	unsigned contexts;
+	bool stop;
+
+	/* workers don't take requests from the ready list */
+	bool paused;
+
+	/* number of workers executing a batch */
+	unsigned active;
+
+	/* signalled when ready list is empty and no worker is active */
+	os_cond_t idle_cond;
+
+	/* signalled when a context is destroyed */
+	os_cond_t contexts_cond;
+
+	unsigned nthreads;
+	os_thread_t threads[];
+};
+
+/*
+ * aio_ctx_enqueue -- puts context on the ready list and wakes up one worker
+ *
+ * Must be called with workers lock held.
+ */
+static void
+aio_ctx_enqueue(struct pmemfile_aio_workers *w, struct pmemfile_aio_ctx *ctx)
+{
+	ASSERT(!ctx->queued);
+	ASSERT(!ctx->busy);
+
+	ctx->queued = true;
+	ctx->next_ready = NULL;
+
+	if (w->ready_tail)
+		w->ready_tail->next_ready = ctx;
+	else
+		w->ready_head = ctx;
+	w->ready_tail = ctx;
+
+	os_cond_signal(&w->work_cond);
+}
+
+/*
+ * aio_ctx_dequeue -- takes first context from the ready list
+ *
+ * Must be called with workers lock held.
+ */
+static struct pmemfile_aio_ctx *
+aio_ctx_dequeue(struct pmemfile_aio_workers *w)
+{
+	struct pmemfile_aio_ctx *ctx = w->ready_head;
+
+	w->ready_head = ctx->next_ready;
+	if (!w->ready_head)
+		w->ready_tail = NULL;
+
+	ctx->next_ready = NULL;
+	ctx->queued = false;
+
+	return ctx;
+}
+
+/*
+ * aio_execute_batch -- executes requests and fills completions
+ */
+static void
+aio_execute_batch(PMEMfilepool *pfp, const struct pmemfile_aio_sqe *sqes,
+		struct pmemfile_aio_cqe *cqes, unsigned nr)
+{
+	bool drain = false;
+
+	for (unsigned i = 0; i < nr; ++i) {
+		const struct pmemfile_aio_sqe *sqe = &sqes[i];
+		pmemfile_ssize_t ret;
+
+		cqes[i].user_data = sqe->user_data;
+
+		switch (sqe->opcode) {
+		case PMEMFILE_AIO_OP_READ:
+			ret = pmemfile_pread(pfp, sqe->file, sqe->buf, sqe->len,
+					sqe->offset);
+			break;
+		case PMEMFILE_AIO_OP_WRITE:
+			ret = pmemfile_pwrite(pfp, sqe->file, sqe->buf,
+					sqe->len, sqe->offset);
+			break;
+		case PMEMFILE_AIO_OP_FALLOCATE:
+			if ((pmemfile_off_t)sqe->len < 0) {
+				errno = EINVAL;
+				ret = -1;
+				break;
+			}
+			ret = pmemfile_fallocate(pfp, sqe->file, sqe->mode,
+					sqe->offset, (pmemfile_off_t)sqe->len);
+			break;
+		case PMEMFILE_AIO_OP_FSYNC:
+			if (!sqe->file) {
+				errno = EBADF;
+				ret = -1;
+				break;
+			}
+			drain = true;
+			ret = 0;
+			break;
+		default:
+			errno = EINVAL;
+			ret = -1;
+			break;
+		}
+
+		cqes[i].res = ret < 0 ? -errno : ret;
+	}
+
+	if (drain)
+		pmemfile_drain(pfp);
+}
+
+/*
+ * aio_post_completions -- copies completions to the completion ring
+ * and notifies waiters
+ *
+ * Must be called with workers lock held.
+ */
+static void
+aio_post_completions(struct pmemfile_aio_ctx *ctx,
+		const struct pmemfile_aio_cqe *cqes, unsigned nr)
+{
+	unsigned mask = ctx->cq_entries - 1;
+
+	for (unsigned i = 0; i < nr; ++i)
+		ctx->cq[ctx->cq_tail++ & mask] = cqes[i];
+
+	os_cond_broadcast(&ctx->cq_cond);
+
+	uint64_t cnt = nr;
+	if (write(ctx->eventfd, &cnt, sizeof(cnt)) != sizeof(cnt))
+		LOG(LINF, "!cannot notify eventfd %d", ctx->eventfd);
+}
+
+/*
+ * aio_worker -- worker thread main loop
+ */
+static void *
+aio_worker(void *arg)
+{
+	struct pmemfile_aio_workers *w = arg;
+	struct pmemfile_aio_sqe sqes[AIO_BATCH];
+	struct pmemfile_aio_cqe cqes[AIO_BATCH];
+
+	os_mutex_lock(&w->lock);
+
+	while (true) {
+		while ((w->paused || !w->ready_head) && !w->stop)
+			os_cond_wait(&w->work_cond, &w->lock);
+
+		/*
+		 * pending requests are executed even if we are stopping,
+		 * unless workers are paused - then they wait for resume
+		 */
+		if (w->paused || !w->ready_head)
+			break;
+
+		struct pmemfile_aio_ctx *ctx = aio_ctx_dequeue(w);
+		ctx->busy = true;
+		w->active++;
+
+		unsigned nr = 0;
+		while (nr < AIO_BATCH && ctx->sq_head != ctx->sq_tail)
+			sqes[nr++] = ctx->sq[ctx->sq_head++ & ctx->sq_mask];
+
+		os_mutex_unlock(&w->lock);
+
+		aio_execute_batch(ctx->pfp, sqes, cqes, nr);
+
+		os_mutex_lock(&w->lock);
+
+		aio_post_completions(ctx, cqes, nr);
+		ctx->busy = false;
+		w->active--;
+
+		if (ctx->sq_head != ctx->sq_tail)
+			aio_ctx_enqueue(w, ctx);
+		else if (!w->active && !w->ready_head)
+			os_cond_broadcast(&w->idle_cond);
+	}
+
+	os_mutex_unlock(&w->lock);
+
+	return NULL;
+}
+
+/*
+ * aio_workers_stop -- stops first nthreads workers and waits for them
+ */
+static void
+aio_workers_stop(struct pmemfile_aio_workers *w, unsigned nthreads)
+{
+	os_mutex_lock(&w->lock);
+	w->stop = true;
+	os_cond_broadcast(&w->work_cond);
+	os_mutex_unlock(&w->lock);
+
+	for (unsigned i = 0; i < nthreads; ++i)
+		os_thread_join(&w->threads[i], NULL);
+}
+
+/*
+ * aio_workers_start -- starts worker threads
+ *
+ * On failure no thread is left running.
+ */
+static int
+aio_workers_start(struct pmemfile_aio_workers *w)
+{
+	os_mutex_lock(&w->lock);
+	w->stop = false;
+	os_mutex_unlock(&w->lock);
+
+	for (unsigned i = 0; i < w->nthreads; ++i) {
+		int error = os_thread_create(&w->threads[i], aio_worker, w);
+		if (error) {
+			ERR("cannot create aio worker thread: %d", error);
+			aio_workers_stop(w, i);
+			return error;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * aio_workers_get -- returns workers of the pool, starts them if needed
+ */
+static struct pmemfile_aio_workers *
+aio_workers_get(PMEMfilepool *pfp)
+{
+	struct pmemfile_aio_workers *w;
+
+	os_mutex_lock(&pfp->aio_mutex);
+
+	w = pfp->aio;
+	if (w)
+		goto end;
+
+	unsigned nthreads = AIO_DEFAULT_WORKERS;
+	char *env = getenv("PMEMFILE_AIO_WORKERS");
+	if (env) {
+		char *end;
+		unsigned long val = strtoul(env, &end, 10);
+		if (*end != 0 || val == 0 || val > AIO_MAX_WORKERS)
+			LOG(LUSR, "invalid PMEMFILE_AIO_WORKERS value: %s",
+					env);
+		else
+			nthreads = (unsigned)val;
+	}
+
+	w = pf_calloc(1, sizeof(*w) + nthreads * sizeof(w->threads[0]));
+	if (!w)
+		goto end;
+
+	os_mutex_init(&w->lock);
+	os_cond_init(&w->work_cond);
+	os_cond_init(&w->idle_cond);
+	os_cond_init(&w->contexts_cond);
+	w->nthreads = nthreads;
+
+	int error = aio_workers_start(w);
+	if (error) {
+		os_cond_destroy(&w->contexts_cond);
+		os_cond_destroy(&w->idle_cond);
+		os_cond_destroy(&w->work_cond);
+		os_mutex_destroy(&w->lock);
+		pf_free(w);
+		w = NULL;
+		errno = error;
+		goto end;
+	}
+
+	pfp->aio = w;
+
+end:
+	os_mutex_unlock(&pfp->aio_mutex);
+
+	return w;
+}
+
+/*
+ * aio_workers_pause -- executes pending requests and pauses workers
+ * of the pool
+ *
+ * Contexts stay valid. Requests submitted from now on are executed after
+ * aio_workers_unpause.
+ */
+void
+aio_workers_pause(PMEMfilepool *pfp)
+{
+	struct pmemfile_aio_workers *w = pfp->aio;
+	if (!w)
+		return;
+
+	os_mutex_lock(&w->lock);
+	while (w->ready_head || w->active)
+		os_cond_wait(&w->idle_cond, &w->lock);
+	w->paused = true;
+	os_mutex_unlock(&w->lock);
+}
+
+/*
+ * aio_workers_unpause -- lets workers execute requests again
+ */
+void
+aio_workers_unpause(PMEMfilepool *pfp)
+{
+	struct pmemfile_aio_workers *w = pfp->aio;
+	if (!w)
+		return;
+
+	os_mutex_lock(&w->lock);
+	w->paused = false;
+	os_cond_broadcast(&w->work_cond);
+	os_mutex_unlock(&w->lock);
+}
+
+/*
+ * aio_workers_suspend -- stops workers paused by aio_workers_pause
+ */
+void
+aio_workers_suspend(PMEMfilepool *pfp)
+{
+	struct pmemfile_aio_workers *w = pfp->aio;
+	if (!w)
+		return;
+
+	ASSERT(w->paused);
+	aio_workers_stop(w, w->nthreads);
+}
+
+/*
+ * aio_workers_resume -- restarts workers stopped by aio_workers_suspend
+ *
+ * Workers stay paused until aio_workers_unpause. On failure no thread is
+ * left running.
+ */
+int
+aio_workers_resume(PMEMfilepool *pfp)
+{
+	struct pmemfile_aio_workers *w = pfp->aio;
+	if (!w)
+		return 0;
+
+	ASSERT(w->paused);
+	int error = aio_workers_start(w);
+	if (error) {
+		errno = error;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * aio_workers_destroy -- stops workers of the pool
+ *
+ * Called on pool close. Waits until all contexts are destroyed, because
+ * they keep pointers to workers.
+ */
+void
+aio_workers_destroy(PMEMfilepool *pfp)
+{
+	struct pmemfile_aio_workers *w = pfp->aio;
+	if (!w)
+		return;
+
+	os_mutex_lock(&w->lock);
+	if (w->contexts)
+		LOG(LUSR, "waiting for %u aio contexts to be destroyed",
+				w->contexts);
+	while (w->contexts)
+		os_cond_wait(&w->contexts_cond, &w->lock);
+	os_mutex_unlock(&w->lock);
+
+	aio_workers_stop(w, w->nthreads);
+
+	os_cond_destroy(&w->contexts_cond);
+	os_cond_destroy(&w->idle_cond);
+	os_cond_destroy(&w->work_cond);
+	os_mutex_destroy(&w->lock);
+	pf_free(w);
+
+	pfp->aio = NULL;
+}
+
+/*
+ * pmemfile_aio_setup -- creates asynchronous I/O context with submission
+ * ring of at least 'entries' entries
+ */
+PMEMfileaioctx *
+pmemfile_aio_setup(PMEMfilepool *pfp, unsigned entries)
+{
+	if (!pfp) {
+		LOG(LUSR, "NULL pool");
+		errno = EFAULT;
+		return NULL;
+	}
+
+	if (entries == 0 || entries > AIO_MAX_ENTRIES) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	unsigned sq_entries = 1;
+	while (sq_entries < entries)
+		sq_entries <<= 1;
+
+	struct pmemfile_aio_workers *w = aio_workers_get(pfp);
+	if (!w)
+		return NULL;
+
+	int error;
+	struct pmemfile_aio_ctx *ctx = pf_calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return NULL;
+
+	ctx->pfp = pfp;
+	ctx->workers = w;
+	ctx->sq_mask = sq_entries - 1;
+	ctx->cq_entries = sq_entries * 2;
+
+	ctx->sq = pf_calloc(sq_entries, sizeof(ctx->sq[0]));
+	if (!ctx->sq) {
+		error = errno;
+		goto sq_alloc_fail;
+	}
+
+	ctx->cq = pf_calloc(ctx->cq_entries, sizeof(ctx->cq[0]));
+	if (!ctx->cq) {
+		error = errno;
+		goto cq_alloc_fail;
+	}
+
+	ctx->eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (ctx->eventfd < 0) {
+		error = errno;
+		ERR("!eventfd");
+		goto eventfd_fail;
+	}
+
+	os_cond_init(&ctx->cq_cond);
+
+	os_mutex_lock(&w->lock);
+	w->contexts++;
+	os_mutex_unlock(&w->lock);
+
+	return ctx;
+
+eventfd_fail:
+	pf_free(ctx->cq);
+cq_alloc_fail:
+	pf_free(ctx->sq);
+sq_alloc_fail:
+	pf_free(ctx);
+	errno = error;
+	return NULL;
+}
+
+/*
+ * pmemfile_aio_submit -- queues up to 'nr' requests, returns number of
+ * queued requests
+ *
+ * Fails with EAGAIN if no request could be queued, because either
+ * the submission ring is full or the completion ring could overflow.
+ */
+int
+pmemfile_aio_submit(PMEMfileaioctx *ctx, const struct pmemfile_aio_sqe *sqes,
+		unsigned nr)
+{
+	if (!ctx || (nr > 0 && !sqes)) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (nr == 0)
+		return 0;
+
+	struct pmemfile_aio_workers *w = ctx->workers;
+
+	os_mutex_lock(&w->lock);
+
+	unsigned sq_free = ctx->sq_mask + 1 - (ctx->sq_tail - ctx->sq_head);
+	unsigned cq_free = ctx->cq_entries - ctx->inflight;
+
+	unsigned n = nr;
+	if (n > sq_free)
+		n = sq_free;
+	if (n > cq_free)
+		n = cq_free;
+
+	if (n == 0) {
+		os_mutex_unlock(&w->lock);
+		errno = EAGAIN;
+		return -1;
+	}
+
+	for (unsigned i = 0; i < n; ++i)
+		ctx->sq[ctx->sq_tail++ & ctx->sq_mask] = sqes[i];
+
+	ctx->inflight += n;
+
+	if (!ctx->busy && !ctx->queued)
+		aio_ctx_enqueue(w, ctx);
+
+	os_mutex_unlock(&w->lock);
+
+	return (int)n;
+}
+
+/*
+ * pmemfile_aio_reap -- waits for at least 'min_nr' completions and copies
+ * up to 'max_nr' of them to 'cqes', returns number of copied completions
+ *
+ * If 'min_nr' is bigger than the number of requests in flight, it waits
+ * for all of them.
+ */
+int
+pmemfile_aio_reap(PMEMfileaioctx *ctx, struct pmemfile_aio_cqe *cqes,
+		unsigned min_nr, unsigned max_nr)
+{
+	if (!ctx || (max_nr > 0 && !cqes)) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (min_nr > max_nr) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	struct pmemfile_aio_workers *w = ctx->workers;
+
+	os_mutex_lock(&w->lock);
+
+	if (min_nr > ctx->inflight)
+		min_nr = ctx->inflight;
+
+	while (ctx->cq_tail - ctx->cq_head < min_nr)
+		os_cond_wait(&ctx->cq_cond, &w->lock);
+
+	unsigned n = ctx->cq_tail - ctx->cq_head;
+	if (n > max_nr)
+		n = max_nr;
+
+	unsigned mask = ctx->cq_entries - 1;
+	for (unsigned i = 0; i < n; ++i)
+		cqes[i] = ctx->cq[ctx->cq_head++ & mask];
+
+	ctx->inflight -= n;
+
+	os_mutex_unlock(&w->lock);
+
+	return (int)n;
+}
+
+/*
+ * pmemfile_aio_eventfd -- returns eventfd signalled on every completion
+ */
+int
+pmemfile_aio_eventfd(PMEMfileaioctx *ctx)
+{
+	if (!ctx) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	return ctx->eventfd;
+}
+
+/*
+ * pmemfile_aio_destroy -- waits for submitted requests to finish and
+ * destroys the context
+ *
+ * Completions which were not reaped are discarded.
+ */
+void
+pmemfile_aio_destroy(PMEMfileaioctx *ctx)
+{
+	if (!ctx)
+		return;
+
+	struct pmemfile_aio_workers *w = ctx->workers;
+
+	os_mutex_lock(&w->lock);
+
+	while (ctx->busy || ctx->sq_head != ctx->sq_tail)
+		os_cond_wait(&ctx->cq_cond, &w->lock);
+
+	ASSERT(!ctx->queued);
+	w->contexts--;
+	os_cond_broadcast(&w->contexts_cond);
+
+	os_mutex_unlock(&w->lock);
+
+	close(ctx->eventfd);
+	os_cond_destroy(&ctx->cq_cond);
+	pf_free(ctx->cq);
+	pf_free(ctx->sq);
+	pf_free(ctx);
+}
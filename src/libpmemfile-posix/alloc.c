@@ -93,6 +93,19 @@ _pf_realloc(void *ptr, size_t size, const char *func)
 	return realloc(ptr, size);
 }
 
+static __thread const char *crash_at;
+
+/*
+ * _pf_crash_point -- terminates the process (leaving pools open), if crash was
+ * injected at the calling function
+ */
+void
+_pf_crash_point(const char *func)
+{
+	if (crash_at && strcmp(func, crash_at) == 0)
+		exit(0);
+}
+
 #ifdef FAULT_INJECTION
 void
 _pmemfile_inject_fault_at(enum pf_allocation_type type, int nth, const char *at)
@@ -118,6 +131,12 @@ _pmemfile_inject_fault_at(enum pf_allocation_type type, int nth, const char *at)
 	}
 }
 
+void
+_pmemfile_inject_crash_at(const char *at)
+{
+	crash_at = at;
+}
+
 int
 _pmemfile_fault_injection_enabled(void)
 {
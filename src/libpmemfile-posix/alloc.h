@@ -41,16 +41,19 @@ void *_pf_malloc(size_t, const char *);
 void *_pf_calloc(size_t, size_t, const char *);
 void _pf_free(void *, const char *);
 void *_pf_realloc(void *, size_t, const char *);
+void _pf_crash_point(const char *);
 
 #define pf_malloc(size) _pf_malloc(size, __func__)
 #define pf_calloc(nmemb, size) _pf_calloc(nmemb, size, __func__)
 #define pf_free(ptr) _pf_free(ptr, __func__)
 #define pf_realloc(ptr, size) _pf_realloc(ptr, size, __func__)
+#define pf_crash_point() _pf_crash_point(__func__)
 #else
 #define pf_malloc(size) malloc(size)
 #define pf_calloc(nmemb, size) calloc(nmemb, size)
 #define pf_free(ptr) free(ptr)
 #define pf_realloc(ptr, size) realloc(ptr, size)
+#define pf_crash_point() do {} while (0)
 #endif
 
 #endif
@@ -0,0 +1,169 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * arena.c -- pmemobj arenas of the pool
+ *
+ * By default pmemobj assigns threads to a handful of automatic arenas, so
+ * all writer threads of pmemfile share them with each other, and with
+ * every other user of the pool. When PMEMFILE_ARENAS is set, pool open
+ * creates that many arenas of its own, and every thread which allocates
+ * anything in the pool (inodes, metadata blocks, data blocks, extent
+ * regions) is bound to one of them, round-robin, on its first allocation.
+ *
+ * Arenas exist only in DRAM, so they are created again on every open and
+ * resume. Creating arenas requires libpmemobj 1.7 (heap.arena.create);
+ * with older versions the error is logged and pmemobj keeps its default
+ * assignment. Versions without pmemobj_ctl_exec don't get arenas at all.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "arena.h"
+#include "out.h"
+#include "pool.h"
+
+/* number of arenas created at pool open, 0 means pmemobj defaults */
+unsigned pmemfile_arenas;
+
+/*
+ * arena_gen of pools the calling thread is bound to - pmemobj keeps the
+ * binding per pool, so a thread using a few pools is bound once in each
+ */
+__thread unsigned arena_bound_gen[ARENA_BOUND_POOLS];
+
+/* which entry of arena_bound_gen is replaced next */
+static __thread unsigned arena_bound_next;
+
+/* identifies pool + pmemobj handle pairs, 0 is never used */
+static unsigned arena_gen;
+
+#ifdef HAVE_PMEMOBJ_CTL_EXEC
+
+/*
+ * arena_init -- creates arenas of the pool
+ *
+ * Failures are not fatal - pmemobj uses its own arenas then.
+ */
+void
+arena_init(PMEMfilepool *pfp)
+{
+	pfp->narenas = 0;
+	pfp->arena_gen = __sync_add_and_fetch(&arena_gen, 1);
+
+	unsigned n = pmemfile_arenas;
+	if (n > PMEMFILE_MAX_ARENAS)
+		n = PMEMFILE_MAX_ARENAS;
+
+	int oerrno = errno;
+
+	for (unsigned i = 0; i < n; ++i) {
+		unsigned id;
+
+		if (pmemobj_ctl_exec(pfp->pop, "heap.arena.create", &id)) {
+			LOG(LINF, "!cannot create arena: %s",
+					pmemobj_errormsg());
+			break;
+		}
+
+		pfp->arena_id[pfp->narenas++] = id;
+	}
+
+	errno = oerrno;
+}
+
+/*
+ * arena_bind_slow -- binds the calling thread to the next arena of the pool
+ */
+void
+arena_bind_slow(PMEMfilepool *pfp)
+{
+	unsigned idx = __sync_fetch_and_add(&pfp->arena_next, 1);
+	unsigned id = pfp->arena_id[idx % pfp->narenas];
+
+	int oerrno = errno;
+	if (pmemobj_ctl_set(pfp->pop, "heap.thread.arena_id", &id))
+		LOG(LINF, "!cannot bind thread to arena %u", id);
+	errno = oerrno;
+
+	/* don't retry on failure - default arena is still usable */
+	arena_bound_gen[arena_bound_next++ % ARENA_BOUND_POOLS] =
+			pfp->arena_gen;
+}
+
+/*
+ * arena_stats -- fills per-arena part of pool statistics
+ */
+void
+arena_stats(PMEMfilepool *pfp, struct pmemfile_runtime_stats *stats)
+{
+	char query[40];
+
+	stats->arenas = pfp->narenas;
+
+	for (unsigned i = 0; i < pfp->narenas; ++i) {
+		uint64_t size = 0;
+
+		sprintf(query, "heap.arena.%u.size", pfp->arena_id[i]);
+		if (pmemobj_ctl_get(pfp->pop, query, &size))
+			LOG(LINF, "!cannot get size of arena %u",
+					pfp->arena_id[i]);
+
+		stats->arena_size[i] = size;
+	}
+}
+
+#else
+
+void
+arena_init(PMEMfilepool *pfp)
+{
+	pfp->narenas = 0;
+	pfp->arena_gen = __sync_add_and_fetch(&arena_gen, 1);
+}
+
+void
+arena_bind_slow(PMEMfilepool *pfp)
+{
+	(void) pfp;
+}
+
+void
+arena_stats(PMEMfilepool *pfp, struct pmemfile_runtime_stats *stats)
+{
+	(void) pfp;
+
+	stats->arenas = 0;
+}
+
+#endif
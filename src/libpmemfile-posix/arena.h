@@ -0,0 +1,70 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef PMEMFILE_ARENA_H
+#define PMEMFILE_ARENA_H
+
+/*
+ * pmemobj arenas of the pool.
+ */
+
+#include "libpmemfile-posix.h"
+#include "pool.h"
+
+extern unsigned pmemfile_arenas;
+
+void arena_init(PMEMfilepool *pfp);
+void arena_bind_slow(PMEMfilepool *pfp);
+void arena_stats(PMEMfilepool *pfp, struct pmemfile_runtime_stats *stats);
+
+/* number of pools a thread can stay bound in at the same time */
+#define ARENA_BOUND_POOLS 4
+
+extern __thread unsigned arena_bound_gen[ARENA_BOUND_POOLS];
+
+/*
+ * arena_bind -- makes sure pmemobj allocations of the calling thread come
+ * from one of arenas of the pool
+ */
+static inline void
+arena_bind(PMEMfilepool *pfp)
+{
+	if (pfp->narenas == 0)
+		return;
+
+	for (unsigned i = 0; i < ARENA_BOUND_POOLS; ++i)
+		if (arena_bound_gen[i] == pfp->arena_gen)
+			return;
+
+	arena_bind_slow(pfp);
+}
+
+#endif
@@ -0,0 +1,851 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * batch.c -- group commit of metadata operations
+ *
+ * A batch collects file creations, directory creations, unlinks and renames
+ * and applies all of them in a single transaction, so the cost of starting,
+ * logging and committing a transaction is paid once per batch instead of
+ * once per operation, and either all operations or none of them take effect.
+ *
+ * Commit happens in 3 steps:
+ * 1) all paths are resolved, without taking any locks; a path whose parent
+ *    directory doesn't exist yet may refer to a directory created by an
+ *    earlier mkdir from the same batch,
+ * 2) files which are going to be unlinked or renamed are looked up and all
+ *    involved inodes (parents, unlinked files, sources and destinations of
+ *    renames) are WRITE locked in ascending order of addresses - the same
+ *    order every other multi-inode operation uses; if any of the looked up
+ *    files changed before the locks were taken, everything is unlocked and
+ *    looked up again,
+ * 3) operations are executed in order in one transaction and all locks are
+ *    dropped after it ends.
+ *
+ * Directories created by the batch don't have to be locked - they become
+ * reachable only when the transaction commits, while their parents are
+ * still locked.
+ *
+ * Files whose link count drops to 0 are put on an orphan list at the end of
+ * the transaction, all at once - inode_array_add keeps the modified element
+ * of the list locked until the transaction ends, so it can't be called
+ * repeatedly for the same list.
+ *
+ * Unlink and rename can operate only on non-directories which exist when
+ * the batch is committed (possibly replaced by an earlier rename from the
+ * same batch). This keeps paths resolved in step 1 valid for all operations.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "callbacks.h"
+#include "creds.h"
+#include "dir.h"
+#include "inode.h"
+#include "libpmemfile-posix.h"
+#include "mkdir.h"
+#include "out.h"
+#include "pool.h"
+#include "rename.h"
+#include "tx_log.h"
+#include "unlink.h"
+#include "utils.h"
+
+enum batch_op_type {
+	BATCH_CREATE,
+	BATCH_MKDIR,
+	BATCH_UNLINK,
+	BATCH_RENAME,
+};
+
+struct batch_op {
+	enum batch_op_type type;
+	pmemfile_mode_t mode;
+	char *path;
+	char *new_path;
+
+	/* state below is valid only during commit */
+
+	/* parent directory of path */
+	struct pmemfile_path_info info;
+	/* parent directory of new_path */
+	struct pmemfile_path_info new_info;
+
+	/* last component of path */
+	const char *name;
+	size_t namelen;
+
+	/*
+	 * Index of mkdir operation from the same batch, which creates parent
+	 * directory of path, or -1.
+	 */
+	ssize_t parent_op;
+
+	/* unlinked file or source of rename, as looked up before locking */
+	struct pmemfile_vinode *vinode;
+	/* destination of rename, as looked up before locking */
+	struct pmemfile_vinode *new_vinode;
+
+	/* renamed file, as found in the transaction */
+	struct pmemfile_vinode *renamed;
+
+	/* inode created by this operation */
+	TOID(struct pmemfile_inode) tinode;
+};
+
+struct pmemfile_batch {
+	PMEMfilepool *pfp;
+
+	struct batch_op *ops;
+
+	/* number of queued operations */
+	size_t nops;
+
+	/* size of ops array */
+	size_t size;
+
+	/* index of currently executed operation */
+	size_t cur;
+
+	/*
+	 * Files whose link count dropped to 0 - they are orphaned at the end
+	 * of transaction, all at once.
+	 */
+	struct pmemfile_vinode **orphans;
+	size_t norphans;
+};
+
+/*
+ * batch_path_dup -- (internal) duplicates path
+ */
+static char *
+batch_path_dup(const char *path)
+{
+	size_t len = strlen(path) + 1;
+	char *ret = pf_malloc(len);
+	if (ret)
+		memcpy(ret, path, len);
+	return ret;
+}
+
+/*
+ * batch_add -- (internal) appends operation to the batch
+ */
+static int
+batch_add(PMEMfilebatch *batch, enum batch_op_type type, const char *path,
+		const char *new_path, pmemfile_mode_t mode)
+{
+	if (!batch) {
+		LOG(LUSR, "NULL batch");
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (!path || (type == BATCH_RENAME && !new_path)) {
+		LOG(LUSR, "NULL pathname");
+		errno = ENOENT;
+		return -1;
+	}
+
+	if (batch->nops == batch->size) {
+		size_t count = batch->size * 2;
+		if (count == 0)
+			count = 16;
+
+		void *new_ops = pf_realloc(batch->ops,
+				count * sizeof(batch->ops[0]));
+		if (!new_ops)
+			return -1;
+
+		batch->ops = new_ops;
+		batch->size = count;
+	}
+
+	struct batch_op *op = &batch->ops[batch->nops];
+	memset(op, 0, sizeof(*op));
+
+	op->type = type;
+	op->mode = mode;
+	op->parent_op = -1;
+
+	op->path = batch_path_dup(path);
+	if (!op->path)
+		return -1;
+
+	if (new_path) {
+		op->new_path = batch_path_dup(new_path);
+		if (!op->new_path) {
+			pf_free(op->path);
+			return -1;
+		}
+	}
+
+	batch->nops++;
+
+	return 0;
+}
+
+/*
+ * batch_find_parent_op -- (internal) looks for mkdir operation, queued before
+ * operation "idx", which creates parent directory of its path
+ *
+ * Sets *name to the last component of the path.
+ */
+static ssize_t
+batch_find_parent_op(PMEMfilebatch *batch, size_t idx, const char **name)
+{
+	const char *path = batch->ops[idx].path;
+	size_t len = strlen(path);
+
+	/* skip trailing slashes, the last component and slashes before it */
+	while (len > 0 && path[len - 1] == '/')
+		len--;
+	while (len > 0 && path[len - 1] != '/')
+		len--;
+	*name = path + len;
+	while (len > 0 && path[len - 1] == '/')
+		len--;
+
+	if (len == 0)
+		return -1;
+
+	for (size_t i = idx; i > 0; --i) {
+		const struct batch_op *op = &batch->ops[i - 1];
+		if (op->type != BATCH_MKDIR)
+			continue;
+
+		size_t plen = strlen(op->path);
+		while (plen > 1 && op->path[plen - 1] == '/')
+			plen--;
+
+		if (plen == len && memcmp(op->path, path, len) == 0)
+			return (ssize_t)(i - 1);
+	}
+
+	return -1;
+}
+
+/*
+ * is_dot_or_dotdot -- (internal) returns true for empty name, "." and ".."
+ */
+static bool
+is_dot_or_dotdot(const char *name, size_t namelen)
+{
+	return namelen == 0 || str_compare(".", name, namelen) == 0 ||
+			str_compare("..", name, namelen) == 0;
+}
+
+/*
+ * batch_resolve -- (internal) resolves paths of operation "idx"
+ *
+ * Returns 0 on success or error code.
+ */
+static int
+batch_resolve(PMEMfilepool *pfp, const struct pmemfile_cred *cred,
+		struct pmemfile_vinode *at, PMEMfilebatch *batch, size_t idx)
+{
+	struct batch_op *op = &batch->ops[idx];
+
+	resolve_pathat(pfp, cred, at, op->path, &op->info, 0);
+
+	if (op->info.error == ENOENT &&
+			(op->type == BATCH_CREATE || op->type == BATCH_MKDIR))
+		op->parent_op = batch_find_parent_op(batch, idx, &op->name);
+
+	if (op->parent_op < 0) {
+		if (op->info.error)
+			return op->info.error;
+
+		op->name = op->info.remaining;
+	}
+
+	op->namelen = component_length(op->name);
+
+	switch (op->type) {
+	case BATCH_CREATE:
+		if (is_dot_or_dotdot(op->name, op->namelen))
+			return EEXIST;
+		if (op->name[op->namelen] == '/')
+			return EISDIR;
+		break;
+	case BATCH_MKDIR:
+		if (is_dot_or_dotdot(op->name, op->namelen))
+			return EEXIST;
+		break;
+	case BATCH_UNLINK:
+		if (is_dot_or_dotdot(op->name, op->namelen))
+			return EISDIR;
+		if (op->name[op->namelen] == '/')
+			return ENOTDIR;
+		break;
+	case BATCH_RENAME:
+		resolve_pathat(pfp, cred, at, op->new_path, &op->new_info, 0);
+		if (op->new_info.error)
+			return op->new_info.error;
+
+		if (is_dot_or_dotdot(op->name, op->namelen) ||
+				is_dot_or_dotdot(op->new_info.remaining,
+				component_length(op->new_info.remaining)))
+			return EINVAL;
+		break;
+	}
+
+	return 0;
+}
+
+/*
+ * batch_lookup -- (internal) looks up files unlinked or renamed by operation
+ *
+ * Returns 0 on success or error code.
+ */
+static int
+batch_lookup(PMEMfilepool *pfp, struct batch_op *op)
+{
+	struct pmemfile_dirent_info info;
+
+	if (op->type != BATCH_UNLINK && op->type != BATCH_RENAME)
+		return 0;
+
+	os_rwlock_rdlock(&op->info.parent->rwlock);
+	info = vinode_lookup_vinode_by_name_locked(pfp, op->info.parent,
+			op->name, op->namelen);
+	os_rwlock_unlock(&op->info.parent->rwlock);
+
+	if (!info.vinode)
+		return errno;
+
+	op->vinode = info.vinode;
+
+	if (op->type != BATCH_RENAME)
+		return 0;
+
+	/* destination may not exist */
+	os_rwlock_rdlock(&op->new_info.parent->rwlock);
+	info = vinode_lookup_vinode_by_name_locked(pfp, op->new_info.parent,
+			op->new_info.remaining,
+			component_length(op->new_info.remaining));
+	os_rwlock_unlock(&op->new_info.parent->rwlock);
+
+	if (info.dirent && !info.vinode)
+		return errno;
+
+	op->new_vinode = info.vinode;
+
+	return 0;
+}
+
+/*
+ * batch_validate -- (internal) checks that files looked up by batch_lookup
+ * didn't change before their parents were locked
+ */
+static bool
+batch_validate(PMEMfilepool *pfp, struct batch_op *op)
+{
+	struct pmemfile_dirent *dirent;
+
+	if (op->vinode) {
+		dirent = vinode_lookup_dirent_by_name_locked(pfp,
+				op->info.parent, op->name, op->namelen);
+		if (!dirent || !TOID_EQUALS(dirent->inode, op->vinode->tinode))
+			return false;
+	}
+
+	if (op->type == BATCH_RENAME) {
+		dirent = vinode_lookup_dirent_by_name_locked(pfp,
+				op->new_info.parent, op->new_info.remaining,
+				component_length(op->new_info.remaining));
+
+		if (!op->new_vinode)
+			return dirent == NULL;
+
+		if (!dirent ||
+			!TOID_EQUALS(dirent->inode, op->new_vinode->tinode))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * batch_unref -- (internal) drops references taken by batch_lookup
+ */
+static void
+batch_unref(PMEMfilepool *pfp, struct batch_op *op)
+{
+	if (op->vinode) {
+		vinode_unref(pfp, op->vinode);
+		op->vinode = NULL;
+	}
+
+	if (op->new_vinode) {
+		vinode_unref(pfp, op->new_vinode);
+		op->new_vinode = NULL;
+	}
+}
+
+/*
+ * batch_find_vinode -- (internal) finds locked vinode of "tinode"
+ *
+ * Inodes which are not locked by the batch were created by it.
+ */
+static struct pmemfile_vinode *
+batch_find_vinode(TOID(struct pmemfile_inode) tinode,
+		struct pmemfile_vinode **locked, size_t nlocked)
+{
+	for (size_t i = 0; i < nlocked; ++i)
+		if (TOID_EQUALS(locked[i]->tinode, tinode))
+			return locked[i];
+
+	LOG(LUSR, "file created by the same batch can't be unlinked or renamed");
+	pmemfile_tx_abort(EINVAL);
+	return NULL;
+}
+
+/*
+ * batch_unlink -- (internal) executes unlink operation
+ */
+static void
+batch_unlink(PMEMfilepool *pfp, PMEMfilebatch *batch, struct batch_op *op,
+		struct pmemfile_vinode **locked, size_t nlocked,
+		struct pmemfile_time t)
+{
+	struct pmemfile_dirent *dirent = vinode_lookup_dirent_by_name_locked(
+			pfp, op->info.parent, op->name, op->namelen);
+	if (!dirent)
+		pmemfile_tx_abort(errno);
+
+	struct pmemfile_vinode *vinode =
+			batch_find_vinode(dirent->inode, locked, nlocked);
+
+	if (vinode_is_dir(vinode))
+		pmemfile_tx_abort(EISDIR);
+
+	vinode_unlink_file(pfp, op->info.parent, dirent, vinode, t);
+
+	if (inode_get_nlink(vinode->inode) == 0)
+		batch->orphans[batch->norphans++] = vinode;
+}
+
+/*
+ * batch_rename -- (internal) executes rename operation
+ */
+static void
+batch_rename(PMEMfilepool *pfp, PMEMfilebatch *batch, struct batch_op *op,
+		struct pmemfile_vinode **locked, size_t nlocked,
+		struct pmemfile_time t)
+{
+	struct pmemfile_dirent_info src_info, dst_info;
+
+	src_info.dirent = vinode_lookup_dirent_by_name_locked(pfp,
+			op->info.parent, op->name, op->namelen);
+	if (!src_info.dirent)
+		pmemfile_tx_abort(errno);
+
+	src_info.vinode = batch_find_vinode(src_info.dirent->inode, locked,
+			nlocked);
+
+	/*
+	 * Renaming a directory could invalidate paths resolved for the
+	 * following operations.
+	 */
+	if (vinode_is_dir(src_info.vinode))
+		pmemfile_tx_abort(EISDIR);
+
+	dst_info.dirent = vinode_lookup_dirent_by_name_locked(pfp,
+			op->new_info.parent, op->new_info.remaining,
+			component_length(op->new_info.remaining));
+	dst_info.vinode = NULL;
+
+	if (dst_info.dirent) {
+		dst_info.vinode = batch_find_vinode(dst_info.dirent->inode,
+				locked, nlocked);
+
+		/* hard links of the same file */
+		if (dst_info.vinode == src_info.vinode)
+			return;
+
+		if (vinode_is_dir(dst_info.vinode))
+			pmemfile_tx_abort(EISDIR);
+	}
+
+	vinode_tx_rename(pfp, &op->info, &src_info, &op->new_info, &dst_info,
+			op->new_path, t);
+
+	if (dst_info.dirent && inode_get_nlink(dst_info.vinode->inode) == 0)
+		batch->orphans[batch->norphans++] = dst_info.vinode;
+
+	op->renamed = src_info.vinode;
+}
+
+/*
+ * batch_exec -- (internal) executes one operation
+ *
+ * Must be called in a transaction.
+ */
+static void
+batch_exec(PMEMfilepool *pfp, PMEMfilebatch *batch, struct batch_op *op,
+		struct pmemfile_cred *cred, struct pmemfile_vinode **locked,
+		size_t nlocked, struct pmemfile_time t)
+{
+	ASSERT_IN_TX();
+
+	TOID(struct pmemfile_inode) parent;
+
+	if (op->parent_op >= 0) {
+		parent = batch->ops[op->parent_op].tinode;
+
+		const struct pmemfile_inode *inode = PF_RO(pfp, parent);
+		struct inode_perms perms;
+		perms.flags = inode_get_flags(inode);
+		perms.uid = inode->uid;
+		perms.gid = inode->gid;
+
+		if (!can_access(cred, perms, PFILE_WANT_WRITE |
+				PFILE_WANT_EXECUTE))
+			pmemfile_tx_abort(EACCES);
+	} else {
+		parent = op->info.parent->tinode;
+	}
+
+	switch (op->type) {
+	case BATCH_CREATE: {
+		pmemfile_mode_t mode = op->mode & PMEMFILE_ALLPERMS;
+		mode &= ~pfp->umask;
+
+		op->tinode = inode_alloc(pfp, cred, PMEMFILE_S_IFREG | mode);
+		inode_add_dirent(pfp, parent, op->name, op->namelen,
+				op->tinode,
+				inode_get_ctime(PF_RO(pfp, op->tinode)));
+		break;
+	}
+	case BATCH_MKDIR:
+		op->tinode = inode_new_dir(pfp, parent, op->name, op->namelen,
+				cred, op->mode);
+		break;
+	case BATCH_UNLINK:
+		batch_unlink(pfp, batch, op, locked, nlocked, t);
+		break;
+	case BATCH_RENAME:
+		batch_rename(pfp, batch, op, locked, nlocked, t);
+		break;
+	}
+}
+
+/*
+ * batch_commit -- (internal) resolves, locks and executes all operations
+ *
+ * Returns 0 on success or error code. Index of the failed operation (or
+ * nops when failure is not related to any operation) is stored in batch->cur.
+ */
+static int
+batch_commit(PMEMfilepool *pfp, PMEMfilebatch *batch)
+{
+	struct pmemfile_cred cred;
+	struct pmemfile_vinode **locked = NULL;
+	size_t nlocked = 0;
+	int error = 0;
+
+	batch->cur = batch->nops;
+
+	if (batch->nops == 0)
+		return 0;
+
+	if (cred_acquire(pfp, &cred))
+		return errno;
+
+	struct pmemfile_vinode *at = pool_get_cwd(pfp);
+
+	for (size_t i = 0; i < batch->nops; ++i) {
+		error = batch_resolve(pfp, &cred, at, batch, i);
+		if (error) {
+			batch->cur = i;
+			goto end;
+		}
+	}
+
+	/* parents, unlinked files, sources and destinations of renames */
+	locked = pf_malloc(4 * batch->nops * sizeof(locked[0]));
+	if (!locked) {
+		error = errno;
+		goto end;
+	}
+
+	/* every operation can orphan at most 1 file */
+	batch->orphans = pf_malloc(batch->nops * sizeof(batch->orphans[0]));
+	if (!batch->orphans) {
+		error = errno;
+		goto end;
+	}
+
+	bool race;
+	do {
+		for (size_t i = 0; i < batch->nops; ++i) {
+			error = batch_lookup(pfp, &batch->ops[i]);
+			if (error) {
+				batch->cur = i;
+				goto end;
+			}
+		}
+
+		size_t n = 0;
+		for (size_t i = 0; i < batch->nops; ++i) {
+			struct batch_op *op = &batch->ops[i];
+
+			if (op->parent_op < 0)
+				locked[n++] = op->info.parent;
+			if (op->type == BATCH_RENAME)
+				locked[n++] = op->new_info.parent;
+			if (op->vinode)
+				locked[n++] = op->vinode;
+			if (op->new_vinode)
+				locked[n++] = op->new_vinode;
+		}
+
+		nlocked = vinode_wrlockv(locked, n);
+
+		race = false;
+		for (size_t i = 0; i < batch->nops && !race; ++i)
+			race = !batch_validate(pfp, &batch->ops[i]);
+
+		if (race) {
+			vinode_unlockv(locked, nlocked);
+			nlocked = 0;
+
+			for (size_t i = 0; i < batch->nops; ++i)
+				batch_unref(pfp, &batch->ops[i]);
+		}
+	} while (race);
+
+	for (size_t i = 0; i < batch->nops; ++i) {
+		struct batch_op *op = &batch->ops[i];
+
+		if ((op->parent_op < 0 && !_vinode_can_access(&cred,
+				op->info.parent, PFILE_WANT_WRITE)) ||
+			(op->type == BATCH_RENAME && !_vinode_can_access(&cred,
+				op->new_info.parent, PFILE_WANT_WRITE))) {
+			batch->cur = i;
+			error = EACCES;
+			goto end;
+		}
+	}
+
+	struct pmemfile_time t;
+	get_current_time(&t);
+
+	ASSERT_NOT_IN_TX();
+
+	TX_BEGIN_CB(pfp->pop, cb_queue, pfp) {
+		tx_log_attach(pfp);
+
+		for (batch->cur = 0; batch->cur < batch->nops; ++batch->cur)
+			batch_exec(pfp, batch, &batch->ops[batch->cur], &cred,
+					locked, nlocked, t);
+
+		if (batch->norphans)
+			vinode_orphan_many(pfp, batch->orphans,
+					batch->norphans);
+	} TX_ONABORT {
+		if (errno == ENOMEM)
+			errno = ENOSPC;
+		error = errno;
+
+		for (size_t i = 0; i < batch->norphans; ++i) {
+			if (!batch->orphans[i])
+				continue;
+
+			batch->orphans[i]->orphaned.arr = NULL;
+			batch->orphans[i]->orphaned.idx = 0;
+		}
+	} TX_END
+
+	if (error)
+		goto end;
+
+	/* update debug information about renamed vinodes */
+	for (size_t i = 0; i < batch->nops; ++i) {
+		struct batch_op *op = &batch->ops[i];
+
+		if (op->renamed)
+			vinode_replace_debug_path_locked(pfp,
+					op->new_info.parent, op->renamed,
+					op->new_info.remaining,
+					component_length(
+						op->new_info.remaining));
+	}
+
+end:
+	vinode_unlockv(locked, nlocked);
+	pf_free(locked);
+	pf_free(batch->orphans);
+	batch->orphans = NULL;
+
+	for (size_t i = 0; i < batch->nops; ++i) {
+		batch_unref(pfp, &batch->ops[i]);
+		path_info_cleanup(pfp, &batch->ops[i].new_info);
+		path_info_cleanup(pfp, &batch->ops[i].info);
+	}
+
+	vinode_unref(pfp, at);
+	cred_release(&cred);
+
+	return error;
+}
+
+/*
+ * batch_free -- (internal) frees the batch
+ */
+static void
+batch_free(PMEMfilebatch *batch)
+{
+	for (size_t i = 0; i < batch->nops; ++i) {
+		pf_free(batch->ops[i].path);
+		pf_free(batch->ops[i].new_path);
+	}
+
+	pf_free(batch->ops);
+	pf_free(batch);
+}
+
+/*
+ * pmemfile_batch_begin -- creates an empty batch of metadata operations
+ */
+PMEMfilebatch *
+pmemfile_batch_begin(PMEMfilepool *pfp)
+{
+	if (!pfp) {
+		LOG(LUSR, "NULL pool");
+		errno = EFAULT;
+		return NULL;
+	}
+
+	PMEMfilebatch *batch = pf_calloc(1, sizeof(*batch));
+	if (!batch)
+		return NULL;
+
+	batch->pfp = pfp;
+
+	return batch;
+}
+
+/*
+ * pmemfile_batch_create -- queues creation of a regular file
+ */
+int
+pmemfile_batch_create(PMEMfilebatch *batch, const char *path,
+		pmemfile_mode_t mode)
+{
+	return batch_add(batch, BATCH_CREATE, path, NULL, mode);
+}
+
+/*
+ * pmemfile_batch_mkdir -- queues creation of a directory
+ */
+int
+pmemfile_batch_mkdir(PMEMfilebatch *batch, const char *path,
+		pmemfile_mode_t mode)
+{
+	return batch_add(batch, BATCH_MKDIR, path, NULL, mode);
+}
+
+/*
+ * pmemfile_batch_unlink -- queues removal of a file
+ */
+int
+pmemfile_batch_unlink(PMEMfilebatch *batch, const char *path)
+{
+	return batch_add(batch, BATCH_UNLINK, path, NULL, 0);
+}
+
+/*
+ * pmemfile_batch_rename -- queues rename of a file
+ */
+int
+pmemfile_batch_rename(PMEMfilebatch *batch, const char *old_path,
+		const char *new_path)
+{
+	return batch_add(batch, BATCH_RENAME, old_path, new_path, 0);
+}
+
+/*
+ * pmemfile_batch_commit -- applies all queued operations atomically and
+ * frees the batch
+ *
+ * If "errors" is not NULL, it receives status of every operation: 0 when
+ * the batch succeeded, error code of the operation which failed and
+ * ECANCELED for all other operations when it didn't.
+ */
+int
+pmemfile_batch_commit(PMEMfilebatch *batch, int *errors)
+{
+	if (!batch) {
+		LOG(LUSR, "NULL batch");
+		errno = EFAULT;
+		return -1;
+	}
+
+	int error = batch_commit(batch->pfp, batch);
+
+	if (errors) {
+		for (size_t i = 0; i < batch->nops; ++i) {
+			if (error == 0)
+				errors[i] = 0;
+			else if (i == batch->cur)
+				errors[i] = error;
+			else
+				errors[i] = ECANCELED;
+		}
+	}
+
+	batch_free(batch);
+
+	if (error) {
+		errno = error;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * pmemfile_batch_abort -- frees the batch without applying any of queued
+ * operations
+ */
+void
+pmemfile_batch_abort(PMEMfilebatch *batch)
+{
+	if (!batch)
+		return;
+
+	batch_free(batch);
+}
@@ -30,12 +30,15 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "arena.h"
 #include "blocks.h"
 #include "layout.h"
 #include "inode.h"
 #include "out.h"
 #include "offset_mapping.h"
 #include "block_array.h"
+#include "block_cursor.h"
+#include "extent.h"
 #include "utils.h"
 
 /*
@@ -73,7 +76,7 @@ update_first_block_info(PMEMfilepool *pfp, struct pmemfile_vinode *vinode)
 	 * slot. This is either the block_array stored right in the
 	 * inode, ...
 	 */
-	binfo->arr = &vinode->inode->file_data.blocks;
+	binfo->arr = &inode_get_data(vinode->inode)->blocks;
 	/*
 	 * ... or if there is more than one block_array, it is
 	 * the one linked to it with the next field.
@@ -158,6 +161,8 @@ allocate_new_block_array(PMEMfilepool *pfp, struct pmemfile_vinode *vinode)
 
 	const struct pmem_block_info *info = metadata_block_info();
 
+	arena_bind(pfp);
+
 	TOID(struct pmemfile_block_array) new =
 			TX_XALLOC(struct pmemfile_block_array, info->size,
 			POBJ_XALLOC_ZERO | info->class_id);
@@ -174,8 +179,11 @@ allocate_new_block_array(PMEMfilepool *pfp, struct pmemfile_vinode *vinode)
 
 	PF_RW(pfp, new)->version = PMEMFILE_BLOCK_ARRAY_VERSION(1);
 
-	PF_RW(pfp, new)->next = vinode->inode->file_data.blocks.next;
-	TX_SET_DIRECT(&vinode->inode->file_data.blocks, next, new);
+	struct pmemfile_block_array *first =
+			&inode_get_data(vinode->inode)->blocks;
+
+	PF_RW(pfp, new)->next = first->next;
+	TX_SET_DIRECT(first, next, new);
 	vinode->first_free_block.arr = PF_RW(pfp, new);
 	vinode->first_free_block.idx = 0;
 }
@@ -352,7 +360,7 @@ is_first_block_array_empty(struct pmemfile_vinode *vinode)
 	 * If yes then in a sense it is the zeroth block array, not the first.
 	 */
 	return vinode->first_free_block.arr !=
-	    &vinode->inode->file_data.blocks;
+	    &inode_get_data(vinode->inode)->blocks;
 }
 
 /*
@@ -372,17 +380,26 @@ remove_first_block_array(PMEMfilepool *pfp, struct pmemfile_vinode *vinode)
 
 	binfo = &vinode->first_free_block;
 
-	to_remove = vinode->inode->file_data.blocks.next;
+	struct pmemfile_block_array *first =
+			&inode_get_data(vinode->inode)->blocks;
+
+	to_remove = first->next;
 
 	new_next = PF_RW(pfp, to_remove)->next;
-	TX_SET_DIRECT(&vinode->inode->file_data.blocks, next, new_next);
+	TX_SET_DIRECT(first, next, new_next);
 	if (TOID_IS_NULL(new_next))
-		binfo->arr = &vinode->inode->file_data.blocks;
+		binfo->arr = first;
 	else
 		binfo->arr = PF_RW(pfp, new_next);
 
 	TX_FREE(to_remove);
 	binfo->idx = binfo->arr->length;
+
+	/*
+	 * The array doesn't hold any block by now, but cursors could still
+	 * point to its (zeroed) slots.
+	 */
+	vinode_invalidate_block_pointers(vinode, 0, UINT64_MAX);
 }
 
 /*
@@ -466,10 +483,13 @@ block_list_remove(PMEMfilepool *pfp,
 	if (vinode->first_block == block)
 		vinode->first_block = PF_RW(pfp, block->next);
 
-	if (!TOID_IS_NULL(block->data))
-		TX_FREE(block->data);
+	block_data_tx_free(pfp, block);
 
 	if (moving_block != block) {
+		/* pointers to the moving block's descriptor become dangling */
+		vinode_invalidate_block_pointers(vinode, moving_block->offset,
+				moving_block->size);
+
 		if (vinode->first_block == moving_block)
 			vinode->first_block = block;
 		remove_block(vinode->blocks, moving_block);
@@ -0,0 +1,187 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * block_cursor.c -- per file handle cache of block pointers
+ *
+ * A cursor holds a raw pointer to a block descriptor, which becomes dangling
+ * when the descriptor is removed, relocated or its block array is freed.
+ * Every such modification is recorded in the vinode as a file range, and
+ * a cursor is dropped only when the range of its block intersects one of the
+ * ranges recorded since the cursors were last synchronized. When too many
+ * modifications happened in the meantime, all cursors are dropped.
+ */
+
+#include "block_cursor.h"
+#include "inode.h"
+#include "out.h"
+
+/*
+ * vinode_invalidate_block_pointers -- records that block descriptors
+ * covering the given file range may no longer be valid
+ *
+ * Must be called with the vinode write-locked.
+ */
+void
+vinode_invalidate_block_pointers(struct pmemfile_vinode *vinode,
+		uint64_t offset, uint64_t len)
+{
+	uint64_t idx = vinode->block_pointer_invalidation_counter %
+			BLOCK_INVALIDATION_LOG_SIZE;
+	struct block_invalidation *inv = &vinode->block_invalidations[idx];
+
+	inv->start = offset;
+	inv->end = offset + len;
+	if (inv->end < offset)
+		inv->end = UINT64_MAX;
+
+	vinode->block_pointer_invalidation_counter++;
+}
+
+/*
+ * block_cursors_sync -- drops cursors affected by modifications of the file
+ * made since the previous call
+ *
+ * Must be called with the vinode locked.
+ */
+void
+block_cursors_sync(struct block_cursors *cursors,
+		const struct pmemfile_vinode *vinode)
+{
+	uint64_t counter = vinode->block_pointer_invalidation_counter;
+	uint64_t observed = cursors->invalidation_observed;
+
+	if (observed == counter)
+		return;
+
+	ASSERT(counter > observed);
+
+	cursors->invalidation_observed = counter;
+
+	if (counter - observed > BLOCK_INVALIDATION_LOG_SIZE) {
+		for (unsigned i = 0; i < BLOCK_CURSORS; ++i)
+			cursors->cursor[i].block = NULL;
+		return;
+	}
+
+	for (; observed != counter; ++observed) {
+		const struct block_invalidation *inv =
+			&vinode->block_invalidations[observed %
+					BLOCK_INVALIDATION_LOG_SIZE];
+
+		for (unsigned i = 0; i < BLOCK_CURSORS; ++i) {
+			struct block_cursor *c = &cursors->cursor[i];
+
+			if (c->block != NULL &&
+					c->start < inv->end && inv->start < c->end)
+				c->block = NULL;
+		}
+	}
+}
+
+/*
+ * block_cursors_find -- picks a cursor for an access starting at offset
+ *
+ * Prefers the stream expected to continue at offset, then a cursor pointing
+ * to the block containing offset. Otherwise the least recently used cursor
+ * is reset and returned, to be taken over by a new stream.
+ */
+struct block_cursor *
+block_cursors_find(struct block_cursors *cursors, uint64_t offset)
+{
+	struct block_cursor *in_block = NULL;
+	struct block_cursor *lru = NULL;
+
+	for (unsigned i = 0; i < BLOCK_CURSORS; ++i) {
+		struct block_cursor *c = &cursors->cursor[i];
+
+		if (c->block == NULL) {
+			if (lru == NULL || lru->block != NULL)
+				lru = c;
+			continue;
+		}
+
+		if (c->pos == offset)
+			return c;
+
+		if (in_block == NULL && c->start <= offset && offset < c->end)
+			in_block = c;
+
+		if (lru == NULL ||
+				(lru->block != NULL &&
+				c->last_used < lru->last_used))
+			lru = c;
+	}
+
+	if (in_block)
+		return in_block;
+
+	lru->block = NULL;
+
+	return lru;
+}
+
+/*
+ * block_cursor_update -- remembers the last block used by an access, which
+ * ended at pos
+ *
+ * Must be called with the vinode locked, before the block can be modified
+ * by others.
+ */
+void
+block_cursor_update(struct block_cursors *cursors, struct block_cursor *cursor,
+		struct pmemfile_block_desc *block, uint64_t pos)
+{
+	cursor->block = block;
+	if (block == NULL)
+		return;
+
+	cursor->start = block->offset;
+	cursor->end = block->offset + block->size;
+	cursor->pos = pos;
+	cursor->last_used = ++cursors->tick;
+}
+
+/*
+ * block_cursors_merge -- stores cursors used by a positional access (a copy
+ * made while the file handle was unlocked) back in the file handle, unless
+ * the handle already holds cursors synchronized with a newer state of the
+ * vinode
+ *
+ * Must be called with the file handle locked.
+ */
+void
+block_cursors_merge(struct block_cursors *dst, const struct block_cursors *src)
+{
+	if (dst->invalidation_observed <= src->invalidation_observed)
+		*dst = *src;
+}
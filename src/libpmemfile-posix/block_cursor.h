@@ -0,0 +1,90 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef PMEMFILE_BLOCK_CURSOR_H
+#define PMEMFILE_BLOCK_CURSOR_H
+
+/*
+ * Block cursors remember the block descriptors used by the most recent
+ * accesses to a file, so that interleaved sequential streams (e.g. reading
+ * header, index and data regions of a file through one handle) don't have
+ * to look up the block tree on every call.
+ */
+
+#include <stdint.h>
+
+#include "layout.h"
+
+struct pmemfile_vinode;
+
+#define BLOCK_CURSORS 4
+
+struct block_cursor {
+	/* the last block used by the stream */
+	struct pmemfile_block_desc *block;
+
+	/* file range covered by the block when it was remembered */
+	uint64_t start;
+	uint64_t end;
+
+	/* where the stream is expected to continue */
+	uint64_t pos;
+
+	/* for picking the least recently used cursor */
+	uint64_t last_used;
+};
+
+struct block_cursors {
+	struct block_cursor cursor[BLOCK_CURSORS];
+
+	/* value of vinode->block_pointer_invalidation_counter applied */
+	uint64_t invalidation_observed;
+
+	uint64_t tick;
+};
+
+void vinode_invalidate_block_pointers(struct pmemfile_vinode *vinode,
+		uint64_t offset, uint64_t len);
+
+void block_cursors_sync(struct block_cursors *cursors,
+		const struct pmemfile_vinode *vinode);
+
+struct block_cursor *block_cursors_find(struct block_cursors *cursors,
+		uint64_t offset);
+
+void block_cursors_merge(struct block_cursors *dst,
+		const struct block_cursors *src);
+
+void block_cursor_update(struct block_cursors *cursors,
+		struct block_cursor *cursor, struct pmemfile_block_desc *block,
+		uint64_t pos);
+
+#endif
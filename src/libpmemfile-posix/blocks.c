@@ -36,37 +36,105 @@
 #include <stdio.h>
 
 #include "blocks.h"
+#include "compiler_utils.h"
 #include "out.h"
 
 #define METADATA_ID 128
 #define FIRST_BLOCK_ID 129
+/* after all possible data block classes */
+#define COMPACT_INODE_ID 136
+
+COMPILE_ERROR_ON(FIRST_BLOCK_ID + PMEMFILE_MAX_BLOCK_CLASSES >
+		COMPACT_INODE_ID);
 
 #define CONST_BLOCK_N_UNITS 16
 
 static struct pmem_block_info metadata_block =
 	{ METADATA_BLOCK_SIZE, 128 };
 
-static struct pmem_block_info data_blocks[] = {
+static struct pmem_block_info compact_inode_block =
+	{ PMEMFILE_COMPACT_INODE_SIZE, 256 };
+
+/* classes of pools created by this process, unless told otherwise */
+static struct pmem_block_info default_blocks[] = {
 	{ MIN_BLOCK_SIZE,	128 },
 	{ 256 * 1024,		16 },
 	{ 2 * 1024 * 1024,	8 },
 	{ 0 } /* terminator */
 };
 
-size_t block_alignment = MIN_BLOCK_SIZE;
-
 /*
  * set const block size
  */
 void
 set_block_size(size_t size)
 {
-	data_blocks[0].size = size;
-	data_blocks[0].units_per_block = CONST_BLOCK_N_UNITS;
+	default_blocks[0].size = size;
+	default_blocks[0].units_per_block = CONST_BLOCK_N_UNITS;
+
+	default_blocks[1].size = 0;
+}
+
+/*
+ * block_classes_default -- fills classes with defaults of the process
+ */
+void
+block_classes_default(struct pmem_block_classes *c)
+{
+	memset(c, 0, sizeof(*c));
 
-	data_blocks[1].size = 0;
+	for (unsigned i = 0; default_blocks[i].size != 0; ++i)
+		c->data[i] = default_blocks[i];
 
-	block_alignment = size;
+	c->alignment = c->data[0].size;
+}
+
+/*
+ * block_classes_set -- fills classes from user provided description
+ *
+ * Sizes must grow and be multiples of the smallest one, which must be
+ * a multiple of MIN_BLOCK_SIZE.
+ */
+int
+block_classes_set(struct pmem_block_classes *c,
+		const struct pmemfile_block_class *classes, unsigned nclasses)
+{
+	if (nclasses == 0 || nclasses > PMEMFILE_MAX_BLOCK_CLASSES) {
+		ERR("invalid number of block classes: %u", nclasses);
+		errno = EINVAL;
+		return -1;
+	}
+
+	size_t smallest = classes[0].size;
+	if (smallest == 0 || smallest % MIN_BLOCK_SIZE != 0) {
+		ERR("invalid smallest block size: %zu", smallest);
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (unsigned i = 0; i < nclasses; ++i) {
+		size_t size = classes[i].size;
+
+		if (size % smallest != 0 || size > MAX_BLOCK_SIZE ||
+				(i > 0 && size <= classes[i - 1].size) ||
+				classes[i].units_per_block == 0) {
+			ERR("invalid block class %zu:%u", size,
+					classes[i].units_per_block);
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	memset(c, 0, sizeof(*c));
+
+	for (unsigned i = 0; i < nclasses; ++i) {
+		c->data[i].size = classes[i].size;
+		c->data[i].units_per_block = classes[i].units_per_block;
+	}
+
+	c->alignment = smallest;
+
+	return 0;
 }
 
 const struct pmem_block_info *
@@ -75,18 +143,25 @@ metadata_block_info(void)
 	return &metadata_block;
 }
 
+const struct pmem_block_info *
+compact_inode_block_info(void)
+{
+	return &compact_inode_block;
+}
+
 /*
  * returns block which is smaller or equal to 'limit'
  * if it's possible (limit value is large enough) returned block
  * will be the smallest block larger than 'size'
  */
 const struct pmem_block_info *
-data_block_info(size_t size, size_t limit)
+data_block_info(const struct pmem_block_classes *c, size_t size,
+		size_t limit)
 {
-	ASSERT(limit >= data_blocks[0].size);
+	ASSERT(limit >= c->data[0].size);
 	const struct pmem_block_info *block;
 
-	for (block = data_blocks; block->size != 0; ++block) {
+	for (block = c->data; block->size != 0; ++block) {
 		if (block->size > limit)
 			return block - 1;
 
@@ -134,7 +209,7 @@ set_alloc_class(PMEMobjpool *pop, struct pmem_block_info *b,
 #endif
 
 int
-initialize_alloc_classes(PMEMobjpool *pop)
+initialize_alloc_classes(PMEMobjpool *pop, struct pmem_block_classes *c)
 {
 	int ret = set_alloc_class(pop, &metadata_block, METADATA_ID);
 	if (ret)
@@ -142,13 +217,17 @@ initialize_alloc_classes(PMEMobjpool *pop)
 
 	struct pmem_block_info *block;
 
-	for (block = data_blocks; block->size != 0; ++block) {
-		int index = (int) (block - data_blocks);
+	for (block = c->data; block->size != 0; ++block) {
+		int index = (int) (block - c->data);
 		ret = set_alloc_class(pop, block, FIRST_BLOCK_ID + index);
 		if (ret)
 			return ret;
 	}
 
+	ret = set_alloc_class(pop, &compact_inode_block, COMPACT_INODE_ID);
+	if (ret)
+		return ret;
+
 	return 0;
 }
 
@@ -160,12 +239,13 @@ initialize_alloc_classes(PMEMobjpool *pop)
  * interval.
  */
 void
-expand_to_full_pages(uint64_t *offset, uint64_t *length)
+expand_to_full_pages(const struct pmem_block_classes *c, uint64_t *offset,
+		uint64_t *length)
 {
 	/* align the offset */
-	*length += *offset % block_alignment;
-	*offset -= *offset % block_alignment;
+	*length += *offset % c->alignment;
+	*offset -= *offset % c->alignment;
 
 	/* align the length */
-	*length = block_roundup(*length);
+	*length = block_roundup(c, *length);
 }
@@ -48,32 +48,48 @@ struct pmem_block_info {
 
 #define MIN_BLOCK_SIZE ((size_t)0x4000)
 
+/* no block can be bigger than that, whatever the classes of the pool */
+#define MAX_BLOCK_SIZE (UINT32_MAX - (UINT32_MAX % MIN_BLOCK_SIZE))
 
-/* block_alignment value is always equal to the smallest block size */
-extern size_t block_alignment;
+/* data block classes of a pool */
+struct pmem_block_classes {
+	/* smallest first, terminated by an entry with size 0 */
+	struct pmem_block_info data[PMEMFILE_MAX_BLOCK_CLASSES + 1];
 
-#define MAX_BLOCK_SIZE (UINT32_MAX - (UINT32_MAX % block_alignment))
+	/* always equal to the smallest block size */
+	size_t alignment;
+};
 
 static inline size_t
-block_rounddown(size_t n)
+block_rounddown(const struct pmem_block_classes *c, size_t n)
 {
-	return n & ~(block_alignment - 1);
+	return n - n % c->alignment;
 }
 
 static inline size_t
-block_roundup(size_t n)
+block_roundup(const struct pmem_block_classes *c, size_t n)
 {
-	return block_rounddown(n + block_alignment - 1);
+	return block_rounddown(c, n + c->alignment - 1);
 }
 
 void set_block_size(size_t size);
 
-void expand_to_full_pages(uint64_t *offset, uint64_t *length);
+void block_classes_default(struct pmem_block_classes *c);
+int block_classes_set(struct pmem_block_classes *c,
+		const struct pmemfile_block_class *classes, unsigned nclasses);
+
+COMPILE_ERROR_ON(PMEMFILE_MAX_BLOCK_CLASSES + 1 != PMEMFILE_BLOCK_CLASS_SLOTS);
+
+void expand_to_full_pages(const struct pmem_block_classes *c,
+		uint64_t *offset, uint64_t *length);
 
 const struct pmem_block_info *metadata_block_info(void);
 
-const struct pmem_block_info *data_block_info(size_t size, size_t limit);
+const struct pmem_block_info *compact_inode_block_info(void);
+
+const struct pmem_block_info *data_block_info(
+		const struct pmem_block_classes *c, size_t size, size_t limit);
 
-int initialize_alloc_classes(PMEMobjpool *pop);
+int initialize_alloc_classes(PMEMobjpool *pop, struct pmem_block_classes *c);
 
 #endif
@@ -35,6 +35,7 @@
  */
 
 #include <errno.h>
+#include <string.h>
 
 #include "alloc.h"
 #include "callbacks.h"
@@ -48,7 +49,14 @@ struct tx_callback {
 	void *arg;
 };
 
+/*
+ * Number of callbacks per stage which fit in preallocated per-thread space.
+ * Only transactions registering more than that allocate memory.
+ */
+#define CB_PREALLOCATED 16
+
 struct tx_callback_array {
+	/* Either "prealloc" or memory allocated when it's not enough. */
 	struct tx_callback *arr;
 
 	/* Size of callbacks array. */
@@ -56,6 +64,8 @@ struct tx_callback_array {
 
 	/* Number of registered callbacks. */
 	unsigned used;
+
+	struct tx_callback prealloc[CB_PREALLOCATED];
 };
 
 struct all_callbacks {
@@ -90,6 +100,13 @@ cb_get(void)
 	if (!c)
 		pmemfile_tx_abort(errno);
 
+	for (unsigned i = 0; i < MAX_TX_STAGE; ++i) {
+		c[i].forward.arr = c[i].forward.prealloc;
+		c[i].forward.size = CB_PREALLOCATED;
+		c[i].backward.arr = c[i].backward.prealloc;
+		c[i].backward.size = CB_PREALLOCATED;
+	}
+
 	int ret = os_tls_set(callbacks_key, c);
 	if (ret) {
 		free(c);
@@ -121,10 +138,18 @@ cb_append(struct tx_callback_array *cb, cb_basic func, void *arg)
 {
 	if (cb->used == cb->size) {
 		unsigned count = cb->size * 2;
-		if (count == 0)
-			count = 4;
+		struct tx_callback *new_arr;
+
+		if (cb->arr == cb->prealloc) {
+			new_arr = pf_malloc(count * sizeof(cb->arr[0]));
+			if (new_arr)
+				memcpy(new_arr, cb->arr,
+						cb->used * sizeof(cb->arr[0]));
+		} else {
+			new_arr = pf_realloc(cb->arr,
+					count * sizeof(cb->arr[0]));
+		}
 
-		void *new_arr = pf_realloc(cb->arr, count * sizeof(cb->arr[0]));
 		if (!new_arr)
 			pmemfile_tx_abort(errno);
 
@@ -178,12 +203,15 @@ cb_free(void *arg)
 	struct all_callbacks *callbacks = arg;
 
 	for (unsigned i = 0; i < MAX_TX_STAGE; ++i) {
-		pf_free(callbacks[i].forward.arr);
+		if (callbacks[i].forward.arr != callbacks[i].forward.prealloc)
+			pf_free(callbacks[i].forward.arr);
 		callbacks[i].forward.arr = NULL;
 		callbacks[i].forward.size = 0;
 		callbacks[i].forward.used = 0;
 
-		pf_free(callbacks[i].backward.arr);
+		if (callbacks[i].backward.arr !=
+				callbacks[i].backward.prealloc)
+			pf_free(callbacks[i].backward.arr);
 		callbacks[i].backward.arr = NULL;
 		callbacks[i].backward.size = 0;
 		callbacks[i].backward.used = 0;
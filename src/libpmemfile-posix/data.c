@@ -30,9 +30,12 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "arena.h"
 #include "block_array.h"
+#include "block_cursor.h"
 #include "blocks.h"
 #include "data.h"
+#include "extent.h"
 #include "offset_mapping.h"
 #include "out.h"
 #include "pool.h"
@@ -79,7 +82,7 @@ vinode_rebuild_block_tree(PMEMfilepool *pfp, struct pmemfile_vinode *vinode)
 	if (!c)
 		return -errno;
 	struct pmemfile_block_array *block_array =
-			&vinode->inode->file_data.blocks;
+			&inode_get_data(vinode->inode)->blocks;
 	struct pmemfile_block_desc *first = NULL;
 
 	while (block_array != NULL) {
@@ -153,12 +156,20 @@ find_closest_block(struct pmemfile_vinode *vinode, uint64_t off)
  * using the proposed last_block
  */
 struct pmemfile_block_desc *
-find_closest_block_with_hint(struct pmemfile_vinode *vinode, uint64_t offset,
-		struct pmemfile_block_desc *last_block)
+find_closest_block_with_hint(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
+		uint64_t offset, struct pmemfile_block_desc *last_block)
 {
+	if (last_block == NULL)
+		return find_closest_block(vinode, offset);
+
 	if (is_offset_in_block(last_block, offset))
 		return last_block;
 
+	/* sequential access crossing the end of the block */
+	struct pmemfile_block_desc *next = PF_RW(pfp, last_block->next);
+	if (is_offset_in_block(next, offset))
+		return next;
+
 	return find_closest_block(vinode, offset);
 }
 
@@ -174,10 +185,17 @@ file_allocate_block_data(PMEMfilepool *pfp,
 {
 	ASSERT_IN_TX();
 	ASSERT(info->size >= MIN_BLOCK_SIZE);
-	ASSERT(info->size % block_alignment == 0);
+	ASSERT(info->size % pfp->blocks.alignment == 0);
 
-	block->data = TX_XALLOC(char, info->size,
-		POBJ_XALLOC_NO_FLUSH | info->class_id);
+	uint32_t flags = BLOCK_EXTENT;
+
+	block->data = extent_tx_alloc(pfp, info->size);
+	if (TOID_IS_NULL(block->data)) {
+		arena_bind(pfp);
+		block->data = TX_XALLOC(char, info->size,
+			POBJ_XALLOC_NO_FLUSH | info->class_id);
+		flags = 0;
+	}
 
 #ifdef DEBUG
 	/* poison block data */
@@ -190,7 +208,7 @@ file_allocate_block_data(PMEMfilepool *pfp,
 
 	block->size = (uint32_t) info->size;
 
-	block->flags = 0;
+	block->flags = flags;
 }
 
 /*
@@ -404,7 +422,7 @@ overallocate_size(uint64_t size)
  */
 size_t
 vinode_allocate_interval(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
-		uint64_t offset, uint64_t size)
+		uint64_t offset, uint64_t size, bool sequential)
 {
 	ASSERT_IN_TX();
 	ASSERT(size > 0);
@@ -414,13 +432,13 @@ vinode_allocate_interval(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
 
 	size_t allocated_space = 0;
 
-	bool over = pmemfile_overallocate_on_append &&
+	bool over = (pmemfile_overallocate_on_append || sequential) &&
 		is_append(vinode, inode, offset, size);
 
 	if (over)
 		size = overallocate_size(size);
 
-	expand_to_full_pages(&offset, &size);
+	expand_to_full_pages(&pfp->blocks, &offset, &size);
 
 	/*
 	 * Start at block with the highest offset lower than or equal to
@@ -510,7 +528,8 @@ vinode_allocate_interval(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
 			/* File size is zero, no blocks in the file so far */
 
 			const struct pmem_block_info *info =
-				data_block_info(size, MAX_BLOCK_SIZE);
+				data_block_info(&pfp->blocks, size,
+						MAX_BLOCK_SIZE);
 
 			block = block_list_insert_after(pfp, vinode, NULL);
 			block->offset = offset;
@@ -528,7 +547,7 @@ vinode_allocate_interval(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
 				count = (uint32_t)(first_offset - offset);
 
 			const struct pmem_block_info *info =
-				data_block_info(size, count);
+				data_block_info(&pfp->blocks, size, count);
 
 			block = block_list_insert_after(pfp, vinode, NULL);
 			block->offset = offset;
@@ -540,7 +559,8 @@ vinode_allocate_interval(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
 			/* After the last allocated block */
 
 			const struct pmem_block_info *info =
-				data_block_info(size, MAX_BLOCK_SIZE);
+				data_block_info(&pfp->blocks, size,
+						MAX_BLOCK_SIZE);
 
 			block = block_list_insert_after(pfp, vinode, block);
 			block->offset = offset;
@@ -560,7 +580,8 @@ vinode_allocate_interval(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
 
 			if (hole_count > 0) { /* Is there any hole at all? */
 				const struct pmem_block_info *info =
-					data_block_info(size, hole_count);
+					data_block_info(&pfp->blocks, size,
+							hole_count);
 
 				block = block_list_insert_after(pfp, vinode,
 						block);
@@ -649,6 +670,59 @@ read_block_range(PMEMfilepool *pfp, const struct pmemfile_block_desc *block,
 	}
 }
 
+#ifdef PMEMOBJ_F_MEM_NODRAIN
+/*
+ * cpy_mem_flags -- translates CPY_* flags to pmemobj_mem* flags
+ */
+static unsigned
+cpy_mem_flags(unsigned cpy_flags)
+{
+	unsigned flags = 0;
+
+	/*
+	 * Data written to a file advised with POSIX_FADV_NOREUSE is not
+	 * expected to be accessed again soon, so there is no point in
+	 * polluting CPU caches with it, even for small writes.
+	 */
+	if (cpy_flags & CPY_NONTEMPORAL)
+		flags |= PMEMOBJ_F_MEM_NONTEMPORAL;
+	if (cpy_flags & CPY_NODRAIN)
+		flags |= PMEMOBJ_F_MEM_NODRAIN;
+
+	return flags;
+}
+#endif
+
+/*
+ * data_memcpy -- persistent memcpy of file data
+ */
+static void
+data_memcpy(PMEMfilepool *pfp, void *dest, const void *src, size_t len,
+		unsigned cpy_flags)
+{
+#ifdef PMEMOBJ_F_MEM_NODRAIN
+	pmemobj_memcpy(pfp->pop, dest, src, len, cpy_mem_flags(cpy_flags));
+#else
+	(void) cpy_flags;
+	pmemobj_memcpy_persist(pfp->pop, dest, src, len);
+#endif
+}
+
+/*
+ * data_memset -- persistent memset of file data
+ */
+static void
+data_memset(PMEMfilepool *pfp, void *dest, int c, size_t len,
+		unsigned cpy_flags)
+{
+#ifdef PMEMOBJ_F_MEM_NODRAIN
+	pmemobj_memset(pfp->pop, dest, c, len, cpy_mem_flags(cpy_flags));
+#else
+	(void) cpy_flags;
+	pmemobj_memset_persist(pfp->pop, dest, c, len);
+#endif
+}
+
 /*
  * write_block_range - copy data from user supplied buffer
  *
@@ -656,7 +730,7 @@ read_block_range(PMEMfilepool *pfp, const struct pmemfile_block_desc *block,
  */
 static void
 write_block_range(PMEMfilepool *pfp, struct pmemfile_block_desc *block,
-	uint64_t offset, uint64_t len, const char *buf)
+	uint64_t offset, uint64_t len, const char *buf, unsigned cpy_flags)
 {
 	ASSERT(block != NULL);
 	ASSERT(len > 0);
@@ -669,17 +743,21 @@ write_block_range(PMEMfilepool *pfp, struct pmemfile_block_desc *block,
 		char *start_zero = data;
 		size_t count = offset;
 		if (count != 0)
-			pmemobj_memset_persist(pfp->pop, start_zero, 0, count);
+			data_memset(pfp, start_zero, 0, count, cpy_flags);
 
 		start_zero = data + offset + len;
 		count = block->size - (offset + len);
 		if (count != 0)
-			pmemobj_memset_persist(pfp->pop, start_zero, 0, count);
+			data_memset(pfp, start_zero, 0, count, cpy_flags);
 	}
 
-	pmemobj_memcpy_persist(pfp->pop, data + offset, buf, len);
+	data_memcpy(pfp, data + offset, buf, len, cpy_flags);
 
 	if (!is_block_data_initialized(block)) {
+		/* the block can't be marked initialized before data hits medium */
+		if (cpy_flags & CPY_NODRAIN)
+			pmemfile_drain(pfp);
+
 		block->flags |= BLOCK_INITIALIZED;
 		pmemfile_persist(pfp, &block->flags);
 	}
@@ -695,7 +773,8 @@ write_block_range(PMEMfilepool *pfp, struct pmemfile_block_desc *block,
 struct pmemfile_block_desc *
 iterate_on_file_range(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
 		struct pmemfile_block_desc *starting_block, uint64_t offset,
-		uint64_t len, char *buf, enum cpy_direction dir)
+		uint64_t len, char *buf, enum cpy_direction dir,
+		unsigned cpy_flags)
 {
 	struct pmemfile_block_desc *block = starting_block;
 	struct pmemfile_block_desc *last_block = starting_block;
@@ -792,7 +871,7 @@ iterate_on_file_range(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
 				in_block_start, in_block_len, buf);
 		else
 			write_block_range(pfp, block,
-				in_block_start, in_block_len, buf);
+				in_block_start, in_block_len, buf, cpy_flags);
 
 		offset += in_block_len;
 		len -= in_block_len;
@@ -804,6 +883,52 @@ iterate_on_file_range(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
 	return last_block;
 }
 
+/*
+ * vinode_prefetch_range -- pulls block descriptors covering the given range
+ * of the file, and at most max_data bytes of their data into CPU caches
+ *
+ * Expects the block tree to be valid.
+ */
+void
+vinode_prefetch_range(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
+		uint64_t offset, uint64_t len, uint64_t max_data)
+{
+	uint64_t end = offset + len;
+	if (end < offset)
+		end = UINT64_MAX;
+
+	struct pmemfile_block_desc *block = find_closest_block(vinode, offset);
+	if (block == NULL)
+		block = vinode->first_block;
+
+	while (block != NULL && block->offset < end) {
+		__builtin_prefetch(block);
+
+		uint64_t block_end = block->offset + block->size;
+
+		if (max_data > 0 && block_end > offset &&
+				is_block_data_initialized(block)) {
+			uint64_t start = 0;
+			if (offset > block->offset)
+				start = offset - block->offset;
+
+			uint64_t stop = block->size;
+			if (end < block_end)
+				stop = end - block->offset;
+
+			if (stop - start > max_data)
+				stop = start + max_data;
+
+			const char *data = PF_RO(pfp, block->data);
+			for (uint64_t i = start; i < stop; i += PREFETCH_STRIDE)
+				__builtin_prefetch(data + i);
+
+			max_data -= stop - start;
+		}
+
+		block = PF_RW(pfp, block->next);
+	}
+}
 
 /*
  * is_block_contained_by_interval -- see vinode_remove_interval
@@ -890,7 +1015,7 @@ vinode_remove_interval(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
 	ASSERT_IN_TX();
 	ASSERT(len > 0);
 
-	vinode->block_pointer_invalidation_counter++;
+	vinode_invalidate_block_pointers(vinode, offset, len);
 
 	size_t deallocated_space = 0;
 
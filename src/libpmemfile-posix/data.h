@@ -41,14 +41,15 @@ int vinode_rebuild_block_tree(PMEMfilepool *pfp,
 size_t vinode_remove_interval(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
 		uint64_t offset, uint64_t len);
 size_t vinode_allocate_interval(PMEMfilepool *pfp,
-		struct pmemfile_vinode *vinode, uint64_t offset, uint64_t size);
+		struct pmemfile_vinode *vinode, uint64_t offset, uint64_t size,
+		bool sequential);
 bool vinode_is_interval_allocated(PMEMfilepool *pfp,
 		struct pmemfile_vinode *vinode, uint64_t offset, uint64_t size,
 		const struct pmemfile_block_desc *last_block);
 
 struct pmemfile_block_desc *find_closest_block(struct pmemfile_vinode *vinode,
 		uint64_t off);
-struct pmemfile_block_desc *find_closest_block_with_hint(
+struct pmemfile_block_desc *find_closest_block_with_hint(PMEMfilepool *pfp,
 		struct pmemfile_vinode *vinode, uint64_t offset,
 		struct pmemfile_block_desc *last_block);
 
@@ -57,9 +58,21 @@ bool is_offset_in_block(const struct pmemfile_block_desc *block,
 
 enum cpy_direction { read_from_blocks, write_to_blocks };
 
+/* use non-temporal stores when writing */
+#define CPY_NONTEMPORAL (1U << 0)
+/* don't wait for written data to reach the medium */
+#define CPY_NODRAIN (1U << 1)
+
 struct pmemfile_block_desc *iterate_on_file_range(PMEMfilepool *pfp,
 		struct pmemfile_vinode *vinode,
 		struct pmemfile_block_desc *starting_block, uint64_t offset,
-		uint64_t len, char *buf, enum cpy_direction dir);
+		uint64_t len, char *buf, enum cpy_direction dir,
+		unsigned cpy_flags);
+
+/* distance between consecutive prefetches, size of a cacheline */
+#define PREFETCH_STRIDE 64
+
+void vinode_prefetch_range(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
+		uint64_t offset, uint64_t len, uint64_t max_data);
 
 #endif
@@ -40,6 +40,7 @@
 #include <stdio.h>
 
 #include "alloc.h"
+#include "arena.h"
 #include "blocks.h"
 #include "callbacks.h"
 #include "dir.h"
@@ -51,6 +52,7 @@
 #include "locks.h"
 #include "os_thread.h"
 #include "out.h"
+#include "tx_log.h"
 #include "utils.h"
 
 /*
@@ -170,7 +172,7 @@ inode_add_dirent(PMEMfilepool *pfp,
 			pmemfile_tx_abort(ENOENT);
 	}
 
-	struct pmemfile_dir *dir = &parent->file_data.dir;
+	struct pmemfile_dir *dir = &inode_get_data(parent)->dir;
 
 	struct pmemfile_dirent *dirent = NULL;
 	bool found = false;
@@ -191,6 +193,9 @@ inode_add_dirent(PMEMfilepool *pfp,
 			const struct pmem_block_info *info =
 				metadata_block_info();
 
+			tx_log_attach(pfp);
+			arena_bind(pfp);
+
 			TX_ADD_DIRECT(&dir->next);
 			dir->next = TX_XALLOC(struct pmemfile_dir, info->size,
 				POBJ_XALLOC_ZERO | info->class_id);
@@ -273,7 +278,7 @@ vinode_lookup_dirent_by_name_locked(PMEMfilepool *pfp,
 	ASSERTne(namelen, 0);
 	ASSERTne(name[0], 0);
 
-	struct pmemfile_dir *dir = &iparent->file_data.dir;
+	struct pmemfile_dir *dir = &inode_get_data(iparent)->dir;
 
 	while (dir != NULL) {
 		for (uint32_t i = 0; i < dir->num_elements; ++i) {
@@ -332,7 +337,7 @@ vinode_lookup_dirent_by_vinode_locked(PMEMfilepool *pfp,
 		return NULL;
 	}
 
-	struct pmemfile_dir *dir = &iparent->file_data.dir;
+	struct pmemfile_dir *dir = &inode_get_data(iparent)->dir;
 
 	while (dir != NULL) {
 		for (uint32_t i = 0; i < dir->num_elements; ++i) {
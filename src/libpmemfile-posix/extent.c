@@ -0,0 +1,918 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * extent.c -- data blocks allocated from pmemfile-managed regions
+ *
+ * Every data block used to be a separate pmemobj heap object, so each
+ * allocation and free of a block was a transactional heap operation, with
+ * heap locks, redo log fences and an undo log entry.
+ *
+ * Instead, data blocks come from extent regions: big pmemobj objects of
+ * PMEMFILE_EXTENT_UNITS units each, allocated by a background thread and
+ * linked from the superblock. Which units are taken is tracked only in DRAM:
+ * by a bitmap per region and by per-CPU caches of free extents of recently
+ * used sizes. A transaction takes an extent from the cache of the CPU it
+ * runs on (or from the bitmaps if the cache is empty) and gives it back when
+ * it aborts. Extents freed by a transaction go to the cache when it commits.
+ * The only persistent record of an allocation is the block descriptor, which
+ * has BLOCK_EXTENT flag set.
+ *
+ * Bitmaps are saved in region headers on pool close and loaded on open. If
+ * the pool wasn't closed cleanly, they are rebuilt from block descriptors of
+ * all inodes.
+ *
+ * When there's no free extent of the requested size, the background thread
+ * is asked for a new region and the block is allocated from the heap, like
+ * before. Blocks bigger than EXTENT_MAX_UNITS units always come from the
+ * heap.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "arena.h"
+#include "blocks.h"
+#include "callbacks.h"
+#include "extent.h"
+#include "inode.h"
+#include "layout.h"
+#include "os_thread.h"
+#include "os_util.h"
+#include "out.h"
+#include "pool.h"
+#include "utils.h"
+
+#define EXTENT_SLOTS 16
+#define EXTENT_LISTS 4
+#define EXTENT_CACHE_DEPTH 8
+
+/* how many extents a cache miss takes from the bitmaps */
+#define EXTENT_REFILL (EXTENT_CACHE_DEPTH / 2)
+
+/* biggest block allocated from regions, in units */
+#define EXTENT_MAX_UNITS (PMEMFILE_EXTENT_UNITS / 4)
+
+/* regions are not created for blocks bigger than that */
+#define EXTENT_MAX_UNIT_SIZE ((size_t)1 << 20)
+
+/* the whole bitmap of a region fits in one word */
+COMPILE_ERROR_ON(PMEMFILE_EXTENT_UNITS != 64);
+
+bool pmemfile_extent_alloc = true;
+
+struct extent_region_info {
+	/* offset of the region object */
+	uint64_t off;
+
+	/* offset of the first unit */
+	uint64_t data;
+
+	uint64_t unit_size;
+
+	/* units taken by blocks, running transactions and caches */
+	uint64_t used;
+};
+
+/* free extents of one size */
+struct extent_list {
+	size_t size;
+	unsigned count;
+	uint64_t off[EXTENT_CACHE_DEPTH];
+};
+
+struct extent_slot {
+	os_mutex_t lock;
+	struct extent_list lists[EXTENT_LISTS];
+};
+
+struct pmemfile_extents {
+	PMEMfilepool *pfp;
+	uint64_t pool_uuid_lo;
+
+	/* protects everything below, except slots */
+	os_mutex_t lock;
+
+	/* sorted by offset */
+	struct extent_region_info *regions;
+	unsigned nregions;
+	unsigned capacity;
+
+	/* region in which the last search succeeded */
+	unsigned hint;
+
+	/* region thread, started on the first request */
+	os_cond_t cond;
+	os_thread_t thread;
+	bool thread_started;
+	bool grow_requested;
+	bool grow_failed;
+	bool stop;
+
+	struct extent_slot slots[EXTENT_SLOTS];
+};
+
+/*
+ * extent_mask -- returns bitmap of "units" units starting at "pos"
+ */
+static inline uint64_t
+extent_mask(uint64_t pos, uint64_t units)
+{
+	ASSERT(units > 0);
+	ASSERT(pos + units <= PMEMFILE_EXTENT_UNITS);
+
+	if (units == PMEMFILE_EXTENT_UNITS)
+		return UINT64_MAX;
+
+	return ((UINT64_C(1) << units) - 1) << pos;
+}
+
+/*
+ * region_find -- returns region containing offset "off", NULL if there's none
+ *
+ * Must be called with extents lock held.
+ */
+static struct extent_region_info *
+region_find(struct pmemfile_extents *e, uint64_t off)
+{
+	unsigned lo = 0;
+	unsigned hi = e->nregions;
+
+	while (lo < hi) {
+		unsigned mid = lo + (hi - lo) / 2;
+
+		if (e->regions[mid].off <= off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == 0)
+		return NULL;
+
+	struct extent_region_info *r = &e->regions[lo - 1];
+	if (off < r->data ||
+			off >= r->data + PMEMFILE_EXTENT_UNITS * r->unit_size)
+		return NULL;
+
+	return r;
+}
+
+/*
+ * region_insert -- starts tracking region at offset "off"
+ *
+ * Must be called with extents lock held.
+ */
+static int
+region_insert(struct pmemfile_extents *e, uint64_t off, uint64_t unit_size,
+		uint64_t used)
+{
+	if (e->nregions == e->capacity) {
+		unsigned capacity = e->capacity ? e->capacity * 2 : 16;
+		struct extent_region_info *regions = pf_realloc(e->regions,
+				capacity * sizeof(*regions));
+		if (!regions)
+			return -1;
+
+		e->regions = regions;
+		e->capacity = capacity;
+	}
+
+	unsigned idx = e->nregions;
+	while (idx > 0 && e->regions[idx - 1].off > off)
+		idx--;
+
+	memmove(&e->regions[idx + 1], &e->regions[idx],
+			(e->nregions - idx) * sizeof(e->regions[0]));
+
+	struct extent_region_info *r = &e->regions[idx];
+	r->off = off;
+	r->data = off + offsetof(struct pmemfile_extent_region, data);
+	r->unit_size = unit_size;
+	r->used = used;
+
+	e->nregions++;
+
+	return 0;
+}
+
+/*
+ * region_take -- marks up to "max" free extents of "units" units as used,
+ * returns their number
+ */
+static unsigned
+region_take(struct extent_region_info *r, uint64_t units, uint64_t *off,
+		unsigned max)
+{
+	/* keep extents aligned to their size, if it's possible */
+	uint64_t step = PMEMFILE_EXTENT_UNITS % units == 0 ? units : 1;
+	unsigned n = 0;
+
+	for (uint64_t pos = 0; pos + units <= PMEMFILE_EXTENT_UNITS && n < max;
+			pos += step) {
+		uint64_t mask = extent_mask(pos, units);
+		if (r->used & mask)
+			continue;
+
+		r->used |= mask;
+		off[n++] = r->data + pos * r->unit_size;
+	}
+
+	return n;
+}
+
+static void *extent_worker(void *arg);
+
+/*
+ * extent_grow_request -- asks the region thread for a new region
+ *
+ * Must be called with extents lock held.
+ */
+static void
+extent_grow_request(struct pmemfile_extents *e)
+{
+	if (e->grow_requested || e->grow_failed || e->stop)
+		return;
+
+	if (!e->thread_started) {
+		int error = os_thread_create(&e->thread, extent_worker, e);
+		if (error) {
+			LOG(LINF, "cannot create extent region thread: %d",
+					error);
+			e->grow_failed = true;
+			return;
+		}
+
+		e->thread_started = true;
+	}
+
+	e->grow_requested = true;
+	os_cond_signal(&e->cond);
+}
+
+/*
+ * central_take -- takes up to "max" extents of "size" bytes from bitmaps,
+ * returns their number
+ *
+ * Must be called with extents lock held.
+ */
+static unsigned
+central_take(struct pmemfile_extents *e, size_t size, uint64_t *off,
+		unsigned max)
+{
+	for (unsigned i = 0; i < e->nregions; ++i) {
+		unsigned idx = (e->hint + i) % e->nregions;
+		struct extent_region_info *r = &e->regions[idx];
+
+		if (size % r->unit_size != 0 ||
+				size / r->unit_size > EXTENT_MAX_UNITS)
+			continue;
+
+		unsigned n = region_take(r, size / r->unit_size, off, max);
+		if (n) {
+			e->hint = idx;
+			return n;
+		}
+	}
+
+	extent_grow_request(e);
+
+	return 0;
+}
+
+/*
+ * central_put -- marks extent as free in bitmaps
+ *
+ * Must be called with extents lock held.
+ */
+static void
+central_put(struct pmemfile_extents *e, uint64_t off, size_t size)
+{
+	struct extent_region_info *r = region_find(e, off);
+	if (!r)
+		FATAL("extent 0x%" PRIx64 " outside of regions", off);
+
+	uint64_t mask = extent_mask((off - r->data) / r->unit_size,
+			size / r->unit_size);
+	ASSERTeq(r->used & mask, mask);
+
+	r->used &= ~mask;
+
+	/* there's some space now, maybe new region fits too */
+	e->grow_failed = false;
+}
+
+/*
+ * slot_list -- returns list of extents of "size" bytes in the slot; if there
+ * isn't one and "claim" is set, takes over an empty list
+ *
+ * Must be called with slot lock held.
+ */
+static struct extent_list *
+slot_list(struct extent_slot *slot, size_t size, bool claim)
+{
+	struct extent_list *empty = NULL;
+
+	for (unsigned i = 0; i < EXTENT_LISTS; ++i) {
+		struct extent_list *l = &slot->lists[i];
+
+		if (l->size == size)
+			return l;
+
+		if (l->count == 0 && !empty)
+			empty = l;
+	}
+
+	if (!claim || !empty)
+		return NULL;
+
+	empty->size = size;
+	return empty;
+}
+
+/*
+ * extent_get -- takes free extent of "size" bytes, returns its offset or 0
+ */
+static uint64_t
+extent_get(struct pmemfile_extents *e, size_t size)
+{
+	struct extent_slot *slot = &e->slots[os_getcpu() % EXTENT_SLOTS];
+	struct extent_list *l;
+	uint64_t off[EXTENT_REFILL];
+
+	os_mutex_lock(&slot->lock);
+	l = slot_list(slot, size, false);
+	if (l && l->count > 0) {
+		off[0] = l->off[--l->count];
+		os_mutex_unlock(&slot->lock);
+		return off[0];
+	}
+	os_mutex_unlock(&slot->lock);
+
+	os_mutex_lock(&e->lock);
+	unsigned n = central_take(e, size, off, EXTENT_REFILL);
+	os_mutex_unlock(&e->lock);
+
+	if (n == 0)
+		return 0;
+
+	/* the rest goes to the cache */
+	unsigned i = 1;
+
+	os_mutex_lock(&slot->lock);
+	l = slot_list(slot, size, true);
+	for (; l && i < n && l->count < EXTENT_CACHE_DEPTH; ++i)
+		l->off[l->count++] = off[i];
+	os_mutex_unlock(&slot->lock);
+
+	if (i < n) {
+		os_mutex_lock(&e->lock);
+		for (; i < n; ++i)
+			central_put(e, off[i], size);
+		os_mutex_unlock(&e->lock);
+	}
+
+	return off[0];
+}
+
+/*
+ * extent_put -- gives back extent of "size" bytes at "off"
+ */
+static void
+extent_put(struct pmemfile_extents *e, uint64_t off, size_t size)
+{
+	/* state couldn't be rebuilt on resume, extent leaks */
+	if (!e)
+		return;
+
+	struct extent_slot *slot = &e->slots[os_getcpu() % EXTENT_SLOTS];
+
+	os_mutex_lock(&slot->lock);
+	struct extent_list *l = slot_list(slot, size, true);
+	if (l && l->count < EXTENT_CACHE_DEPTH) {
+		l->off[l->count++] = off;
+		os_mutex_unlock(&slot->lock);
+		return;
+	}
+	os_mutex_unlock(&slot->lock);
+
+	os_mutex_lock(&e->lock);
+	central_put(e, off, size);
+	os_mutex_unlock(&e->lock);
+}
+
+/*
+ * extent_pack -- packs extent into a callback argument
+ *
+ * Sizes of extents are multiples of MIN_BLOCK_SIZE, not bigger than
+ * EXTENT_MAX_UNITS * EXTENT_MAX_UNIT_SIZE.
+ */
+static void *
+extent_pack(uint64_t off, size_t size)
+{
+	ASSERTeq(size % MIN_BLOCK_SIZE, 0);
+	ASSERT(off < (UINT64_C(1) << 48));
+
+	return (void *)(uintptr_t)(off << 16 | size / MIN_BLOCK_SIZE);
+}
+
+/*
+ * extent_release_cb -- gives back extent packed by extent_pack
+ */
+static void
+extent_release_cb(void *pfp, void *arg)
+{
+	uint64_t packed = (uint64_t)(uintptr_t)arg;
+
+	extent_put(((PMEMfilepool *)pfp)->extents, packed >> 16,
+			(packed & 0xffff) * MIN_BLOCK_SIZE);
+}
+
+/*
+ * extent_tx_alloc -- allocates block data of "size" bytes from extent
+ * regions, returns TOID_NULL if it's not possible
+ *
+ * Allocation is undone when the transaction aborts. Must be called in
+ * a transaction.
+ */
+TOID(char)
+extent_tx_alloc(PMEMfilepool *pfp, size_t size)
+{
+	ASSERT_IN_TX();
+
+	TOID(char) data = TOID_NULL(char);
+	struct pmemfile_extents *e = pfp->extents;
+
+	size_t unit = pfp->blocks.alignment;
+
+	/* state couldn't be rebuilt on resume */
+	if (!e)
+		return data;
+
+	if (!pmemfile_extent_alloc || unit > EXTENT_MAX_UNIT_SIZE ||
+			size > EXTENT_MAX_UNITS * unit)
+		return data;
+
+	/* heap allocation will be used instead, don't touch errno */
+	int oerrno = errno;
+	uint64_t off = extent_get(e, size);
+	errno = oerrno;
+
+	if (off == 0)
+		return data;
+
+	cb_push_front(TX_STAGE_ONABORT, extent_release_cb,
+			extent_pack(off, size));
+
+	data.oid.pool_uuid_lo = e->pool_uuid_lo;
+	data.oid.off = off;
+
+	return data;
+}
+
+/*
+ * block_data_tx_free -- frees block data, wherever it was allocated from
+ *
+ * Must be called in a transaction.
+ */
+void
+block_data_tx_free(PMEMfilepool *pfp, struct pmemfile_block_desc *block)
+{
+	ASSERT_IN_TX();
+
+	if (TOID_IS_NULL(block->data))
+		return;
+
+	if (!(block->flags & BLOCK_EXTENT)) {
+		TX_FREE(block->data);
+		return;
+	}
+
+	cb_push_back(TX_STAGE_ONCOMMIT, extent_release_cb,
+			extent_pack(block->data.oid.off, block->size));
+}
+
+/*
+ * block_data_free -- frees block data and clears the pointer to it, outside
+ * of a transaction
+ */
+void
+block_data_free(PMEMfilepool *pfp, struct pmemfile_block_desc *block)
+{
+	ASSERT_NOT_IN_TX();
+
+	if (TOID_IS_NULL(block->data))
+		return;
+
+	if (!(block->flags & BLOCK_EXTENT)) {
+		POBJ_FREE(&block->data);
+		return;
+	}
+
+	uint64_t off = block->data.oid.off;
+
+	/* the extent is free as soon as nothing points to it */
+	block->data.oid.off = 0;
+	pmemfile_persist(pfp, &block->data.oid.off);
+
+	extent_put(pfp->extents, off, block->size);
+}
+
+typedef void (*extent_block_cb)(PMEMfilepool *pfp,
+		const struct pmemfile_block_desc *block, void *arg);
+
+/*
+ * is_inode -- checks whether object is an inode
+ */
+static bool
+is_inode(PMEMfilepool *pfp, PMEMoid oid)
+{
+	unsigned t = (unsigned)pmemobj_type_num(oid);
+
+	if (t != 0)
+		return t == TOID_TYPE_NUM(struct pmemfile_inode);
+
+	/* allocated from one of allocation classes */
+	size_t size = pmemobj_alloc_usable_size(oid);
+	if (size != METADATA_BLOCK_SIZE && size != PMEMFILE_COMPACT_INODE_SIZE)
+		return false;
+
+	uint32_t v = *(uint32_t *)pmemfile_direct(pfp, oid);
+
+	/* only compare 24 least significant bits - discard version number */
+	return (v & 0xFFFFFF) == (PMEMFILE_INODE_VERSION(0) & 0xFFFFFF);
+}
+
+/*
+ * extent_foreach_block -- calls "cb" for all blocks allocated from regions
+ */
+static void
+extent_foreach_block(PMEMfilepool *pfp, extent_block_cb cb, void *arg)
+{
+	PMEMoid oid;
+
+	POBJ_FOREACH(pfp->pop, oid) {
+		if (!is_inode(pfp, oid))
+			continue;
+
+		struct pmemfile_inode *inode = pmemfile_direct(pfp, oid);
+		if (!inode_is_regular_file(inode))
+			continue;
+
+		const struct pmemfile_block_array *arr =
+				&inode_get_data(inode)->blocks;
+
+		while (arr != NULL) {
+			for (uint32_t i = 0; i < arr->length; ++i) {
+				const struct pmemfile_block_desc *b =
+						&arr->blocks[i];
+
+				if (!TOID_IS_NULL(b->data) &&
+						(b->flags & BLOCK_EXTENT))
+					cb(pfp, b, arg);
+			}
+
+			arr = PF_RO(pfp, arr->next);
+		}
+	}
+}
+
+/*
+ * extent_mark_cb -- marks units of the block as used
+ */
+static void
+extent_mark_cb(PMEMfilepool *pfp, const struct pmemfile_block_desc *block,
+		void *arg)
+{
+	struct pmemfile_extents *e = arg;
+	struct extent_region_info *r = region_find(e, block->data.oid.off);
+
+	if (!r) {
+		LOG(LUSR, "block 0x%" PRIx64 " outside of extent regions",
+				block->data.oid.off);
+		return;
+	}
+
+	r->used |= extent_mask((block->data.oid.off - r->data) / r->unit_size,
+			block->size / r->unit_size);
+}
+
+/*
+ * extent_count_cb -- counts blocks
+ */
+static void
+extent_count_cb(PMEMfilepool *pfp, const struct pmemfile_block_desc *block,
+		void *arg)
+{
+	(*(unsigned *)arg)++;
+}
+
+/*
+ * extent_count_blocks -- returns number of blocks allocated from regions
+ */
+unsigned
+extent_count_blocks(PMEMfilepool *pfp)
+{
+	unsigned count = 0;
+
+	extent_foreach_block(pfp, extent_count_cb, &count);
+
+	return count;
+}
+
+/*
+ * extent_region_alloc -- allocates new region, returns 0 on success
+ */
+static int
+extent_region_alloc(struct pmemfile_extents *e)
+{
+	PMEMfilepool *pfp = e->pfp;
+	size_t unit_size = pfp->blocks.alignment;
+	size_t size = sizeof(struct pmemfile_extent_region) +
+			PMEMFILE_EXTENT_UNITS * unit_size;
+	TOID(struct pmemfile_extent_region) tregion =
+			TOID_NULL(struct pmemfile_extent_region);
+	int error = 0;
+
+	arena_bind(pfp);
+
+	TX_BEGIN_CB(pfp->pop, cb_queue, pfp) {
+		TX_ADD_FIELD_DIRECT(pfp->super, extent_regions);
+
+		tregion = TX_XALLOC(struct pmemfile_extent_region, size,
+				POBJ_XALLOC_NO_FLUSH);
+
+		struct pmemfile_extent_region *region = PF_RW(pfp, tregion);
+		region->version = PMEMFILE_EXTENT_REGION_VERSION(1);
+		region->unit_size = (uint32_t)unit_size;
+		region->next = pfp->super->extent_regions;
+		region->saved = 0;
+		region->used = 0;
+		pmemobj_persist(pfp->pop, region,
+				offsetof(struct pmemfile_extent_region,
+						padding));
+
+		pfp->super->extent_regions = tregion;
+	} TX_ONABORT {
+		error = errno;
+	} TX_END
+
+	if (error) {
+		errno = error;
+		LOG(LINF, "!cannot allocate extent region");
+		return -1;
+	}
+
+	os_mutex_lock(&e->lock);
+	/* new region is empty, its units can be handed out right away */
+	if (region_insert(e, tregion.oid.off, unit_size, 0))
+		LOG(LINF, "!cannot track extent region");
+	os_mutex_unlock(&e->lock);
+
+	return 0;
+}
+
+/*
+ * extent_worker -- allocates regions on request
+ */
+static void *
+extent_worker(void *arg)
+{
+	struct pmemfile_extents *e = arg;
+
+	os_mutex_lock(&e->lock);
+
+	while (!e->stop) {
+		if (!e->grow_requested) {
+			os_cond_wait(&e->cond, &e->lock);
+			continue;
+		}
+
+		os_mutex_unlock(&e->lock);
+		int ret = extent_region_alloc(e);
+		os_mutex_lock(&e->lock);
+
+		e->grow_requested = false;
+		if (ret)
+			e->grow_failed = true;
+	}
+
+	os_mutex_unlock(&e->lock);
+
+	return NULL;
+}
+
+/*
+ * extents_free -- releases volatile state of extents
+ */
+static void
+extents_free(struct pmemfile_extents *e)
+{
+	for (unsigned i = 0; i < EXTENT_SLOTS; ++i)
+		os_mutex_destroy(&e->slots[i].lock);
+	os_cond_destroy(&e->cond);
+	os_mutex_destroy(&e->lock);
+	pf_free(e->regions);
+	pf_free(e);
+}
+
+/*
+ * extent_init -- loads or rebuilds state of extent regions
+ *
+ * Can't be called in a transaction.
+ */
+int
+extent_init(PMEMfilepool *pfp)
+{
+	ASSERT_NOT_IN_TX();
+
+	struct pmemfile_extents *e = pf_calloc(1, sizeof(*e));
+	if (!e)
+		return -1;
+
+	e->pfp = pfp;
+	e->pool_uuid_lo = pmemobj_oid(pfp->super).pool_uuid_lo;
+	os_mutex_init(&e->lock);
+	os_cond_init(&e->cond);
+	for (unsigned i = 0; i < EXTENT_SLOTS; ++i)
+		os_mutex_init(&e->slots[i].lock);
+
+	bool saved = true;
+	TOID(struct pmemfile_extent_region) tregion =
+			pfp->super->extent_regions;
+
+	while (!TOID_IS_NULL(tregion)) {
+		struct pmemfile_extent_region *region = PF_RW(pfp, tregion);
+
+		if (region->version != PMEMFILE_EXTENT_REGION_VERSION(1)) {
+			ERR("unknown extent region version: 0x%x",
+					region->version);
+			errno = EINVAL;
+			goto err;
+		}
+
+		if (region_insert(e, tregion.oid.off, region->unit_size,
+				region->used)) {
+			ERR("!cannot track extent region");
+			goto err;
+		}
+
+		saved = saved && region->saved;
+		tregion = region->next;
+	}
+
+	/* pool wasn't closed cleanly, saved bitmaps can't be trusted */
+	if (!saved) {
+		LOG(LINF, "rebuilding extent bitmaps");
+
+		for (unsigned i = 0; i < e->nregions; ++i)
+			e->regions[i].used = 0;
+
+		extent_foreach_block(pfp, extent_mark_cb, e);
+	}
+
+	/* saved bitmaps get stale with the first allocation */
+	for (unsigned i = 0; i < e->nregions; ++i) {
+		struct pmemfile_extent_region *region =
+			pmemfile_direct(pfp, (PMEMoid){0, e->regions[i].off});
+
+		if (region->saved) {
+			region->saved = 0;
+			pmemfile_persist(pfp, &region->saved);
+		}
+	}
+
+	pfp->extents = e;
+
+	return 0;
+
+err:
+	extents_free(e);
+	return -1;
+}
+
+/*
+ * extent_thread_stop -- stops the region thread, new one is not started
+ * until extent_resume
+ */
+static void
+extent_thread_stop(struct pmemfile_extents *e)
+{
+	os_mutex_lock(&e->lock);
+	e->stop = true;
+	os_cond_signal(&e->cond);
+	os_mutex_unlock(&e->lock);
+
+	if (e->thread_started)
+		os_thread_join(&e->thread, NULL);
+
+	e->thread_started = false;
+	e->grow_requested = false;
+}
+
+/*
+ * extent_suspend -- stops the region thread before pool is closed by
+ * pmemfile_pool_suspend
+ */
+void
+extent_suspend(PMEMfilepool *pfp)
+{
+	extent_thread_stop(pfp->extents);
+}
+
+/*
+ * extent_resume -- allows the region thread to be started again
+ *
+ * If caches_valid is false, the pool was used by someone else while it was
+ * suspended, so bitmaps, central lists and per-CPU caches may hand out units
+ * that are in use now. In that case all of it is dropped (without saving it
+ * in region headers) and state is loaded again, like in extent_init.
+ */
+int
+extent_resume(PMEMfilepool *pfp, bool caches_valid)
+{
+	struct pmemfile_extents *e = pfp->extents;
+
+	if (!caches_valid) {
+		pfp->extents = NULL;
+		extents_free(e);
+
+		return extent_init(pfp);
+	}
+
+	os_mutex_lock(&e->lock);
+	e->stop = false;
+	os_mutex_unlock(&e->lock);
+
+	return 0;
+}
+
+/*
+ * extent_destroy -- stops the region thread and saves bitmaps in region
+ * headers
+ */
+void
+extent_destroy(PMEMfilepool *pfp)
+{
+	struct pmemfile_extents *e = pfp->extents;
+	if (!e)
+		return;
+
+	extent_thread_stop(e);
+
+	/* cached extents are free */
+	for (unsigned i = 0; i < EXTENT_SLOTS; ++i) {
+		for (unsigned j = 0; j < EXTENT_LISTS; ++j) {
+			struct extent_list *l = &e->slots[i].lists[j];
+
+			for (unsigned k = 0; k < l->count; ++k)
+				central_put(e, l->off[k], l->size);
+		}
+	}
+
+	for (unsigned i = 0; i < e->nregions; ++i) {
+		struct pmemfile_extent_region *region =
+			pmemfile_direct(pfp, (PMEMoid){0, e->regions[i].off});
+
+		region->used = e->regions[i].used;
+		pmemfile_persist(pfp, &region->used);
+
+		/* must reach media after the bitmap */
+		region->saved = 1;
+		pmemfile_persist(pfp, &region->saved);
+	}
+
+	extents_free(e);
+	pfp->extents = NULL;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef PMEMFILE_EXTENT_H
+#define PMEMFILE_EXTENT_H
+
+/*
+ * Data blocks carved out of pmemfile-managed extent regions.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "layout.h"
+#include "libpmemfile-posix.h"
+
+extern bool pmemfile_extent_alloc;
+
+int extent_init(PMEMfilepool *pfp);
+void extent_destroy(PMEMfilepool *pfp);
+void extent_suspend(PMEMfilepool *pfp);
+int extent_resume(PMEMfilepool *pfp, bool caches_valid);
+
+TOID(char) extent_tx_alloc(PMEMfilepool *pfp, size_t size);
+
+void block_data_tx_free(PMEMfilepool *pfp, struct pmemfile_block_desc *block);
+void block_data_free(PMEMfilepool *pfp, struct pmemfile_block_desc *block);
+
+unsigned extent_count_blocks(PMEMfilepool *pfp);
+
+#endif
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * fadvise.c -- pmemfile_fadvise implementation
+ */
+
+#include "data.h"
+#include "file.h"
+#include "inode.h"
+#include "libpmemfile-posix.h"
+#include "out.h"
+#include "pool.h"
+#include "utils.h"
+
+/*
+ * Upper limit of file data pulled into CPU caches by one WILLNEED advice.
+ * Prefetching more than what fits in caches would only evict the beginning
+ * of the range before it is read.
+ */
+#define FADVISE_PREFETCH_MAX (256 * 1024)
+
+/*
+ * vinode_willneed -- builds the block tree of a file (if it doesn't exist yet)
+ * and prefetches the metadata and the beginning of data of the given range
+ */
+static int
+vinode_willneed(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
+		uint64_t offset, uint64_t len)
+{
+	int error = vinode_rdlock_with_block_tree(pfp, vinode);
+	if (error)
+		return -error;
+
+	uint64_t size = inode_get_size(vinode->inode);
+
+	if (offset < size) {
+		if (len == 0 || size - offset < len)
+			len = size - offset;
+
+		vinode_prefetch_range(pfp, vinode, offset, len,
+				FADVISE_PREFETCH_MAX);
+	}
+
+	os_rwlock_unlock(&vinode->rwlock);
+
+	return 0;
+}
+
+/*
+ * vinode_dontneed -- drops the runtime block tree of a file
+ *
+ * The tree is dropped only when the advice covers the whole file, as it can't
+ * be partially rebuilt. It's going to be rebuilt on next access.
+ */
+static void
+vinode_dontneed(struct pmemfile_vinode *vinode, uint64_t offset, uint64_t len)
+{
+	os_rwlock_wrlock(&vinode->rwlock);
+
+	uint64_t size = inode_get_size(vinode->inode);
+
+	if (offset == 0 && (len == 0 || len >= size) && vinode->blocks) {
+		offset_map_delete(vinode->blocks);
+		vinode->blocks = NULL;
+	}
+
+	os_rwlock_unlock(&vinode->rwlock);
+}
+
+int
+pmemfile_fadvise(PMEMfilepool *pfp, PMEMfile *file, pmemfile_off_t offset,
+		pmemfile_off_t len, int advice)
+{
+	if (!pfp) {
+		LOG(LUSR, "NULL pool");
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (!file) {
+		LOG(LUSR, "NULL file");
+		errno = EFAULT;
+		return -1;
+	}
+
+	int error = 0;
+
+	if (offset < 0 || len < 0) {
+		error = EINVAL;
+		goto end;
+	}
+
+	os_mutex_lock(&file->mutex);
+
+	if (file->flags & PFILE_PATH) {
+		os_mutex_unlock(&file->mutex);
+		error = EBADF;
+		goto end;
+	}
+
+	struct pmemfile_vinode *vinode = file->vinode;
+
+	switch (advice) {
+		case PMEMFILE_POSIX_FADV_NORMAL:
+			file->flags &= ~(PFILE_SEQUENTIAL | PFILE_NOREUSE);
+			break;
+		case PMEMFILE_POSIX_FADV_RANDOM:
+			file->flags &= ~PFILE_SEQUENTIAL;
+			break;
+		case PMEMFILE_POSIX_FADV_SEQUENTIAL:
+			file->flags |= PFILE_SEQUENTIAL;
+			break;
+		case PMEMFILE_POSIX_FADV_NOREUSE:
+			file->flags |= PFILE_NOREUSE;
+			break;
+		case PMEMFILE_POSIX_FADV_WILLNEED:
+		case PMEMFILE_POSIX_FADV_DONTNEED:
+			break;
+		default:
+			error = EINVAL;
+			break;
+	}
+
+	os_mutex_unlock(&file->mutex);
+
+	if (error)
+		goto end;
+
+	/* readahead(2), which ends up here, fails like that too */
+	if (!vinode_is_regular_file(vinode)) {
+		error = EINVAL;
+		goto end;
+	}
+
+	if (advice == PMEMFILE_POSIX_FADV_WILLNEED)
+		error = vinode_willneed(pfp, vinode, (uint64_t)offset,
+				(uint64_t)len);
+	else if (advice == PMEMFILE_POSIX_FADV_DONTNEED)
+		vinode_dontneed(vinode, (uint64_t)offset, (uint64_t)len);
+
+end:
+	if (error != 0) {
+		errno = error;
+		return -1;
+	}
+
+	return 0;
+}
@@ -60,7 +60,7 @@ vinode_fallocate(PMEMfilepool *pfp, struct pmemfile_vinode *vinode, int mode,
 	uint64_t off_plus_len = offset + length;
 
 	if (!(mode & PMEMFILE_FALLOC_FL_PUNCH_HOLE))
-		expand_to_full_pages(&offset, &length);
+		expand_to_full_pages(&pfp->blocks, &offset, &length);
 
 	if (length == 0)
 		return 0;
@@ -82,7 +82,7 @@ vinode_fallocate(PMEMfilepool *pfp, struct pmemfile_vinode *vinode, int mode,
 				offset, length);
 		} else {
 			allocated_space += vinode_allocate_interval(pfp, vinode,
-				offset, length);
+				offset, length, false);
 			if ((mode & PMEMFILE_FALLOC_FL_KEEP_SIZE) == 0 &&
 					inode_get_size(inode) < off_plus_len)
 				inode_tx_set_size(inode, off_plus_len);
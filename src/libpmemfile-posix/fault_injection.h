@@ -43,6 +43,8 @@ enum pf_allocation_type { PF_MALLOC, PF_CALLOC, PF_REALLOC };
 void _pmemfile_inject_fault_at(enum pf_allocation_type type,
 	int nth, const char *at);
 
+void _pmemfile_inject_crash_at(const char *at);
+
 int _pmemfile_fault_injection_enabled(void);
 #endif
 
@@ -57,6 +59,12 @@ _pmemfile_inject_fault_at(enum pf_allocation_type type, int nth, const char *at)
 	abort();
 }
 
+static inline void
+_pmemfile_inject_crash_at(const char *at)
+{
+	abort();
+}
+
 static inline int
 _pmemfile_fault_injection_enabled(void)
 {
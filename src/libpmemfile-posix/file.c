@@ -43,6 +43,7 @@
 #include "libpmemfile-posix.h"
 #include "out.h"
 #include "pool.h"
+#include "redo.h"
 #include "truncate.h"
 #include "utils.h"
 
@@ -241,6 +242,10 @@ _pmemfile_openat(PMEMfilepool *pfp, struct pmemfile_vinode *dir,
 
 		if (vinode && vinode_is_symlink(vinode)) {
 			if (flags & PMEMFILE_O_NOFOLLOW) {
+				/* O_PATH opens the symlink itself, like Linux */
+				if (flags & PMEMFILE_O_PATH)
+					break;
+
 				error = ELOOP;
 				goto end;
 			}
@@ -399,30 +404,29 @@ _pmemfile_openat(PMEMfilepool *pfp, struct pmemfile_vinode *dir,
 			goto end;
 		}
 
-		if (tmpfile)
-			/* access to orphaned list requires superblock lock */
-			os_rwlock_wrlock(&pfp->super_rwlock);
-
 		struct inode_orphan_info orphan_info;
 
-		TX_BEGIN_CB(pfp->pop, cb_queue, pfp) {
-			tinode = inode_alloc(pfp, &cred,
-					PMEMFILE_S_IFREG | mode);
-
-			if (tmpfile)
-				orphan_info = inode_orphan(pfp, tinode);
-			else
-				inode_add_dirent(pfp, vparent->tinode,
-					info.remaining, namelen, tinode,
-					inode_get_ctime(PF_RO(pfp, tinode)));
-		} TX_ONABORT {
-			if (errno == ENOMEM)
-				errno = ENOSPC;
-			error = errno;
-		} TX_END
-
-		if (tmpfile)
-			os_rwlock_unlock(&pfp->super_rwlock);
+		/* try the common case first, without a transaction */
+		if (tmpfile || !inode_create_redo(pfp, &cred, vparent,
+				info.remaining, namelen,
+				PMEMFILE_S_IFREG | mode, &tinode)) {
+			TX_BEGIN_CB(pfp->pop, cb_queue, pfp) {
+				tinode = inode_alloc(pfp, &cred,
+						PMEMFILE_S_IFREG | mode);
+
+				if (tmpfile)
+					orphan_info = inode_orphan(pfp, tinode);
+				else
+					inode_add_dirent(pfp, vparent->tinode,
+						info.remaining, namelen, tinode,
+						inode_get_ctime(
+							PF_RO(pfp, tinode)));
+			} TX_ONABORT {
+				if (errno == ENOMEM)
+					errno = ENOSPC;
+				error = errno;
+			} TX_END
+		}
 
 		if (error) {
 			os_rwlock_unlock(&vparent->rwlock);
@@ -486,7 +490,7 @@ _pmemfile_openat(PMEMfilepool *pfp, struct pmemfile_vinode *dir,
 
 	file->vinode = vinode;
 	if (vinode_is_dir(vinode))
-		file->dir_pos.dir = &vinode->inode->file_data.dir;
+		file->dir_pos.dir = &inode_get_data(vinode->inode)->dir;
 
 end:
 	if (vparent)
@@ -588,7 +592,11 @@ pmemfile_open_root(PMEMfilepool *pfp, unsigned index, int flags)
 		return NULL;
 	}
 
-	return _pmemfile_openat(pfp, pfp->root[index], ".", PMEMFILE_O_PATH);
+	struct pmemfile_vinode *root = pool_get_root(pfp, index);
+	if (!root)
+		return NULL;
+
+	return _pmemfile_openat(pfp, root, ".", PMEMFILE_O_PATH);
 }
 
 
@@ -37,6 +37,7 @@
  */
 
 #include <stddef.h>
+#include "block_cursor.h"
 #include "inode.h"
 #include "layout.h"
 #include "os_thread.h"
@@ -46,6 +47,12 @@
 #define PFILE_NOATIME (1ULL << 2)
 #define PFILE_APPEND (1ULL << 3)
 #define PFILE_PATH (1ULL << 4)
+#define PFILE_SEQUENTIAL (1ULL << 5)
+#define PFILE_NOREUSE (1ULL << 6)
+
+/* flags accepted by pmemfile_preadv2 / pmemfile_pwritev2 */
+#define PFILE_RWF_SUPPORTED (PMEMFILE_RWF_HIPRI | PMEMFILE_RWF_DSYNC | \
+		PMEMFILE_RWF_SYNC | PMEMFILE_RWF_NOWAIT | PMEMFILE_RWF_APPEND)
 
 /* file handle */
 struct pmemfile_file {
@@ -64,9 +71,8 @@ struct pmemfile_file {
 	/* requested/current position */
 	size_t offset;
 
-	/* current position cache, the latest block used */
-	struct pmemfile_block_desc *block_pointer_cache;
-	uint64_t last_block_pointer_invalidation_observed;
+	/* blocks used by the latest accesses */
+	struct block_cursors cursors;
 
 	/* current position cache if directory */
 	struct pmemfile_dir_pos {
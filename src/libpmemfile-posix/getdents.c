@@ -60,7 +60,7 @@ file_seek_dir(PMEMfilepool *pfp, PMEMfile *file, struct pmemfile_dir **dir,
 	struct pmemfile_inode *inode = file->vinode->inode;
 
 	if (file->offset == 0) {
-		file->dir_pos.dir = &inode->file_data.dir;
+		file->dir_pos.dir = &inode_get_data(inode)->dir;
 		file->dir_pos.dir_id = 0;
 
 		*dir = file->dir_pos.dir;
@@ -69,7 +69,7 @@ file_seek_dir(PMEMfilepool *pfp, PMEMfile *file, struct pmemfile_dir **dir,
 		if (*dir == NULL)
 			return 0;
 	} else {
-		*dir = &inode->file_data.dir;
+		*dir = &inode_get_data(inode)->dir;
 
 		unsigned dir_id = 0;
 		while (DIR_ID(file->offset) != dir_id) {
@@ -38,16 +38,22 @@
 #include <inttypes.h>
 
 #include "alloc.h"
+#include "arena.h"
+#include "block_cursor.h"
 #include "blocks.h"
 #include "callbacks.h"
 #include "data.h"
 #include "dir.h"
+#include "extent.h"
 #include "hash_map.h"
 #include "inode.h"
 #include "inode_array.h"
+#include "inode_reserve.h"
 #include "locks.h"
 #include "os_thread.h"
+#include "os_util.h"
 #include "out.h"
+#include "tx_log.h"
 #include "utils.h"
 
 static void
@@ -99,7 +105,9 @@ inode_ref(PMEMfilepool *pfp, TOID(struct pmemfile_inode) inode,
 
 	ASSERT_NOT_IN_TX();
 
-	if (PF_RO(pfp, inode)->version != PMEMFILE_INODE_VERSION(2)) {
+	uint32_t version = PF_RO(pfp, inode)->version;
+	if (version != PMEMFILE_INODE_VERSION(2) &&
+			version != PMEMFILE_INODE_VERSION(3)) {
 		ERR("unknown inode version 0x%x for inode 0x%" PRIx64,
 				PF_RO(pfp, inode)->version, inode.oid.off);
 		errno = EINVAL;
@@ -180,6 +188,8 @@ vinode_free_pmem(PMEMfilepool *pfp, struct pmemfile_vinode *vinode)
 	inode_trim(pfp, vinode->tinode);
 
 	TX_BEGIN_CB(pfp->pop, cb_queue, pfp) {
+		tx_log_attach(pfp);
+
 		inode_array_unregister(pfp, vinode->orphaned.arr,
 				vinode->orphaned.idx);
 
@@ -293,18 +303,61 @@ inode_alloc(PMEMfilepool *pfp, struct pmemfile_cred *cred, uint64_t flags)
 
 	ASSERT_IN_TX();
 
-	const struct pmem_block_info *info = metadata_block_info();
+	const struct pmem_block_info *info = pfp->inode_block;
+
+	TOID(struct pmemfile_inode) tinode;
+	TOID_ASSIGN(tinode, inode_reserve_take(pfp));
 
-	TOID(struct pmemfile_inode) tinode =
-		TX_XALLOC(struct pmemfile_inode, info->size,
-			POBJ_XALLOC_ZERO | info->class_id);
+	bool reserved = !TOID_IS_NULL(tinode);
+	if (!reserved) {
+		arena_bind(pfp);
+		tinode = TX_XALLOC(struct pmemfile_inode, info->size,
+				POBJ_XALLOC_ZERO | info->class_id);
+	}
 
 	struct pmemfile_inode *inode = PF_RW(pfp, tinode);
 
+	/*
+	 * Published reservation is not flushed on commit like a transactional
+	 * allocation, so add the parts written here and by the callers to the
+	 * transaction. Snapshotting a few cachelines of zeroes is still much
+	 * cheaper than allocating in the transaction. The version is stored
+	 * only by inode_init, after the snapshot.
+	 */
+	if (reserved) {
+		union pmemfile_inode_data *data =
+				inode_get_data_at(inode, pfp->inode_version);
+
+		pmemobj_tx_add_range_direct(inode,
+				offsetof(struct pmemfile_inode, byte_padding));
+		pmemobj_tx_add_range_direct(data, sizeof(data->blocks));
+	}
+
 	struct pmemfile_time t;
 	get_current_time(&t);
 
-	inode->version = PMEMFILE_INODE_VERSION(2);
+	inode_init(pfp, inode, cred, flags, t);
+
+	return tinode;
+}
+
+/*
+ * inode_init -- initializes freshly allocated (zeroed) inode
+ *
+ * Doesn't flush anything.
+ */
+void
+inode_init(PMEMfilepool *pfp, struct pmemfile_inode *inode,
+		struct pmemfile_cred *cred, uint64_t flags,
+		struct pmemfile_time t)
+{
+	const struct pmem_block_info *info = pfp->inode_block;
+
+	/* the location of in-inode storage depends on the version */
+	inode->version = pfp->inode_version;
+	union pmemfile_inode_data *data = inode_get_data(inode);
+	size_t data_size = inode_get_data_size(inode);
+
 	inode->flags[0] = flags;
 	inode->ctime[0] = t;
 	inode->mtime[0] = t;
@@ -314,33 +367,38 @@ inode_alloc(PMEMfilepool *pfp, struct pmemfile_cred *cred, uint64_t flags)
 	inode->gid = cred->egid;
 
 	if (inode_is_regular_file(inode)) {
-		inode->file_data.blocks.version =
-			PMEMFILE_BLOCK_ARRAY_VERSION(1);
-		inode->file_data.blocks.length =
-				(sizeof(inode->file_data) -
-				sizeof(inode->file_data.blocks)) /
-				sizeof(struct pmemfile_block_desc);
+		data->blocks.version = PMEMFILE_BLOCK_ARRAY_VERSION(1);
+		data->blocks.length = (uint32_t)
+				((data_size - sizeof(data->blocks)) /
+				sizeof(struct pmemfile_block_desc));
 	} else if (inode_is_dir(inode)) {
-		inode->file_data.dir.version = PMEMFILE_DIR_VERSION(1);
-		inode->file_data.dir.num_elements =
-				(sizeof(inode->file_data) -
-				sizeof(inode->file_data.dir)) /
-				sizeof(struct pmemfile_dirent);
+		data->dir.version = PMEMFILE_DIR_VERSION(1);
+		data->dir.num_elements = (uint32_t)
+				((data_size - sizeof(data->dir)) /
+				sizeof(struct pmemfile_dirent));
 		inode->size[0] = info->size;
 	}
+}
 
-	return tinode;
+/*
+ * orphan_list -- picks the list of orphaned inodes for the calling thread
+ *
+ * Every inode array has its own lock, held until the end of transaction, so
+ * threads orphaning inodes at the same time shouldn't all pick the same list.
+ */
+TOID(struct pmemfile_inode_array)
+orphan_list(PMEMfilepool *pfp)
+{
+	return *pool_orphan_list(pfp, os_getcpu() % PMEMFILE_ORPHAN_LISTS);
 }
 
 /*
- * vinode_orphan_unlocked -- register specified inode in orphaned_inodes array
+ * vinode_orphan -- register specified inode in one of orphaned inode lists
  *
  * Must be called in a transaction.
- *
- * Assumes superblock lock already has been taken.
  */
 void
-vinode_orphan_unlocked(PMEMfilepool *pfp, struct pmemfile_vinode *vinode)
+vinode_orphan(PMEMfilepool *pfp, struct pmemfile_vinode *vinode)
 {
 	LOG(LDBG, "inode 0x%" PRIx64 " path %s", vinode->tinode.oid.off,
 			pmfi_path(vinode));
@@ -351,41 +409,53 @@ vinode_orphan_unlocked(PMEMfilepool *pfp, struct pmemfile_vinode *vinode)
 	if (vinode->inode->suspended_references > 0)
 		return;
 
-	TOID(struct pmemfile_inode_array) orphaned =
-			pfp->super->orphaned_inodes;
-
-	inode_array_add(pfp, orphaned, vinode->tinode,
+	inode_array_add(pfp, orphan_list(pfp), vinode->tinode,
 			&vinode->orphaned.arr, &vinode->orphaned.idx);
 }
 
-struct inode_orphan_info
-inode_orphan(PMEMfilepool *pfp, TOID(struct pmemfile_inode) tinode)
+/*
+ * vinode_orphan_many -- register specified vinodes in one of orphaned inode
+ * lists
+ *
+ * Must be called in a transaction, which doesn't orphan any other inodes.
+ * Entries of vinodes which can't be orphaned are set to NULL.
+ */
+void
+vinode_orphan_many(PMEMfilepool *pfp, struct pmemfile_vinode **vinodes,
+		size_t n)
 {
-	LOG(LDBG, "inode 0x%" PRIx64, tinode.oid.off);
+	LOG(LDBG, "%zu inodes", n);
 
 	ASSERT_IN_TX();
 
-	struct inode_orphan_info info;
+	for (size_t i = 0; i < n; ++i) {
+		ASSERTeq(vinodes[i]->orphaned.arr, NULL);
 
-	inode_array_add(pfp, pfp->super->orphaned_inodes, tinode, &info.arr,
-			&info.idx);
+		if (vinodes[i]->inode->suspended_references > 0)
+			vinodes[i] = NULL;
+	}
 
-	return info;
+	inode_array_add_vinodes(pfp, orphan_list(pfp), vinodes, n);
 }
 
 /*
- * vinode_orphan -- register specified inode in orphaned_inodes array
+ * inode_orphan -- register specified inode in one of orphaned inode lists,
+ * before its vinode exists
  *
  * Must be called in a transaction.
  */
-void
-vinode_orphan(PMEMfilepool *pfp, struct pmemfile_vinode *vinode)
+struct inode_orphan_info
+inode_orphan(PMEMfilepool *pfp, TOID(struct pmemfile_inode) tinode)
 {
-	rwlock_tx_wlock(&pfp->super_rwlock);
+	LOG(LDBG, "inode 0x%" PRIx64, tinode.oid.off);
+
+	ASSERT_IN_TX();
 
-	vinode_orphan_unlocked(pfp, vinode);
+	struct inode_orphan_info info;
+
+	inode_array_add(pfp, orphan_list(pfp), tinode, &info.arr, &info.idx);
 
-	rwlock_tx_unlock_on_commit(&pfp->super_rwlock);
+	return info;
 }
 
 /*
@@ -396,7 +466,7 @@ inode_free_dir(PMEMfilepool *pfp, struct pmemfile_inode *inode)
 {
 	ASSERT_IN_TX();
 
-	struct pmemfile_dir *dir = &inode->file_data.dir;
+	struct pmemfile_dir *dir = &inode_get_data(inode)->dir;
 	TOID(struct pmemfile_dir) tdir = TOID_NULL(struct pmemfile_dir);
 
 	while (dir != NULL) {
@@ -422,11 +492,11 @@ inode_trim_reg_file(PMEMfilepool *pfp, struct pmemfile_inode *inode)
 {
 	ASSERT_NOT_IN_TX();
 
-	struct pmemfile_block_array *arr = &inode->file_data.blocks;
+	struct pmemfile_block_array *arr = &inode_get_data(inode)->blocks;
 
 	while (arr != NULL) {
 		for (unsigned i = 0; i < arr->length; ++i)
-			POBJ_FREE(&arr->blocks[i].data);
+			block_data_free(pfp, &arr->blocks[i]);
 
 		arr = PF_RW(pfp, arr->next);
 	}
@@ -447,13 +517,13 @@ inode_free_reg_file(PMEMfilepool *pfp, struct pmemfile_inode *inode)
 {
 	ASSERT_IN_TX();
 
-	struct pmemfile_block_array *arr = &inode->file_data.blocks;
+	struct pmemfile_block_array *arr = &inode_get_data(inode)->blocks;
 	TOID(struct pmemfile_block_array) tarr =
 			TOID_NULL(struct pmemfile_block_array);
 
 	while (arr != NULL) {
 		for (unsigned i = 0; i < arr->length; ++i)
-			TX_FREE(arr->blocks[i].data);
+			block_data_tx_free(pfp, &arr->blocks[i]);
 
 		TOID(struct pmemfile_block_array) next = arr->next;
 		if (!TOID_IS_NULL(tarr))
@@ -640,6 +710,41 @@ vinode_unlockN(struct pmemfile_vinode *v[static 5])
 		os_rwlock_unlock(&v[i++]->rwlock);
 }
 
+/*
+ * vinode_wrlockv -- sort and deduplicate "n" inodes from "v" and take WRITE
+ * locks on them in ascending order. Returns the number of locked inodes,
+ * which are stored at the beginning of "v".
+ */
+size_t
+vinode_wrlockv(struct pmemfile_vinode **v, size_t n)
+{
+	if (n == 0)
+		return 0;
+
+	qsort(v, n, sizeof(v[0]), vinode_cmp);
+
+	size_t u = 1;
+	for (size_t i = 1; i < n; ++i)
+		if (v[i] != v[u - 1])
+			v[u++] = v[i];
+
+	/* take all locks in order of increasing addresses */
+	for (size_t i = 0; i < u; ++i)
+		os_rwlock_wrlock(&v[i]->rwlock);
+
+	return u;
+}
+
+/*
+ * vinode_unlockv -- drop locks taken by vinode_wrlockv
+ */
+void
+vinode_unlockv(struct pmemfile_vinode **v, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		os_rwlock_unlock(&v[i]->rwlock);
+}
+
 /*
  * vinode_snapshot
  * Saves some volatile state in vinode, that can be altered during a
@@ -733,15 +838,7 @@ vinode_suspend(PMEMfilepool *pfp, struct pmemfile_vinode *vinode)
 			&vinode->suspended.arr, &vinode->suspended.idx,
 			INODE_ARRAY_NOLOCK);
 
-	if (vinode->blocks) {
-		offset_map_delete(vinode->blocks);
-		vinode->blocks = NULL;
-	}
-
-	vinode->first_free_block.arr = NULL;
-	vinode->first_free_block.idx = 0;
-
-	vinode->first_block = NULL;
+	/* the block tree is dropped at resume, if it turns out to be stale */
 }
 
 static inline void *
@@ -780,14 +877,32 @@ inode_resume(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
 
 /*
  * vinode_resume -- restores runtime part of inode after suspend
+ *
+ * If caches_valid is false, the pool was used by another process or was
+ * mapped at a different address, so everything cached in the vinode which
+ * points into the pool is dropped.
  */
 void
 vinode_resume(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
-		PMEMobjpool *old_pop)
+		PMEMobjpool *old_pop, bool caches_valid)
 {
 	vinode->suspended.arr = NULL;
 	vinode->suspended.idx = 0;
 
+	if (!caches_valid) {
+		if (vinode->blocks) {
+			offset_map_delete(vinode->blocks);
+			vinode->blocks = NULL;
+		}
+
+		vinode->first_free_block.arr = NULL;
+		vinode->first_free_block.idx = 0;
+
+		vinode->first_block = NULL;
+
+		vinode_invalidate_block_pointers(vinode, 0, UINT64_MAX);
+	}
+
 	if (pfp->pop != old_pop) {
 		uintptr_t diff = (uintptr_t)pfp->pop - (uintptr_t)old_pop;
 
@@ -45,6 +45,8 @@
 COMPILE_ERROR_ON((PMEMFILE_S_IFMT | PMEMFILE_ALLPERMS) &
 		PMEMFILE_S_LONGSYMLINK);
 
+#define BLOCK_INVALIDATION_LOG_SIZE 8
+
 /* volatile inode */
 struct pmemfile_vinode {
 	/* reference counter */
@@ -55,10 +57,19 @@ struct pmemfile_vinode {
 
 	/*
 	 * Counter to keep track of modifications that potentially
-	 * invalidate a block_pointer_cache field in pmemfile_file struct.
+	 * invalidate block cursors in pmemfile_file struct.
 	 */
 	uint64_t block_pointer_invalidation_counter;
 
+	/*
+	 * File ranges affected by the last BLOCK_INVALIDATION_LOG_SIZE
+	 * invalidations, see block_cursor.c.
+	 */
+	struct block_invalidation {
+		uint64_t start;
+		uint64_t end;
+	} block_invalidations[BLOCK_INVALIDATION_LOG_SIZE];
+
 	/* persistent inode */
 	struct pmemfile_inode *inode;
 
@@ -227,6 +238,40 @@ inode_get_allocated_space(const struct pmemfile_inode *i)
 	return i->allocated_space[i->slots.bits.allocated_space];
 }
 
+/*
+ * inode_get_data_at -- returns in-inode storage of an inode of given version,
+ * which doesn't have to be stored in the inode yet
+ */
+static inline union pmemfile_inode_data *
+inode_get_data_at(struct pmemfile_inode *i, uint32_t version)
+{
+	if (version == PMEMFILE_INODE_VERSION(3))
+		return (union pmemfile_inode_data *)
+				((char *)i + PMEMFILE_INODE_HEADER_SIZE);
+
+	return &i->file_data;
+}
+
+/*
+ * inode_get_data -- returns in-inode storage of blocks, dirents or symlink,
+ * which in compact inodes follows the header immediately
+ */
+static inline union pmemfile_inode_data *
+inode_get_data(struct pmemfile_inode *i)
+{
+	return inode_get_data_at(i, i->version);
+}
+
+static inline size_t
+inode_get_data_size(const struct pmemfile_inode *i)
+{
+	if (i->version == PMEMFILE_INODE_VERSION(3))
+		return PMEMFILE_COMPACT_INODE_SIZE -
+				PMEMFILE_INODE_HEADER_SIZE;
+
+	return sizeof(i->file_data);
+}
+
 static inline uint64_t *
 inode_get_flags_ptr(struct pmemfile_inode *i)
 {
@@ -357,6 +402,9 @@ const char *get_symlink(PMEMfilepool *pfp, struct pmemfile_vinode *vinode);
 struct pmemfile_cred;
 TOID(struct pmemfile_inode) inode_alloc(PMEMfilepool *pfp,
 		struct pmemfile_cred *cred, uint64_t flags);
+void inode_init(PMEMfilepool *pfp, struct pmemfile_inode *inode,
+		struct pmemfile_cred *cred, uint64_t flags,
+		struct pmemfile_time t);
 
 void inode_free(PMEMfilepool *pfp, TOID(struct pmemfile_inode) tinode);
 void inode_trim(PMEMfilepool *pfp, TOID(struct pmemfile_inode) tinode);
@@ -376,11 +424,13 @@ void vinode_unref(PMEMfilepool *pfp, struct pmemfile_vinode *vinode);
 void vinode_cleanup(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
 		bool preserve_errno);
 
+TOID(struct pmemfile_inode_array) orphan_list(PMEMfilepool *pfp);
 struct inode_orphan_info inode_orphan(PMEMfilepool *pfp,
 		TOID(struct pmemfile_inode) tinode);
 
-void vinode_orphan_unlocked(PMEMfilepool *pfp, struct pmemfile_vinode *vinode);
 void vinode_orphan(PMEMfilepool *pfp, struct pmemfile_vinode *vinode);
+void vinode_orphan_many(PMEMfilepool *pfp, struct pmemfile_vinode **vinodes,
+		size_t n);
 
 void vinode_snapshot(struct pmemfile_vinode *vinode);
 void vinode_restore_on_abort(struct pmemfile_vinode *vinode);
@@ -394,6 +444,8 @@ void vinode_wrlockN(struct pmemfile_vinode *v[static 5],
 		struct pmemfile_vinode *v3,
 		struct pmemfile_vinode *v4);
 void vinode_unlockN(struct pmemfile_vinode *v[static 5]);
+size_t vinode_wrlockv(struct pmemfile_vinode **v, size_t n);
+void vinode_unlockv(struct pmemfile_vinode **v, size_t n);
 
 static inline TOID(struct pmemfile_block_desc)
 blockp_as_oid(struct pmemfile_block_desc *block)
@@ -407,6 +459,6 @@ void vinode_suspend(PMEMfilepool *pfp, struct pmemfile_vinode *vinode);
 void inode_resume(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
 		PMEMobjpool *old_pop);
 void vinode_resume(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
-		PMEMobjpool *old_pop);
+		PMEMobjpool *old_pop, bool caches_valid);
 
 #endif
@@ -34,6 +34,7 @@
  * inode_array.c -- inode_array utility functions
  */
 
+#include "arena.h"
 #include "blocks.h"
 #include "inode.h"
 #include "inode_array.h"
@@ -87,6 +88,8 @@ inode_array_alloc(PMEMfilepool *pfp)
 
 	const struct pmem_block_info *info = metadata_block_info();
 
+	arena_bind(pfp);
+
 	TOID(struct pmemfile_inode_array) array =
 		TX_XALLOC(struct pmemfile_inode_array, info->size,
 			POBJ_XALLOC_ZERO | info->class_id);
@@ -162,6 +165,115 @@ inode_array_add(PMEMfilepool *pfp,
 	_inode_array_add(pfp, array, tinode, ins, ins_idx, INODE_ARRAY_LOCK);
 }
 
+/*
+ * inode_array_add_vinodes -- adds inodes of "n" vinodes to array and stores
+ * their positions in vinode->orphaned, NULL entries are skipped
+ *
+ * Unlike inode_array_add, which keeps the element it modified locked until
+ * the end of transaction, this function locks every element at most once,
+ * so it can add any number of inodes in one transaction (as long as it's
+ * called only once for the array).
+ *
+ * Must be called in a transaction.
+ */
+void
+inode_array_add_vinodes(PMEMfilepool *pfp,
+		TOID(struct pmemfile_inode_array) array,
+		struct pmemfile_vinode **vinodes,
+		size_t n)
+{
+	ASSERT_IN_TX();
+
+	size_t done = 0;
+	while (done < n && !vinodes[done])
+		done++;
+
+	while (done < n) {
+		struct pmemfile_inode_array *cur = PF_RW(pfp, array);
+
+		pmemobj_mutex_lock_nofail(pfp->pop, &cur->mtx);
+
+		bool modified = false;
+
+		for (unsigned i = 0; i < NUMINODES_PER_ENTRY && done < n &&
+				cur->used < NUMINODES_PER_ENTRY; ++i) {
+			if (!TOID_IS_NULL(cur->inodes[i]))
+				continue;
+
+			if (!modified) {
+				mutex_tx_unlock_on_abort(&cur->mtx);
+				TX_ADD_DIRECT(&cur->used);
+				modified = true;
+			}
+
+			TX_ADD_DIRECT(&cur->inodes[i]);
+			cur->inodes[i] = vinodes[done]->tinode;
+			cur->used++;
+
+			vinodes[done]->orphaned.arr = cur;
+			vinodes[done]->orphaned.idx = i;
+
+			do {
+				done++;
+			} while (done < n && !vinodes[done]);
+		}
+
+		if (done < n && TOID_IS_NULL(cur->next)) {
+			if (!modified) {
+				mutex_tx_unlock_on_abort(&cur->mtx);
+				modified = true;
+			}
+
+			TX_ADD_DIRECT(&cur->next);
+			cur->next = inode_array_alloc(pfp);
+			PF_RW(pfp, cur->next)->prev = array;
+		}
+
+		array = cur->next;
+
+		if (modified)
+			mutex_tx_unlock_on_commit(&cur->mtx);
+		else
+			pmemobj_mutex_unlock_nofail(pfp->pop, &cur->mtx);
+	}
+}
+
+/*
+ * inode_array_lock_free_entry -- finds free entry in array without extending
+ * it, returns the element containing it
+ *
+ * Returned element is locked - caller must unlock it after the entry is
+ * filled (or not). Returns NULL if all elements are full.
+ *
+ * Doesn't need a transaction.
+ */
+struct pmemfile_inode_array *
+inode_array_lock_free_entry(PMEMfilepool *pfp,
+		TOID(struct pmemfile_inode_array) array,
+		unsigned *idx)
+{
+	struct pmemfile_inode_array *cur = PF_RW(pfp, array);
+
+	while (cur) {
+		pmemobj_mutex_lock_nofail(pfp->pop, &cur->mtx);
+
+		if (cur->used < NUMINODES_PER_ENTRY) {
+			for (unsigned i = 0; i < NUMINODES_PER_ENTRY; ++i) {
+				if (TOID_IS_NULL(cur->inodes[i])) {
+					*idx = i;
+					return cur;
+				}
+			}
+		}
+
+		struct pmemfile_inode_array *next = PF_RW(pfp, cur->next);
+		pmemobj_mutex_unlock_nofail(pfp->pop, &cur->mtx);
+		cur = next;
+	}
+
+	return NULL;
+}
+
 void
 _inode_array_unregister(PMEMfilepool *pfp,
 		struct pmemfile_inode_array *cur,
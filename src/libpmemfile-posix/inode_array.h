@@ -50,6 +50,15 @@ void inode_array_add(PMEMfilepool *pfp,
 		struct pmemfile_inode_array **ins,
 		unsigned *ins_idx);
 
+void inode_array_add_vinodes(PMEMfilepool *pfp,
+		TOID(struct pmemfile_inode_array) array,
+		struct pmemfile_vinode **vinodes,
+		size_t n);
+
+struct pmemfile_inode_array *inode_array_lock_free_entry(PMEMfilepool *pfp,
+		TOID(struct pmemfile_inode_array) array,
+		unsigned *idx);
+
 void _inode_array_unregister(PMEMfilepool *pfp,
 		struct pmemfile_inode_array *cur,
 		unsigned idx,
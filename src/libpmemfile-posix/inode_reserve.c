@@ -0,0 +1,380 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * inode_reserve.c -- per-CPU reservations of pre-zeroed inodes
+ *
+ * Allocating an inode inside of the create transaction costs a heap
+ * operation (serialized on pmemobj heap locks) and zeroing of a whole
+ * metadata block. Instead, a background thread reserves zeroed metadata
+ * blocks ahead of time with pmemobj_xreserve and puts them into per-CPU
+ * slots. inode_alloc takes one from the slot of the CPU it runs on and
+ * publishes it as a part of its transaction. If that transaction aborts,
+ * pmemobj cancels the reservation.
+ *
+ * Reservations exist only in volatile memory - the heap doesn't record them
+ * until they are published - so reservations left behind by a process that
+ * crashed or didn't close the pool are returned to the heap when the pool is
+ * opened again, as part of the heap recovery. Reservations still held on
+ * pool close or suspend are cancelled - they are tied to the pmemobj pool
+ * handle - and the refill thread is stopped, to be started again by the
+ * next inode_alloc.
+ *
+ * Without reservation support in libpmemobj (older than 1.5), inode_alloc
+ * always allocates in the transaction.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+
+#include "alloc.h"
+#include "arena.h"
+#include "blocks.h"
+#include "inode.h"
+#include "inode_reserve.h"
+#include "layout.h"
+#include "os_thread.h"
+#include "os_util.h"
+#include "out.h"
+#include "pool.h"
+#include "utils.h"
+
+#ifdef POBJ_XRESERVE_ALLOC
+
+#define INODE_RESERVE_SLOTS 16
+#define INODE_RESERVE_DEPTH 16
+#define INODE_RESERVE_LOW 4
+
+struct inode_reserve_slot {
+	/* protects count, oid and act */
+	os_mutex_t lock;
+	unsigned count;
+	PMEMoid oid[INODE_RESERVE_DEPTH];
+	struct pobj_action act[INODE_RESERVE_DEPTH];
+
+	/* protected by pmemfile_inode_reserve.lock */
+	bool refill_requested;
+};
+
+struct pmemfile_inode_reserve {
+	PMEMfilepool *pfp;
+
+	/* protects stop and refill_requested of all slots */
+	os_mutex_t lock;
+
+	/* signalled when a slot needs a refill or the thread should stop */
+	os_cond_t cond;
+	bool stop;
+
+	os_thread_t thread;
+
+	struct inode_reserve_slot slots[INODE_RESERVE_SLOTS];
+};
+
+/*
+ * inode_reserve_refill -- fills up one slot with new reservations
+ */
+static void
+inode_reserve_refill(PMEMfilepool *pfp, struct inode_reserve_slot *slot)
+{
+	const struct pmem_block_info *info = pfp->inode_block;
+	PMEMoid oid[INODE_RESERVE_DEPTH];
+	struct pobj_action act[INODE_RESERVE_DEPTH];
+
+	os_mutex_lock(&slot->lock);
+	unsigned missing = INODE_RESERVE_DEPTH - slot->count;
+	os_mutex_unlock(&slot->lock);
+
+	arena_bind(pfp);
+
+	/* zeroing happens here, without holding the slot lock */
+	unsigned n;
+	for (n = 0; n < missing; ++n) {
+		oid[n] = POBJ_XRESERVE_ALLOC(pfp->pop, struct pmemfile_inode,
+				info->size, &act[n],
+				POBJ_XALLOC_ZERO | info->class_id).oid;
+
+		/* out of space - inode_alloc will fall back to tx alloc */
+		if (OID_IS_NULL(oid[n]))
+			break;
+	}
+
+	os_mutex_lock(&slot->lock);
+
+	unsigned fit = INODE_RESERVE_DEPTH - slot->count;
+	if (fit > n)
+		fit = n;
+
+	for (unsigned i = 0; i < fit; ++i) {
+		slot->oid[slot->count] = oid[i];
+		slot->act[slot->count] = act[i];
+		slot->count++;
+	}
+
+	os_mutex_unlock(&slot->lock);
+
+	if (fit < n)
+		pmemobj_cancel(pfp->pop, &act[fit], n - fit);
+}
+
+/*
+ * inode_reserve_worker -- refills slots on request
+ */
+static void *
+inode_reserve_worker(void *arg)
+{
+	struct pmemfile_inode_reserve *r = arg;
+
+	os_mutex_lock(&r->lock);
+
+	while (!r->stop) {
+		struct inode_reserve_slot *slot = NULL;
+
+		for (unsigned i = 0; i < INODE_RESERVE_SLOTS; ++i) {
+			if (r->slots[i].refill_requested) {
+				slot = &r->slots[i];
+				break;
+			}
+		}
+
+		if (!slot) {
+			os_cond_wait(&r->cond, &r->lock);
+			continue;
+		}
+
+		slot->refill_requested = false;
+
+		os_mutex_unlock(&r->lock);
+		inode_reserve_refill(r->pfp, slot);
+		os_mutex_lock(&r->lock);
+	}
+
+	os_mutex_unlock(&r->lock);
+
+	return NULL;
+}
+
+/*
+ * inode_reserve_get -- returns reservations of the pool, starts the refill
+ * thread if needed
+ */
+static struct pmemfile_inode_reserve *
+inode_reserve_get(PMEMfilepool *pfp)
+{
+	struct pmemfile_inode_reserve *r;
+
+	os_mutex_lock(&pfp->inode_reserve_mutex);
+
+	r = pfp->inode_reserve;
+	if (r)
+		goto end;
+
+	r = pf_calloc(1, sizeof(*r));
+	if (!r)
+		goto end;
+
+	r->pfp = pfp;
+	os_mutex_init(&r->lock);
+	os_cond_init(&r->cond);
+	for (unsigned i = 0; i < INODE_RESERVE_SLOTS; ++i)
+		os_mutex_init(&r->slots[i].lock);
+
+	int error = os_thread_create(&r->thread, inode_reserve_worker, r);
+	if (error) {
+		ERR("cannot create inode reservation thread: %d", error);
+		for (unsigned i = 0; i < INODE_RESERVE_SLOTS; ++i)
+			os_mutex_destroy(&r->slots[i].lock);
+		os_cond_destroy(&r->cond);
+		os_mutex_destroy(&r->lock);
+		pf_free(r);
+		r = NULL;
+		goto end;
+	}
+
+	/* inode_reserve_pop reads it without the mutex */
+	__atomic_store_n(&pfp->inode_reserve, r, __ATOMIC_RELEASE);
+
+end:
+	os_mutex_unlock(&pfp->inode_reserve_mutex);
+
+	return r;
+}
+
+/*
+ * inode_reserve_pop -- takes a pre-zeroed inode reserved on the current CPU,
+ * returns OID_NULL if there's none
+ */
+static PMEMoid
+inode_reserve_pop(PMEMfilepool *pfp, struct pobj_action *act)
+{
+	struct pmemfile_inode_reserve *r =
+			__atomic_load_n(&pfp->inode_reserve, __ATOMIC_ACQUIRE);
+	if (!r) {
+		/* don't fail the caller if the thread can't be started */
+		int oerrno = errno;
+		r = inode_reserve_get(pfp);
+		errno = oerrno;
+		if (!r)
+			return OID_NULL;
+	}
+
+	struct inode_reserve_slot *slot =
+			&r->slots[os_getcpu() % INODE_RESERVE_SLOTS];
+	PMEMoid oid = OID_NULL;
+
+	os_mutex_lock(&slot->lock);
+	if (slot->count > 0) {
+		slot->count--;
+		oid = slot->oid[slot->count];
+		*act = slot->act[slot->count];
+	}
+	bool low = slot->count < INODE_RESERVE_LOW;
+	os_mutex_unlock(&slot->lock);
+
+	if (low) {
+		os_mutex_lock(&r->lock);
+		if (!slot->refill_requested) {
+			slot->refill_requested = true;
+			os_cond_signal(&r->cond);
+		}
+		os_mutex_unlock(&r->lock);
+	}
+
+	return oid;
+}
+
+/*
+ * inode_reserve_take -- takes a pre-zeroed inode reserved on the current CPU
+ * and publishes it in the current transaction
+ *
+ * Returns OID_NULL if there's no reservation available. Fields written to
+ * the returned inode are not tracked by the transaction - the caller must
+ * flush them before commit.
+ */
+PMEMoid
+inode_reserve_take(PMEMfilepool *pfp)
+{
+	ASSERT_IN_TX();
+
+	struct pobj_action act;
+	PMEMoid oid = inode_reserve_pop(pfp, &act);
+
+	if (OID_IS_NULL(oid))
+		return oid;
+
+	if (pmemobj_tx_publish(&act, 1)) {
+		pmemobj_cancel(pfp->pop, &act, 1);
+		pmemfile_tx_abort(errno);
+	}
+
+	return oid;
+}
+
+/*
+ * inode_reserve_take_action -- takes a pre-zeroed inode reserved on the
+ * current CPU, without publishing it
+ *
+ * Returns OID_NULL if there's no reservation available. Otherwise the caller
+ * owns the reservation and must either publish or cancel "act".
+ */
+PMEMoid
+inode_reserve_take_action(PMEMfilepool *pfp, struct pobj_action *act)
+{
+	ASSERT_NOT_IN_TX();
+
+	return inode_reserve_pop(pfp, act);
+}
+
+/*
+ * inode_reserve_destroy -- stops the refill thread and cancels all unused
+ * reservations
+ *
+ * Called on pool close and suspend, when no other pmemfile call is
+ * in progress.
+ */
+void
+inode_reserve_destroy(PMEMfilepool *pfp)
+{
+	os_mutex_lock(&pfp->inode_reserve_mutex);
+	struct pmemfile_inode_reserve *r = pfp->inode_reserve;
+	__atomic_store_n(&pfp->inode_reserve, NULL, __ATOMIC_RELEASE);
+	os_mutex_unlock(&pfp->inode_reserve_mutex);
+
+	if (!r)
+		return;
+
+	os_mutex_lock(&r->lock);
+	r->stop = true;
+	os_cond_signal(&r->cond);
+	os_mutex_unlock(&r->lock);
+
+	os_thread_join(&r->thread, NULL);
+
+	for (unsigned i = 0; i < INODE_RESERVE_SLOTS; ++i) {
+		struct inode_reserve_slot *slot = &r->slots[i];
+
+		if (slot->count)
+			pmemobj_cancel(pfp->pop, slot->act, slot->count);
+		os_mutex_destroy(&slot->lock);
+	}
+
+	os_cond_destroy(&r->cond);
+	os_mutex_destroy(&r->lock);
+	pf_free(r);
+}
+
+#else
+
+PMEMoid
+inode_reserve_take(PMEMfilepool *pfp)
+{
+	(void) pfp;
+
+	return OID_NULL;
+}
+
+PMEMoid
+inode_reserve_take_action(PMEMfilepool *pfp, struct pobj_action *act)
+{
+	(void) pfp;
+	(void) act;
+
+	return OID_NULL;
+}
+
+void
+inode_reserve_destroy(PMEMfilepool *pfp)
+{
+	(void) pfp;
+}
+
+#endif
@@ -51,6 +51,8 @@ POBJ_LAYOUT_TOID(pmemfile, struct pmemfile_block_array);
 POBJ_LAYOUT_TOID(pmemfile, struct pmemfile_block_desc);
 POBJ_LAYOUT_TOID(pmemfile, struct pmemfile_inode_array);
 POBJ_LAYOUT_TOID(pmemfile, char);
+POBJ_LAYOUT_TOID(pmemfile, struct pmemfile_tx_logs);
+POBJ_LAYOUT_TOID(pmemfile, struct pmemfile_extent_region);
 POBJ_LAYOUT_END(pmemfile);
 
 #define METADATA_BLOCK_SIZE 4096
@@ -76,6 +78,8 @@ struct pmemfile_block_desc {
 };
 
 #define BLOCK_INITIALIZED 1
+/* block data lives in an extent region, not in its own heap object */
+#define BLOCK_EXTENT 2
 
 #define PMEMFILE_BLOCK_ARRAY_VERSION(a) ((uint32_t)0x00414C42 | \
 		((uint32_t)(a + '0') << 24))
@@ -140,7 +144,17 @@ struct pmemfile_time {
 #define PMEMFILE_INODE_VERSION(a) ((uint32_t)0x00444E49 | \
 		((uint32_t)(a + '0') << 24))
 
+/*
+ * Version 2 inodes take PMEMFILE_INODE_SIZE bytes, with in-inode storage
+ * placed at the end (file_data).
+ *
+ * Version 3 (compact) inodes take PMEMFILE_COMPACT_INODE_SIZE bytes. They
+ * share the header with version 2, but the in-inode storage starts right
+ * after it, at PMEMFILE_INODE_HEADER_SIZE - see inode_get_data. It is too
+ * small for dirents, so all entries of a directory are stored out of line.
+ */
 #define PMEMFILE_INODE_SIZE METADATA_BLOCK_SIZE
+#define PMEMFILE_COMPACT_INODE_SIZE 512
 #define PMEMFILE_IN_INODE_STORAGE \
 	(sizeof(struct pmemfile_dir) + 2 * sizeof(struct pmemfile_dirent) + 8)
 
@@ -218,7 +232,7 @@ struct pmemfile_inode {
 	/* ---- cacheline boundary ---- */
 
 	/* data! */
-	union {
+	union pmemfile_inode_data {
 		/* file specific data */
 		struct pmemfile_block_array blocks;
 
@@ -239,6 +253,13 @@ COMPILE_ERROR_ON(sizeof(union pmemfile_inode_slots) != 8);
 
 COMPILE_ERROR_ON(sizeof(struct pmemfile_inode) != PMEMFILE_INODE_SIZE);
 
+#define PMEMFILE_INODE_HEADER_SIZE offsetof(struct pmemfile_inode, padding3)
+
+COMPILE_ERROR_ON(PMEMFILE_INODE_HEADER_SIZE != 320);
+COMPILE_ERROR_ON(PMEMFILE_COMPACT_INODE_SIZE - PMEMFILE_INODE_HEADER_SIZE <
+		sizeof(struct pmemfile_block_array) +
+		sizeof(struct pmemfile_block_desc));
+
 #define PMEMFILE_INODE_ARRAY_VERSION(a) ((uint32_t)0x00414E49 | \
 		((uint32_t)(a + '0') << 24))
 #define PMEMFILE_INODE_ARRAY_SIZE METADATA_BLOCK_SIZE
@@ -286,6 +307,69 @@ COMPILE_ERROR_ON(sizeof(struct pmemfile_inode_array) !=
  */
 #define PMEMFILE_ROOT_COUNT 4
 
+/*
+ * Number of independent lists of orphaned inodes. A list is picked by the CPU
+ * the orphaning thread runs on, so that unlinks of open files don't serialize
+ * on one inode array.
+ */
+#define PMEMFILE_ORPHAN_LISTS 8
+
+/*
+ * Preallocated transaction log buffers (see tx_log.c). Each one is used by
+ * at most one transaction at a time.
+ */
+#define PMEMFILE_TX_LOGS 8
+#define PMEMFILE_TX_LOG_SIZE (32 << 10)
+
+struct pmemfile_tx_logs {
+	char buf[PMEMFILE_TX_LOGS][PMEMFILE_TX_LOG_SIZE];
+};
+
+#define PMEMFILE_EXTENT_REGION_VERSION(a) ((uint32_t)0x00474552 | \
+		((uint32_t)(a + '0') << 24))
+
+/*
+ * Data blocks managed by pmemfile instead of the pmemobj heap (see extent.c).
+ * One bit of "used" per unit.
+ */
+#define PMEMFILE_EXTENT_UNITS 64
+#define PMEMFILE_EXTENT_HEADER_SIZE 4096
+
+struct pmemfile_extent_region {
+	/* layout version */
+	uint32_t version;
+
+	/* size of one unit, the smallest block size at region creation */
+	uint32_t unit_size;
+
+	/* next region */
+	TOID(struct pmemfile_extent_region) next;
+
+	/* used and blocks are up to date - set on clean pool close */
+	uint64_t saved;
+
+	/* units taken by blocks */
+	uint64_t used;
+
+	/* padding / unused */
+	char padding[PMEMFILE_EXTENT_HEADER_SIZE - 40];
+
+	/* PMEMFILE_EXTENT_UNITS units of unit_size bytes */
+	char data[];
+};
+
+COMPILE_ERROR_ON(sizeof(struct pmemfile_extent_region) !=
+		PMEMFILE_EXTENT_HEADER_SIZE);
+
+/* data block class recorded in superblock, see pmemfile_block_class */
+struct pmemfile_block_class_desc {
+	uint32_t size;
+	uint32_t units_per_block;
+};
+
+/* PMEMFILE_MAX_BLOCK_CLASSES and a terminator */
+#define PMEMFILE_BLOCK_CLASS_SLOTS 8
+
 /* superblock */
 struct pmemfile_super {
 	/* superblock version */
@@ -305,11 +389,61 @@ struct pmemfile_super {
 	 */
 	TOID(struct pmemfile_inode) root_inode[PMEMFILE_ROOT_COUNT];
 
+	/*
+	 * Layout version of inodes created in this pool, 0 in pools created
+	 * before it was recorded, which means PMEMFILE_INODE_VERSION(2).
+	 */
+	uint64_t inode_version;
+
+	/*
+	 * Orphaned inode lists other than orphaned_inodes. Pools created
+	 * before they existed have them allocated on open.
+	 */
+	TOID(struct pmemfile_inode_array)
+		more_orphaned_inodes[PMEMFILE_ORPHAN_LISTS - 1];
+
+	/*
+	 * Transaction log buffers. Pools created before they existed have
+	 * them allocated on open.
+	 */
+	TOID(struct pmemfile_tx_logs) tx_logs;
+
+	/* list of extent regions */
+	TOID(struct pmemfile_extent_region) extent_regions;
+
+	/*
+	 * Data block classes, smallest first, terminated by size 0. Pools
+	 * created before they were recorded have all zeroes here and use
+	 * the defaults of the process which opens them.
+	 */
+	struct pmemfile_block_class_desc
+		block_classes[PMEMFILE_BLOCK_CLASS_SLOTS];
+
+	/*
+	 * Orphaned inode lists left by previous runs, which are being freed
+	 * in background (see orphan.c).
+	 */
+	TOID(struct pmemfile_inode_array) stale_orphans[PMEMFILE_ORPHAN_LISTS];
+
+	/*
+	 * Bumped every time a process opens or resumes the pool, so a process
+	 * resuming it can tell whether anyone else used the pool since it was
+	 * suspended.
+	 */
+	uint64_t generation;
+
 	char padding[PMEMFILE_SUPER_SIZE
 			- 8  /* version */
+			- 8  /* inode_version */
+			- 16 * (PMEMFILE_ORPHAN_LISTS - 1) /* toid */
 			- 16 * (PMEMFILE_ROOT_COUNT) /* toid */
 			- 16 /* toid */
-			- 16 /* toid */];
+			- 16 /* toid */
+			- 16 /* toid */
+			- 16 /* toid */
+			- 8 * PMEMFILE_BLOCK_CLASS_SLOTS /* block classes */
+			- 16 * PMEMFILE_ORPHAN_LISTS /* toid */
+			- 8  /* generation */];
 };
 
 COMPILE_ERROR_ON(sizeof(struct pmemfile_super) != PMEMFILE_SUPER_SIZE);
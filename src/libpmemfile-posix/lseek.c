@@ -113,7 +113,7 @@ lseek_end_directory(PMEMfilepool *pfp, struct pmemfile_inode *inode,
 	pmemfile_off_t ret_dir_num = 0;
 	pmemfile_off_t dir_num = 0;
 	struct pmemfile_dir *ret_dir = NULL;
-	struct pmemfile_dir *dir = &inode->file_data.dir;
+	struct pmemfile_dir *dir = &inode_get_data(inode)->dir;
 
 	struct pmemfile_dir *next = NULL;
 	do {
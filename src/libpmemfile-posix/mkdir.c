@@ -46,20 +46,17 @@
 #include "utils.h"
 
 /*
- * vinode_new_dir -- creates new directory relative to parent
+ * inode_new_dir -- creates new directory in directory specified by
+ * parent inode
  *
- * Note: caller must hold WRITE lock on parent.
+ * Note: caller must have exclusive access to parent.
  * Must be called in a transaction.
  */
 TOID(struct pmemfile_inode)
-vinode_new_dir(PMEMfilepool *pfp, struct pmemfile_vinode *parent,
+inode_new_dir(PMEMfilepool *pfp, TOID(struct pmemfile_inode) parent,
 		const char *name, size_t namelen, struct pmemfile_cred *cred,
 		pmemfile_mode_t mode)
 {
-	LOG(LDBG, "parent 0x%" PRIx64 " ppath %s new_name %.*s",
-			parent ? parent->tinode.oid.off : 0,
-			pmfi_path(parent), (int)namelen, name);
-
 	ASSERT_IN_TX();
 
 	if (mode & ~(pmemfile_mode_t)PMEMFILE_ACCESSPERMS) {
@@ -77,17 +74,36 @@ vinode_new_dir(PMEMfilepool *pfp, struct pmemfile_vinode *parent,
 	/* add . and .. to new directory */
 	inode_add_dirent(pfp, tchild, ".", 1, tchild, t);
 
-	if (parent == NULL) { /* special case - root directory */
+	if (TOID_IS_NULL(parent)) { /* special case - root directory */
 		inode_add_dirent(pfp, tchild, "..", 2, tchild, t);
 	} else {
-		inode_add_dirent(pfp, tchild, "..", 2, parent->tinode, t);
-		inode_add_dirent(pfp, parent->tinode, name, namelen, tchild,
-				t);
+		inode_add_dirent(pfp, tchild, "..", 2, parent, t);
+		inode_add_dirent(pfp, parent, name, namelen, tchild, t);
 	}
 
 	return tchild;
 }
 
+/*
+ * vinode_new_dir -- creates new directory relative to parent
+ *
+ * Note: caller must hold WRITE lock on parent.
+ * Must be called in a transaction.
+ */
+TOID(struct pmemfile_inode)
+vinode_new_dir(PMEMfilepool *pfp, struct pmemfile_vinode *parent,
+		const char *name, size_t namelen, struct pmemfile_cred *cred,
+		pmemfile_mode_t mode)
+{
+	LOG(LDBG, "parent 0x%" PRIx64 " ppath %s new_name %.*s",
+			parent ? parent->tinode.oid.off : 0,
+			pmfi_path(parent), (int)namelen, name);
+
+	return inode_new_dir(pfp, parent ? parent->tinode :
+			TOID_NULL(struct pmemfile_inode), name, namelen, cred,
+			mode);
+}
+
 static int
 _pmemfile_mkdirat(PMEMfilepool *pfp, struct pmemfile_vinode *dir,
 		const char *path, pmemfile_mode_t mode)
@@ -35,6 +35,11 @@
 #include "creds.h"
 #include "inode.h"
 
+TOID(struct pmemfile_inode) inode_new_dir(PMEMfilepool *pfp,
+		TOID(struct pmemfile_inode) parent, const char *name,
+		size_t namelen, struct pmemfile_cred *cred,
+		pmemfile_mode_t mode);
+
 TOID(struct pmemfile_inode) vinode_new_dir(PMEMfilepool *pfp,
 		struct pmemfile_vinode *parent, const char *name,
 		size_t namelen, struct pmemfile_cred *cred,
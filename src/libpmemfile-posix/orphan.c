@@ -0,0 +1,379 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * orphan.c -- background freeing of inodes orphaned by previous runs
+ *
+ * Files which are unlinked while still open are kept on one of the orphaned
+ * inode lists until they are closed. When the pool isn't closed cleanly
+ * (or files are not closed before the pool), the lists keep them forever,
+ * so they must be freed on the next pool open. Doing it synchronously makes
+ * open as slow as freeing all of them, which with enough temporary files
+ * can take minutes.
+ *
+ * Instead, pool open only moves the whole lists to super->stale_orphans
+ * (one small transaction, independent of the number of orphans) and gives
+ * the orphaned lists fresh arrays. A background thread then trims and frees
+ * stale inodes, a few per transaction, and frees the arrays as they become
+ * empty. Nothing else in the process can reach stale inodes, so the thread
+ * doesn't take any locks besides its own.
+ *
+ * If the pool is closed, suspended or crashes before the thread is done,
+ * what's left on the stale lists is picked up by the next open or resume.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "callbacks.h"
+#include "inode.h"
+#include "inode_array.h"
+#include "layout.h"
+#include "orphan.h"
+#include "os_thread.h"
+#include "out.h"
+#include "pool.h"
+#include "utils.h"
+
+/* number of inodes freed in one transaction */
+#define ORPHAN_RECLAIM_BATCH 16
+
+struct pmemfile_orphan_reclaim {
+	PMEMfilepool *pfp;
+
+	/* protects stop */
+	os_mutex_t lock;
+	bool stop;
+
+	os_thread_t thread;
+};
+
+/*
+ * orphan_list_is_trivial -- returns true if list doesn't hold any inodes
+ * and consists of just one array
+ */
+static bool
+orphan_list_is_trivial(PMEMfilepool *pfp,
+		TOID(struct pmemfile_inode_array) list)
+{
+	return inode_array_empty(pfp, list) &&
+			inode_array_is_small(pfp, list);
+}
+
+/*
+ * orphan_list_tail -- returns last array of the list
+ */
+static TOID(struct pmemfile_inode_array)
+orphan_list_tail(PMEMfilepool *pfp, TOID(struct pmemfile_inode_array) list)
+{
+	while (!TOID_IS_NULL(PF_RO(pfp, list)->next))
+		list = PF_RO(pfp, list)->next;
+
+	return list;
+}
+
+/*
+ * orphan_detach -- moves orphaned inode lists left by previous runs of
+ * the pool to the stale lists
+ *
+ * Must be called on pool open, before any inode can be orphaned.
+ */
+void
+orphan_detach(PMEMfilepool *pfp)
+{
+	struct pmemfile_super *super = pfp->super;
+	int error = 0;
+
+	TX_BEGIN_CB(pfp->pop, cb_queue, pfp) {
+		for (unsigned i = 0; i < PMEMFILE_ORPHAN_LISTS; ++i) {
+			TOID(struct pmemfile_inode_array) *list =
+					pool_orphan_list(pfp, i);
+			TOID(struct pmemfile_inode_array) *stale =
+					&super->stale_orphans[i];
+
+			if (orphan_list_is_trivial(pfp, *list))
+				continue;
+
+			/*
+			 * Previous run crashed before it freed everything -
+			 * put what's left behind the new stale inodes.
+			 */
+			if (!TOID_IS_NULL(*stale)) {
+				TOID(struct pmemfile_inode_array) tail =
+						orphan_list_tail(pfp, *list);
+
+				TX_ADD_FIELD_DIRECT(PF_RW(pfp, tail), next);
+				PF_RW(pfp, tail)->next = *stale;
+
+				TX_ADD_FIELD_DIRECT(PF_RW(pfp, *stale), prev);
+				PF_RW(pfp, *stale)->prev = tail;
+			}
+
+			TX_ADD_DIRECT(stale);
+			*stale = *list;
+
+			TX_ADD_DIRECT(list);
+			*list = inode_array_alloc(pfp);
+		}
+	} TX_ONABORT {
+		error = errno;
+	} TX_END
+
+	/* inodes stay where they were, and will be freed by the next open */
+	if (error)
+		LOG(LUSR, "cannot detach lists of deleted files: %s",
+				strerror(error));
+}
+
+/*
+ * orphan_count -- counts inodes and arrays on stale lists
+ */
+static unsigned
+orphan_count(PMEMfilepool *pfp)
+{
+	unsigned count = 0;
+
+	for (unsigned i = 0; i < PMEMFILE_ORPHAN_LISTS; ++i) {
+		TOID(struct pmemfile_inode_array) tarr =
+				pfp->super->stale_orphans[i];
+
+		while (!TOID_IS_NULL(tarr)) {
+			const struct pmemfile_inode_array *arr =
+					PF_RO(pfp, tarr);
+
+			count += arr->used + 1;
+			tarr = arr->next;
+		}
+	}
+
+	return count;
+}
+
+/*
+ * orphan_reclaim_batch -- frees up to ORPHAN_RECLAIM_BATCH inodes from the
+ * first array of the stale list, and the array itself once it's empty
+ */
+static int
+orphan_reclaim_batch(PMEMfilepool *pfp,
+		TOID(struct pmemfile_inode_array) *list)
+{
+	TOID(struct pmemfile_inode_array) tarr = *list;
+	struct pmemfile_inode_array *arr = PF_RW(pfp, tarr);
+	TOID(struct pmemfile_inode) inodes[ORPHAN_RECLAIM_BATCH];
+	unsigned idx[ORPHAN_RECLAIM_BATCH];
+	unsigned n = 0;
+	unsigned left = 0;
+
+	for (unsigned i = 0; i < NUMINODES_PER_ENTRY; ++i) {
+		if (TOID_IS_NULL(arr->inodes[i]))
+			continue;
+
+		if (n < ORPHAN_RECLAIM_BATCH) {
+			inodes[n] = arr->inodes[i];
+			idx[n] = i;
+			n++;
+		} else {
+			left++;
+		}
+	}
+
+	/* let the transaction below finish without running out of space */
+	for (unsigned i = 0; i < n; ++i) {
+		ASSERTeq(inode_get_nlink(PF_RW(pfp, inodes[i])), 0);
+		inode_trim(pfp, inodes[i]);
+	}
+
+	bool last = left == 0;
+	int error = 0;
+
+	TX_BEGIN_CB(pfp->pop, cb_queue, pfp) {
+		for (unsigned i = 0; i < n; ++i)
+			inode_free(pfp, inodes[i]);
+
+		if (last) {
+			TOID(struct pmemfile_inode_array) next = arr->next;
+
+			TX_ADD_DIRECT(list);
+			*list = next;
+
+			if (!TOID_IS_NULL(next)) {
+				TX_ADD_FIELD_DIRECT(PF_RW(pfp, next), prev);
+				PF_RW(pfp, next)->prev =
+					TOID_NULL(struct pmemfile_inode_array);
+			}
+
+			TX_FREE(tarr);
+		} else {
+			for (unsigned i = 0; i < n; ++i) {
+				TX_ADD_DIRECT(&arr->inodes[idx[i]]);
+				arr->inodes[idx[i]] =
+					TOID_NULL(struct pmemfile_inode);
+			}
+
+			TX_ADD_FIELD_DIRECT(arr, used);
+			arr->used -= n;
+		}
+	} TX_ONABORT {
+		error = errno;
+	} TX_END
+
+	if (error) {
+		LOG(LUSR, "cannot free deleted files: %s", strerror(error));
+		return -1;
+	}
+
+	__sync_sub_and_fetch(&pfp->orphans_pending, n + (last ? 1 : 0));
+
+	return 0;
+}
+
+/*
+ * orphan_reclaim_stopped -- returns true if reclaim thread should stop
+ */
+static bool
+orphan_reclaim_stopped(struct pmemfile_orphan_reclaim *r)
+{
+	if (!r)
+		return false;
+
+	os_mutex_lock(&r->lock);
+	bool stop = r->stop;
+	os_mutex_unlock(&r->lock);
+
+	return stop;
+}
+
+/*
+ * orphan_reclaim_all -- frees everything on stale lists, unless stopped
+ */
+static void
+orphan_reclaim_all(PMEMfilepool *pfp, struct pmemfile_orphan_reclaim *r)
+{
+	for (unsigned i = 0; i < PMEMFILE_ORPHAN_LISTS; ++i) {
+		TOID(struct pmemfile_inode_array) *list =
+				&pfp->super->stale_orphans[i];
+
+		while (!TOID_IS_NULL(*list)) {
+			if (orphan_reclaim_stopped(r))
+				return;
+
+			if (orphan_reclaim_batch(pfp, list))
+				return;
+		}
+	}
+}
+
+/*
+ * orphan_reclaim_worker -- reclaim thread
+ */
+static void *
+orphan_reclaim_worker(void *arg)
+{
+	struct pmemfile_orphan_reclaim *r = arg;
+
+	orphan_reclaim_all(r->pfp, r);
+
+	return NULL;
+}
+
+/*
+ * orphan_reclaim_start -- starts freeing inodes on stale lists in background
+ *
+ * If the thread can't be started, frees them before returning.
+ */
+void
+orphan_reclaim_start(PMEMfilepool *pfp)
+{
+	ASSERTeq(pfp->orphan_reclaim, NULL);
+
+	pfp->orphans_pending = orphan_count(pfp);
+	if (pfp->orphans_pending == 0)
+		return;
+
+	struct pmemfile_orphan_reclaim *r = pf_calloc(1, sizeof(*r));
+	if (!r)
+		goto sync;
+
+	r->pfp = pfp;
+	os_mutex_init(&r->lock);
+
+	int error = os_thread_create(&r->thread, orphan_reclaim_worker, r);
+	if (error) {
+		ERR("cannot create reclaim thread: %d", error);
+		os_mutex_destroy(&r->lock);
+		pf_free(r);
+		goto sync;
+	}
+
+	pfp->orphan_reclaim = r;
+	return;
+
+sync:
+	orphan_reclaim_all(pfp, NULL);
+}
+
+/*
+ * orphan_reclaim_stop -- stops reclaim thread, inodes it didn't get to are
+ * left on stale lists
+ */
+void
+orphan_reclaim_stop(PMEMfilepool *pfp)
+{
+	struct pmemfile_orphan_reclaim *r = pfp->orphan_reclaim;
+	if (!r)
+		return;
+
+	os_mutex_lock(&r->lock);
+	r->stop = true;
+	os_mutex_unlock(&r->lock);
+
+	os_thread_join(&r->thread, NULL);
+
+	os_mutex_destroy(&r->lock);
+	pf_free(r);
+
+	pfp->orphan_reclaim = NULL;
+}
+
+/*
+ * orphan_reclaim_pending -- returns number of inodes and arrays on stale
+ * lists which are not freed yet
+ */
+unsigned
+orphan_reclaim_pending(PMEMfilepool *pfp)
+{
+	return __atomic_load_n(&pfp->orphans_pending, __ATOMIC_ACQUIRE);
+}
@@ -49,4 +49,10 @@ const char *os_getexecname(void);
 
 int os_usleep(unsigned usec);
 
+/*
+ * os_getcpu -- return number of the CPU the calling thread is running on,
+ * or 0 if it can't be determined
+ */
+unsigned os_getcpu(void);
+
 #endif
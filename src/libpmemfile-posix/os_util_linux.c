@@ -33,6 +33,7 @@
 #include <limits.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -82,3 +83,15 @@ os_usleep(unsigned usec)
 {
 	return usleep(usec);
 }
+
+unsigned
+os_getcpu(void)
+{
+	unsigned cpu;
+
+	/* sched_getcpu would require _GNU_SOURCE, see os_describe_errno */
+	if (syscall(SYS_getcpu, &cpu, NULL, NULL))
+		return 0;
+
+	return cpu;
+}
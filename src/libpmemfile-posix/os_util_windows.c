@@ -64,3 +64,9 @@ os_getexecname(void)
 	return namepath;
 }
 #endif	/* DEBUG */
+
+unsigned
+os_getcpu(void)
+{
+	return (unsigned)GetCurrentProcessorNumber();
+}
@@ -38,12 +38,15 @@
 
 #include <limits.h>
 
+#include "arena.h"
 #include "blocks.h"
 #include "callbacks.h"
 #include "compiler_utils.h"
 #include "data.h"
+#include "extent.h"
 #include "locks.h"
 #include "out.h"
+#include "redo.h"
 #include "valgrind_internal.h"
 
 #include "verify_consts.h"
@@ -90,8 +93,10 @@ libpmemfile_posix_init(void)
 		} else if (blk_size > MAX_BLOCK_SIZE) {
 			pmemfile_posix_block_size = MAX_BLOCK_SIZE;
 		} else {
-			pmemfile_posix_block_size =
-					block_roundup((size_t)blk_size);
+			pmemfile_posix_block_size = (size_t)blk_size +
+					MIN_BLOCK_SIZE - 1;
+			pmemfile_posix_block_size -=
+				pmemfile_posix_block_size % MIN_BLOCK_SIZE;
 		}
 	}
 	LOG(LINF, "block size %zu", pmemfile_posix_block_size);
@@ -106,6 +111,30 @@ libpmemfile_posix_init(void)
 	}
 	LOG(LINF, "overallocate_on_append flag is %s",
 		(pmemfile_overallocate_on_append ? "set" : "not set"));
+
+	env = getenv("PMEMFILE_REDO_METADATA");
+	if (env && env[0] == '0')
+		pmemfile_redo_metadata = false;
+	LOG(LINF, "redo_metadata flag is %s",
+		(pmemfile_redo_metadata ? "set" : "not set"));
+
+	env = getenv("PMEMFILE_ARENAS");
+	if (env) {
+		char *end;
+		unsigned long arenas = strtoul(env, &end, 0);
+		if (env[0] == '\0' || end[0] != '\0' ||
+				arenas > PMEMFILE_MAX_ARENAS)
+			LOG(LUSR, "Invalid value of PMEMFILE_ARENAS");
+		else
+			pmemfile_arenas = (unsigned)arenas;
+	}
+	LOG(LINF, "arenas %u", pmemfile_arenas);
+
+	env = getenv("PMEMFILE_EXTENT_ALLOC");
+	if (env && env[0] == '0')
+		pmemfile_extent_alloc = false;
+	LOG(LINF, "extent_alloc flag is %s",
+		(pmemfile_extent_alloc ? "set" : "not set"));
 }
 
 /*
@@ -36,21 +36,29 @@
 
 #include <errno.h>
 #include <inttypes.h>
+#include <string.h>
+#include <time.h>
 
+#include "aio.h"
 #include "alloc.h"
+#include "arena.h"
 #include "blocks.h"
 #include "callbacks.h"
 #include "compiler_utils.h"
 #include "dir.h"
+#include "extent.h"
 #include "hash_map.h"
 #include "inode.h"
 #include "inode_array.h"
+#include "inode_reserve.h"
 #include "locks.h"
 #include "mkdir.h"
+#include "orphan.h"
 #include "os_thread.h"
 #include "os_util.h"
 #include "out.h"
 #include "pool.h"
+#include "tx_log.h"
 #include "utils.h"
 
 COMPILE_ERROR_ON(PMEMFILE_ROOT_COUNT <= 0);
@@ -66,39 +74,189 @@ pmemfile_pool_root_count(PMEMfilepool *pfp)
 
 #define PMEMFILE_CUR_VERSION \
 	PMEMFILE_SUPER_VERSION(PMEMFILE_MAJOR_VERSION, PMEMFILE_MINOR_VERSION)
+/*
+ * block_classes_load -- reads data block classes recorded in superblock
+ */
+static int
+block_classes_load(PMEMfilepool *pfp)
+{
+	const struct pmemfile_block_class_desc *desc =
+			pfp->super->block_classes;
+
+	if (desc[0].size == 0) {
+		/* pool created before classes were recorded */
+		block_classes_default(&pfp->blocks);
+		return 0;
+	}
+
+	struct pmemfile_block_class classes[PMEMFILE_MAX_BLOCK_CLASSES];
+	unsigned n;
+
+	for (n = 0; n < PMEMFILE_MAX_BLOCK_CLASSES && desc[n].size; ++n) {
+		classes[n].size = desc[n].size;
+		classes[n].units_per_block = desc[n].units_per_block;
+	}
+
+	if (block_classes_set(&pfp->blocks, classes, n)) {
+		ERR("invalid block classes in superblock");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * block_classes_store -- records data block classes in superblock
+ *
+ * Must be called in a transaction, with superblock already added to it.
+ */
+static void
+block_classes_store(PMEMfilepool *pfp)
+{
+	struct pmemfile_block_class_desc *desc = pfp->super->block_classes;
+	const struct pmem_block_info *block = pfp->blocks.data;
+
+	memset(desc, 0, sizeof(pfp->super->block_classes));
+
+	for (unsigned i = 0; block[i].size != 0; ++i) {
+		desc[i].size = (uint32_t)block[i].size;
+		desc[i].units_per_block = block[i].units_per_block;
+	}
+}
+
+/*
+ * root_ref -- sets up vinode of root directory
+ */
+static struct pmemfile_vinode *
+root_ref(PMEMfilepool *pfp, unsigned idx)
+{
+	struct pmemfile_vinode *root = inode_ref(pfp,
+			pfp->super->root_inode[idx], NULL, NULL, 0);
+	if (!root) {
+		ERR("!cannot access root inode");
+		return NULL;
+	}
+
+	root->parent = root;
+
+#ifdef DEBUG
+	root->path = strdup("/");
+	ASSERTne(root->path, NULL);
+#endif
+
+	return root;
+}
+
+/*
+ * pool_get_root -- returns vinode of root directory, sets it up on first use
+ *
+ * Returned vinode is NOT referenced - it lives as long as the pool.
+ */
+struct pmemfile_vinode *
+pool_get_root(PMEMfilepool *pfp, unsigned idx)
+{
+	ASSERT(idx < PMEMFILE_ROOT_COUNT);
+
+	struct pmemfile_vinode *root =
+			__atomic_load_n(&pfp->root[idx], __ATOMIC_ACQUIRE);
+	if (root)
+		return root;
+
+	os_mutex_lock(&pfp->root_mutex);
+
+	root = pfp->root[idx];
+	if (!root) {
+		root = root_ref(pfp, idx);
+		if (root)
+			__atomic_store_n(&pfp->root[idx], root,
+					__ATOMIC_RELEASE);
+	}
+
+	os_mutex_unlock(&pfp->root_mutex);
+
+	return root;
+}
+
+/*
+ * pool_bump_generation -- records that the pool is now used by this process
+ */
+static void
+pool_bump_generation(PMEMfilepool *pfp)
+{
+	pfp->generation = ++pfp->super->generation;
+	pmemobj_persist(pfp->pop, &pfp->super->generation,
+			sizeof(pfp->super->generation));
+}
+
 /*
  * initialize_super_block -- initializes super block
  *
  * Can't be called in a transaction.
  */
 static int
-initialize_super_block(PMEMfilepool *pfp)
+initialize_super_block(PMEMfilepool *pfp, uint64_t flags,
+		const struct pmem_block_classes *classes)
 {
-	LOG(LDBG, "pfp %p", pfp);
+	LOG(LDBG, "pfp %p flags 0x%" PRIx64, pfp, flags);
 
 	ASSERT_NOT_IN_TX();
 
 	int error = 0;
 	struct pmemfile_super *super = pfp->super;
+	bool initialized = !TOID_IS_NULL(super->root_inode[0]);
 
-	if (!TOID_IS_NULL(super->root_inode[0]) &&
-			super->version != PMEMFILE_CUR_VERSION) {
+	if (initialized && super->version != PMEMFILE_CUR_VERSION) {
 		ERR("unknown superblock version: 0x%lx", super->version);
 		errno = EINVAL;
 		return -1;
 	}
 
+	uint64_t inode_version;
+	if (initialized)
+		inode_version = super->inode_version;
+	else if (flags & PMEMFILE_POOL_COMPACT_INODES)
+		inode_version = PMEMFILE_INODE_VERSION(3);
+	else
+		inode_version = PMEMFILE_INODE_VERSION(2);
+
+	if (inode_version == 0 ||
+			inode_version == PMEMFILE_INODE_VERSION(2)) {
+		pfp->inode_version = PMEMFILE_INODE_VERSION(2);
+		pfp->inode_block = metadata_block_info();
+	} else if (inode_version == PMEMFILE_INODE_VERSION(3)) {
+		pfp->inode_version = PMEMFILE_INODE_VERSION(3);
+		pfp->inode_block = compact_inode_block_info();
+	} else {
+		ERR("unknown inode version: 0x%" PRIx64, inode_version);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (initialized) {
+		if (block_classes_load(pfp))
+			return -1;
+	} else if (classes) {
+		pfp->blocks = *classes;
+	} else {
+		block_classes_default(&pfp->blocks);
+	}
+
 	os_rwlock_init(&pfp->cred_rwlock);
 	os_rwlock_init(&pfp->super_rwlock);
 	os_rwlock_init(&pfp->cwd_rwlock);
 	os_rwlock_init(&pfp->inode_map_rwlock);
+	os_mutex_init(&pfp->aio_mutex);
+	os_mutex_init(&pfp->inode_reserve_mutex);
+	os_mutex_init(&pfp->root_mutex);
 
-	error = initialize_alloc_classes(pfp->pop);
+	error = initialize_alloc_classes(pfp->pop, &pfp->blocks);
 	if (error) {
 		error = 0;
 		/* allocation classes will not be used - ignore error */
 	}
 
+	arena_init(pfp);
+
 	struct pmemfile_cred cred;
 	if (cred_acquire(pfp, &cred)) {
 		error = errno;
@@ -112,7 +270,7 @@ initialize_super_block(PMEMfilepool *pfp)
 		goto inode_map_alloc_fail;
 	}
 
-	if (TOID_IS_NULL(super->root_inode[0])) {
+	if (!initialized) {
 		TX_BEGIN_CB(pfp->pop, cb_queue, pfp) {
 			TX_ADD_DIRECT(super);
 			for (unsigned i = 0; i < PMEMFILE_ROOT_COUNT; ++i) {
@@ -122,8 +280,13 @@ initialize_super_block(PMEMfilepool *pfp)
 			}
 
 			super->version = PMEMFILE_CUR_VERSION;
-			super->orphaned_inodes = inode_array_alloc(pfp);
+			super->inode_version = pfp->inode_version;
+			block_classes_store(pfp);
+			for (unsigned i = 0; i < PMEMFILE_ORPHAN_LISTS; ++i)
+				*pool_orphan_list(pfp, i) =
+						inode_array_alloc(pfp);
 			super->suspended_inodes = inode_array_alloc(pfp);
+			tx_log_alloc(pfp);
 		} TX_ONABORT {
 			error = errno;
 		} TX_END
@@ -134,25 +297,19 @@ initialize_super_block(PMEMfilepool *pfp)
 		}
 	}
 
-	for (unsigned i = 0; i < PMEMFILE_ROOT_COUNT; ++i) {
-		pfp->root[i] = inode_ref(pfp, super->root_inode[i],
-							NULL, NULL, 0);
-		if (!pfp->root[i]) {
-			error = errno;
-
-			ERR("!cannot access root inode");
-			goto ref_err;
-		}
+	pool_bump_generation(pfp);
 
-		pfp->root[i]->parent = pfp->root[i];
+	if (extent_init(pfp)) {
+		error = errno;
+		goto tx_err;
 	}
 
-#ifdef DEBUG
-	for (unsigned i = 0; i < PMEMFILE_ROOT_COUNT; ++i) {
-		pfp->root[i]->path = strdup("/");
-		ASSERTne(pfp->root[i]->path, NULL);
+	/* other roots are set up by pool_get_root */
+	pfp->root[0] = root_ref(pfp, 0);
+	if (!pfp->root[0]) {
+		error = errno;
+		goto ref_err;
 	}
-#endif
 
 	pfp->cwd = vinode_ref(pfp, pfp->root[0]);
 	pfp->dev = pfp->root[0]->tinode.oid.pool_uuid_lo;
@@ -160,7 +317,9 @@ initialize_super_block(PMEMfilepool *pfp)
 
 	return 0;
 ref_err:
+	extent_destroy(pfp);
 tx_err:
+	inode_reserve_destroy(pfp);
 	inode_map_free(pfp);
 inode_map_alloc_fail:
 	cred_release(&cred);
@@ -169,18 +328,35 @@ get_cred_fail:
 	os_rwlock_destroy(&pfp->cwd_rwlock);
 	os_rwlock_destroy(&pfp->cred_rwlock);
 	os_rwlock_destroy(&pfp->inode_map_rwlock);
+	os_mutex_destroy(&pfp->aio_mutex);
+	os_mutex_destroy(&pfp->inode_reserve_mutex);
+	os_mutex_destroy(&pfp->root_mutex);
 	errno = error;
 	return -1;
 }
 
 /*
- * pmemfile_pool_create -- create pmem file system on specified file
+ * pmemfile_pool_xcreate_classes -- create pmem file system on specified file,
+ * with format options and data block classes
  */
 PMEMfilepool *
-pmemfile_pool_create(const char *pathname, size_t poolsize,
-		pmemfile_mode_t mode)
+pmemfile_pool_xcreate_classes(const char *pathname, size_t poolsize,
+		pmemfile_mode_t mode, uint64_t flags,
+		const struct pmemfile_block_class *classes, unsigned nclasses)
 {
-	LOG(LDBG, "pathname %s poolsize %zu mode %o", pathname, poolsize, mode);
+	LOG(LDBG, "pathname %s poolsize %zu mode %o flags 0x%" PRIx64
+			" classes %p nclasses %u", pathname, poolsize, mode,
+			flags, classes, nclasses);
+
+	if (flags & ~(uint64_t)PMEMFILE_POOL_COMPACT_INODES) {
+		ERR("invalid flags 0x%" PRIx64, flags);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	struct pmem_block_classes blocks;
+	if (classes && block_classes_set(&blocks, classes, nclasses))
+		return NULL;
 
 	PMEMfilepool *pfp = pf_calloc(1, sizeof(*pfp));
 	if (!pfp)
@@ -204,7 +380,7 @@ pmemfile_pool_create(const char *pathname, size_t poolsize,
 	}
 	pfp->super = PF_RW(pfp, super);
 
-	if (initialize_super_block(pfp)) {
+	if (initialize_super_block(pfp, flags, classes ? &blocks : NULL)) {
 		error = errno;
 		goto init_failed;
 	}
@@ -220,18 +396,26 @@ pool_create:
 	return NULL;
 }
 
-static void
-inode_trim_cb(PMEMfilepool *pfp, TOID(struct pmemfile_inode) inode)
+/*
+ * pmemfile_pool_xcreate -- create pmem file system on specified file, with
+ * format options
+ */
+PMEMfilepool *
+pmemfile_pool_xcreate(const char *pathname, size_t poolsize,
+		pmemfile_mode_t mode, uint64_t flags)
 {
-	ASSERTeq(inode_get_nlink(PF_RW(pfp, inode)), 0);
-	inode_trim(pfp, inode);
+	return pmemfile_pool_xcreate_classes(pathname, poolsize, mode, flags,
+			NULL, 0);
 }
 
-static void
-inode_free_cb(PMEMfilepool *pfp, TOID(struct pmemfile_inode) inode)
+/*
+ * pmemfile_pool_create -- create pmem file system on specified file
+ */
+PMEMfilepool *
+pmemfile_pool_create(const char *pathname, size_t poolsize,
+		pmemfile_mode_t mode)
 {
-	ASSERTeq(inode_get_nlink(PF_RW(pfp, inode)), 0);
-	inode_free(pfp, inode);
+	return pmemfile_pool_xcreate(pathname, poolsize, mode, 0);
 }
 
 /*
@@ -242,6 +426,9 @@ pmemfile_pool_open(const char *pathname)
 {
 	LOG(LDBG, "pathname %s", pathname);
 
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
 	PMEMfilepool *pfp = pf_calloc(1, sizeof(*pfp));
 	if (!pfp)
 		return NULL;
@@ -262,30 +449,50 @@ pmemfile_pool_open(const char *pathname)
 	}
 	pfp->super = pmemobj_direct(super);
 
-	if (initialize_super_block(pfp)) {
+	if (initialize_super_block(pfp, 0, NULL)) {
 		error = errno;
 		goto init_failed;
 	}
 
-	TOID(struct pmemfile_inode_array) orphaned =
-			pfp->super->orphaned_inodes;
-	if (!inode_array_empty(pfp, orphaned) ||
-			!inode_array_is_small(pfp, orphaned)) {
-		inode_array_traverse(pfp, orphaned, inode_trim_cb);
+	if (TOID_IS_NULL(pfp->super->more_orphaned_inodes[0])) {
+		error = 0;
 
 		TX_BEGIN_CB(pfp->pop, cb_queue, pfp) {
-			TX_ADD_FIELD_DIRECT(pfp->super, orphaned_inodes);
+			TX_ADD_FIELD_DIRECT(pfp->super, more_orphaned_inodes);
 
-			inode_array_traverse(pfp, orphaned, inode_free_cb);
+			for (unsigned i = 1; i < PMEMFILE_ORPHAN_LISTS; ++i)
+				*pool_orphan_list(pfp, i) =
+						inode_array_alloc(pfp);
+		} TX_ONABORT {
+			error = errno;
+		} TX_END
 
-			inode_array_free(pfp, orphaned);
+		if (error) {
+			ERR("!cannot allocate lists of deleted files");
+			pmemfile_pool_close(pfp);
+			errno = error;
+			return NULL;
+		}
+	}
 
-			pfp->super->orphaned_inodes = inode_array_alloc(pfp);
+	/* log buffers are optional, pool without space for them is usable */
+	if (TOID_IS_NULL(pfp->super->tx_logs)) {
+		TX_BEGIN_CB(pfp->pop, cb_queue, pfp) {
+			tx_log_alloc(pfp);
 		} TX_ONABORT {
-			FATAL("!cannot cleanup list of deleted files");
+			LOG(LINF, "!cannot allocate transaction log buffers");
 		} TX_END
 	}
 
+	/* inodes orphaned by previous runs are freed in background */
+	orphan_detach(pfp);
+	orphan_reclaim_start(pfp);
+
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	pfp->open_ns = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000 +
+			(uint64_t)end.tv_nsec - (uint64_t)start.tv_nsec;
+
 	return pfp;
 
 init_failed:
@@ -314,16 +521,24 @@ pmemfile_pool_close(PMEMfilepool *pfp)
 {
 	LOG(LDBG, "pfp %p", pfp);
 
+	orphan_reclaim_stop(pfp);
+	aio_workers_destroy(pfp);
+	inode_reserve_destroy(pfp);
+
 	pf_free(pfp->cred.groups);
 
 	vinode_unref(pfp, pfp->cwd);
 	for (unsigned i = 0; i < PMEMFILE_ROOT_COUNT; ++i)
 		vinode_unref(pfp, pfp->root[i]);
 	inode_map_free(pfp);
+	extent_destroy(pfp);
 	os_rwlock_destroy(&pfp->cred_rwlock);
 	os_rwlock_destroy(&pfp->super_rwlock);
 	os_rwlock_destroy(&pfp->cwd_rwlock);
 	os_rwlock_destroy(&pfp->inode_map_rwlock);
+	os_mutex_destroy(&pfp->aio_mutex);
+	os_mutex_destroy(&pfp->inode_reserve_mutex);
+	os_mutex_destroy(&pfp->root_mutex);
 
 	pmemobj_close(pfp->pop);
 
@@ -335,6 +550,7 @@ pmemfile_pool_close(PMEMfilepool *pfp)
 struct resume_info {
 	PMEMfilepool *pfp;
 	PMEMobjpool *old_pop;
+	bool caches_valid;
 };
 
 static void
@@ -354,7 +570,7 @@ static void
 vinode_resume_cb(uint64_t off, void *vinode, void *arg)
 {
 	struct resume_info *info = arg;
-	vinode_resume(info->pfp, vinode, info->old_pop);
+	vinode_resume(info->pfp, vinode, info->old_pop, info->caches_valid);
 }
 
 /*
@@ -374,6 +590,17 @@ pmemfile_pool_resume(PMEMfilepool *pfp, const char *pathname)
 			os_usleep(1000);
 	}
 
+	/*
+	 * Workers can't be created later without leaving the pool half
+	 * resumed. They stay paused until the end.
+	 */
+	if (aio_workers_resume(pfp)) {
+		int oerrno = errno;
+		pmemobj_close(new_pop);
+		errno = oerrno;
+		return -1;
+	}
+
 	int error = 0;
 	PMEMobjpool *old_pop = pfp->pop;
 	struct pmemfile_super *old_super = pfp->super;
@@ -383,13 +610,23 @@ pmemfile_pool_resume(PMEMfilepool *pfp, const char *pathname)
 		pfp->super = pmemobj_direct(pmemobj_root(pfp->pop, 0));
 	}
 
-	error = initialize_alloc_classes(pfp->pop);
+	error = initialize_alloc_classes(pfp->pop, &pfp->blocks);
 	if (error) {
 		error = 0;
 		/* allocation classes will not be used - ignore error */
 	}
 
-	struct resume_info arg = {pfp, old_pop};
+	arena_init(pfp);
+
+	/*
+	 * Runtime state derived from the pool (block trees, extent bitmaps and
+	 * caches) can be kept if the pool was mapped at the same address and
+	 * nobody else opened it since we suspended it. Inode reservations,
+	 * arenas and orphan counts are tied to the pmemobj pool handle, so they
+	 * are dropped on suspend and set up again here unconditionally.
+	 */
+	struct resume_info arg = {pfp, old_pop,
+		new_pop == old_pop && pfp->super->generation == pfp->generation};
 
 	TX_BEGIN_CB(pfp->pop, cb_queue, pfp) {
 		hash_map_traverse(pfp->inode_map, inode_resume_cb, &arg);
@@ -399,6 +636,7 @@ pmemfile_pool_resume(PMEMfilepool *pfp, const char *pathname)
 
 	if (error) {
 		int oerrno = errno;
+		aio_workers_suspend(pfp);
 		pmemobj_close(new_pop);
 		errno = oerrno;
 
@@ -407,7 +645,19 @@ pmemfile_pool_resume(PMEMfilepool *pfp, const char *pathname)
 		return -1;
 	}
 
+	pool_bump_generation(pfp);
+
 	hash_map_traverse(pfp->inode_map, vinode_resume_cb, &arg);
+	if (extent_resume(pfp, arg.caches_valid)) {
+		int oerrno = errno;
+		aio_workers_suspend(pfp);
+		errno = oerrno;
+		return -1;
+	}
+
+	orphan_reclaim_start(pfp);
+
+	aio_workers_unpause(pfp);
 
 	return 0;
 }
@@ -425,14 +675,33 @@ pmemfile_pool_suspend(PMEMfilepool *pfp)
 {
 	int error = 0;
 
+	/* aio workers call pmemfile functions on their own */
+	aio_workers_pause(pfp);
+
+	/* just like the region thread, it runs transactions on its own */
+	orphan_reclaim_stop(pfp);
+
+	/* reservations belong to the pmemobj pool handle closed below */
+	inode_reserve_destroy(pfp);
+
 	TX_BEGIN_CB(pfp->pop, cb_queue, pfp) {
 		hash_map_traverse(pfp->inode_map, vinode_suspend_cb, pfp);
 	} TX_ONABORT {
 		error = -1;
 	} TX_END
 
-	if (error)
+	if (error) {
+		int oerrno = errno;
+		orphan_reclaim_start(pfp);
+		aio_workers_unpause(pfp);
+		errno = oerrno;
 		return -1;
+	}
+
+	/* region thread runs transactions on its own */
+	extent_suspend(pfp);
+
+	aio_workers_suspend(pfp);
 
 	pmemobj_close(pfp->pop);
 	return 0;
@@ -36,6 +36,7 @@
  * Runtime pool state.
  */
 
+#include "blocks.h"
 #include "creds.h"
 #include "hash_map.h"
 #include "inode.h"
@@ -49,8 +50,9 @@ struct pmemfilepool {
 
 	pmemfile_dev_t dev;
 
-	/* root directories */
+	/* root directories, all but the first one set up on first use */
 	struct pmemfile_vinode *root[PMEMFILE_ROOT_COUNT];
+	os_mutex_t root_mutex;
 	mode_t umask;
 
 	/* current working directory */
@@ -61,6 +63,13 @@ struct pmemfilepool {
 	struct pmemfile_super *super;
 	os_rwlock_t super_rwlock;
 
+	/* layout version and allocation class of new inodes */
+	uint32_t inode_version;
+	const struct pmem_block_info *inode_block;
+
+	/* data block classes, as recorded in superblock */
+	struct pmem_block_classes blocks;
+
 	/* map between inodes and vinodes */
 	struct hash_map *inode_map;
 	os_rwlock_t inode_map_rwlock;
@@ -68,6 +77,51 @@ struct pmemfilepool {
 	/* current credentials */
 	struct pmemfile_cred cred;
 	os_rwlock_t cred_rwlock;
+
+	/* asynchronous I/O workers, started on first use */
+	struct pmemfile_aio_workers *aio;
+	os_mutex_t aio_mutex;
+
+	/* pre-zeroed inodes, refill thread started on first inode_alloc */
+	struct pmemfile_inode_reserve *inode_reserve;
+	os_mutex_t inode_reserve_mutex;
+
+	/* which of super->tx_logs buffers are used by running transactions */
+	unsigned tx_log_busy[PMEMFILE_TX_LOGS];
+	uint64_t tx_logs_attached;
+
+	/* free space in extent regions */
+	struct pmemfile_extents *extents;
+
+	/* pmemobj arenas created for this pool, see arena.c */
+	unsigned narenas;
+	unsigned arena_id[PMEMFILE_MAX_ARENAS];
+	unsigned arena_next;
+	unsigned arena_gen;
+
+	/* freeing of inodes orphaned by previous runs, see orphan.c */
+	struct pmemfile_orphan_reclaim *orphan_reclaim;
+	unsigned orphans_pending;
+
+	/* super->generation as of the last open or resume by this process */
+	uint64_t generation;
+
+	/* how long pmemfile_pool_open took */
+	uint64_t open_ns;
 };
 
+/*
+ * pool_orphan_list -- returns head of one of the orphaned inode lists
+ */
+static inline TOID(struct pmemfile_inode_array) *
+pool_orphan_list(PMEMfilepool *pfp, unsigned idx)
+{
+	if (idx == 0)
+		return &pfp->super->orphaned_inodes;
+
+	return &pfp->super->more_orphaned_inodes[idx - 1];
+}
+
+struct pmemfile_vinode *pool_get_root(PMEMfilepool *pfp, unsigned idx);
+
 #endif
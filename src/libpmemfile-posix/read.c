@@ -67,10 +67,10 @@ vinode_read(PMEMfilepool *pfp, struct pmemfile_vinode *vinode, size_t offset,
 		count = size - offset;
 
 	struct pmemfile_block_desc *block =
-		find_closest_block_with_hint(vinode, offset, *last_block);
+		find_closest_block_with_hint(pfp, vinode, offset, *last_block);
 
 	block = iterate_on_file_range(pfp, vinode, block, offset,
-			count, buf, read_from_blocks);
+			count, buf, read_from_blocks, 0);
 
 	if (block)
 		*last_block = block;
@@ -105,6 +105,11 @@ pmemfile_preadv_args_check(PMEMfile *file,
 {
 	LOG(LDBG, "vinode %p iov %p iovcnt %d", file->vinode, iov, iovcnt);
 
+	if (file->flags & PFILE_PATH) {
+		errno = EBADF;
+		return -1;
+	}
+
 	if (!vinode_is_regular_file(file->vinode)) {
 		if (vinode_is_dir(file->vinode))
 			errno = EISDIR;
@@ -161,15 +166,41 @@ pmemfile_preadv_internal(PMEMfilepool *pfp,
 	return ret;
 }
 
+/*
+ * vinode_rdlock_for_read -- acquires read lock on a vinode instance with
+ * valid block tree
+ *
+ * With PMEMFILE_RWF_NOWAIT, fails with -EAGAIN instead of waiting for the
+ * lock or rebuilding the block tree.
+ */
+static int
+vinode_rdlock_for_read(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
+		int rwflags)
+{
+	if (!(rwflags & PMEMFILE_RWF_NOWAIT))
+		return vinode_rdlock_with_block_tree(pfp, vinode);
+
+	if (os_rwlock_tryrdlock(&vinode->rwlock))
+		return -EAGAIN;
+
+	if (!vinode->blocks) {
+		os_rwlock_unlock(&vinode->rwlock);
+		return -EAGAIN;
+	}
+
+	return 0;
+}
+
 /*
  * handle_atime -
  * Updates the atime field following a read operation, if necessary.
  * The vinode must not be locked when calling this function.
+ * With PMEMFILE_RWF_NOWAIT the update is skipped if the vinode is busy.
  */
 static void
 handle_atime(PMEMfilepool *pfp,
 		struct pmemfile_vinode *vinode,
-		uint64_t file_flags)
+		uint64_t file_flags, int rwflags)
 {
 	if (file_flags & PFILE_NOATIME)
 		return;
@@ -189,7 +220,13 @@ handle_atime(PMEMfilepool *pfp,
 	    (time_cmp(atime, inode_get_mtime_ptr(inode)) >= 0))
 		return;
 
-	os_rwlock_wrlock(&vinode->rwlock);
+	if (rwflags & PMEMFILE_RWF_NOWAIT) {
+		if (os_rwlock_trywrlock(&vinode->rwlock))
+			return;
+	} else {
+		os_rwlock_wrlock(&vinode->rwlock);
+	}
+
 	vinode->atime = tm;
 	vinode->atime_dirty = true;
 	os_rwlock_unlock(&vinode->rwlock);
@@ -207,7 +244,7 @@ pmemfile_read(PMEMfilepool *pfp, PMEMfile *file, void *buf, size_t count)
 
 static pmemfile_ssize_t
 pmemfile_readv_under_filelock(PMEMfilepool *pfp, PMEMfile *file,
-		const pmemfile_iovec_t *iov, int iovcnt)
+		const pmemfile_iovec_t *iov, int iovcnt, int rwflags)
 {
 	pmemfile_ssize_t ret;
 
@@ -220,34 +257,58 @@ pmemfile_readv_under_filelock(PMEMfilepool *pfp, PMEMfile *file,
 	if (iovcnt == 0)
 		return 0;
 
-	ret = vinode_rdlock_with_block_tree(pfp, file->vinode);
-	if (ret != 0)
-		return ret;
-
-	if (file->last_block_pointer_invalidation_observed !=
-			file->vinode->block_pointer_invalidation_counter) {
-		file->block_pointer_cache = NULL;
-		file->last_block_pointer_invalidation_observed =
-			file->vinode->block_pointer_invalidation_counter;
+	ret = vinode_rdlock_for_read(pfp, file->vinode, rwflags);
+	if (ret != 0) {
+		errno = (int)-ret;
+		return -1;
 	}
 
+	block_cursors_sync(&file->cursors, file->vinode);
+
 	uint64_t flags = file->flags;
-	last_block = file->block_pointer_cache;
+	struct block_cursor *cursor =
+			block_cursors_find(&file->cursors, file->offset);
+	last_block = cursor->block;
 
 	ret = pmemfile_preadv_internal(pfp, file->vinode,
 		&last_block, file->offset, iov, iovcnt);
 
+	if (ret > 0) {
+		file->offset += (size_t)ret;
+		block_cursor_update(&file->cursors, cursor, last_block,
+				file->offset);
+	} else {
+		block_cursor_update(&file->cursors, cursor, NULL, 0);
+	}
 
 	os_rwlock_unlock(&file->vinode->rwlock);
 
-	if (ret > 0) {
-		file->offset += (size_t)ret;
-		file->block_pointer_cache = last_block;
+	handle_atime(pfp, file->vinode, flags, rwflags);
+
+	return ret;
+}
+
+/*
+ * pmemfile_readv_flags -- reads from a file at the current position while
+ * holding the locks both for the PMEMfile instance, and the vinode instance.
+ */
+static pmemfile_ssize_t
+pmemfile_readv_flags(PMEMfilepool *pfp, PMEMfile *file,
+		const pmemfile_iovec_t *iov, int iovcnt, int rwflags)
+{
+	if (rwflags & PMEMFILE_RWF_NOWAIT) {
+		if (os_mutex_trylock(&file->mutex)) {
+			errno = EAGAIN;
+			return -1;
+		}
 	} else {
-		file->block_pointer_cache = NULL;
+		os_mutex_lock(&file->mutex);
 	}
 
-	handle_atime(pfp, file->vinode, flags);
+	pmemfile_ssize_t ret =
+		pmemfile_readv_under_filelock(pfp, file, iov, iovcnt, rwflags);
+
+	os_mutex_unlock(&file->mutex);
 
 	return ret;
 }
@@ -272,14 +333,7 @@ pmemfile_readv(PMEMfilepool *pfp, PMEMfile *file, const pmemfile_iovec_t *iov,
 		return -1;
 	}
 
-	os_mutex_lock(&file->mutex);
-
-	pmemfile_ssize_t ret =
-		pmemfile_readv_under_filelock(pfp, file, iov, iovcnt);
-
-	os_mutex_unlock(&file->mutex);
-
-	return ret;
+	return pmemfile_readv_flags(pfp, file, iov, iovcnt, 0);
 }
 
 pmemfile_ssize_t
@@ -291,7 +345,7 @@ pmemfile_pread(PMEMfilepool *pfp, PMEMfile *file, void *buf, size_t count,
 }
 
 /*
- * pmemfile_preadv - reads from a file starting at a position supplied as
+ * pmemfile_preadv_flags - reads from a file starting at a position supplied as
  * argument.
  *
  * Since this does not require making any modification to the PMEMfile instance,
@@ -299,6 +353,73 @@ pmemfile_pread(PMEMfilepool *pfp, PMEMfile *file, void *buf, size_t count,
  * no point in time where this function holds locks of both the PMEMfile
  * instance, and the vinode instance it points to.
  */
+static pmemfile_ssize_t
+pmemfile_preadv_flags(PMEMfilepool *pfp, PMEMfile *file,
+		const pmemfile_iovec_t *iov, int iovcnt, size_t offset,
+		int rwflags)
+{
+	pmemfile_ssize_t ret;
+
+	if (rwflags & PMEMFILE_RWF_NOWAIT) {
+		if (os_mutex_trylock(&file->mutex)) {
+			errno = EAGAIN;
+			return -1;
+		}
+	} else {
+		os_mutex_lock(&file->mutex);
+	}
+
+	ret = pmemfile_preadv_args_check(file, iov, iovcnt);
+
+	struct block_cursors cursors = file->cursors;
+	uint64_t flags = file->flags;
+
+	os_mutex_unlock(&file->mutex);
+
+	if (ret != 0)
+		return ret;
+
+	if (iovcnt == 0)
+		return 0;
+
+	ret = vinode_rdlock_for_read(pfp, file->vinode, rwflags);
+	if (ret != 0) {
+		errno = (int)-ret;
+		return -1;
+	}
+
+	block_cursors_sync(&cursors, file->vinode);
+
+	struct block_cursor *cursor = block_cursors_find(&cursors, offset);
+	struct pmemfile_block_desc *last_block = cursor->block;
+
+	ret = pmemfile_preadv_internal(pfp, file->vinode, &last_block,
+			offset, iov, iovcnt);
+
+	if (ret > 0)
+		block_cursor_update(&cursors, cursor, last_block,
+				offset + (size_t)ret);
+
+	os_rwlock_unlock(&file->vinode->rwlock);
+
+	handle_atime(pfp, file->vinode, flags, rwflags);
+
+	/*
+	 * Cursors are just hints, so don't wait for the file handle if it's
+	 * busy.
+	 */
+	if (os_mutex_trylock(&file->mutex) == 0) {
+		block_cursors_merge(&file->cursors, &cursors);
+		os_mutex_unlock(&file->mutex);
+	}
+
+	return ret;
+}
+
+/*
+ * pmemfile_preadv - reads from a file starting at a position supplied as
+ * argument.
+ */
 pmemfile_ssize_t
 pmemfile_preadv(PMEMfilepool *pfp, PMEMfile *file, const pmemfile_iovec_t *iov,
 		int iovcnt, pmemfile_off_t offset)
@@ -320,38 +441,46 @@ pmemfile_preadv(PMEMfilepool *pfp, PMEMfile *file, const pmemfile_iovec_t *iov,
 		return -1;
 	}
 
-	pmemfile_ssize_t ret;
-
-	os_mutex_lock(&file->mutex);
-
-	ret = pmemfile_preadv_args_check(file, iov, iovcnt);
-
-	uint64_t last_bp_iv_obs =
-			file->last_block_pointer_invalidation_observed;
-	struct pmemfile_block_desc *last_block = file->block_pointer_cache;
-	uint64_t flags = file->flags;
-
-	os_mutex_unlock(&file->mutex);
-
-	if (ret != 0)
-		return ret;
-
-	if (iovcnt == 0)
-		return 0;
+	return pmemfile_preadv_flags(pfp, file, iov, iovcnt, (size_t)offset, 0);
+}
 
-	ret = vinode_rdlock_with_block_tree(pfp, file->vinode);
-	if (ret != 0)
-		return ret;
+/*
+ * pmemfile_preadv2 -- pmemfile_preadv with flags
+ *
+ * PMEMFILE_RWF_NOWAIT makes it fail with EAGAIN instead of blocking on
+ * the file's locks. Other flags have no meaning for reads.
+ */
+pmemfile_ssize_t
+pmemfile_preadv2(PMEMfilepool *pfp, PMEMfile *file,
+		const pmemfile_iovec_t *iov, int iovcnt, pmemfile_off_t offset,
+		int flags)
+{
+	if (!pfp) {
+		LOG(LUSR, "NULL pool");
+		errno = EFAULT;
+		return -1;
+	}
 
-	if (last_bp_iv_obs != file->vinode->block_pointer_invalidation_counter)
-		last_block = NULL;
+	if (!file) {
+		LOG(LUSR, "NULL file");
+		errno = EFAULT;
+		return -1;
+	}
 
-	ret = pmemfile_preadv_internal(pfp, file->vinode, &last_block,
-			(size_t)offset, iov, iovcnt);
+	if (flags & ~PFILE_RWF_SUPPORTED) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
 
-	os_rwlock_unlock(&file->vinode->rwlock);
+	if (offset == -1)
+		return pmemfile_readv_flags(pfp, file, iov, iovcnt, flags);
 
-	handle_atime(pfp, file->vinode, flags);
+	if (offset < 0) {
+		errno = EINVAL;
+		return -1;
+	}
 
-	return ret;
+	return pmemfile_preadv_flags(pfp, file, iov, iovcnt, (size_t)offset,
+			flags);
 }
+
@@ -36,10 +36,32 @@
 
 #include "creds.h"
 #include "dir.h"
+#include "file.h"
 #include "libpmemfile-posix.h"
 #include "out.h"
 #include "utils.h"
 
+/*
+ * vinode_readlink -- copies the target of a symlink to buf
+ */
+static pmemfile_ssize_t
+vinode_readlink(PMEMfilepool *pfp, struct pmemfile_vinode *vinode, char *buf,
+		size_t bufsiz)
+{
+	os_rwlock_rdlock(&vinode->rwlock);
+
+	const char *data = get_symlink(pfp, vinode);
+	size_t len = inode_get_size(vinode->inode);
+
+	if (len > bufsiz)
+		len = bufsiz;
+	memcpy(buf, data, len);
+
+	os_rwlock_unlock(&vinode->rwlock);
+
+	return (pmemfile_ssize_t)len;
+}
+
 static pmemfile_ssize_t
 _pmemfile_readlinkat(PMEMfilepool *pfp, struct pmemfile_vinode *dir,
 		const char *pathname, char *buf, size_t bufsiz)
@@ -78,17 +100,7 @@ _pmemfile_readlinkat(PMEMfilepool *pfp, struct pmemfile_vinode *dir,
 		goto end;
 	}
 
-	os_rwlock_rdlock(&vinode->rwlock);
-
-	const char *data = get_symlink(pfp, vinode);
-	size_t len = inode_get_size(vinode->inode);
-
-	if (len > bufsiz)
-		len = bufsiz;
-	memcpy(buf, data, len);
-	ret = (pmemfile_ssize_t)len;
-
-	os_rwlock_unlock(&vinode->rwlock);
+	ret = vinode_readlink(pfp, vinode, buf, bufsiz);
 
 end:
 	path_info_cleanup(pfp, &info);
@@ -135,6 +147,19 @@ pmemfile_readlinkat(PMEMfilepool *pfp, PMEMfile *dir, const char *pathname,
 		return -1;
 	}
 
+	/*
+	 * Like on Linux, an empty path refers to the symlink itself, opened
+	 * with O_PATH | O_NOFOLLOW.
+	 */
+	if (pathname[0] == 0 && dir != PMEMFILE_AT_CWD) {
+		if (!vinode_is_symlink(dir->vinode)) {
+			errno = ENOENT;
+			return -1;
+		}
+
+		return vinode_readlink(pfp, dir->vinode, buf, bufsiz);
+	}
+
 	at = pool_get_dir_for_path(pfp, dir, pathname, &at_unref);
 
 	pmemfile_ssize_t ret =
@@ -0,0 +1,384 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * redo.c -- create and unlink without undo log transactions
+ *
+ * In the common case creating a file changes: a pre-zeroed inode (see
+ * inode_reserve.c), one free slot of the parent directory and timestamps of
+ * the parent. Unlinking changes: one directory slot, link count and
+ * timestamps and, if it was the last link, one entry of an orphan list.
+ * Instead of snapshotting all of that in an undo log, functions in this
+ * file:
+ * - write everything nobody can see yet directly and flush it - the reserved
+ *   inode, the tail of the name in a free directory slot, the inactive copies
+ *   of nlink, ctime and mtime (see "slots" in struct pmemfile_inode),
+ * - then make it all visible with a handful of 8-byte stores - inode and
+ *   the first 8 bytes of the name in the directory slot, slot selectors of
+ *   both inodes, an orphan list entry - which pmemobj_publish applies
+ *   atomically (using the redo log of pmemobj), along with the inode
+ *   reservation.
+ *
+ * A crash before pmemobj_publish leaves behind only writes to places nobody
+ * reads, after it the heap recovery completes the operation.
+ *
+ * Anything less common - no free slot in the directory, no free entry in
+ * the orphan list, no inode reservation, errors - is left to the
+ * transactional implementation. Without reservations in libpmemobj (see
+ * inode_reserve.c), or when PMEMFILE_REDO_METADATA is set to 0, everything
+ * is done in transactions.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "compiler_utils.h"
+#include "dir.h"
+#include "inode.h"
+#include "inode_array.h"
+#include "inode_reserve.h"
+#include "layout.h"
+#include "locks.h"
+#include "out.h"
+#include "pool.h"
+#include "redo.h"
+#include "utils.h"
+
+bool pmemfile_redo_metadata = true;
+
+#ifdef POBJ_XRESERVE_ALLOC
+
+/* inode reservation, dirent (3), parent slots */
+#define CREATE_ACTIONS 5
+
+/* dirent (3), inode slots, parent slots, orphan list entry (3) */
+#define UNLINK_ACTIONS 8
+
+/* the first 8 bytes of the name are published with one store */
+COMPILE_ERROR_ON(offsetof(struct pmemfile_dir, dirents) % 8 != 0);
+COMPILE_ERROR_ON(sizeof(struct pmemfile_dirent) % 8 != 0);
+COMPILE_ERROR_ON(offsetof(struct pmemfile_dirent, name) % 8 != 0);
+
+/* number of used entries is published with the version */
+COMPILE_ERROR_ON(offsetof(struct pmemfile_inode_array, version) != 0);
+COMPILE_ERROR_ON(offsetof(struct pmemfile_inode_array, used) !=
+		sizeof(uint32_t));
+
+/*
+ * redo_set_dirent -- adds actions setting inode and the first 8 bytes of
+ * the name of dirent
+ */
+static void
+redo_set_dirent(PMEMfilepool *pfp, struct pobj_action *act,
+		struct pmemfile_dirent *dirent, PMEMoid oid, uint64_t name_head)
+{
+	pmemobj_set_value(pfp->pop, &act[0], &dirent->inode.oid.pool_uuid_lo,
+			oid.pool_uuid_lo);
+	pmemobj_set_value(pfp->pop, &act[1], &dirent->inode.oid.off, oid.off);
+	pmemobj_set_value(pfp->pop, &act[2], (uint64_t *)dirent->name,
+			name_head);
+}
+
+/*
+ * redo_find_free_dirent -- looks for a free slot in directory, returns NULL
+ * if there's none or name already exists
+ */
+static struct pmemfile_dirent *
+redo_find_free_dirent(PMEMfilepool *pfp, struct pmemfile_inode *parent,
+		const char *name, size_t namelen)
+{
+	struct pmemfile_dir *dir = &inode_get_data(parent)->dir;
+	struct pmemfile_dirent *dirent = NULL;
+
+	while (dir) {
+		for (uint32_t i = 0; i < dir->num_elements; ++i) {
+			if (str_compare(dir->dirents[i].name, name, namelen)
+					== 0)
+				return NULL;
+
+			if (!dirent && dir->dirents[i].name[0] == 0)
+				dirent = &dir->dirents[i];
+		}
+
+		dir = PF_RW(pfp, dir->next);
+	}
+
+	return dirent;
+}
+
+/*
+ * inode_create_redo -- allocates inode and adds it to parent directory
+ * under specified name
+ *
+ * Returns false if it can't be done without a transaction - nothing is
+ * changed then. Caller must have exclusive access to parent inode, by locking
+ * parent in WRITE mode.
+ */
+bool
+inode_create_redo(PMEMfilepool *pfp, struct pmemfile_cred *cred,
+		struct pmemfile_vinode *parent, const char *name,
+		size_t namelen, uint64_t flags,
+		TOID(struct pmemfile_inode) *tinode)
+{
+	LOG(LDBG, "parent 0x%" PRIx64 " name %.*s", parent->tinode.oid.off,
+			(int)namelen, name);
+
+	ASSERT_NOT_IN_TX();
+
+	struct pmemfile_inode *pinode = parent->inode;
+
+	if (!pmemfile_redo_metadata || namelen > PMEMFILE_MAX_FILE_NAME ||
+			inode_get_nlink(pinode) == 0)
+		return false;
+
+	struct pmemfile_dirent *dirent =
+			redo_find_free_dirent(pfp, pinode, name, namelen);
+	if (!dirent)
+		return false;
+
+	struct pobj_action act[CREATE_ACTIONS];
+	PMEMoid oid = inode_reserve_take_action(pfp, &act[0]);
+	if (OID_IS_NULL(oid))
+		return false;
+
+	struct pmemfile_time t;
+	get_current_time(&t);
+
+	/* new inode */
+	struct pmemfile_inode *inode = pmemobj_direct(oid);
+	inode_init(pfp, inode, cred, flags, t);
+	inode->nlink[0] = 1;
+
+	union pmemfile_inode_data *data = inode_get_data(inode);
+	pmemobj_flush(pfp->pop, inode,
+			offsetof(struct pmemfile_inode, byte_padding));
+	pmemobj_flush(pfp->pop, data, sizeof(data->blocks));
+
+	/* name, except for the first 8 bytes */
+	uint64_t name_head = 0;
+	if (namelen < sizeof(name_head)) {
+		memcpy(&name_head, name, namelen);
+	} else {
+		memcpy(&name_head, name, sizeof(name_head));
+		memcpy(dirent->name + sizeof(name_head),
+				name + sizeof(name_head),
+				namelen - sizeof(name_head));
+		dirent->name[namelen] = '\0';
+		pmemobj_flush(pfp->pop, dirent->name + sizeof(name_head),
+				namelen - sizeof(name_head) + 1);
+	}
+
+	/*
+	 * From "open" man page:
+	 * "If the file is newly created, its st_atime, st_ctime, st_mtime
+	 * fields (...) are set to the current time, and so are the st_ctime
+	 * and st_mtime fields of the parent directory."
+	 */
+	union pmemfile_inode_slots pslots = pinode->slots;
+	pslots.bits.mtime = inode_next_mtime_slot(pinode);
+	pslots.bits.ctime = inode_next_ctime_slot(pinode);
+	pinode->mtime[pslots.bits.mtime] = t;
+	pinode->ctime[pslots.bits.ctime] = t;
+	pmemfile_flush(pfp, &pinode->mtime[pslots.bits.mtime]);
+	pmemfile_flush(pfp, &pinode->ctime[pslots.bits.ctime]);
+
+	/* everything above must be on the medium before publish */
+	pmemfile_drain(pfp);
+
+	redo_set_dirent(pfp, &act[1], dirent, oid, name_head);
+	pmemobj_set_value(pfp->pop, &act[4], &pinode->slots.value,
+			pslots.value);
+
+	pf_crash_point();
+
+	if (pmemobj_publish(pfp->pop, act, CREATE_ACTIONS)) {
+		LOG(LINF, "!publish failed, falling back to transaction");
+		pmemobj_cancel(pfp->pop, act, CREATE_ACTIONS);
+		return false;
+	}
+
+	TOID_ASSIGN(*tinode, oid);
+
+	return true;
+}
+
+/*
+ * vinode_unlink_redo -- removes file dirent from directory and, if it was
+ * the last link, registers file in one of orphaned inode lists
+ *
+ * Returns false if it can't be done without a transaction - nothing is
+ * changed then. Caller must have exclusive access to both parent and child
+ * inode by locking them in WRITE mode.
+ */
+bool
+vinode_unlink_redo(PMEMfilepool *pfp,
+		struct pmemfile_vinode *parent,
+		struct pmemfile_dirent *dirent,
+		struct pmemfile_vinode *vinode,
+		struct pmemfile_time tm)
+{
+	LOG(LDBG, "parent 0x%" PRIx64 " ppath %s name %s",
+		parent->tinode.oid.off, pmfi_path(parent), dirent->name);
+
+	ASSERT_NOT_IN_TX();
+
+	if (!pmemfile_redo_metadata)
+		return false;
+
+	struct pmemfile_inode *inode = vinode->inode;
+	struct pmemfile_inode *pinode = parent->inode;
+
+	uint64_t nlink = inode_get_nlink(inode);
+	ASSERT(nlink > 0);
+	nlink--;
+
+	struct pmemfile_inode_array *arr = NULL;
+	unsigned idx = 0;
+	if (nlink == 0 && inode->suspended_references == 0) {
+		ASSERTeq(vinode->orphaned.arr, NULL);
+
+		arr = inode_array_lock_free_entry(pfp, orphan_list(pfp), &idx);
+		if (!arr)
+			return false;
+	}
+
+	union pmemfile_inode_slots slots = inode->slots;
+	slots.bits.nlink = inode_next_nlink_slot(inode);
+	inode->nlink[slots.bits.nlink] = nlink;
+	pmemfile_flush(pfp, &inode->nlink[slots.bits.nlink]);
+
+	if (nlink > 0) {
+		/*
+		 * From "stat" man page:
+		 * "The field st_ctime is changed by writing or by setting inode
+		 * information (i.e., owner, group, link count, mode, etc.)."
+		 */
+		slots.bits.ctime = inode_next_ctime_slot(inode);
+		inode->ctime[slots.bits.ctime] = tm;
+		pmemfile_flush(pfp, &inode->ctime[slots.bits.ctime]);
+	}
+
+	/*
+	 * From "stat" man page:
+	 * "st_mtime of a directory is changed by the creation
+	 * or deletion of files in that directory."
+	 */
+	union pmemfile_inode_slots pslots = pinode->slots;
+	pslots.bits.mtime = inode_next_mtime_slot(pinode);
+	pinode->mtime[pslots.bits.mtime] = tm;
+	pmemfile_flush(pfp, &pinode->mtime[pslots.bits.mtime]);
+
+	/* everything above must be on the medium before publish */
+	pmemfile_drain(pfp);
+
+	struct pobj_action act[UNLINK_ACTIONS];
+	size_t nact = 0;
+
+	redo_set_dirent(pfp, &act[nact], dirent, OID_NULL, 0);
+	nact += 3;
+
+	pmemobj_set_value(pfp->pop, &act[nact++], &inode->slots.value,
+			slots.value);
+	pmemobj_set_value(pfp->pop, &act[nact++], &pinode->slots.value,
+			pslots.value);
+
+	if (arr) {
+		uint32_t header[2] = { arr->version, arr->used + 1 };
+		uint64_t header_val;
+		memcpy(&header_val, header, sizeof(header_val));
+
+		pmemobj_set_value(pfp->pop, &act[nact++],
+				&arr->inodes[idx].oid.pool_uuid_lo,
+				vinode->tinode.oid.pool_uuid_lo);
+		pmemobj_set_value(pfp->pop, &act[nact++],
+				&arr->inodes[idx].oid.off,
+				vinode->tinode.oid.off);
+		pmemobj_set_value(pfp->pop, &act[nact++],
+				(uint64_t *)&arr->version, header_val);
+	}
+
+	ASSERT(nact <= UNLINK_ACTIONS);
+
+	pf_crash_point();
+
+	bool published = pmemobj_publish(pfp->pop, act, nact) == 0;
+	if (!published) {
+		LOG(LINF, "!publish failed, falling back to transaction");
+		pmemobj_cancel(pfp->pop, act, nact);
+	} else if (arr) {
+		vinode->orphaned.arr = arr;
+		vinode->orphaned.idx = idx;
+	}
+
+	if (arr)
+		pmemobj_mutex_unlock_nofail(pfp->pop, &arr->mtx);
+
+	return published;
+}
+
+#else
+
+bool
+inode_create_redo(PMEMfilepool *pfp, struct pmemfile_cred *cred,
+		struct pmemfile_vinode *parent, const char *name,
+		size_t namelen, uint64_t flags,
+		TOID(struct pmemfile_inode) *tinode)
+{
+	(void) pfp;
+	(void) cred;
+	(void) parent;
+	(void) name;
+	(void) namelen;
+	(void) flags;
+	(void) tinode;
+
+	return false;
+}
+
+bool
+vinode_unlink_redo(PMEMfilepool *pfp,
+		struct pmemfile_vinode *parent,
+		struct pmemfile_dirent *dirent,
+		struct pmemfile_vinode *vinode,
+		struct pmemfile_time tm)
+{
+	(void) pfp;
+	(void) parent;
+	(void) dirent;
+	(void) vinode;
+	(void) tm;
+
+	return false;
+}
+
+#endif
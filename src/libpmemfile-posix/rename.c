@@ -39,7 +39,9 @@
 #include "libpmemfile-posix.h"
 #include "out.h"
 #include "pool.h"
+#include "rename.h"
 #include "rmdir.h"
+#include "tx_log.h"
 #include "unlink.h"
 #include "utils.h"
 
@@ -55,7 +57,7 @@ vinode_update_parent(PMEMfilepool *pfp,
 {
 	ASSERT_IN_TX();
 
-	struct pmemfile_dir *dir = &vinode->inode->file_data.dir;
+	struct pmemfile_dir *dir = &inode_get_data(vinode->inode)->dir;
 
 	struct pmemfile_dirent *dirent = NULL;
 
@@ -172,6 +174,84 @@ vinode_exchange(PMEMfilepool *pfp,
 	return error;
 }
 
+/*
+ * vinode_tx_rename -- replaces dst/dst_info (if it exists) with
+ * src/src_info
+ *
+ * Must be called in a transaction. Caller must hold WRITE locks on both
+ * parents, source and destination (if it exists). Caller is responsible for
+ * orphaning the destination if its link count drops to 0.
+ */
+void
+vinode_tx_rename(PMEMfilepool *pfp,
+		struct pmemfile_path_info *src,
+		struct pmemfile_dirent_info *src_info,
+		struct pmemfile_path_info *dst,
+		struct pmemfile_dirent_info *dst_info,
+		const char *new_path,
+		struct pmemfile_time t)
+{
+	ASSERT_IN_TX();
+
+	size_t new_name_len = component_length(dst->remaining);
+
+	if (dst_info->dirent) {
+		if (vinode_is_dir(dst_info->vinode)) {
+			vinode_unlink_dir(pfp, dst->parent,
+					dst_info->dirent,
+					dst_info->vinode,
+					new_path,
+					t);
+		} else {
+			vinode_unlink_file(pfp, dst->parent,
+					dst_info->dirent,
+					dst_info->vinode,
+					t);
+		}
+	}
+
+	if (src->parent == dst->parent) {
+		/* optimized rename */
+
+		if (new_name_len > PMEMFILE_MAX_FILE_NAME) {
+			LOG(LUSR, "file name too long");
+			pmemfile_tx_abort(ENAMETOOLONG);
+		}
+
+		pmemobj_tx_add_range_direct(src_info->dirent->name,
+				new_name_len + 1);
+
+		strncpy(src_info->dirent->name, dst->remaining,
+				new_name_len);
+		src_info->dirent->name[new_name_len] = '\0';
+
+		/*
+		 * From "stat" man page:
+		 * "st_mtime of a directory is changed by the creation
+		 * or deletion of files in that directory."
+		 */
+		inode_tx_set_mtime(src->parent->inode, t);
+
+		/*
+		 * Even though in this case we are not updating any
+		 * metadata we have to update ctime, because that's what
+		 * file system tests expect :/.
+		 */
+		inode_tx_set_ctime(src_info->vinode->inode, t);
+	} else {
+		inode_add_dirent(pfp, dst->parent->tinode,
+				dst->remaining, new_name_len,
+				src_info->vinode->tinode, t);
+
+		vinode_unlink_file(pfp, src->parent, src_info->dirent,
+				src_info->vinode, t);
+
+		if (vinode_is_dir(src_info->vinode))
+			vinode_update_parent(pfp, src_info->vinode,
+					src->parent, dst->parent);
+	}
+}
+
 /*
  * vinode_rename -- renames src/src_info to dst/dst_info
  *
@@ -188,8 +268,6 @@ vinode_rename(PMEMfilepool *pfp,
 	int error = 0;
 	ASSERT_NOT_IN_TX();
 
-	size_t new_name_len = component_length(dst->remaining);
-
 	if (vinode_is_dir(src_info->vinode)) {
 		/*
 		 * From rename man page:
@@ -212,64 +290,15 @@ vinode_rename(PMEMfilepool *pfp,
 	get_current_time(&t);
 
 	TX_BEGIN_CB(pfp->pop, cb_queue, pfp) {
-		if (dst_info->dirent) {
-			if (vinode_is_dir(dst_info->vinode)) {
-				vinode_unlink_dir(pfp, dst->parent,
-						dst_info->dirent,
-						dst_info->vinode,
-						new_path,
-						t);
-			} else {
-				vinode_unlink_file(pfp, dst->parent,
-						dst_info->dirent,
-						dst_info->vinode,
-						t);
-			}
+		if (dst_info->dirent)
+			tx_log_attach(pfp);
 
-			if (inode_get_nlink(dst_info->vinode->inode) == 0)
-				vinode_orphan_unlocked(pfp, dst_info->vinode);
-		}
-
-		if (src->parent == dst->parent) {
-			/* optimized rename */
+		vinode_tx_rename(pfp, src, src_info, dst, dst_info, new_path,
+				t);
 
-			if (new_name_len > PMEMFILE_MAX_FILE_NAME) {
-				LOG(LUSR, "file name too long");
-				pmemfile_tx_abort(ENAMETOOLONG);
-			}
-
-			pmemobj_tx_add_range_direct(src_info->dirent->name,
-					new_name_len + 1);
-
-			strncpy(src_info->dirent->name, dst->remaining,
-					new_name_len);
-			src_info->dirent->name[new_name_len] = '\0';
-
-			/*
-			 * From "stat" man page:
-			 * "st_mtime of a directory is changed by the creation
-			 * or deletion of files in that directory."
-			 */
-			inode_tx_set_mtime(src->parent->inode, t);
-
-			/*
-			 * Even though in this case we are not updating any
-			 * metadata we have to update ctime, because that's what
-			 * file system tests expect :/.
-			 */
-			inode_tx_set_ctime(src_info->vinode->inode, t);
-		} else {
-			inode_add_dirent(pfp, dst->parent->tinode,
-					dst->remaining, new_name_len,
-					src_info->vinode->tinode, t);
-
-			vinode_unlink_file(pfp, src->parent, src_info->dirent,
-					src_info->vinode, t);
-
-			if (vinode_is_dir(src_info->vinode))
-				vinode_update_parent(pfp, src_info->vinode,
-						src->parent, dst->parent);
-		}
+		if (dst_info->dirent &&
+				inode_get_nlink(dst_info->vinode->inode) == 0)
+			vinode_orphan(pfp, dst_info->vinode);
 	} TX_ONABORT {
 		error = errno;
 	} TX_END
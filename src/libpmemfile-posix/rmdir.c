@@ -59,7 +59,7 @@ vinode_unlink_dir(PMEMfilepool *pfp,
 {
 	struct pmemfile_inode *iparent = vparent->inode;
 	struct pmemfile_inode *idir = vdir->inode;
-	struct pmemfile_dir *ddir = &idir->file_data.dir;
+	struct pmemfile_dir *ddir = &inode_get_data(idir)->dir;
 
 	ASSERT_IN_TX();
 
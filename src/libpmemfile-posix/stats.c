@@ -31,14 +31,21 @@
  */
 
 /*
- * stats.c -- pmemfile_stats implementation
+ * stats.c -- pmemfile_stats and pmemfile_runtime_stats implementation
  */
 
+#include <errno.h>
+#include <string.h>
+
+#include "arena.h"
 #include "blocks.h"
+#include "extent.h"
 #include "libpmemfile-posix.h"
+#include "orphan.h"
 #include "out.h"
 #include "pool.h"
 #include "layout.h"
+#include "tx_log.h"
 #include "utils.h"
 
 static bool
@@ -61,6 +68,10 @@ stats_header(PMEMfilepool *pfp, unsigned t, struct pmemfile_stats *stats)
 		stats->inode_arrays++;
 	else if (t == TOID_TYPE_NUM(char))
 		stats->blocks++;
+	else if (t == TOID_TYPE_NUM(struct pmemfile_tx_logs))
+		return; /* transaction log buffers are not reported */
+	else if (t == TOID_TYPE_NUM(struct pmemfile_extent_region))
+		return; /* blocks in regions are counted separately */
 	else
 		FATAL("unknown type %u", t);
 }
@@ -69,7 +80,8 @@ stats_alloc_class(PMEMfilepool *pfp, PMEMoid oid, struct pmemfile_stats *stats)
 {
 	size_t size = pmemobj_alloc_usable_size(oid);
 
-	if (size == METADATA_BLOCK_SIZE) {
+	if (size == METADATA_BLOCK_SIZE ||
+			size == PMEMFILE_COMPACT_INODE_SIZE) {
 		uint32_t v = *((uint32_t *) pmemfile_direct(pfp, oid));
 
 		if (cmp(v, PMEMFILE_INODE_VERSION(0)))
@@ -82,7 +94,8 @@ stats_alloc_class(PMEMfilepool *pfp, PMEMoid oid, struct pmemfile_stats *stats)
 			stats->inode_arrays++;
 		else
 			FATAL("unknown metadata 0x%x", v);
-	} else if (data_block_info(size, MAX_BLOCK_SIZE)->size == size) {
+	} else if (data_block_info(&pfp->blocks, size, MAX_BLOCK_SIZE)->size ==
+			size) {
 		stats->blocks++;
 	} else {
 		FATAL("unknown block");
@@ -110,4 +123,41 @@ pmemfile_stats(PMEMfilepool *pfp, struct pmemfile_stats *stats)
 		else
 			stats_alloc_class(pfp, oid, stats);
 	}
+
+	stats->blocks += extent_count_blocks(pfp);
+}
+
+/*
+ * pmemfile_runtime_stats -- get statistics of the pool in this process
+ *
+ * Fills "size" bytes of "stats". Fields this version doesn't know about are
+ * zeroed, fields that don't fit in "size" are left out.
+ */
+int
+pmemfile_runtime_stats(PMEMfilepool *pfp,
+		struct pmemfile_runtime_stats *stats, size_t size)
+{
+	if (!pfp || !stats) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	struct pmemfile_runtime_stats s;
+	memset(&s, 0, sizeof(s));
+
+	arena_stats(pfp, &s);
+
+	s.orphans = orphan_reclaim_pending(pfp);
+	s.open_ns = pfp->open_ns;
+
+	tx_log_stats(pfp, &s);
+
+	if (size > sizeof(s)) {
+		memset((char *)stats + sizeof(s), 0, size - sizeof(s));
+		size = sizeof(s);
+	}
+
+	memcpy(stats, &s, size);
+
+	return 0;
 }
@@ -47,11 +47,12 @@ get_symlink(PMEMfilepool *pfp, struct pmemfile_vinode *vinode)
 {
 	const char *symlink_target;
 	struct pmemfile_inode *inode = vinode->inode;
+	union pmemfile_inode_data *data = inode_get_data(inode);
 
 	if (inode_is_longsymlink(inode))
-		symlink_target = PF_RO(pfp, inode->file_data.long_symlink);
+		symlink_target = PF_RO(pfp, data->long_symlink);
 	else
-		symlink_target = inode->file_data.short_symlink;
+		symlink_target = data->short_symlink;
 
 	return symlink_target;
 }
@@ -91,7 +92,7 @@ _pmemfile_symlinkat(PMEMfilepool *pfp, const char *target,
 	size_t len = strlen(target);
 
 	const struct pmem_block_info *block_info =
-			data_block_info(len + 1, MAX_BLOCK_SIZE);
+			data_block_info(&pfp->blocks, len + 1, MAX_BLOCK_SIZE);
 
 	if (len + 1 > PMEMFILE_PATH_MAX) {
 		error = ENAMETOOLONG;
@@ -114,19 +115,20 @@ _pmemfile_symlinkat(PMEMfilepool *pfp, const char *target,
 		TOID(struct pmemfile_inode) tinode = inode_alloc(pfp, &cred,
 				PMEMFILE_S_IFLNK | PMEMFILE_ACCESSPERMS);
 		struct pmemfile_inode *inode = PF_RW(pfp, tinode);
+		union pmemfile_inode_data *data = inode_get_data(inode);
 		char *buf;
 
-		if (len + 1 <= sizeof(inode->file_data.short_symlink)) {
-			buf = inode->file_data.short_symlink;
+		if (len + 1 <= inode_get_data_size(inode)) {
+			buf = data->short_symlink;
 		} else {
-			inode->file_data.long_symlink =
+			data->long_symlink =
 				TX_XALLOC(char, block_info->size,
 					POBJ_XALLOC_NO_FLUSH |
 					block_info->class_id);
 
 			inode->flags[0] |= PMEMFILE_S_LONGSYMLINK;
 
-			buf = PF_RW(pfp, inode->file_data.long_symlink);
+			buf = PF_RW(pfp, data->long_symlink);
 		}
 
 		pmemobj_memcpy_persist(pfp->pop, buf, target, len + 1);
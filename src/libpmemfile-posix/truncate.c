@@ -44,6 +44,7 @@
 #include "out.h"
 #include "pool.h"
 #include "truncate.h"
+#include "tx_log.h"
 #include "utils.h"
 
 /*
@@ -70,6 +71,8 @@ vinode_truncate(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
 	vinode_snapshot(vinode);
 
 	TX_BEGIN_CB(pfp->pop, cb_queue, pfp) {
+		tx_log_attach(pfp);
+
 		/*
 		 * Might need to handle the special case where size == 0.
 		 * Setting all the next and prev fields is pointless, when all
@@ -83,7 +86,7 @@ vinode_truncate(PMEMfilepool *pfp, struct pmemfile_vinode *vinode,
 		uint64_t inode_size = inode_get_size(inode);
 		if (inode_size < size)
 			allocated_space += vinode_allocate_interval(pfp, vinode,
-			    inode_size, size - inode_size);
+			    inode_size, size - inode_size, false);
 
 		if (inode_get_size(inode) != size) {
 			inode_tx_set_size(inode, size);
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * tx_log.c -- preallocated transaction log buffers
+ *
+ * Undo log of pmemobj lives in per-lane space of fixed size. When a
+ * transaction snapshots, allocates or frees more than fits there, pmemobj
+ * allocates log extensions from the heap in the middle of the transaction,
+ * which adds heap operations (and their latency) to exactly the biggest
+ * operations, and makes them fail when the pool is full.
+ *
+ * Each pool has PMEMFILE_TX_LOGS log buffers, allocated together with the
+ * pool. Transactions which can grow big (truncate, rename, growing
+ * a directory, freeing an inode, batches) call tx_log_attach, which takes
+ * a free buffer (starting from the one of the current CPU) and hands it to
+ * pmemobj as log space for snapshots and intents. Buffer is released when
+ * the transaction ends. When all buffers are taken, transaction gets log
+ * extensions like before.
+ *
+ * Requires pmemobj_tx_log_append_buffer, without it buffers are not
+ * allocated.
+ */
+
+#include <errno.h>
+
+#include "callbacks.h"
+#include "layout.h"
+#include "os_util.h"
+#include "out.h"
+#include "pool.h"
+#include "tx_log.h"
+#include "utils.h"
+
+#ifdef HAVE_PMEMOBJ_TX_LOG_BUFFER
+
+/* log buffers must be cacheline aligned */
+#define TX_LOG_ALIGNMENT 64
+
+/* buffer attached to the current transaction of this thread */
+static __thread unsigned *attached;
+
+/*
+ * tx_log_alloc -- allocates log buffers of the pool, if there are none
+ *
+ * Must be called in a transaction.
+ */
+void
+tx_log_alloc(PMEMfilepool *pfp)
+{
+	ASSERT_IN_TX();
+
+	if (!TOID_IS_NULL(pfp->super->tx_logs))
+		return;
+
+	TX_ADD_FIELD_DIRECT(pfp->super, tx_logs);
+	pfp->super->tx_logs = TX_NEW(struct pmemfile_tx_logs);
+}
+
+/*
+ * tx_log_release -- makes buffer available for other transactions
+ */
+static void
+tx_log_release(void *pfp, void *arg)
+{
+	(void) pfp;
+
+	unsigned *busy = arg;
+
+	ASSERTeq(attached, busy);
+	attached = NULL;
+
+	__sync_lock_release(busy);
+}
+
+/*
+ * tx_log_append -- gives part of the buffer to the current transaction
+ */
+static int
+tx_log_append(enum pobj_log_type type, char *start, size_t size)
+{
+	char *aligned = (char *)(((uintptr_t)start + TX_LOG_ALIGNMENT - 1) &
+			~((uintptr_t)TX_LOG_ALIGNMENT - 1));
+	size -= (size_t)(aligned - start);
+	size &= ~((size_t)TX_LOG_ALIGNMENT - 1);
+
+	return pmemobj_tx_log_append_buffer(type, aligned, size);
+}
+
+/*
+ * tx_log_attach -- attaches one of preallocated log buffers to the current
+ * transaction
+ *
+ * Does nothing if the transaction already has one or there are no free
+ * buffers. Must be called in a transaction.
+ */
+void
+tx_log_attach(PMEMfilepool *pfp)
+{
+	ASSERT_IN_TX();
+
+	if (attached || TOID_IS_NULL(pfp->super->tx_logs))
+		return;
+
+	unsigned first = os_getcpu();
+	unsigned idx = 0;
+	unsigned *busy = NULL;
+
+	for (unsigned i = 0; i < PMEMFILE_TX_LOGS; ++i) {
+		idx = (first + i) % PMEMFILE_TX_LOGS;
+
+		if (__sync_lock_test_and_set(&pfp->tx_log_busy[idx], 1) == 0) {
+			busy = &pfp->tx_log_busy[idx];
+			break;
+		}
+	}
+
+	if (!busy)
+		return;
+
+	/* buffer is in use until the end, even if only one append worked */
+	cb_push_back(TX_STAGE_NONE, tx_log_release, busy);
+	attached = busy;
+	__sync_fetch_and_add(&pfp->tx_logs_attached, 1);
+
+	char *buf = PF_RW(pfp, pfp->super->tx_logs)->buf[idx];
+
+	/* most of the space for snapshots, the rest for allocations/frees */
+	size_t snapshots = PMEMFILE_TX_LOG_SIZE / 4 * 3;
+
+	if (tx_log_append(TX_LOG_TYPE_SNAPSHOT, buf, snapshots) ||
+			tx_log_append(TX_LOG_TYPE_INTENT, buf + snapshots,
+					PMEMFILE_TX_LOG_SIZE - snapshots))
+		LOG(LINF, "!cannot append log buffer");
+}
+
+/*
+ * tx_log_stats -- fills log buffer part of runtime statistics
+ */
+void
+tx_log_stats(PMEMfilepool *pfp, struct pmemfile_runtime_stats *stats)
+{
+	if (TOID_IS_NULL(pfp->super->tx_logs))
+		return;
+
+	stats->tx_logs = PMEMFILE_TX_LOGS;
+
+	for (unsigned i = 0; i < PMEMFILE_TX_LOGS; ++i)
+		if (__atomic_load_n(&pfp->tx_log_busy[i], __ATOMIC_ACQUIRE))
+			stats->tx_logs_busy++;
+
+	stats->tx_logs_attached = __atomic_load_n(&pfp->tx_logs_attached,
+			__ATOMIC_RELAXED);
+}
+
+#else
+
+void
+tx_log_alloc(PMEMfilepool *pfp)
+{
+	(void) pfp;
+}
+
+void
+tx_log_attach(PMEMfilepool *pfp)
+{
+	(void) pfp;
+}
+
+void
+tx_log_stats(PMEMfilepool *pfp, struct pmemfile_runtime_stats *stats)
+{
+	(void) pfp;
+	(void) stats;
+}
+
+#endif
@@ -41,6 +41,7 @@
 #include "libpmemfile-posix.h"
 #include "out.h"
 #include "pool.h"
+#include "redo.h"
 #include "rmdir.h"
 #include "unlink.h"
 #include "utils.h"
@@ -149,6 +150,11 @@ _pmemfile_unlinkat(PMEMfilepool *pfp, struct pmemfile_vinode *dir,
 	struct pmemfile_time t;
 	get_current_time(&t);
 
+	/* try the common case first, without a transaction */
+	if (vinode_unlink_redo(pfp, info.parent, dirent_info.dirent,
+			dirent_info.vinode, t))
+		goto end_vinode;
+
 	TX_BEGIN_CB(pfp->pop, cb_queue, pfp) {
 		vinode_unlink_file(pfp, info.parent, dirent_info.dirent,
 				dirent_info.vinode, t);
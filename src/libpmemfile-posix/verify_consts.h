@@ -163,6 +163,29 @@ VERIFY(FALLOC_FL_PUNCH_HOLE);
 	VERIFY(FALLOC_FL_INSERT_RANGE);
 #endif
 
+VERIFY(POSIX_FADV_NORMAL);
+VERIFY(POSIX_FADV_RANDOM);
+VERIFY(POSIX_FADV_SEQUENTIAL);
+VERIFY(POSIX_FADV_WILLNEED);
+VERIFY(POSIX_FADV_DONTNEED);
+VERIFY(POSIX_FADV_NOREUSE);
+
+#ifdef RWF_HIPRI
+	VERIFY(RWF_HIPRI);
+#endif
+#ifdef RWF_DSYNC
+	VERIFY(RWF_DSYNC);
+#endif
+#ifdef RWF_SYNC
+	VERIFY(RWF_SYNC);
+#endif
+#ifdef RWF_NOWAIT
+	VERIFY(RWF_NOWAIT);
+#endif
+#ifdef RWF_APPEND
+	VERIFY(RWF_APPEND);
+#endif
+
 VERIFY(FD_CLOEXEC);
 
 VERIFY(RENAME_EXCHANGE);
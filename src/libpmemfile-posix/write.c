@@ -50,7 +50,7 @@
 static void
 vinode_write(PMEMfilepool *pfp, struct pmemfile_vinode *vinode, size_t offset,
 		struct pmemfile_block_desc **last_block,
-		const char *buf, size_t count)
+		const char *buf, size_t count, unsigned cpy_flags)
 {
 	ASSERT(count > 0);
 
@@ -64,10 +64,10 @@ vinode_write(PMEMfilepool *pfp, struct pmemfile_vinode *vinode, size_t offset,
 	/* All blocks needed for writing are properly allocated at this point */
 
 	struct pmemfile_block_desc *block =
-		find_closest_block_with_hint(vinode, offset, *last_block);
+		find_closest_block_with_hint(pfp, vinode, offset, *last_block);
 
 	block = iterate_on_file_range(pfp, vinode, block, offset,
-			count, (char *)buf, write_to_blocks);
+			count, (char *)buf, write_to_blocks, cpy_flags);
 
 	if (block)
 		*last_block = block;
@@ -117,7 +117,7 @@ pmemfile_pwritev_args_check(struct pmemfile_file *file,
 static int
 pmemfile_allocate_space(PMEMfilepool *pfp,
 		struct pmemfile_vinode *vinode, size_t offset, size_t len,
-		bool expect_changes)
+		uint64_t file_flags, bool expect_changes)
 {
 	struct pmemfile_inode *inode = vinode->inode;
 	int error = 0;
@@ -126,7 +126,8 @@ pmemfile_allocate_space(PMEMfilepool *pfp,
 
 	TX_BEGIN_CB(pfp->pop, cb_queue, pfp) {
 		size_t allocated_space = inode_get_allocated_space(inode) +
-			vinode_allocate_interval(pfp, vinode, offset, len);
+			vinode_allocate_interval(pfp, vinode, offset, len,
+				(file_flags & PFILE_SEQUENTIAL) != 0);
 
 		if (expect_changes)
 			/* Non-fatal condition we would like to know about. */
@@ -156,6 +157,7 @@ pmemfile_pwritev_internal(PMEMfilepool *pfp,
 		struct pmemfile_vinode *vinode,
 		struct pmemfile_block_desc **last_block,
 		uint64_t file_flags,
+		int rwflags,
 		size_t offset,
 		const pmemfile_iovec_t *iov,
 		int iovcnt)
@@ -169,12 +171,17 @@ pmemfile_pwritev_internal(PMEMfilepool *pfp,
 	ASSERT_NOT_IN_TX();
 
 	if (!vinode->blocks) {
+		if (rwflags & PMEMFILE_RWF_NOWAIT) {
+			error = EAGAIN;
+			goto end;
+		}
+
 		error = vinode_rebuild_block_tree(pfp, vinode);
 		if (error)
 			goto end;
 	}
 
-	if (file_flags & PFILE_APPEND)
+	if ((file_flags & PFILE_APPEND) || (rwflags & PMEMFILE_RWF_APPEND))
 		offset = inode_get_size(inode);
 
 	size_t sum_len = 0;
@@ -202,8 +209,12 @@ pmemfile_pwritev_internal(PMEMfilepool *pfp,
 
 	if (!vinode_is_interval_allocated(pfp, vinode, offset, sum_len,
 			*last_block)) {
-		error = pmemfile_allocate_space(pfp, vinode, offset, sum_len,
-				true);
+		/* allocation requires a transaction, which can take a while */
+		if (rwflags & PMEMFILE_RWF_NOWAIT)
+			error = EAGAIN;
+		else
+			error = pmemfile_allocate_space(pfp, vinode, offset,
+					sum_len, file_flags, true);
 	} else {
 #ifdef DEBUG
 		static int verify = -1;
@@ -218,7 +229,7 @@ pmemfile_pwritev_internal(PMEMfilepool *pfp,
 
 		if (verify)
 			error = pmemfile_allocate_space(pfp, vinode, offset,
-					sum_len, false);
+					sum_len, file_flags, false);
 #endif
 	}
 	if (error)
@@ -246,11 +257,19 @@ pmemfile_pwritev_internal(PMEMfilepool *pfp,
 	 */
 	pmemfile_persist(pfp, &inode->slots);
 
+	unsigned cpy_flags = 0;
+	if (file_flags & PFILE_NOREUSE)
+		cpy_flags |= CPY_NONTEMPORAL;
+
 	/*
-	 * Now write the data. It uses pmemobj_memcpy_persist, which has
-	 * a built-in fence. We actually don't need its fence here, but there's
-	 * no way to opt out of it without introducing new API to pmemobj.
+	 * Now write the data. Unless a synchronous write was requested, data
+	 * is copied without waiting for each chunk to reach the medium - one
+	 * fence after all chunks are copied is enough. PMEMFILE_RWF_DSYNC
+	 * (and PMEMFILE_RWF_SYNC) write fences after every chunk.
 	 */
+	if (!(rwflags & (PMEMFILE_RWF_DSYNC | PMEMFILE_RWF_SYNC)))
+		cpy_flags |= CPY_NODRAIN;
+
 	for (int i = 0; i < iovcnt; ++i) {
 		size_t len = iov[i].iov_len;
 
@@ -265,7 +284,7 @@ pmemfile_pwritev_internal(PMEMfilepool *pfp,
 
 		if (len > 0)
 			vinode_write(pfp, vinode, offset, last_block,
-					iov[i].iov_base, len);
+					iov[i].iov_base, len, cpy_flags);
 
 		ret += len;
 		offset += len;
@@ -298,6 +317,14 @@ pmemfile_pwritev_internal(PMEMfilepool *pfp,
 	bool update_atime = vinode->atime_dirty &&
 				(update_mtime || update_size);
 
+	/*
+	 * Metadata update below waits for the data to reach the medium before
+	 * switching slots, otherwise the fence has to be issued here.
+	 */
+	if ((cpy_flags & CPY_NODRAIN) &&
+			!update_mtime && !update_size && !update_atime)
+		pmemfile_drain(pfp);
+
 	inode_slot size_slot = inode->slots.bits.size;
 	inode_slot ctime_slot = inode->slots.bits.ctime;
 	inode_slot atime_slot = inode->slots.bits.atime;
@@ -382,7 +409,7 @@ pmemfile_write(PMEMfilepool *pfp, PMEMfile *file, const void *buf, size_t count)
  */
 static pmemfile_ssize_t
 pmemfile_writev_under_filelock(PMEMfilepool *pfp, PMEMfile *file,
-		const pmemfile_iovec_t *iov, int iovcnt)
+		const pmemfile_iovec_t *iov, int iovcnt, int rwflags)
 {
 	pmemfile_ssize_t ret;
 
@@ -395,33 +422,70 @@ pmemfile_writev_under_filelock(PMEMfilepool *pfp, PMEMfile *file,
 	if (iovcnt == 0)
 		return 0;
 
-	os_rwlock_wrlock(&file->vinode->rwlock);
-
-	if (file->last_block_pointer_invalidation_observed !=
-			file->vinode->block_pointer_invalidation_counter) {
-		file->block_pointer_cache = NULL;
-		file->last_block_pointer_invalidation_observed =
-			file->vinode->block_pointer_invalidation_counter;
+	if (rwflags & PMEMFILE_RWF_NOWAIT) {
+		if (os_rwlock_trywrlock(&file->vinode->rwlock)) {
+			errno = EAGAIN;
+			return -1;
+		}
+	} else {
+		os_rwlock_wrlock(&file->vinode->rwlock);
 	}
 
-	last_block = file->block_pointer_cache;
+	block_cursors_sync(&file->cursors, file->vinode);
+
+	struct block_cursor *cursor =
+			block_cursors_find(&file->cursors, file->offset);
+	last_block = cursor->block;
 
 	ret = pmemfile_pwritev_internal(pfp,
 					file->vinode,
 					&last_block,
 					file->flags,
+					rwflags,
 					file->offset, iov, iovcnt);
 
+	/* appending write leaves the position at the end of file */
+	bool append = (file->flags & PFILE_APPEND) ||
+			(rwflags & PMEMFILE_RWF_APPEND);
+
+	if (ret > 0) {
+		if (append)
+			file->offset = inode_get_size(file->vinode->inode);
+		else
+			file->offset += (size_t)ret;
+		block_cursor_update(&file->cursors, cursor, last_block,
+				file->offset);
+	} else {
+		block_cursor_update(&file->cursors, cursor, NULL, 0);
+	}
 
 	os_rwlock_unlock(&file->vinode->rwlock);
 
-	if (ret > 0) {
-		file->offset += (size_t)ret;
-		file->block_pointer_cache = last_block;
+	return ret;
+}
+
+/*
+ * pmemfile_writev_flags - write to a file while holding the locks both for the
+ * PMEMfile instance, and the vinode instance.
+ */
+static pmemfile_ssize_t
+pmemfile_writev_flags(PMEMfilepool *pfp, PMEMfile *file,
+		const pmemfile_iovec_t *iov, int iovcnt, int rwflags)
+{
+	if (rwflags & PMEMFILE_RWF_NOWAIT) {
+		if (os_mutex_trylock(&file->mutex)) {
+			errno = EAGAIN;
+			return -1;
+		}
 	} else {
-		file->block_pointer_cache = NULL;
+		os_mutex_lock(&file->mutex);
 	}
 
+	pmemfile_ssize_t ret = pmemfile_writev_under_filelock(pfp, file, iov,
+			iovcnt, rwflags);
+
+	os_mutex_unlock(&file->mutex);
+
 	return ret;
 }
 
@@ -445,14 +509,7 @@ pmemfile_writev(PMEMfilepool *pfp, PMEMfile *file, const pmemfile_iovec_t *iov,
 		return -1;
 	}
 
-	os_mutex_lock(&file->mutex);
-
-	pmemfile_ssize_t ret =
-		pmemfile_writev_under_filelock(pfp, file, iov, iovcnt);
-
-	os_mutex_unlock(&file->mutex);
-
-	return ret;
+	return pmemfile_writev_flags(pfp, file, iov, iovcnt, 0);
 }
 
 /*
@@ -467,7 +524,7 @@ pmemfile_pwrite(PMEMfilepool *pfp, PMEMfile *file, const void *buf,
 }
 
 /*
- * pmemfile_pwritev - writes to a file starting at a position supplied as
+ * pmemfile_pwritev_flags - writes to a file starting at a position supplied as
  * argument.
  *
  * Since this does not require making any modification to the PMEMfile instance,
@@ -496,15 +553,15 @@ pmemfile_pwrite(PMEMfilepool *pfp, PMEMfile *file, const void *buf,
  * | lock(file);                                                             |
  * |                                                                         |
  * |  if (is_data_modification_indicated(file)) {  ---+                      |
- * |     block_pointer_cache = NULL;                  |                      |
+ * |     drop all cursors;                            |                      |
  * |  }                                               |                      |
- * |  Make a local copy of block_pointer_cache.       | The underlying file  |
+ * |  Make a local copy of the cursors.               | The underlying file  |
  * |                                                  | can be modified here,|
  * | unlock(file);                                    | invalidating the     |
- * |                                                  | block_pointer_cache. |
+ * |                                                  | cursors.             |
  * | lock(vinode);                                    |                      |
  * |   Write to the file, using the local copy     ---+                      |
- * |    of block_pointer_cache.                                              |
+ * |    of the cursors.                                                      |
  * | unlock(vinode);                                                         |
  * |                                                                         |
  * +-------------------------------------------------------------------------+
@@ -519,46 +576,35 @@ pmemfile_pwrite(PMEMfilepool *pfp, PMEMfile *file, const void *buf,
  * |                                                                         |
  * | lock(vinode);                                                           |
  * |   if (is_data_modification_indicated(file)) { ---+                      |
- * |     block_pointer_cache = NULL;                  | block_pointer_cache  |
+ * |     drop all cursors;                            | the cursors          |
  * |  }                                               | can be modified here |
  * |                                                  |                      |
  * |   Write to the file, using the local copy     ---+                      |
- * |    of block_pointer_cache.                                              |
+ * |    of the cursors.                                                      |
  * | unlock(vinode);                                                         |
  * |                                                                         |
  * +-------------------------------------------------------------------------+
  *
  */
-pmemfile_ssize_t
-pmemfile_pwritev(PMEMfilepool *pfp, PMEMfile *file, const pmemfile_iovec_t *iov,
-		int iovcnt, pmemfile_off_t offset)
+static pmemfile_ssize_t
+pmemfile_pwritev_flags(PMEMfilepool *pfp, PMEMfile *file,
+		const pmemfile_iovec_t *iov, int iovcnt, size_t offset,
+		int rwflags)
 {
-	if (!pfp) {
-		LOG(LUSR, "NULL pool");
-		errno = EFAULT;
-		return -1;
-	}
-
-	if (!file) {
-		LOG(LUSR, "NULL file");
-		errno = EFAULT;
-		return -1;
-	}
-
-	if (offset < 0) {
-		errno = EINVAL;
-		return -1;
-	}
-
 	pmemfile_ssize_t ret;
 
-	os_mutex_lock(&file->mutex);
+	if (rwflags & PMEMFILE_RWF_NOWAIT) {
+		if (os_mutex_trylock(&file->mutex)) {
+			errno = EAGAIN;
+			return -1;
+		}
+	} else {
+		os_mutex_lock(&file->mutex);
+	}
 
 	ret = pmemfile_pwritev_args_check(file, iov, iovcnt);
 
-	uint64_t last_bp_iv_obs =
-			file->last_block_pointer_invalidation_observed;
-	struct pmemfile_block_desc *last_block = file->block_pointer_cache;
+	struct block_cursors cursors = file->cursors;
 	uint64_t flags = file->flags;
 
 	os_mutex_unlock(&file->mutex);
@@ -569,23 +615,121 @@ pmemfile_pwritev(PMEMfilepool *pfp, PMEMfile *file, const pmemfile_iovec_t *iov,
 	if (iovcnt == 0)
 		return 0;
 
-	os_rwlock_wrlock(&file->vinode->rwlock);
+	if (rwflags & PMEMFILE_RWF_NOWAIT) {
+		if (os_rwlock_trywrlock(&file->vinode->rwlock)) {
+			errno = EAGAIN;
+			return -1;
+		}
+	} else {
+		os_rwlock_wrlock(&file->vinode->rwlock);
+	}
+
 	/*
-	 * Using the variables last_bp_iv_obs, last_block, and flags, which
-	 * serve to represent the state in which the PMEMfile instance was
-	 * observable while the corresponding lock was held.
+	 * Using the variables cursors and flags, which serve to represent
+	 * the state in which the PMEMfile instance was observable while the
+	 * corresponding lock was held.
 	 * Note: the file->vinode pointer can not be modified during the
 	 * lifetime of the instance, so there is no need to work with a copy of
 	 * that field.
 	 */
 
-	if (last_bp_iv_obs != file->vinode->block_pointer_invalidation_counter)
-		last_block = NULL;
+	block_cursors_sync(&cursors, file->vinode);
+
+	struct block_cursor *cursor = block_cursors_find(&cursors, offset);
+	struct pmemfile_block_desc *last_block = cursor->block;
 
 	ret = pmemfile_pwritev_internal(pfp, file->vinode, &last_block, flags,
-		(size_t)offset, iov, iovcnt);
+		rwflags, offset, iov, iovcnt);
+
+	if (ret > 0) {
+		if ((flags & PFILE_APPEND) || (rwflags & PMEMFILE_RWF_APPEND))
+			offset = inode_get_size(file->vinode->inode);
+		else
+			offset += (size_t)ret;
+
+		block_cursor_update(&cursors, cursor, last_block, offset);
+	}
 
 	os_rwlock_unlock(&file->vinode->rwlock);
 
+	/*
+	 * Cursors are just hints, so don't wait for the file handle if it's
+	 * busy.
+	 */
+	if (os_mutex_trylock(&file->mutex) == 0) {
+		block_cursors_merge(&file->cursors, &cursors);
+		os_mutex_unlock(&file->mutex);
+	}
+
 	return ret;
 }
+
+/*
+ * pmemfile_pwritev - writes to a file starting at a position supplied as
+ * argument.
+ */
+pmemfile_ssize_t
+pmemfile_pwritev(PMEMfilepool *pfp, PMEMfile *file, const pmemfile_iovec_t *iov,
+		int iovcnt, pmemfile_off_t offset)
+{
+	if (!pfp) {
+		LOG(LUSR, "NULL pool");
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (!file) {
+		LOG(LUSR, "NULL file");
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (offset < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return pmemfile_pwritev_flags(pfp, file, iov, iovcnt, (size_t)offset,
+			0);
+}
+
+/*
+ * pmemfile_pwritev2 -- pmemfile_pwritev with flags
+ *
+ * PMEMFILE_RWF_NOWAIT makes it fail with EAGAIN instead of blocking on the
+ * file's locks or allocating space, PMEMFILE_RWF_APPEND appends data to the
+ * file and PMEMFILE_RWF_DSYNC / PMEMFILE_RWF_SYNC use fully fenced copies.
+ */
+pmemfile_ssize_t
+pmemfile_pwritev2(PMEMfilepool *pfp, PMEMfile *file,
+		const pmemfile_iovec_t *iov, int iovcnt, pmemfile_off_t offset,
+		int flags)
+{
+	if (!pfp) {
+		LOG(LUSR, "NULL pool");
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (!file) {
+		LOG(LUSR, "NULL file");
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (flags & ~PFILE_RWF_SUPPORTED) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	if (offset == -1)
+		return pmemfile_writev_flags(pfp, file, iov, iovcnt, flags);
+
+	if (offset < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return pmemfile_pwritev_flags(pfp, file, iov, iovcnt, (size_t)offset,
+			flags);
+}
@@ -0,0 +1,653 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * io_uring.c -- support for pmemfile resident files in io_uring instances
+ *
+ * The kernel knows nothing about pmemfile resident files - file descriptors
+ * handed out by libpmemfile refer to placeholder files. To make io_uring
+ * work with them, libpmemfile maps the submission queue of every io_uring
+ * instance created by the application and on each io_uring_enter scans the
+ * SQEs about to be consumed by the kernel. Requests referring to pmemfile
+ * resident files are executed right away, in submission order (pmemfile
+ * writes are synchronous, so there's nothing left to persist once the
+ * batch is done). Each such SQE is then rewritten to an IORING_OP_MSG_RING
+ * request targeting the same ring, which makes the kernel post a CQE with
+ * the result and the original user_data. IOSQE_CQE_SKIP_SUCCESS suppresses
+ * the completion of the MSG_RING request itself. All other requests are
+ * left untouched.
+ *
+ * Limitations:
+ * - rings created with IORING_SETUP_SQPOLL are not tracked - the kernel
+ *   thread consumes SQEs without calling io_uring_enter,
+ * - io_uring_enter with IORING_ENTER_REGISTERED_RING is not tracked,
+ * - pmemfile resident files can't be registered as fixed files,
+ * - pmemfile requests are executed at submission time, so they do not wait
+ *   for kernel handled requests linked before them.
+ */
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <syscall.h>
+
+#include <libsyscall_intercept_hook_point.h>
+
+#include "io_uring.h"
+#include "preload.h"
+#include "sys_util.h"
+#include "syscall_early_filter.h"
+#include "vfd_table.h"
+
+#ifndef IORING_SETUP_NO_SQARRAY
+#define IORING_SETUP_NO_SQARRAY (1U << 16)
+#endif
+
+#ifndef IORING_ENTER_REGISTERED_RING
+#define IORING_ENTER_REGISTERED_RING (1U << 4)
+#endif
+
+struct uring {
+	int fd;
+	unsigned sq_entries;
+
+	void *sq_ring;
+	size_t sq_ring_size;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array; /* NULL for IORING_SETUP_NO_SQARRAY rings */
+
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	unsigned sqe_shift; /* 1 for IORING_SETUP_SQE128 rings */
+};
+
+/*
+ * Tracked rings are indexed by fd in a two level table, covering the same fd
+ * range as the vfd table. The directory is mapped on first io_uring_setup,
+ * chunks are allocated on first use and never freed, so lookups can read
+ * them without a lock.
+ */
+#define RING_CHUNK_SHIFT 10
+#define RING_CHUNK_SIZE (1u << RING_CHUNK_SHIFT)
+
+struct ring_chunk {
+	struct uring *rings[RING_CHUNK_SIZE];
+};
+
+static struct ring_chunk **ring_chunks;
+static unsigned rings_size;
+
+/*
+ * The lock protects the table above against concurrent setup/close, so
+ * rings can't be unmapped while some thread scans them.
+ */
+static pthread_rwlock_t rings_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/*
+ * ring_slot -- returns the table slot of fd, or NULL if no ring was ever
+ * tracked in its chunk
+ */
+static struct uring **
+ring_slot(int fd)
+{
+	struct ring_chunk **chunks =
+			__atomic_load_n(&ring_chunks, __ATOMIC_ACQUIRE);
+
+	if (chunks == NULL || fd < 0 || (unsigned)fd >= rings_size)
+		return NULL;
+
+	struct ring_chunk *chunk = __atomic_load_n(
+			chunks + ((unsigned)fd >> RING_CHUNK_SHIFT),
+			__ATOMIC_ACQUIRE);
+
+	if (chunk == NULL)
+		return NULL;
+
+	return chunk->rings + ((unsigned)fd & (RING_CHUNK_SIZE - 1));
+}
+
+/*
+ * ring_slot_alloc -- same as ring_slot, but allocates the table and the chunk
+ * if needed. Must be called while holding rings_lock for writing.
+ */
+static struct uring **
+ring_slot_alloc(int fd)
+{
+	if (ring_chunks == NULL) {
+		unsigned size = pmemfile_vfd_table_size();
+		long ret = syscall_no_intercept(SYS_mmap, NULL,
+			(size >> RING_CHUNK_SHIFT) * sizeof(*ring_chunks),
+			PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+		if (syscall_error_code(ret) != 0)
+			return NULL;
+
+		rings_size = size;
+		__atomic_store_n(&ring_chunks, (struct ring_chunk **)ret,
+				__ATOMIC_RELEASE);
+	}
+
+	if (fd < 0 || (unsigned)fd >= rings_size)
+		return NULL;
+
+	struct ring_chunk **chunk = ring_chunks +
+			((unsigned)fd >> RING_CHUNK_SHIFT);
+
+	if (*chunk == NULL) {
+		struct ring_chunk *new_chunk = calloc(1, sizeof(**chunk));
+		if (new_chunk == NULL)
+			return NULL;
+
+		__atomic_store_n(chunk, new_chunk, __ATOMIC_RELEASE);
+	}
+
+	return (*chunk)->rings + ((unsigned)fd & (RING_CHUNK_SIZE - 1));
+}
+
+static void
+uring_unmap(struct uring *r)
+{
+	if (r->sqes)
+		syscall_no_intercept(SYS_munmap, r->sqes, r->sqes_size);
+	if (r->sq_ring)
+		syscall_no_intercept(SYS_munmap, r->sq_ring, r->sq_ring_size);
+
+	free(r);
+}
+
+static void *
+uring_map(int fd, size_t size, long offset)
+{
+	long ret = syscall_no_intercept(SYS_mmap, NULL, size,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			fd, offset);
+
+	if (syscall_error_code(ret) != 0)
+		return NULL;
+
+	return (void *)ret;
+}
+
+static struct uring *
+uring_new(int fd, const struct io_uring_params *params)
+{
+	struct uring *r = calloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+
+	r->fd = fd;
+	r->sq_entries = params->sq_entries;
+
+	const struct io_sqring_offsets *off = &params->sq_off;
+
+	size_t size = off->head;
+	if (off->tail > size)
+		size = off->tail;
+	if (off->ring_mask > size)
+		size = off->ring_mask;
+	size += sizeof(unsigned);
+
+	if (!(params->flags & IORING_SETUP_NO_SQARRAY))
+		size = off->array + params->sq_entries * sizeof(unsigned);
+
+	r->sq_ring_size = size;
+	r->sq_ring = uring_map(fd, size, IORING_OFF_SQ_RING);
+	if (!r->sq_ring)
+		goto err;
+
+	char *base = r->sq_ring;
+	r->sq_head = (unsigned *)(base + off->head);
+	r->sq_tail = (unsigned *)(base + off->tail);
+	r->sq_mask = (unsigned *)(base + off->ring_mask);
+	if (!(params->flags & IORING_SETUP_NO_SQARRAY))
+		r->sq_array = (unsigned *)(base + off->array);
+
+	r->sqe_shift = (params->flags & IORING_SETUP_SQE128) ? 1 : 0;
+	r->sqes_size = (params->sq_entries * sizeof(struct io_uring_sqe)) <<
+			r->sqe_shift;
+	r->sqes = uring_map(fd, r->sqes_size, IORING_OFF_SQES);
+	if (!r->sqes)
+		goto err;
+
+	return r;
+
+err:
+	uring_unmap(r);
+	return NULL;
+}
+
+/*
+ * uring_msg_ring_supported -- checks whether the kernel can execute
+ * IORING_OP_MSG_RING requests in the ring
+ *
+ * IORING_FEAT_CQE_SKIP appeared one release earlier, so it doesn't prove
+ * anything.
+ */
+static bool
+uring_msg_ring_supported(int fd)
+{
+	unsigned nr = IORING_OP_MSG_RING + 1;
+	struct io_uring_probe *probe = calloc(1, sizeof(*probe) +
+			nr * sizeof(probe->ops[0]));
+	if (!probe)
+		return false;
+
+	bool ret = false;
+	if (syscall_no_intercept(SYS_io_uring_register, fd,
+			IORING_REGISTER_PROBE, probe, nr) == 0 &&
+			probe->last_op >= IORING_OP_MSG_RING)
+		ret = (probe->ops[IORING_OP_MSG_RING].flags &
+				IO_URING_OP_SUPPORTED) != 0;
+
+	free(probe);
+	return ret;
+}
+
+/*
+ * hook_io_uring_setup -- creates io_uring instance and starts tracking it
+ */
+long
+hook_io_uring_setup(unsigned entries, void *arg)
+{
+	struct io_uring_params *params = arg;
+
+	long fd = syscall_no_intercept(SYS_io_uring_setup, entries, params);
+	if (fd < 0)
+		return fd;
+
+	if (params->flags & IORING_SETUP_SQPOLL) {
+		log_write("io_uring %ld uses SQPOLL, pmemfile resident files "
+				"are not supported in it", fd);
+		return fd;
+	}
+
+	if (!(params->features & IORING_FEAT_CQE_SKIP)) {
+		log_write("io_uring %ld: kernel does not support "
+				"IOSQE_CQE_SKIP_SUCCESS, pmemfile resident "
+				"files are not supported in it", fd);
+		return fd;
+	}
+
+	if (!uring_msg_ring_supported((int)fd)) {
+		log_write("io_uring %ld: kernel does not support "
+				"IORING_OP_MSG_RING, pmemfile resident "
+				"files are not supported in it", fd);
+		return fd;
+	}
+
+	struct uring *r = uring_new((int)fd, params);
+	if (!r) {
+		log_write("io_uring %ld: cannot map submission queue", fd);
+		return fd;
+	}
+
+	util_rwlock_wrlock(&rings_lock);
+
+	struct uring **slot = ring_slot_alloc((int)fd);
+	if (slot == NULL) {
+		util_rwlock_unlock(&rings_lock);
+		log_write("io_uring %ld: cannot track", fd);
+		uring_unmap(r);
+		return fd;
+	}
+
+	struct uring *old = *slot;
+	__atomic_store_n(slot, r, __ATOMIC_RELEASE);
+	util_rwlock_unlock(&rings_lock);
+
+	/* fd was closed in a way we didn't notice (e.g. by dup2) */
+	if (old)
+		uring_unmap(old);
+
+	return fd;
+}
+
+/*
+ * io_uring_forget -- stops tracking io_uring instance, called when fd is
+ * closed, or replaced by dup2/dup3
+ */
+void
+io_uring_forget(int fd)
+{
+	struct uring **slot = ring_slot(fd);
+
+	if (slot == NULL || __atomic_load_n(slot, __ATOMIC_ACQUIRE) == NULL)
+		return;
+
+	util_rwlock_wrlock(&rings_lock);
+	struct uring *r = *slot;
+	__atomic_store_n(slot, NULL, __ATOMIC_RELEASE);
+	util_rwlock_unlock(&rings_lock);
+
+	if (r)
+		uring_unmap(r);
+}
+
+/*
+ * io_uring_forget_range -- stops tracking io_uring instances with fds from
+ * first to last (inclusive), called on close_range
+ */
+void
+io_uring_forget_range(unsigned first, unsigned last)
+{
+	if (__atomic_load_n(&ring_chunks, __ATOMIC_ACQUIRE) == NULL ||
+	    first >= rings_size)
+		return;
+
+	if (last >= rings_size)
+		last = rings_size - 1;
+
+	util_rwlock_wrlock(&rings_lock);
+
+	unsigned fd = first;
+	while (fd <= last) {
+		struct ring_chunk *chunk =
+				ring_chunks[fd >> RING_CHUNK_SHIFT];
+		unsigned chunk_end = (fd | (RING_CHUNK_SIZE - 1));
+		if (chunk_end > last)
+			chunk_end = last;
+
+		for (; chunk != NULL && fd <= chunk_end; ++fd) {
+			struct uring **slot = chunk->rings +
+					(fd & (RING_CHUNK_SIZE - 1));
+			struct uring *r = *slot;
+
+			if (r) {
+				__atomic_store_n(slot, NULL, __ATOMIC_RELEASE);
+				uring_unmap(r);
+			}
+		}
+
+		if (chunk_end == last)
+			break;
+		fd = chunk_end + 1;
+	}
+
+	util_rwlock_unlock(&rings_lock);
+}
+
+/*
+ * uring_op_uses_file -- returns true for opcodes, which operate on the file
+ * referred to by sqe->fd, and which can be executed by libpmemfile
+ */
+static bool
+uring_op_uses_file(__u8 opcode)
+{
+	switch (opcode) {
+	case IORING_OP_READV:
+	case IORING_OP_WRITEV:
+	case IORING_OP_READ_FIXED:
+	case IORING_OP_WRITE_FIXED:
+	case IORING_OP_READ:
+	case IORING_OP_WRITE:
+	case IORING_OP_FSYNC:
+	case IORING_OP_SYNC_FILE_RANGE:
+	case IORING_OP_FALLOCATE:
+	case IORING_OP_FADVISE:
+	case IORING_OP_CLOSE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * uring_rw -- executes read/write request using the same code path as
+ * the corresponding syscall
+ */
+static long
+uring_rw(const struct io_uring_sqe *sqe, struct vfd_reference *file,
+		bool write, bool vectored)
+{
+	struct iovec iov;
+	long iovp;
+	long iovcnt;
+
+	if (vectored) {
+		iovp = (long)sqe->addr;
+		iovcnt = (long)sqe->len;
+	} else {
+		iov.iov_base = (void *)(uintptr_t)sqe->addr;
+		iov.iov_len = sqe->len;
+		iovp = (long)&iov;
+		iovcnt = 1;
+	}
+
+	/* offset -1 means "use and update the file offset" */
+	return fd_first_syscall(write ? SYS_pwritev2 : SYS_preadv2, file,
+			iovp, iovcnt, (long)sqe->off, 0, (long)sqe->rw_flags);
+}
+
+/*
+ * uring_execute -- executes request referring to pmemfile resident file
+ */
+static long
+uring_execute(const struct io_uring_sqe *sqe, struct vfd_reference *file)
+{
+	switch (sqe->opcode) {
+	case IORING_OP_READV:
+		return uring_rw(sqe, file, false, true);
+	case IORING_OP_WRITEV:
+		return uring_rw(sqe, file, true, true);
+	case IORING_OP_READ_FIXED:
+	case IORING_OP_READ:
+		return uring_rw(sqe, file, false, false);
+	case IORING_OP_WRITE_FIXED:
+	case IORING_OP_WRITE:
+		return uring_rw(sqe, file, true, false);
+	case IORING_OP_FSYNC:
+		return fd_first_syscall(SYS_fsync, file, 0, 0, 0, 0, 0);
+	case IORING_OP_SYNC_FILE_RANGE:
+		/* pmemfile writes are synchronous */
+		return 0;
+	case IORING_OP_FALLOCATE:
+		return fd_first_syscall(SYS_fallocate, file, (long)sqe->len,
+				(long)sqe->off, (long)sqe->addr, 0, 0);
+	case IORING_OP_FADVISE:
+		return fd_first_syscall(SYS_fadvise64, file, (long)sqe->off,
+				(long)sqe->len, (long)sqe->fadvise_advice, 0, 0);
+	case IORING_OP_CLOSE:
+		return pmemfile_vfd_close(sqe->fd);
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * uring_complete -- replaces sqe with a request posting a CQE with
+ * the result of the original request
+ */
+static void
+uring_complete(const struct uring *r, struct io_uring_sqe *sqe, long res)
+{
+	__u64 user_data = sqe->user_data;
+	__u8 flags = sqe->flags &
+		(IOSQE_IO_LINK | IOSQE_IO_HARDLINK | IOSQE_IO_DRAIN);
+
+	memset(sqe, 0, sizeof(*sqe));
+
+	sqe->opcode = IORING_OP_MSG_RING;
+	sqe->flags = flags | IOSQE_CQE_SKIP_SUCCESS;
+	sqe->fd = r->fd;
+	sqe->addr = IORING_MSG_DATA;
+	sqe->len = (__u32)(int)res;
+	sqe->off = user_data;
+	sqe->user_data = user_data;
+}
+
+/*
+ * uring_scan -- executes all pmemfile requests among those which will be
+ * consumed by the kernel
+ */
+static void
+uring_scan(const struct uring *r, unsigned to_submit)
+{
+	unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+	unsigned tail = __atomic_load_n(r->sq_tail, __ATOMIC_ACQUIRE);
+	unsigned mask = *r->sq_mask;
+
+	unsigned count = tail - head;
+	if (count > to_submit)
+		count = to_submit;
+
+	for (unsigned i = 0; i < count; ++i) {
+		unsigned idx = (head + i) & mask;
+		if (r->sq_array)
+			idx = r->sq_array[idx];
+
+		/* the kernel will report an invalid index */
+		if (idx >= r->sq_entries)
+			continue;
+
+		struct io_uring_sqe *sqe = &r->sqes[idx << r->sqe_shift];
+
+		if (sqe->flags & IOSQE_FIXED_FILE)
+			continue;
+
+		if (!uring_op_uses_file(sqe->opcode))
+			continue;
+
+		struct vfd_reference file = pmemfile_vfd_ref(sqe->fd);
+
+		if (file.pool != NULL) {
+			long res = uring_execute(sqe, &file);
+			uring_complete(r, sqe, res);
+		}
+
+		pmemfile_vfd_unref(file);
+	}
+}
+
+/*
+ * hook_io_uring_enter -- handles pmemfile requests and forwards the call
+ * to the kernel
+ */
+long
+hook_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+		unsigned flags, long sig, long sigsz)
+{
+	struct uring **slot = NULL;
+
+	if (to_submit > 0 && !(flags & IORING_ENTER_REGISTERED_RING))
+		slot = ring_slot(fd);
+
+	if (slot != NULL && __atomic_load_n(slot, __ATOMIC_ACQUIRE) != NULL) {
+		util_rwlock_rdlock(&rings_lock);
+
+		struct uring *r = *slot;
+		if (r)
+			uring_scan(r, to_submit);
+
+		util_rwlock_unlock(&rings_lock);
+	}
+
+	return syscall_no_intercept(SYS_io_uring_enter, fd, to_submit,
+			min_complete, flags, sig, sigsz);
+}
+
+/*
+ * uring_check_fds -- returns -ENOTSUP if any of fds refers to a pmemfile
+ * resident file
+ */
+static long
+uring_check_fds(const __s32 *fds, unsigned nr)
+{
+	if (!fds)
+		return 0;
+
+	for (unsigned i = 0; i < nr; ++i) {
+		if (fds[i] < 0)
+			continue;
+
+		struct vfd_reference file = pmemfile_vfd_ref(fds[i]);
+		bool pmemfile_file = file.pool != NULL;
+		pmemfile_vfd_unref(file);
+
+		if (pmemfile_file)
+			return -ENOTSUP;
+	}
+
+	return 0;
+}
+
+/*
+ * hook_io_uring_register -- refuses to register pmemfile resident files
+ * as fixed files, forwards everything else to the kernel
+ */
+long
+hook_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+	long ret = 0;
+
+	if (arg == NULL)
+		goto forward;
+
+	switch (opcode) {
+	case IORING_REGISTER_FILES:
+		ret = uring_check_fds(arg, nr_args);
+		break;
+	case IORING_REGISTER_FILES_UPDATE: {
+		struct io_uring_files_update *up = arg;
+		ret = uring_check_fds((const __s32 *)(uintptr_t)up->fds,
+				nr_args);
+		break;
+	}
+	case IORING_REGISTER_FILES2: {
+		struct io_uring_rsrc_register *rr = arg;
+		ret = uring_check_fds((const __s32 *)(uintptr_t)rr->data,
+				rr->nr);
+		break;
+	}
+	case IORING_REGISTER_FILES_UPDATE2: {
+		struct io_uring_rsrc_update2 *up = arg;
+		ret = uring_check_fds((const __s32 *)(uintptr_t)up->data,
+				up->nr);
+		break;
+	}
+	}
+
+	if (ret)
+		return ret;
+
+forward:
+	return syscall_no_intercept(SYS_io_uring_register, fd, opcode, arg,
+			nr_args);
+}
@@ -140,6 +140,36 @@ fd_first_pmemfile_pwritev(struct vfd_reference *file,
 		(pmemfile_off_t)offset);
 }
 
+static inline pmemfile_ssize_t
+fd_first_pmemfile_preadv2(struct vfd_reference *file,
+		long iov,
+		long iovcnt,
+		long offset,
+		long flags)
+{
+	assert(!file->pool->suspended);
+	return wrapper_pmemfile_preadv2(file->pool->pool, file->file,
+		(const pmemfile_iovec_t *)iov,
+		(int)iovcnt,
+		(pmemfile_off_t)offset,
+		(int)flags);
+}
+
+static inline pmemfile_ssize_t
+fd_first_pmemfile_pwritev2(struct vfd_reference *file,
+		long iov,
+		long iovcnt,
+		long offset,
+		long flags)
+{
+	assert(!file->pool->suspended);
+	return wrapper_pmemfile_pwritev2(file->pool->pool, file->file,
+		(const pmemfile_iovec_t *)iov,
+		(int)iovcnt,
+		(pmemfile_off_t)offset,
+		(int)flags);
+}
+
 static inline pmemfile_off_t
 fd_first_pmemfile_lseek(struct vfd_reference *file,
 		long offset,
@@ -224,6 +254,19 @@ fd_first_pmemfile_fallocate(struct vfd_reference *file,
 		(pmemfile_off_t)length);
 }
 
+static inline int
+fd_first_pmemfile_fadvise(struct vfd_reference *file,
+		long offset,
+		long len,
+		long advice)
+{
+	assert(!file->pool->suspended);
+	return wrapper_pmemfile_fadvise(file->pool->pool, file->file,
+		(pmemfile_off_t)offset,
+		(pmemfile_off_t)len,
+		(int)advice);
+}
+
 static inline int
 fd_first_pmemfile_flock(struct vfd_reference *file,
 		long operation)
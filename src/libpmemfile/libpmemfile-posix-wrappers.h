@@ -75,6 +75,61 @@ wrapper_pmemfile_pool_create(const char *pathname,
 	return ret;
 }
 
+static inline PMEMfilepool *
+wrapper_pmemfile_pool_xcreate(const char *pathname,
+		size_t poolsize,
+		pmemfile_mode_t mode,
+		uint64_t flags)
+{
+	PMEMfilepool *ret;
+
+	ret = pmemfile_pool_xcreate(pathname,
+		poolsize,
+		mode,
+		flags);
+
+	log_write(
+	    "pmemfile_pool_xcreate(\"%s\", %zu, %3jo, 0x%" PRIx64 ") = %p",
+		pathname,
+		poolsize,
+		(uintmax_t)mode,
+		flags,
+		ret);
+
+	return ret;
+}
+
+static inline PMEMfilepool *
+wrapper_pmemfile_pool_xcreate_classes(const char *pathname,
+		size_t poolsize,
+		pmemfile_mode_t mode,
+		uint64_t flags,
+		const struct pmemfile_block_class *classes,
+		unsigned nclasses)
+{
+	PMEMfilepool *ret;
+
+	ret = pmemfile_pool_xcreate_classes(pathname,
+		poolsize,
+		mode,
+		flags,
+		classes,
+		nclasses);
+
+	log_write(
+	    "pmemfile_pool_xcreate_classes(\"%s\", %zu, %3jo, 0x%" PRIx64
+	    ", %p, %u) = %p",
+		pathname,
+		poolsize,
+		(uintmax_t)mode,
+		flags,
+		classes,
+		nclasses,
+		ret);
+
+	return ret;
+}
+
 static inline PMEMfilepool *
 wrapper_pmemfile_pool_open(const char *pathname)
 {
@@ -573,6 +628,70 @@ wrapper_pmemfile_pwritev(PMEMfilepool *pfp,
 	return ret;
 }
 
+static inline pmemfile_ssize_t
+wrapper_pmemfile_preadv2(PMEMfilepool *pfp,
+		PMEMfile *file,
+		const pmemfile_iovec_t *iov,
+		int iovcnt,
+		pmemfile_off_t offset,
+		int flags)
+{
+	pmemfile_ssize_t ret;
+
+	ret = pmemfile_preadv2(pfp,
+		file,
+		iov,
+		iovcnt,
+		offset,
+		flags);
+	if (ret < 0)
+		ret = -errno;
+
+	log_write(
+	    "pmemfile_preadv2(%p, %p, %p, %d, %jx, %d) = %zd",
+		pfp,
+		file,
+		iov,
+		iovcnt,
+		(uintmax_t)offset,
+		flags,
+		ret);
+
+	return ret;
+}
+
+static inline pmemfile_ssize_t
+wrapper_pmemfile_pwritev2(PMEMfilepool *pfp,
+		PMEMfile *file,
+		const pmemfile_iovec_t *iov,
+		int iovcnt,
+		pmemfile_off_t offset,
+		int flags)
+{
+	pmemfile_ssize_t ret;
+
+	ret = pmemfile_pwritev2(pfp,
+		file,
+		iov,
+		iovcnt,
+		offset,
+		flags);
+	if (ret < 0)
+		ret = -errno;
+
+	log_write(
+	    "pmemfile_pwritev2(%p, %p, %p, %d, %jx, %d) = %zd",
+		pfp,
+		file,
+		iov,
+		iovcnt,
+		(uintmax_t)offset,
+		flags,
+		ret);
+
+	return ret;
+}
+
 static inline pmemfile_off_t
 wrapper_pmemfile_lseek(PMEMfilepool *pfp,
 		PMEMfile *file,
@@ -1754,6 +1873,29 @@ wrapper_pmemfile_stats(PMEMfilepool *pfp,
 		stats);
 }
 
+static inline int
+wrapper_pmemfile_runtime_stats(PMEMfilepool *pfp,
+		struct pmemfile_runtime_stats *stats,
+		size_t size)
+{
+	int ret;
+
+	ret = pmemfile_runtime_stats(pfp,
+		stats,
+		size);
+	if (ret < 0)
+		ret = -errno;
+
+	log_write(
+	    "pmemfile_runtime_stats(%p, %p, %zu) = %d",
+		pfp,
+		stats,
+		size,
+		ret);
+
+	return ret;
+}
+
 static inline int
 wrapper_pmemfile_statfs(PMEMfilepool *pfp,
 		pmemfile_statfs_t *buf)
@@ -1875,6 +2017,35 @@ wrapper_pmemfile_posix_fallocate(PMEMfilepool *pfp,
 	return ret;
 }
 
+static inline int
+wrapper_pmemfile_fadvise(PMEMfilepool *pfp,
+		PMEMfile *file,
+		pmemfile_off_t offset,
+		pmemfile_off_t len,
+		int advice)
+{
+	int ret;
+
+	ret = pmemfile_fadvise(pfp,
+		file,
+		offset,
+		len,
+		advice);
+	if (ret < 0)
+		ret = -errno;
+
+	log_write(
+	    "pmemfile_fadvise(%p, %p, %jx, %jx, %d) = %d",
+		pfp,
+		file,
+		(uintmax_t)offset,
+		(uintmax_t)len,
+		advice,
+		ret);
+
+	return ret;
+}
+
 static inline char *
 wrapper_pmemfile_get_dir_path(PMEMfilepool *pfp,
 		PMEMfile *dir,
@@ -1977,6 +2148,234 @@ wrapper_pmemfile_pool_suspend(PMEMfilepool *pfp)
 	return ret;
 }
 
+static inline PMEMfileaioctx *
+wrapper_pmemfile_aio_setup(PMEMfilepool *pfp,
+		unsigned entries)
+{
+	PMEMfileaioctx *ret;
+
+	ret = pmemfile_aio_setup(pfp,
+		entries);
+
+	log_write(
+	    "pmemfile_aio_setup(%p, %u) = %p",
+		pfp,
+		entries,
+		ret);
+
+	return ret;
+}
+
+static inline int
+wrapper_pmemfile_aio_submit(PMEMfileaioctx *ctx,
+		const struct pmemfile_aio_sqe *sqes,
+		unsigned nr)
+{
+	int ret;
+
+	ret = pmemfile_aio_submit(ctx,
+		sqes,
+		nr);
+	if (ret < 0)
+		ret = -errno;
+
+	log_write(
+	    "pmemfile_aio_submit(%p, %p, %u) = %d",
+		ctx,
+		sqes,
+		nr,
+		ret);
+
+	return ret;
+}
+
+static inline int
+wrapper_pmemfile_aio_reap(PMEMfileaioctx *ctx,
+		struct pmemfile_aio_cqe *cqes,
+		unsigned min_nr,
+		unsigned max_nr)
+{
+	int ret;
+
+	ret = pmemfile_aio_reap(ctx,
+		cqes,
+		min_nr,
+		max_nr);
+	if (ret < 0)
+		ret = -errno;
+
+	log_write(
+	    "pmemfile_aio_reap(%p, %p, %u, %u) = %d",
+		ctx,
+		cqes,
+		min_nr,
+		max_nr,
+		ret);
+
+	return ret;
+}
+
+static inline int
+wrapper_pmemfile_aio_eventfd(PMEMfileaioctx *ctx)
+{
+	int ret;
+
+	ret = pmemfile_aio_eventfd(ctx);
+	if (ret < 0)
+		ret = -errno;
+
+	log_write(
+	    "pmemfile_aio_eventfd(%p) = %d",
+		ctx,
+		ret);
+
+	return ret;
+}
+
+static inline void
+wrapper_pmemfile_aio_destroy(PMEMfileaioctx *ctx)
+{
+	log_write(
+	    "pmemfile_aio_destroy(%p)",
+		ctx);
+
+	pmemfile_aio_destroy(ctx);
+}
+
+static inline PMEMfilebatch *
+wrapper_pmemfile_batch_begin(PMEMfilepool *pfp)
+{
+	PMEMfilebatch *ret;
+
+	ret = pmemfile_batch_begin(pfp);
+
+	log_write(
+	    "pmemfile_batch_begin(%p) = %p",
+		pfp,
+		ret);
+
+	return ret;
+}
+
+static inline int
+wrapper_pmemfile_batch_create(PMEMfilebatch *batch,
+		const char *path,
+		pmemfile_mode_t mode)
+{
+	int ret;
+
+	ret = pmemfile_batch_create(batch,
+		path,
+		mode);
+	if (ret < 0)
+		ret = -errno;
+
+	log_write(
+	    "pmemfile_batch_create(%p, \"%s\", %3jo) = %d",
+		batch,
+		path,
+		(uintmax_t)mode,
+		ret);
+
+	return ret;
+}
+
+static inline int
+wrapper_pmemfile_batch_mkdir(PMEMfilebatch *batch,
+		const char *path,
+		pmemfile_mode_t mode)
+{
+	int ret;
+
+	ret = pmemfile_batch_mkdir(batch,
+		path,
+		mode);
+	if (ret < 0)
+		ret = -errno;
+
+	log_write(
+	    "pmemfile_batch_mkdir(%p, \"%s\", %3jo) = %d",
+		batch,
+		path,
+		(uintmax_t)mode,
+		ret);
+
+	return ret;
+}
+
+static inline int
+wrapper_pmemfile_batch_unlink(PMEMfilebatch *batch,
+		const char *path)
+{
+	int ret;
+
+	ret = pmemfile_batch_unlink(batch,
+		path);
+	if (ret < 0)
+		ret = -errno;
+
+	log_write(
+	    "pmemfile_batch_unlink(%p, \"%s\") = %d",
+		batch,
+		path,
+		ret);
+
+	return ret;
+}
+
+static inline int
+wrapper_pmemfile_batch_rename(PMEMfilebatch *batch,
+		const char *old_path,
+		const char *new_path)
+{
+	int ret;
+
+	ret = pmemfile_batch_rename(batch,
+		old_path,
+		new_path);
+	if (ret < 0)
+		ret = -errno;
+
+	log_write(
+	    "pmemfile_batch_rename(%p, \"%s\", \"%s\") = %d",
+		batch,
+		old_path,
+		new_path,
+		ret);
+
+	return ret;
+}
+
+static inline int
+wrapper_pmemfile_batch_commit(PMEMfilebatch *batch,
+		int *errors)
+{
+	int ret;
+
+	ret = pmemfile_batch_commit(batch,
+		errors);
+	if (ret < 0)
+		ret = -errno;
+
+	log_write(
+	    "pmemfile_batch_commit(%p, %p) = %d",
+		batch,
+		errors,
+		ret);
+
+	return ret;
+}
+
+static inline void
+wrapper_pmemfile_batch_abort(PMEMfilebatch *batch)
+{
+	log_write(
+	    "pmemfile_batch_abort(%p)",
+		batch);
+
+	pmemfile_batch_abort(batch);
+}
+
 static inline int
 wrapper_pmemfile_flock(PMEMfilepool *pfp,
 		PMEMfile *file,
@@ -35,11 +35,14 @@
  * XXX: clean up this whole file, and add some more explanations.
  */
 
+#define _GNU_SOURCE
+
 #include <assert.h>
 #include <stdbool.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <syscall.h>
 #include <sys/stat.h>
 #include <errno.h>
@@ -49,17 +52,324 @@
 #include "libpmemfile-posix.h"
 
 #include "preload.h"
+#include "sys_util.h"
+
+/*
+ * Paths are resolved one component at a time, and every component is
+ * stat-ed. Stat-ing the whole prefix each time would make the kernel (or
+ * libpmemfile-posix) walk it again from the start, so resolving a path of
+ * depth d would cost O(d^2) lookups. Instead, the resolver keeps a cursor -
+ * an intermediate directory it opened (O_PATH fd, or PMEMfile in a pool) -
+ * and stats only the part of the path following it.
+ *
+ * Inside of a pool the cursor moves with every directory, as pmemfile lookups
+ * are cheap compared to walking the prefix. In the kernel, opening a directory
+ * costs two syscalls (openat and close) while walking a component of the
+ * prefix is cheap, so the cursor moves only every KERNEL_CURSOR_STEP
+ * directories.
+ *
+ * The cursor is an implementation detail - result->path is always relative to
+ * result->at_kernel / result->at_dir, as if it wasn't there.
+ */
+#define POOL_CURSOR_STEP 1
+#define KERNEL_CURSOR_STEP 8
+
+struct resolve_cursor {
+	/* directory opened by the resolver, -1 / NULL if there's none */
+	long kernel_fd;
+	struct pool_description *pool;
+	PMEMfile *file;
+
+	/* offset in result->path of the part relative to the cursor */
+	size_t off;
+
+	/* number of directories between the cursor and off */
+	unsigned depth;
+};
+
+static void
+cursor_init(struct resolve_cursor *c)
+{
+	c->kernel_fd = -1;
+	c->pool = NULL;
+	c->file = NULL;
+	c->off = 0;
+	c->depth = 0;
+}
+
+/*
+ * cursor_reset - closes the directory opened by the resolver, following
+ * lookups are relative to result->at_kernel / result->at_dir again
+ */
+static void
+cursor_reset(struct resolve_cursor *c)
+{
+	if (c->kernel_fd >= 0)
+		syscall_no_intercept(SYS_close, c->kernel_fd);
+
+	if (c->file) {
+		pool_acquire(c->pool);
+		pmemfile_close(c->pool->pool, c->file);
+		pool_release(c->pool);
+	}
+
+	cursor_init(c);
+}
+
+static long
+cursor_kernel_fd(const struct resolved_path *result,
+		const struct resolve_cursor *c)
+{
+	return c->kernel_fd >= 0 ? c->kernel_fd : result->at_kernel;
+}
+
+static PMEMfile *
+cursor_dir(const struct resolved_path *result, const struct resolve_cursor *c)
+{
+	return c->file ? c->file : result->at_dir;
+}
+
+/*
+ * cursor_advance - notes that the component ending at "end" is a directory,
+ * and opens it if enough of them piled up behind the cursor
+ *
+ * The "next" argument is the offset of the component following it. Failure to
+ * open the directory is not an error, lookups just stay relative to the old
+ * cursor.
+ */
+static void
+cursor_advance(struct resolved_path *result, struct resolve_cursor *c,
+		size_t end, size_t next)
+{
+	unsigned step = result->at_pool ? POOL_CURSOR_STEP : KERNEL_CURSOR_STEP;
+
+	if (++c->depth < step)
+		return;
+
+	c->depth = 0;
+
+	char saved = result->path[end];
+	result->path[end] = '\0';
+
+	const char *rel = result->path + c->off;
+
+	if (result->at_pool == NULL) {
+		long fd = syscall_no_intercept(SYS_openat,
+				cursor_kernel_fd(result, c), rel,
+				O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+		if (fd >= 0) {
+			cursor_reset(c);
+			c->kernel_fd = fd;
+			c->off = next;
+		}
+	} else {
+		struct pool_description *pool = result->at_pool;
+		int oerrno = errno;
+
+		pool_acquire(pool);
+		PMEMfile *file = pmemfile_openat(pool->pool,
+				cursor_dir(result, c), rel,
+				PMEMFILE_O_PATH | PMEMFILE_O_DIRECTORY |
+				PMEMFILE_O_NOFOLLOW);
+		pool_release(pool);
+
+		errno = oerrno;
+
+		if (file) {
+			cursor_reset(c);
+			c->pool = pool;
+			c->file = file;
+			c->off = next;
+		}
+	}
+
+	result->path[end] = saved;
+}
+
+/*
+ * The path cache remembers canonical kernel directories - absolute paths
+ * without symlinks, "." or ".." components, and without mount points along
+ * the way - which the resolver already walked. An absolute path whose parent
+ * directory is in the cache can't lead into a pmemfile pool, unless its last
+ * component does. That leaves one string lookup, and for syscalls following
+ * the last symlink one stat of the whole path, instead of a stat for every
+ * component of it.
+ *
+ * The cache can't notice other processes modifying the directory tree, e.g.
+ * replacing a cached directory with a symlink into a pool, so it is disabled
+ * unless PMEMFILE_PRELOAD_PATH_CACHE is set to 1. It is flushed whenever this
+ * process renames or removes a directory, or changes the mounts or its root
+ * directory. Entries added concurrently with such a
+ * flush are dropped, as the resolver inserts entries only if the generation
+ * counter didn't change since it started.
+ */
+#define PATH_CACHE_SLOTS 256
+#define PATH_CACHE_MAX_LEN 256
+
+struct path_cache_entry {
+	bool valid;
+	size_t len;
+	char path[PATH_CACHE_MAX_LEN];
+};
+
+static struct path_cache_entry path_cache[PATH_CACHE_SLOTS];
+static pthread_rwlock_t path_cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+static uint64_t path_cache_generation;
+static bool path_cache_enabled;
+
+/*
+ * path_cache_init -- enables the cache when env is set to "1"
+ */
+void
+path_cache_init(const char *env)
+{
+	if (env && env[0] == '1')
+		path_cache_enabled = true;
+}
+
+static size_t
+path_cache_slot(const char *path, size_t len)
+{
+	/* FNV-1a */
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= (unsigned char)path[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return (size_t)(hash % PATH_CACHE_SLOTS);
+}
+
+static uint64_t
+path_cache_gen(void)
+{
+	return __atomic_load_n(&path_cache_generation, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * path_cache_lookup -- checks whether the first len characters of path are
+ * a directory in the cache. The root directory is stored as an empty string.
+ */
+static bool
+path_cache_lookup(const char *path, size_t len)
+{
+	if (len >= PATH_CACHE_MAX_LEN)
+		return false;
+
+	struct path_cache_entry *e = &path_cache[path_cache_slot(path, len)];
+	bool found;
+
+	util_rwlock_rdlock(&path_cache_lock);
+	found = e->valid && e->len == len && memcmp(e->path, path, len) == 0;
+	util_rwlock_unlock(&path_cache_lock);
+
+	return found;
+}
+
+/*
+ * path_cache_insert -- adds a directory to the cache, unless the cache was
+ * flushed after generation gen was read
+ */
+static void
+path_cache_insert(const char *path, size_t len, uint64_t gen)
+{
+	if (len >= PATH_CACHE_MAX_LEN)
+		return;
+
+	struct path_cache_entry *e = &path_cache[path_cache_slot(path, len)];
+
+	util_rwlock_wrlock(&path_cache_lock);
+	if (path_cache_generation == gen) {
+		memcpy(e->path, path, len);
+		e->len = len;
+		e->valid = true;
+	}
+	util_rwlock_unlock(&path_cache_lock);
+}
+
+/*
+ * path_cache_invalidate -- forgets all directories, called after any change
+ * to the kernel's directory tree which could turn a cached directory into
+ * something else
+ */
+void
+path_cache_invalidate(void)
+{
+	if (!path_cache_enabled)
+		return;
+
+	util_rwlock_wrlock(&path_cache_lock);
+	__atomic_add_fetch(&path_cache_generation, 1, __ATOMIC_RELEASE);
+	for (size_t i = 0; i < PATH_CACHE_SLOTS; ++i)
+		path_cache[i].valid = false;
+	util_rwlock_unlock(&path_cache_lock);
+}
+
+/*
+ * resolve_cached - resolves an absolute path whose parent directory is in the
+ * path cache. Returns false if the path must be resolved the slow way.
+ */
+static bool
+resolve_cached(struct vfd_reference at, const char *path,
+		struct resolved_path *result, int flags)
+{
+	if (!path_cache_enabled || path == NULL || path[0] != '/')
+		return false;
+
+	size_t len = strnlen(path, sizeof(result->path));
+
+	/* too long paths and trailing slashes are left for the slow path */
+	if (len == sizeof(result->path) || path[len - 1] == '/')
+		return false;
+
+	size_t dir_len = len - 1;
+	while (path[dir_len] != '/')
+		--dir_len;
+
+	if (!path_cache_lookup(path, dir_len))
+		return false;
+
+	result->error_code = 0;
+
+	if ((flags & RESOLVE_LAST_SLINK_MASK) != NO_RESOLVE_LAST_SLINK) {
+		struct stat stat_buf;
+
+		long r = syscall_no_intercept(SYS_newfstatat, AT_FDCWD, path,
+				&stat_buf, AT_SYMLINK_NOFOLLOW);
+
+		if (r != 0) {
+			result->error_code = r;
+		} else if (S_ISLNK(stat_buf.st_mode)) {
+			return false;
+		} else if (S_ISDIR(stat_buf.st_mode) &&
+				lookup_pd_by_inode(&stat_buf) != NULL) {
+			return false;
+		}
+	}
+
+	result->at_kernel = at.kernel_fd;
+	result->at_pool = NULL;
+	result->at_dir = at.file;
+	memcpy(result->path, path, len + 1);
+
+	return true;
+}
 
 /*
  * get_stat - stat equivalent, fills a struct stat by asking
  * either the kernel, or libpmemfile-posix.
  */
 static int
-get_stat(struct resolved_path *result, struct stat *buf)
+get_stat(struct resolved_path *result, const struct resolve_cursor *c,
+		struct stat *buf)
 {
+	const char *rel = result->path + c->off;
+
 	if (result->at_pool == NULL) {
 		long error_code = syscall_no_intercept(SYS_newfstatat,
-					result->at_kernel, result->path,
+					cursor_kernel_fd(result, c), rel,
 					buf, AT_SYMLINK_NOFOLLOW);
 		if (error_code == 0) {
 			return 0;
@@ -71,7 +381,7 @@ get_stat(struct resolved_path *result, struct stat *buf)
 		pool_acquire(result->at_pool);
 
 		int r = pmemfile_fstatat(result->at_pool->pool,
-					result->at_dir, result->path,
+					cursor_dir(result, c), rel,
 					(pmemfile_stat_t *)buf,
 					AT_SYMLINK_NOFOLLOW);
 
@@ -95,7 +405,7 @@ get_stat(struct resolved_path *result, struct stat *buf)
  * replaced.
  */
 static void
-resolve_symlink(struct resolved_path *result,
+resolve_symlink(struct resolved_path *result, struct resolve_cursor *c,
 		size_t *resolved, size_t *end, size_t *size,
 		bool *is_last_component)
 {
@@ -106,8 +416,8 @@ resolve_symlink(struct resolved_path *result,
 
 	if (result->at_pool == NULL) {
 		link_len = syscall_no_intercept(SYS_readlinkat,
-			result->at_kernel,
-			result->path,
+			cursor_kernel_fd(result, c),
+			result->path + c->off,
 			link_buf,
 			sizeof(link_buf) - 1);
 
@@ -119,8 +429,8 @@ resolve_symlink(struct resolved_path *result,
 		pool_acquire(result->at_pool);
 
 		link_len = pmemfile_readlinkat(result->at_pool->pool,
-				result->at_dir,
-				result->path,
+				cursor_dir(result, c),
+				result->path + c->off,
 				link_buf,
 				sizeof(link_buf) - 1);
 
@@ -218,8 +528,11 @@ resolve_symlink(struct resolved_path *result,
 	*size = postfix_insert + postfix_len - 1;
 	*resolved = link_insert;
 
-	if (link_buf[0] == '/')
+	/* the part of the path behind the cursor is gone */
+	if (link_buf[0] == '/') {
 		result->at_pool = NULL;
+		cursor_reset(c);
+	}
 }
 
 /*
@@ -228,9 +541,12 @@ resolve_symlink(struct resolved_path *result,
  *
  */
 static void
-enter_pool(struct resolved_path *result, struct pool_description *pool,
+enter_pool(struct resolved_path *result, struct resolve_cursor *c,
+		struct pool_description *pool,
 		size_t *resolved, size_t end, size_t *size)
 {
+	cursor_reset(c);
+
 	memmove(result->path, result->path + end, *size - end);
 	result->path[0] = '/';
 	result->at_pool = pool;
@@ -254,19 +570,27 @@ enter_pool(struct resolved_path *result, struct pool_description *pool,
  * E.g.: after referring a ".." entry at the root of a pmemfile pool.
  */
 static void
-exit_pool(struct resolved_path *result, size_t resolved, size_t *size)
+exit_pool(struct resolved_path *result, struct resolve_cursor *c,
+		size_t *resolved, size_t *size)
 {
+	cursor_reset(c);
+
 	result->at_kernel = result->at_pool->fd;
 	result->at_pool = NULL;
-	memmove(result->path, result->path + resolved, *size - resolved + 1);
-	*size -= resolved;
+	memmove(result->path, result->path + *resolved,
+			*size - *resolved + 1);
+	*size -= *resolved;
+
+	/* the ".." is now relative to the mount point */
+	*resolved = 0;
 }
 
 static void
 _resolve_path(struct vfd_reference at,
 			const char *path,
 			struct resolved_path *result,
-			int flags)
+			int flags,
+			struct resolve_cursor *cursor)
 {
 	if (path == NULL) {
 		result->error_code = -EFAULT;
@@ -286,7 +610,7 @@ _resolve_path(struct vfd_reference at,
 	result->path[0] = '.';
 	result->path[1] = 0;
 
-	if (get_stat(result, &stat_buf) != 0)
+	if (get_stat(result, cursor, &stat_buf) != 0)
 		return;
 
 	bool at_pmem_root = at.pool &&
@@ -320,6 +644,14 @@ _resolve_path(struct vfd_reference at,
 	int num_symlinks = 0;
 	struct pool_description *last_pool = NULL;
 
+	/*
+	 * Is the path resolved so far a canonical kernel directory, which can
+	 * be put in the path cache?
+	 */
+	uint64_t cache_gen = path_cache_gen();
+	bool canonical = path_cache_enabled && path[0] == '/' &&
+			strspn(path, "/") == 1;
+
 	/*
 	 * XXX
 	 * Path resolution needs more tests.
@@ -345,13 +677,17 @@ _resolve_path(struct vfd_reference at,
 
 		bool is_last_component = (result->path[end] == '\0');
 
+		if (is_last_component && canonical)
+			path_cache_insert(result->path, resolved - 1,
+					cache_gen);
+
 		if (is_last_component && ((flags & RESOLVE_LAST_SLINK_MASK) ==
 						NO_RESOLVE_LAST_SLINK))
 			break;
 
 		result->path[end] = '\0';
 
-		if (get_stat(result, &stat_buf) != 0)
+		if (get_stat(result, cursor, &stat_buf) != 0)
 			break;
 
 		if (!is_last_component)
@@ -365,7 +701,7 @@ _resolve_path(struct vfd_reference at,
 		if (at_pmem_root && (end - resolved) == 2 &&
 				memcmp(&result->path[resolved], "..", 2) == 0) {
 			last_pool = result->at_pool;
-			exit_pool(result, resolved, &size);
+			exit_pool(result, cursor, &resolved, &size);
 			at_pmem_root = false;
 			continue;
 		}
@@ -373,7 +709,8 @@ _resolve_path(struct vfd_reference at,
 		at_pmem_root = false;
 
 		if (S_ISLNK(stat_buf.st_mode)) {
-			resolve_symlink(result,
+			canonical = false;
+			resolve_symlink(result, cursor,
 				&resolved, &end, &size, &is_last_component);
 			num_symlinks++;
 			/*
@@ -400,7 +737,9 @@ _resolve_path(struct vfd_reference at,
 					result->error_code = -EIO;
 					return;
 				}
-				enter_pool(result, pool, &resolved, end, &size);
+				enter_pool(result, cursor, pool, &resolved, end,
+						&size);
+				canonical = false;
 				at_pmem_root = true;
 				continue;
 			}
@@ -409,8 +748,19 @@ _resolve_path(struct vfd_reference at,
 				at_pmem_root = true;
 		}
 
+		if (result->path[resolved] == '.' && (end - resolved == 1 ||
+		    (end - resolved == 2 && result->path[resolved + 1] == '.')))
+			canonical = false;
+
 		for (resolved = end; result->path[resolved] == '/'; ++resolved)
 			;
+
+		/* cache entries are matched as strings, e.g.: no "a//b" */
+		if (resolved - end > 1)
+			canonical = false;
+
+		if (!is_last_component)
+			cursor_advance(result, cursor, end, resolved);
 	}
 
 	if (last_component_is_dir && result->path[size - 1] != '/') {
@@ -457,12 +807,20 @@ resolve_path(struct vfd_reference at,
 			struct resolved_path *result,
 			int flags)
 {
+	if (resolve_cached(at, path, result, flags))
+		return;
+
 	struct pool_description *pool = at.pool;
 
 	if (pool)
 		pool_acquire(pool);
 
-	_resolve_path(at, path, result, flags);
+	struct resolve_cursor cursor;
+	cursor_init(&cursor);
+
+	_resolve_path(at, path, result, flags, &cursor);
+
+	cursor_reset(&cursor);
 
 	if (pool)
 		pool_release(pool);
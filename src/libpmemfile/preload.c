@@ -75,6 +75,7 @@
 #include "libsyscall_intercept_hook_point.h"
 #include "libpmemfile-posix.h"
 #include "sys_util.h"
+#include "io_uring.h"
 #include "preload.h"
 #include "syscall_early_filter.h"
 
@@ -118,24 +119,50 @@ log_write(const char *fmt, ...)
 	syscall_no_intercept(SYS_write, log_fd, buf, len);
 }
 
+/*
+ * Serializes chdir and fchdir. Readers of the cwd don't take it, they get
+ * a reference to the cwd entry via pmemfile_vfd_at_ref(AT_FDCWD).
+ */
 static pthread_mutex_t cwd_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static struct pool_description pools[0x100];
 static int pool_count;
 
-#define PMEMFILE_MAX_FD 0x8000
+/*
+ * pool_ref_get_fast -- increments ref_cnt if the pool is already in use by
+ * another thread, which means it is resumed
+ */
+static inline bool
+pool_ref_get_fast(struct pool_description *pool)
+{
+	int cnt = __atomic_load_n(&pool->ref_cnt, __ATOMIC_RELAXED);
 
-#ifndef RWF_HIPRI
-#define RWF_HIPRI 0x00000001
-#endif
+	while (cnt > 0) {
+		if (__atomic_compare_exchange_n(&pool->ref_cnt, &cnt, cnt + 1,
+				false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return true;
+	}
 
-#ifndef RWF_DSYNC
-#define RWF_DSYNC 0x00000002
-#endif
+	return false;
+}
 
-#ifndef RWF_SYNC
-#define RWF_SYNC 0x00000004
-#endif
+/*
+ * pool_ref_put_fast -- decrements ref_cnt if the calling thread is not the
+ * last one using the pool
+ */
+static inline bool
+pool_ref_put_fast(struct pool_description *pool)
+{
+	int cnt = __atomic_load_n(&pool->ref_cnt, __ATOMIC_RELAXED);
+
+	while (cnt > 1) {
+		if (__atomic_compare_exchange_n(&pool->ref_cnt, &cnt, cnt - 1,
+				false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			return true;
+	}
+
+	return false;
+}
 
 /*
  * pool_acquire -- acquires access to pool
@@ -146,13 +173,21 @@ pool_acquire(struct pool_description *pool)
 	if (!process_switching)
 		return;
 
+	if (pool_ref_get_fast(pool))
+		return;
+
 	util_mutex_lock(&pool->process_switching_lock);
-	pool->ref_cnt++;
 
-	if (pool->ref_cnt == 1 && pool->suspended) {
-		if (pmemfile_pool_resume(pool->pool, pool->poolfile_path))
-			FATAL("could not restore pmemfile pool");
-		pool->suspended = false;
+	/* someone else could have resumed the pool in the meantime */
+	if (!pool_ref_get_fast(pool)) {
+		if (pool->suspended) {
+			if (pmemfile_pool_resume(pool->pool,
+					pool->poolfile_path))
+				FATAL("could not restore pmemfile pool");
+			pool->suspended = false;
+		}
+
+		__atomic_store_n(&pool->ref_cnt, 1, __ATOMIC_RELEASE);
 	}
 
 	util_mutex_unlock(&pool->process_switching_lock);
@@ -167,12 +202,19 @@ pool_release(struct pool_description *pool)
 	if (!process_switching)
 		return;
 
+	if (pool_ref_put_fast(pool))
+		return;
+
 	int oerrno = errno;
 
 	util_mutex_lock(&pool->process_switching_lock);
-	pool->ref_cnt--;
 
-	if (pool->ref_cnt == 0 && !pool->suspended) {
+	/*
+	 * Other threads can still take and drop references on the fast path,
+	 * so whoever drops the last one under the lock suspends the pool.
+	 */
+	if (__atomic_sub_fetch(&pool->ref_cnt, 1, __ATOMIC_ACQ_REL) == 0) {
+		assert(!pool->suspended);
 		if (pmemfile_pool_suspend(pool->pool))
 			FATAL("could not suspend pmemfile pool");
 		pool->suspended = true;
@@ -183,14 +225,6 @@ pool_release(struct pool_description *pool)
 	errno = oerrno;
 }
 
-/*
- * A separate place to keep track of fds used to hold mount points open, in
- * the previous array. The application should not be aware of these, thus
- * whenever these file descriptors are encountered during interposing, -EBADF
- * must be returned. The contents of this array does not change after startup.
- */
-static bool mount_point_fds[PMEMFILE_MAX_FD + 1];
-
 static int exit_on_ENOTSUP;
 static long check_errno(long e, long syscall_no)
 {
@@ -232,27 +266,45 @@ static size_t page_size;
 
 static bool validate_pointers;
 
+/*
+ * Pointers are validated by reading one byte of every page they span using
+ * process_vm_readv on the process itself. It fails with EFAULT instead of
+ * raising SIGSEGV, and checks up to PROBE_BATCH pages in a single syscall.
+ * When process_vm_readv is not available (e.g. filtered by seccomp), the
+ * slower method of writing the buffer to a pipe is used.
+ */
+#define PROBE_BATCH 64
+
+static bool use_process_vm_readv = true;
+static long self_pid;
+
+static void
+validate_pointers_atfork_child(void)
+{
+	self_pid = syscall_no_intercept(SYS_getpid);
+}
+
 static void
 initialize_validate_pointers(void)
 {
 	const char *env_str = getenv("PMEMFILE_PRELOAD_VALIDATE_POINTERS");
 	if (env_str)
 		validate_pointers = env_str[0] == '1';
+
+	if (!validate_pointers)
+		return;
+
+	self_pid = syscall_no_intercept(SYS_getpid);
+	pthread_atfork(NULL, NULL, validate_pointers_atfork_child);
 }
 
 /*
- * returns true when [buf, buf+len] is accessible
+ * probe_pages_pipe -- returns true when [ptr, ptr+len) is readable, checked
+ * by writing it to a pipe
  */
 static bool
-is_accessible(const void *ptr, size_t len)
+probe_pages_pipe(const void *ptr, size_t len)
 {
-	if (!validate_pointers)
-		return true;
-	if (len == 0)
-		return true;
-	if (!ptr)
-		return false;
-
 	int pipes[2];
 	bool ret = true;
 
@@ -289,6 +341,78 @@ end:
 	return ret;
 }
 
+/*
+ * probe_pages -- returns true when [ptr, ptr+len) is readable
+ */
+static bool
+probe_pages(const void *ptr, size_t len)
+{
+	uintptr_t addr = (uintptr_t)ptr;
+	uintptr_t last = addr + len - 1;
+
+	if (last < addr)
+		return false;
+
+	while (use_process_vm_readv) {
+		char bytes[PROBE_BATCH];
+		struct iovec local = {bytes, 0};
+		struct iovec remote[PROBE_BATCH];
+		unsigned long cnt = 0;
+		uintptr_t batch = addr;
+
+		/* the first byte of ptr and of every following page */
+		while (cnt < PROBE_BATCH) {
+			remote[cnt].iov_base = (void *)addr;
+			remote[cnt].iov_len = 1;
+			cnt++;
+
+			uintptr_t next = (addr | (page_size - 1)) + 1;
+			if (next == 0 || next > last) {
+				addr = 0;
+				break;
+			}
+			addr = next;
+		}
+
+		local.iov_len = cnt;
+
+		long r = syscall_no_intercept(SYS_process_vm_readv, self_pid,
+				&local, 1, remote, cnt, 0);
+
+		if (r == -ENOSYS || r == -EPERM) {
+			log_write("process_vm_readv failure %ld", r);
+			use_process_vm_readv = false;
+			addr = batch;
+			break;
+		}
+
+		/* a fault on any page after the first one ends the read */
+		if (r != (long)cnt)
+			return false;
+
+		if (addr == 0)
+			return true;
+	}
+
+	return probe_pages_pipe((const void *)addr, last - addr + 1);
+}
+
+/*
+ * returns true when [buf, buf+len] is accessible
+ */
+static bool
+is_accessible(const void *ptr, size_t len)
+{
+	if (!validate_pointers)
+		return true;
+	if (len == 0)
+		return true;
+	if (!ptr)
+		return false;
+
+	return probe_pages(ptr, len);
+}
+
 /*
  * returns true when null terminated string str is accessible
  */
@@ -300,41 +424,18 @@ is_str_accessible(const char *str)
 	if (!str)
 		return false;
 
-	int pipes[2];
-	bool ret;
+	/* check page by page, stopping at the page with the terminator */
+	for (;;) {
+		size_t in_page = page_size - ((uintptr_t)str & (page_size - 1));
 
-	long r = syscall_no_intercept(SYS_pipe, pipes);
-	if (r < 0) {
-		log_write("pipe failure %ld", r);
-		return true;
-	}
-
-	while (1) {
-		r = syscall_no_intercept(SYS_write, pipes[1], str, 1);
-		if (r == -EFAULT) {
-			ret = false;
-			goto end;
-		}
+		if (!probe_pages(str, 1))
+			return false;
 
-		if (r != 1) {
-			errno = -(int)r;
-			FATAL("!write to pipe returned unexpected value");
-		}
+		if (memchr(str, 0, in_page) != NULL)
+			return true;
 
-		if (*str == 0) {
-			ret = true;
-			goto end;
-		}
-
-		char c;
-		(void) syscall_no_intercept(SYS_read, pipes[0], &c, 1);
-		str++;
+		str += in_page;
 	}
-
-end:
-	syscall_no_intercept(SYS_close, pipes[0]);
-	syscall_no_intercept(SYS_close, pipes[1]);
-	return ret;
 }
 
 static int
@@ -461,6 +562,9 @@ hook_unlinkat(int fd, const char *path, long flags)
 		/* Not pmemfile resident path */
 		ret = syscall_no_intercept(SYS_unlinkat,
 				where.at_kernel, where.path, flags);
+
+		if (ret == 0 && (flags & AT_REMOVEDIR))
+			path_cache_invalidate();
 	} else {
 		pool_acquire(where.at_pool);
 
@@ -562,13 +666,11 @@ hook_pool_getcwd(struct pool_description *pool, char *buf, size_t size)
 static long
 hook_getcwd(char *buf, size_t size)
 {
-	util_mutex_lock(&cwd_mutex);
 	struct vfd_reference at = pmemfile_vfd_at_ref(AT_FDCWD);
 
 	long result = hook_pool_getcwd(at.pool, buf, size);
 
 	pmemfile_vfd_unref(at);
-	util_mutex_unlock(&cwd_mutex);
 
 	return result;
 }
@@ -899,6 +1001,9 @@ hook_renameat2(int fd_old, const char *path_old, int fd_new,
 			    where_old.at_kernel, where_old.path,
 			    where_new.at_kernel, where_new.path, flags);
 		}
+
+		if (ret == 0)
+			path_cache_invalidate();
 	} else {
 		pool_acquire(where_old.at_pool);
 
@@ -1493,14 +1598,12 @@ hook_execveat(int fd, const char *path, char *const argv[],
 		struct execvat_desc desc = {
 		    .argv = argv, .envp = envp, .flags = flags, };
 
-		util_mutex_lock(&cwd_mutex);
 		struct vfd_reference cwd = pmemfile_vfd_at_ref(AT_FDCWD);
 
 		if (process_switching && cwd.pool != NULL)
 			ret = hook_execveat_vfdref(cwd.pool, &desc);
 
 		pmemfile_vfd_unref(cwd);
-		util_mutex_unlock(&cwd_mutex);
 
 		if (ret == 0)
 			ret = syscall_no_intercept(SYS_execveat,
@@ -1873,6 +1976,44 @@ hook_bind(int sockfd, const struct sockaddr *addr, socklen_t addrlen)
 	return ret;
 }
 
+/*
+ * hook_dup2 -- an io_uring instance at new_fd is closed by dup2, so it must
+ * not be tracked anymore - the fd number now refers to another file
+ */
+static long
+hook_dup2(int old_fd, int new_fd)
+{
+	long ret = pmemfile_vfd_dup2(old_fd, new_fd);
+
+	if (ret >= 0 && old_fd != new_fd)
+		io_uring_forget(new_fd);
+
+	return ret;
+}
+
+static long
+hook_dup3(int old_fd, int new_fd, int flags)
+{
+	long ret = pmemfile_vfd_dup3(old_fd, new_fd, flags);
+
+	if (ret >= 0)
+		io_uring_forget(new_fd);
+
+	return ret;
+}
+
+static long
+hook_close_range(unsigned first, unsigned last, unsigned flags)
+{
+	long ret = pmemfile_vfd_close_range(first, last, flags);
+
+	/* just like dup2, forget rings only if their fds are really gone */
+	if (ret == 0 && first <= last && !(flags & CLOSE_RANGE_CLOEXEC))
+		io_uring_forget_range(first, last);
+
+	return ret;
+}
+
 static long
 hook_statfs(const char *path, struct statfs *buf)
 {
@@ -1995,8 +2136,20 @@ dispatch_syscall(long syscall_number,
 				(pmemfile_stat_t *)arg2, arg3);
 
 	case SYS_close:
+		io_uring_forget((int)arg0);
 		return pmemfile_vfd_close((int)arg0);
 
+	case SYS_io_uring_setup:
+		return hook_io_uring_setup((unsigned)arg0, (void *)arg1);
+
+	case SYS_io_uring_enter:
+		return hook_io_uring_enter((int)arg0, (unsigned)arg1,
+				(unsigned)arg2, (unsigned)arg3, arg4, arg5);
+
+	case SYS_io_uring_register:
+		return hook_io_uring_register((int)arg0, (unsigned)arg1,
+				(void *)arg2, (unsigned)arg3);
+
 	case SYS_mmap:
 		return hook_mmap(arg0, arg1, arg2, arg3, (int)arg4, arg5);
 
@@ -2101,7 +2254,17 @@ dispatch_syscall(long syscall_number,
 	 * resident, -ENOTSUP is returned, otherwise, the call is forwarded
 	 * to the kernel.
 	 */
-	case SYS_chroot:
+	case SYS_chroot: {
+		long ret = nosup_syscall_with_path(syscall_number,
+		    (const char *)arg0, RESOLVE_LAST_SLINK,
+		    arg1, arg2, arg3, arg4, arg5);
+
+		if (ret == 0)
+			path_cache_invalidate();
+
+		return ret;
+	}
+
 	case SYS_listxattr:
 	case SYS_removexattr:
 		return nosup_syscall_with_path(syscall_number,
@@ -2166,10 +2329,14 @@ dispatch_syscall(long syscall_number,
 		return pmemfile_vfd_dup((int)arg0);
 
 	case SYS_dup2:
-		return pmemfile_vfd_dup2((int)arg0, (int)arg1);
+		return hook_dup2((int)arg0, (int)arg1);
 
 	case SYS_dup3:
-		return pmemfile_vfd_dup3((int)arg0, (int)arg1, (int)arg2);
+		return hook_dup3((int)arg0, (int)arg1, (int)arg2);
+
+	case SYS_close_range:
+		return hook_close_range((unsigned)arg0, (unsigned)arg1,
+				(unsigned)arg2);
 
 	case SYS_statfs:
 		return hook_statfs((const char *)arg0, (struct statfs *)arg1);
@@ -2237,10 +2404,6 @@ dispatch_syscall_fd_first(long syscall_number,
 		return fd_first_pmemfile_pwrite(arg0, arg1, arg2, arg3);
 	}
 
-	case SYS_preadv2:
-		if (arg4 & ~(RWF_DSYNC | RWF_HIPRI | RWF_SYNC))
-			return -EINVAL;
-		/* fallthrough */
 	case SYS_preadv: {
 		int ret;
 		if ((ret = verify_iovec(arg1, arg2)))
@@ -2248,10 +2411,19 @@ dispatch_syscall_fd_first(long syscall_number,
 
 		return fd_first_pmemfile_preadv(arg0, arg1, arg2, arg3);
 	}
-	case SYS_pwritev2:
-		if (arg4 & ~(RWF_DSYNC | RWF_HIPRI | RWF_SYNC))
-			return -EINVAL;
-		/* fallthrough */
+
+	/*
+	 * On 64 bit architectures arg4 (high part of offset) is ignored
+	 * and arg5 contains flags.
+	 */
+	case SYS_preadv2: {
+		int ret;
+		if ((ret = verify_iovec(arg1, arg2)))
+			return ret;
+
+		return fd_first_pmemfile_preadv2(arg0, arg1, arg2, arg3, arg5);
+	}
+
 	case SYS_pwritev: {
 		int ret;
 		if ((ret = verify_iovec(arg1, arg2)))
@@ -2260,6 +2432,14 @@ dispatch_syscall_fd_first(long syscall_number,
 		return fd_first_pmemfile_pwritev(arg0, arg1, arg2, arg3);
 	}
 
+	case SYS_pwritev2: {
+		int ret;
+		if ((ret = verify_iovec(arg1, arg2)))
+			return ret;
+
+		return fd_first_pmemfile_pwritev2(arg0, arg1, arg2, arg3, arg5);
+	}
+
 	case SYS_getdents: {
 		if (!is_accessible((void *)arg1, (size_t)arg2))
 			return -EFAULT;
@@ -2292,6 +2472,13 @@ dispatch_syscall_fd_first(long syscall_number,
 	case SYS_fallocate:
 		return fd_first_pmemfile_fallocate(arg0, arg1, arg2, arg3);
 
+	case SYS_fadvise64:
+		return fd_first_pmemfile_fadvise(arg0, arg1, arg2, arg3);
+
+	case SYS_readahead:
+		return fd_first_pmemfile_fadvise(arg0, arg1, arg2,
+				PMEMFILE_POSIX_FADV_WILLNEED);
+
 	case SYS_fstat: {
 		if (!is_accessible((void *)arg1, sizeof(struct stat)))
 			return -EFAULT;
@@ -2435,6 +2622,38 @@ lookup_pd_by_inode(struct stat *stat)
 	return NULL;
 }
 
+/*
+ * fd_first_syscall -- handles a syscall whose first argument is an fd
+ * referring to a pmemfile resident file. The caller holds a reference to
+ * the file.
+ */
+long
+fd_first_syscall(long syscall_number, struct vfd_reference *file,
+			long arg1, long arg2, long arg3, long arg4, long arg5)
+{
+	struct syscall_early_filter_entry filter_entry;
+	filter_entry = get_early_filter_entry(syscall_number);
+
+	assert(filter_entry.fd_first_arg);
+
+	if (filter_entry.returns_zero)
+		return 0;
+
+	if (filter_entry.returns_ENOTSUP)
+		return check_errno(-ENOTSUP, syscall_number);
+
+	pool_acquire(file->pool);
+
+	long ret = dispatch_syscall_fd_first(syscall_number, file,
+			arg1, arg2, arg3, arg4, arg5);
+
+	ret = check_errno(ret, syscall_number);
+
+	pool_release(file->pool);
+
+	return ret;
+}
+
 /*
  * Return values expected by libsyscall_intercept:
  * A non-zero return value if it should execute the syscall,
@@ -2457,12 +2676,21 @@ hook(const struct syscall_early_filter_entry *filter_entry, long syscall_number,
 	}
 
 	if (syscall_number == SYS_fchdir) {
-		util_mutex_unlock(&cwd_mutex);
+		util_mutex_lock(&cwd_mutex);
 		*syscall_return_value = pmemfile_vfd_fchdir((int)arg0);
 		util_mutex_unlock(&cwd_mutex);
 		return HOOKED;
 	}
 
+	if (syscall_number == SYS_mount || syscall_number == SYS_umount2 ||
+	    syscall_number == SYS_pivot_root) {
+		/* these might change what the cached kernel paths refer to */
+		*syscall_return_value = syscall_no_intercept(syscall_number,
+			arg0, arg1, arg2, arg3, arg4);
+		path_cache_invalidate();
+		return HOOKED;
+	}
+
 	if (syscall_number == SYS_getcwd) {
 		*syscall_return_value = hook_getcwd((char *)arg0, (size_t)arg1);
 		return HOOKED;
@@ -2488,24 +2716,14 @@ hook(const struct syscall_early_filter_entry *filter_entry, long syscall_number,
 	if (filter_entry->fd_first_arg) {
 		struct vfd_reference file = pmemfile_vfd_ref((int)arg0);
 
-		if (file.pool == NULL) {
+		if (file.pool == NULL && file.kernel_fd != (int)arg0) {
+			/* a placeholder fd, unknown to the application */
+			*syscall_return_value = -EBADF;
+		} else if (file.pool == NULL) {
 			is_hooked = NOT_HOOKED;
-		} else if (filter_entry->returns_zero) {
-			*syscall_return_value = 0;
-		} else if (filter_entry->returns_ENOTSUP) {
-			*syscall_return_value =
-			    check_errno(-ENOTSUP, syscall_number);
 		} else {
-			pool_acquire(file.pool);
-
-			*syscall_return_value =
-			    dispatch_syscall_fd_first(syscall_number,
+			*syscall_return_value = fd_first_syscall(syscall_number,
 			    &file, arg1, arg2, arg3, arg4, arg5);
-
-			*syscall_return_value =
-			    check_errno(*syscall_return_value, syscall_number);
-
-			pool_release(file.pool);
 		}
 
 		pmemfile_vfd_unref(file);
@@ -2651,8 +2869,7 @@ parse_pool_path(struct pool_description *pool, const char *conf)
 }
 
 /*
- * open_mount_point - Grab a file descriptor for the mount point, and mark it
- * in the mount_point_fds table.
+ * open_mount_point - Grab a file descriptor for the mount point.
  */
 static void
 open_mount_point(struct pool_description *pool)
@@ -2665,13 +2882,6 @@ open_mount_point(struct pool_description *pool)
 			"invalid pmemfile config: cannot open mount point");
 	}
 
-	if ((size_t)pool->fd >= ARRAY_SIZE(mount_point_fds)) {
-		exit_with_msg(PMEMFILE_PRELOAD_EXIT_TOO_MANY_FDS,
-				"mount point fd too large");
-	}
-
-	mount_point_fds[pool->fd] = true;
-
 	if (syscall_no_intercept(SYS_fstat, pool->fd, &pool->stat) != 0) {
 		config_error(
 			"invalid pmemfile config: cannot fstat mount point");
@@ -2970,6 +3180,11 @@ pmemfile_preload_constructor(void)
 
 	initialize_validate_pointers();
 
+	path_cache_init(getenv("PMEMFILE_PRELOAD_PATH_CACHE"));
+
+	pmemfile_vfd_fd_pool_init(getenv("PMEMFILE_PRELOAD_FD_POOL"),
+			getenv("PMEMFILE_PRELOAD_FD_POOL_SYNC"));
+
 	env_str = getenv("PMEMFILE_PRELOAD_PAUSE_AT_START");
 	if (env_str && env_str[0] == '1') {
 		pause_at_start = 1;
@@ -85,6 +85,12 @@ struct pool_description {
 	 */
 	struct pmemfilepool *pool;
 
+	/*
+	 * Process switching state. ref_cnt is the number of threads using
+	 * the pool. It is changed atomically while it stays above zero,
+	 * the 0 <-> 1 transitions (resuming and suspending the pool) are
+	 * done under process_switching_lock.
+	 */
 	pthread_mutex_t process_switching_lock;
 	int ref_cnt;
 	bool suspended;
@@ -122,9 +128,15 @@ void resolve_path(struct vfd_reference at,
 			struct resolved_path *result,
 			int flags);
 
+void path_cache_init(const char *env);
+void path_cache_invalidate(void);
+
 pf_printf_like(1, 2) void log_write(const char *fmt, ...);
 
 void pool_acquire(struct pool_description *pool);
 void pool_release(struct pool_description *pool);
 
+long fd_first_syscall(long syscall_number, struct vfd_reference *file,
+			long arg1, long arg2, long arg3, long arg4, long arg5);
+
 #endif
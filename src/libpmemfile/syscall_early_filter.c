@@ -58,6 +58,9 @@ static struct syscall_early_filter_entry filter_table[] = {
 	[SYS_close] = {
 		.must_handle = true,
 	},
+	[SYS_close_range] = {
+		.must_handle = true,
+	},
 	[SYS_creat] = {
 		.must_handle = true,
 	},
@@ -67,7 +70,6 @@ static struct syscall_early_filter_entry filter_table[] = {
 	[SYS_fadvise64] = {
 		.must_handle = true,
 		.fd_first_arg = true,
-		.returns_zero = true,
 	},
 	[SYS_fallocate] = {
 		.must_handle = true,
@@ -147,6 +149,15 @@ static struct syscall_early_filter_entry filter_table[] = {
 	[SYS_getxattr] = {
 		.must_handle = true,
 	},
+	[SYS_io_uring_enter] = {
+		.must_handle = true,
+	},
+	[SYS_io_uring_register] = {
+		.must_handle = true,
+	},
+	[SYS_io_uring_setup] = {
+		.must_handle = true,
+	},
 	[SYS_lchown] = {
 		.must_handle = true,
 	},
@@ -218,6 +229,10 @@ static struct syscall_early_filter_entry filter_table[] = {
 		.must_handle = true,
 		.fd_first_arg = true,
 	},
+	[SYS_readahead] = {
+		.must_handle = true,
+		.fd_first_arg = true,
+	},
 	[SYS_readlinkat] = {
 		.must_handle = true,
 	},
@@ -367,11 +382,6 @@ static struct syscall_early_filter_entry filter_table[] = {
 	[SYS_name_to_handle_at] = {
 		.must_handle = true,
 	},
-	[SYS_readahead] = {
-		.must_handle = true,
-		.fd_first_arg = true,
-		.returns_ENOTSUP = true,
-	},
 	[SYS_removexattr] = {
 		.must_handle = true,
 	},
@@ -381,6 +391,17 @@ static struct syscall_early_filter_entry filter_table[] = {
 	[SYS_splice] = {
 		.must_handle = true,
 	},
+
+	/* Forwarded to the kernel, but invalidate the path cache */
+	[SYS_mount] = {
+		.must_handle = true,
+	},
+	[SYS_pivot_root] = {
+		.must_handle = true,
+	},
+	[SYS_umount2] = {
+		.must_handle = true,
+	},
 };
 
 struct syscall_early_filter_entry
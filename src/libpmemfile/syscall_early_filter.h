@@ -142,4 +142,20 @@ struct syscall_early_filter_entry get_early_filter_entry(long syscall_number);
 #define SYS_pwritev2 328
 #endif
 
+#ifndef SYS_io_uring_setup
+#define SYS_io_uring_setup 425
+#endif
+
+#ifndef SYS_io_uring_enter
+#define SYS_io_uring_enter 426
+#endif
+
+#ifndef SYS_io_uring_register
+#define SYS_io_uring_register 427
+#endif
+
+#ifndef SYS_close_range
+#define SYS_close_range 436
+#endif
+
 #endif
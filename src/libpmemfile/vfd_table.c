@@ -35,13 +35,17 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <fcntl.h>
+#include <stdlib.h>
 #include <syscall.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 
 #include <libsyscall_intercept_hook_point.h>
 #include <libpmemfile-posix.h>
 
 #include "sys_util.h"
 #include "preload.h"
+#include "syscall_early_filter.h"
 
 struct vfile_description {
 	struct pool_description *pool;
@@ -49,6 +53,9 @@ struct vfile_description {
 	int kernel_cwd_fd;
 	bool is_special_cwd_desc;
 	int ref_count;
+
+	/* link in the free list, not touched by lock-free readers */
+	struct vfile_description *next_free;
 };
 
 static void
@@ -70,18 +77,141 @@ vf_ref_count_dec_and_fetch(struct vfile_description *entry)
 	return __atomic_sub_fetch(&entry->ref_count, 1, __ATOMIC_ACQ_REL);
 }
 
+/*
+ * vf_ref_count_inc_not_zero -- increases the ref count, unless it already
+ * dropped to zero, i.e. the entry is free, or is about to be freed.
+ */
+static bool
+vf_ref_count_inc_not_zero(struct vfile_description *entry)
+{
+	int count = __atomic_load_n(&entry->ref_count, __ATOMIC_ACQUIRE);
+
+	do {
+		if (count == 0)
+			return false;
+	} while (!__atomic_compare_exchange_n(&entry->ref_count, &count,
+			count + 1, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	return true;
+}
+
+/*
+ * init_entry -- initializes a free entry with a single reference.
+ *
+ * Readers holding a stale pointer to the entry might look at its ref count at
+ * any time, but they never touch an entry with a zero ref count, so the ref
+ * count is published last.
+ */
+static void
+init_entry(struct vfile_description *entry, struct pool_description *pool,
+		PMEMfile *file, int kernel_cwd_fd, bool is_special_cwd_desc)
+{
+	assert(__atomic_load_n(&entry->ref_count, __ATOMIC_RELAXED) == 0);
+
+	entry->pool = pool;
+	entry->file = file;
+	entry->kernel_cwd_fd = kernel_cwd_fd;
+	entry->is_special_cwd_desc = is_special_cwd_desc;
+	__atomic_store_n(&entry->ref_count, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * The entry describing the current working directory. It is replaced while
+ * holding vfd_table_mutex, but read without it, the same way as the entries
+ * in the vfd table (see get_fdcwd_reference).
+ */
 static struct vfile_description *cwd_entry;
-static struct vfile_description *vfd_table[0x8000];
 
+/*
+ * replace_cwd_entry -- publishes a new cwd entry, returns the old one, whose
+ * reference is now owned by the caller
+ * Must be called while holding vfd_table_mutex.
+ */
+static struct vfile_description *
+replace_cwd_entry(struct vfile_description *entry)
+{
+	struct vfile_description *old = cwd_entry;
+
+	__atomic_store_n(&cwd_entry, entry, __ATOMIC_RELEASE);
+
+	return old;
+}
+
+/*
+ * The vfd table is a two level table: a directory of pointers to chunks of
+ * VFD_CHUNK_SIZE entry pointers each. The directory covers all fds allowed by
+ * the hard RLIMIT_NOFILE limit at startup, and is an anonymous mapping, so
+ * the parts covering unused fd ranges are never backed by memory. Chunks are
+ * allocated on first use, and are never freed, so lookups can read them
+ * without a lock.
+ */
+#define VFD_CHUNK_SHIFT 10
+#define VFD_CHUNK_SIZE (1u << VFD_CHUNK_SHIFT)
+
+/* the default, and the minimum, if the limit is lower */
+#define VFD_TABLE_MIN_SIZE 0x8000u
+
+/* the highest possible value of /proc/sys/fs/nr_open */
+#define VFD_TABLE_MAX_SIZE (1u << 30)
+
+struct vfd_chunk {
+	struct vfile_description *entries[VFD_CHUNK_SIZE];
+};
+
+static struct vfd_chunk **vfd_chunks;
+static unsigned vfd_table_size;
+
+/*
+ * Marks placeholder fds waiting in the fd pool (see below) in the vfd table.
+ * The application doesn't know about these fds, so lookups treat them as
+ * invalid fds. It is never referenced or freed.
+ */
+static struct vfile_description fd_pool_entry;
+
+static void fd_pool_forget(int fd);
+static void fd_pool_forget_range(unsigned first, unsigned last);
+
+/*
+ * The vfd_table_mutex serializes modifications of the vfd_table (and of the
+ * cwd_entry pointer). Lookups of vfds don't take it: pmemfile_vfd_ref loads
+ * a pointer from the table, takes a reference unless the ref count already
+ * dropped to zero, and checks the table still holds the same pointer.
+ *
+ * This works because vfile_description entries are never unmapped, they are
+ * only recycled through the free list - a stale pointer always points to
+ * a valid ref count. An entry stored in the table always has a non-zero ref
+ * count, as the table owns one reference to it. Thus writers must remove an
+ * entry from the table before dropping the table's reference.
+ */
 static pthread_mutex_t vfd_table_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * map_anon -- allocates zeroed memory directly from the kernel, without
+ * going through malloc
+ */
+static void *
+map_anon(size_t size, int flags)
+{
+	long addr = syscall_no_intercept(SYS_mmap, NULL, size,
+			PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+
+	if (addr < 0 && addr > -4096)
+		return NULL;
+
+	return (void *)addr;
+}
+
 /*
  * The fetch_free_file_slot and mark_as_free_file_slot functions can be
  * used to allocate, and deallocate vfile_description entries.
  *
+ * Entries are allocated in batches, when the free list runs empty, and are
+ * never returned to the system, see the comment at vfd_table_mutex.
  */
-static struct vfile_description *free_vfile_slots[ARRAY_SIZE(vfd_table)];
-static unsigned free_slot_count;
+#define FREE_SLOT_BATCH_SIZE 0x10000
+
+static struct vfile_description *free_vfile_slots;
 static pthread_mutex_t free_vfile_slot_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static void
@@ -89,13 +219,32 @@ mark_as_free_file_slot(struct vfile_description *entry)
 {
 	util_mutex_lock(&free_vfile_slot_mutex);
 
-	assert(entry->ref_count == 0);
+	assert(__atomic_load_n(&entry->ref_count, __ATOMIC_RELAXED) == 0);
 
-	free_vfile_slots[free_slot_count++] = entry;
+	entry->next_free = free_vfile_slots;
+	free_vfile_slots = entry;
 
 	util_mutex_unlock(&free_vfile_slot_mutex);
 }
 
+/*
+ * alloc_free_slots -- fills the free list with a new batch of entries.
+ * Must be called while holding free_vfile_slot_mutex.
+ */
+static void
+alloc_free_slots(void)
+{
+	struct vfile_description *store = map_anon(FREE_SLOT_BATCH_SIZE, 0);
+
+	if (store == NULL)
+		return;
+
+	for (size_t i = 0; i < FREE_SLOT_BATCH_SIZE / sizeof(*store); ++i) {
+		store[i].next_free = free_vfile_slots;
+		free_vfile_slots = store + i;
+	}
+}
+
 static struct vfile_description *
 fetch_free_file_slot(void)
 {
@@ -103,57 +252,141 @@ fetch_free_file_slot(void)
 
 	util_mutex_lock(&free_vfile_slot_mutex);
 
-	if (free_slot_count == 0)
-		entry = NULL;
-	else
-		entry = free_vfile_slots[--free_slot_count];
+	if (free_vfile_slots == NULL)
+		alloc_free_slots();
+
+	entry = free_vfile_slots;
+	if (entry != NULL)
+		free_vfile_slots = entry->next_free;
 
 	util_mutex_unlock(&free_vfile_slot_mutex);
 
 	return entry;
 }
 
+static void unref_entry(struct vfile_description *entry);
+static void release_entry(struct vfile_description *entry);
+
 /*
- * setup_free_slots -- fills the free list with pointers to vfile_description
- * entries, allocated in BSS.
- * Must be called during startup.
+ * is_in_vfd_table_range -- check if the number can be used as an index
+ * for the vfd_table.
  */
-static void
-setup_free_slots(void)
+static bool
+is_in_vfd_table_range(int number)
 {
-	static struct vfile_description store[ARRAY_SIZE(free_vfile_slots) - 1];
+	return (number >= 0) && ((unsigned)number < vfd_table_size);
+}
 
-	for (unsigned i = 0; i < ARRAY_SIZE(store); ++i)
-		mark_as_free_file_slot(store + i);
+/*
+ * vfd_slot -- returns a pointer to the table slot of vfd, or NULL if the
+ * vfd is out of range, or its chunk was never allocated - i.e. the vfd was
+ * never handled by pmemfile.
+ */
+static struct vfile_description **
+vfd_slot(int vfd)
+{
+	if (!is_in_vfd_table_range(vfd))
+		return NULL;
+
+	struct vfd_chunk *chunk = __atomic_load_n(
+			vfd_chunks + ((unsigned)vfd >> VFD_CHUNK_SHIFT),
+			__ATOMIC_ACQUIRE);
+
+	if (chunk == NULL)
+		return NULL;
+
+	return chunk->entries + ((unsigned)vfd & (VFD_CHUNK_SIZE - 1));
 }
 
-static struct vfd_reference
-pmemfile_ref_vfd_under_mutex(int vfd)
+/*
+ * vfd_slot_alloc -- same as vfd_slot, but allocates the chunk if needed.
+ * Must be called while holding vfd_table_mutex.
+ */
+static struct vfile_description **
+vfd_slot_alloc(int vfd)
 {
-	struct vfile_description *entry = vfd_table[vfd];
+	if (!is_in_vfd_table_range(vfd))
+		return NULL;
 
-	if (entry == NULL) {
-		/*
-		 * Return a vfd_reference with the field called internal
-		 * set to NULL.
-		 */
-		return (struct vfd_reference) {.kernel_fd = vfd, };
+	struct vfd_chunk **chunk = vfd_chunks +
+			((unsigned)vfd >> VFD_CHUNK_SHIFT);
+
+	if (*chunk == NULL) {
+		struct vfd_chunk *new_chunk = map_anon(sizeof(**chunk), 0);
+
+		if (new_chunk == NULL)
+			return NULL;
+
+		__atomic_store_n(chunk, new_chunk, __ATOMIC_RELEASE);
 	}
 
-	vf_ref_count_inc(entry);
+	return (*chunk)->entries + ((unsigned)vfd & (VFD_CHUNK_SIZE - 1));
+}
 
-	return (struct vfd_reference) {
-	    .pool = entry->pool, .file = entry->file, .internal = entry, };
+/*
+ * vfd_entry -- returns the entry at vfd, or NULL.
+ * Must be called while holding vfd_table_mutex.
+ */
+static struct vfile_description *
+vfd_entry(int vfd)
+{
+	struct vfile_description **slot = vfd_slot(vfd);
+
+	if (slot == NULL || *slot == &fd_pool_entry)
+		return NULL;
+
+	return *slot;
 }
 
 /*
- * is_in_vfd_table_range -- check if the number can be used as an index
- * for the vfd_table array.
+ * vfd_is_placeholder -- returns true if the vfd is a placeholder in the fd
+ * pool, i.e. it's not open as far as the application is concerned.
  */
 static bool
-is_in_vfd_table_range(int number)
+vfd_is_placeholder(int vfd)
+{
+	struct vfile_description **slot = vfd_slot(vfd);
+
+	return slot != NULL &&
+		__atomic_load_n(slot, __ATOMIC_ACQUIRE) == &fd_pool_entry;
+}
+
+/*
+ * setup_vfd_table -- sizes the vfd table according to RLIMIT_NOFILE, and maps
+ * the chunk directory.
+ * Must be called during startup.
+ */
+static void
+setup_vfd_table(void)
+{
+	struct rlimit limit;
+	rlim_t size = VFD_TABLE_MIN_SIZE;
+
+	if (syscall_no_intercept(SYS_getrlimit, RLIMIT_NOFILE, &limit) == 0 &&
+	    limit.rlim_max > size)
+		size = limit.rlim_max;
+
+	if (size > VFD_TABLE_MAX_SIZE)
+		size = VFD_TABLE_MAX_SIZE;
+
+	size = (size + VFD_CHUNK_SIZE - 1) & ~(rlim_t)(VFD_CHUNK_SIZE - 1);
+
+	vfd_chunks = map_anon((size >> VFD_CHUNK_SHIFT) * sizeof(*vfd_chunks),
+			MAP_NORESERVE);
+	if (vfd_chunks == NULL)
+		exit_with_msg(1, "vfd table");
+
+	vfd_table_size = (unsigned)size;
+}
+
+/*
+ * pmemfile_vfd_table_size -- returns the number of fds covered by the vfd
+ * table
+ */
+unsigned
+pmemfile_vfd_table_size(void)
 {
-	return (number >= 0) && (number < (int)ARRAY_SIZE(vfd_table));
+	return vfd_table_size;
 }
 
 /*
@@ -161,18 +394,19 @@ is_in_vfd_table_range(int number)
  * not handled by pmemfile, i.e. not in the vfd_table array.
  * This is done without holding the vfd_table_mutex. Determining
  * that a vfd is not in the array is an atomic operation, but the
- * opposite (determining that is in in the array) requires the mutex to
- * be locked, as that involves the second step of increasing a ref count.
- * Thus if this function returns true, one must acquire the vfd_table_mutex,
- * and check again.
+ * opposite (determining that is in in the array) involves the second step
+ * of increasing a ref count. Thus if this function returns true, one must
+ * check again while taking a reference, or while holding vfd_table_mutex.
  */
 static bool
 can_be_in_vfd_table(int vfd)
 {
-	if (!is_in_vfd_table_range(vfd))
+	struct vfile_description **slot = vfd_slot(vfd);
+
+	if (slot == NULL)
 		return false;
 
-	return __atomic_load_n(vfd_table + vfd, __ATOMIC_CONSUME) != NULL;
+	return __atomic_load_n(slot, __ATOMIC_CONSUME) != NULL;
 }
 
 /*
@@ -183,41 +417,73 @@ can_be_in_vfd_table(int vfd)
 struct vfd_reference
 pmemfile_vfd_ref(int vfd)
 {
-	if (!can_be_in_vfd_table(vfd)) {
-		/*
-		 * Return a vfd_reference with the field called internal
-		 * set to NULL.
-		 */
+	struct vfile_description **slot = vfd_slot(vfd);
+	struct vfile_description *entry;
+
+	if (slot == NULL)
 		return (struct vfd_reference) {.kernel_fd = vfd, };
-	}
 
-	util_mutex_lock(&vfd_table_mutex);
+	for (;;) {
+		entry = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
 
-	struct vfd_reference result = pmemfile_ref_vfd_under_mutex(vfd);
+		if (entry == NULL) {
+			/*
+			 * Return a vfd_reference with the field called
+			 * internal set to NULL.
+			 */
+			return (struct vfd_reference) {.kernel_fd = vfd, };
+		}
 
-	util_mutex_unlock(&vfd_table_mutex);
+		/* the kernel would report EBADF for this one */
+		if (entry == &fd_pool_entry)
+			return (struct vfd_reference) {.kernel_fd = -1, };
 
-	return result;
+		/*
+		 * A zero ref count means the entry was already removed from
+		 * the table, just look again.
+		 */
+		if (!vf_ref_count_inc_not_zero(entry))
+			continue;
+
+		/*
+		 * The entry might have been closed and recycled for another
+		 * vfd between loading the pointer and taking the reference.
+		 */
+		if (__atomic_load_n(slot, __ATOMIC_ACQUIRE) == entry)
+			break;
+
+		unref_entry(entry);
+	}
+
+	return (struct vfd_reference) {
+	    .pool = entry->pool, .file = entry->file, .internal = entry, };
 }
 
+/*
+ * get_fdcwd_reference -- takes a reference to the current cwd entry, without
+ * locking, just like pmemfile_vfd_ref does with vfd table slots
+ */
 static struct vfd_reference
 get_fdcwd_reference(void)
 {
-	struct vfd_reference result;
-
-	util_mutex_lock(&vfd_table_mutex);
+	struct vfile_description *entry;
 
-	vf_ref_count_inc(cwd_entry);
+	for (;;) {
+		entry = __atomic_load_n(&cwd_entry, __ATOMIC_ACQUIRE);
 
-	result.internal = cwd_entry;
+		/* a concurrent chdir might have dropped the last reference */
+		if (!vf_ref_count_inc_not_zero(entry))
+			continue;
 
-	result.kernel_fd = cwd_entry->kernel_cwd_fd;
-	result.pool = cwd_entry->pool;
-	result.file = cwd_entry->file;
+		if (__atomic_load_n(&cwd_entry, __ATOMIC_ACQUIRE) == entry)
+			break;
 
-	util_mutex_unlock(&vfd_table_mutex);
+		unref_entry(entry);
+	}
 
-	return result;
+	return (struct vfd_reference) {
+	    .pool = entry->pool, .file = entry->file,
+	    .kernel_fd = entry->kernel_cwd_fd, .internal = entry, };
 }
 
 /*
@@ -238,6 +504,26 @@ pmemfile_vfd_at_ref(int vfd)
 		return pmemfile_vfd_ref(vfd);
 }
 
+/*
+ * release_entry -- internal function, releases the resources held by an entry
+ * whose last reference was dropped.
+ *
+ * It should not be called while holding the vfd_table mutex, as closing
+ * a pmemfile file can take a while.
+ */
+static void
+release_entry(struct vfile_description *entry)
+{
+	if (entry->is_special_cwd_desc) {
+		syscall_no_intercept(SYS_close, entry->kernel_cwd_fd);
+	} else {
+		pool_acquire(entry->pool);
+		pmemfile_close(entry->pool->pool, entry->file);
+		pool_release(entry->pool);
+	}
+	mark_as_free_file_slot(entry);
+}
+
 /*
  * unref_entry -- internal function, decrases the ref count of an entry, and
  * releases the resources it holds, if needed.
@@ -251,16 +537,8 @@ unref_entry(struct vfile_description *entry)
 	if (entry == NULL)
 		return;
 
-	if (vf_ref_count_dec_and_fetch(entry) == 0) {
-		if (entry->is_special_cwd_desc) {
-			syscall_no_intercept(SYS_close, entry->kernel_cwd_fd);
-		} else {
-			pool_acquire(entry->pool);
-			pmemfile_close(entry->pool->pool, entry->file);
-			pool_release(entry->pool);
-		}
-		mark_as_free_file_slot(entry);
-	}
+	if (vf_ref_count_dec_and_fetch(entry) == 0)
+		release_entry(entry);
 }
 
 /*
@@ -280,8 +558,8 @@ pmemfile_vfd_unref(struct vfd_reference ref)
  * If the old_vfd refers to entry, increase the corresponding ref_count.
  * If the new_vfd refers to entry, decrease the corresponding ref_count.
  * Overwrite the entry pointer in the vfd_table.
- * The order of the three operations does not matter, as long as the entries
- * as different, and all three happen while holding the vfd_table_mutex.
+ * All three happen while holding the vfd_table_mutex, and the entry at new_vfd
+ * is unreferenced last, as lookups don't take the mutex.
  *
  * Important: dup2 must be atomic from the user's point of view.
  */
@@ -302,19 +580,35 @@ vfd_dup2_under_mutex(int old_vfd, int new_vfd)
 	if (old_vfd == new_vfd)
 		return new_vfd;
 
-	if (!is_in_vfd_table_range(new_vfd)) {
+	struct vfile_description *entry = vfd_entry(old_vfd);
+	struct vfile_description **slot = vfd_slot(new_vfd);
+	struct vfile_description *old_entry = slot ? *slot : NULL;
+
+	if (old_entry == &fd_pool_entry) {
+		/* the placeholder was replaced by the kernel */
+		fd_pool_forget(new_vfd);
+		__atomic_store_n(slot, NULL, __ATOMIC_RELEASE);
+		old_entry = NULL;
+	}
+
+	if (entry == old_entry)
+		return new_vfd;
+
+	slot = vfd_slot_alloc(new_vfd);
+
+	if (slot == NULL) {
 		/* new_vfd can't be used to index the vfd_table */
 		syscall_no_intercept(SYS_close, new_vfd);
 		return -ENOMEM;
 	}
 
-	if (vfd_table[old_vfd] == vfd_table[new_vfd])
-		return new_vfd;
-
-	ref_entry(vfd_table[old_vfd]);
-	unref_entry(vfd_table[new_vfd]);
-	__atomic_store_n(vfd_table + new_vfd, vfd_table[old_vfd],
-			__ATOMIC_RELEASE);
+	/*
+	 * The entry replaced must leave the table before its reference is
+	 * dropped, see the comment at vfd_table_mutex.
+	 */
+	ref_entry(entry);
+	__atomic_store_n(slot, entry, __ATOMIC_RELEASE);
+	unref_entry(old_entry);
 
 	return new_vfd;
 }
@@ -332,6 +626,11 @@ pmemfile_vfd_dup(int vfd)
 	int new_vfd;
 	util_mutex_lock(&vfd_table_mutex);
 
+	if (vfd_is_placeholder(vfd)) {
+		util_mutex_unlock(&vfd_table_mutex);
+		return -EBADF;
+	}
+
 	new_vfd = (int)syscall_no_intercept(SYS_dup, vfd);
 
 	new_vfd = vfd_dup2_under_mutex(vfd, new_vfd);
@@ -351,6 +650,11 @@ pmemfile_vfd_fcntl_dup(int vfd, int min_new_vfd)
 	int new_vfd;
 	util_mutex_lock(&vfd_table_mutex);
 
+	if (vfd_is_placeholder(vfd)) {
+		util_mutex_unlock(&vfd_table_mutex);
+		return -EBADF;
+	}
+
 	new_vfd = (int)syscall_no_intercept(SYS_fcntl,
 				vfd, F_DUPFD, min_new_vfd);
 
@@ -375,6 +679,11 @@ pmemfile_vfd_dup2(int old_vfd, int new_vfd)
 
 	util_mutex_lock(&vfd_table_mutex);
 
+	if (vfd_is_placeholder(old_vfd)) {
+		util_mutex_unlock(&vfd_table_mutex);
+		return -EBADF;
+	}
+
 	result = (int)syscall_no_intercept(SYS_dup2, old_vfd, new_vfd);
 
 	assert(result == new_vfd);
@@ -411,8 +720,8 @@ pmemfile_vfd_dup3(int old_vfd, int new_vfd, int flags)
 }
 
 /*
- * pmemfile_vfd_close -- remove a reference from the vfd_table array (if
- * there was one at vfd_table[vfd]).
+ * pmemfile_vfd_close -- remove a reference from the vfd_table (if
+ * there was one at vfd).
  * This does not necessarily close an underlying pmemfile file, as some
  * vfd_reference structs given to the user might still reference that entry.
  */
@@ -423,13 +732,27 @@ pmemfile_vfd_close(int vfd)
 
 	util_mutex_lock(&vfd_table_mutex);
 
-	entry = vfd_table[vfd];
-	vfd_table[vfd] = NULL;
+	struct vfile_description **slot = vfd_slot(vfd);
+
+	if (slot != NULL) {
+		entry = *slot;
+		__atomic_store_n(slot, NULL, __ATOMIC_RELEASE);
+	}
+
+	bool placeholder = (entry == &fd_pool_entry);
+	if (placeholder) {
+		fd_pool_forget(vfd);
+		entry = NULL;
+	}
 
 	long result = syscall_no_intercept(SYS_close, vfd);
 
 	util_mutex_unlock(&vfd_table_mutex);
 
+	/* as far as the application knows, the fd was not open */
+	if (placeholder)
+		result = -EBADF;
+
 	if (entry != NULL) {
 		assert(!entry->is_special_cwd_desc);
 		unref_entry(entry);
@@ -439,6 +762,73 @@ pmemfile_vfd_close(int vfd)
 	return result;
 }
 
+/*
+ * pmemfile_vfd_close_range -- close_range(2) aware of the vfd table: drops
+ * pmemfile files and placeholders from the range, once the kernel closed the
+ * underlying fds.
+ */
+long
+pmemfile_vfd_close_range(unsigned first, unsigned last, unsigned flags)
+{
+	/*
+	 * Entries whose last reference was in the range, linked via
+	 * next_free - they are released after unlocking, like in
+	 * pmemfile_vfd_close. An entry can be referenced from a few fds, but
+	 * its ref count drops to zero only once.
+	 */
+	struct vfile_description *released = NULL;
+
+	util_mutex_lock(&vfd_table_mutex);
+
+	long result = syscall_no_intercept(SYS_close_range, first, last, flags);
+
+	/* with CLOSE_RANGE_CLOEXEC fds stay open */
+	if (result != 0 || (flags & CLOSE_RANGE_CLOEXEC) ||
+			first >= vfd_table_size) {
+		util_mutex_unlock(&vfd_table_mutex);
+		return result;
+	}
+
+	if (last >= vfd_table_size)
+		last = vfd_table_size - 1;
+
+	for (unsigned vfd = first; vfd <= last; ++vfd) {
+		struct vfile_description **slot = vfd_slot((int)vfd);
+
+		if (slot == NULL) {
+			/* skip the rest of the chunk */
+			vfd |= VFD_CHUNK_SIZE - 1;
+			continue;
+		}
+
+		struct vfile_description *entry = *slot;
+		if (entry == NULL)
+			continue;
+
+		__atomic_store_n(slot, NULL, __ATOMIC_RELEASE);
+
+		if (entry != &fd_pool_entry) {
+			assert(!entry->is_special_cwd_desc);
+			if (vf_ref_count_dec_and_fetch(entry) == 0) {
+				entry->next_free = released;
+				released = entry;
+			}
+		}
+	}
+
+	fd_pool_forget_range(first, last);
+
+	util_mutex_unlock(&vfd_table_mutex);
+
+	while (released != NULL) {
+		struct vfile_description *next = released->next_free;
+		release_entry(released);
+		released = next;
+	}
+
+	return result;
+}
+
 /*
  * setup_cwd -- initializes an entry to hold the cwd, and cwd_entry pointer
  * to point to it.
@@ -454,11 +844,7 @@ setup_cwd(void)
 
 	cwd_entry = fetch_free_file_slot();
 	assert(cwd_entry != NULL); /* Noone else did allocate during startup */
-	cwd_entry->pool = NULL;
-	cwd_entry->file = NULL;
-	cwd_entry->kernel_cwd_fd = (int)fd;
-	cwd_entry->is_special_cwd_desc = true;
-	cwd_entry->ref_count = 1;
+	init_entry(cwd_entry, NULL, NULL, (int)fd, true);
 }
 
 /*
@@ -480,14 +866,9 @@ pmemfile_vfd_chdir_pf(struct pool_description *pool, struct pmemfile_file *file)
 		struct vfile_description *entry = fetch_free_file_slot();
 
 		if (entry != NULL) {
-			*entry = (struct vfile_description) {
-				.pool = pool, .file = file,
-				.kernel_cwd_fd = -1,
-				.is_special_cwd_desc = false,
-				.ref_count = 1};
-
-			old_cwd_entry = cwd_entry;
-			cwd_entry = entry;
+			init_entry(entry, pool, file, -1, false);
+
+			old_cwd_entry = replace_cwd_entry(entry);
 			result = 0;
 		} else {
 			result = -ENOMEM;
@@ -521,14 +902,9 @@ pmemfile_vfd_chdir_kernel_fd(int fd)
 		struct vfile_description *entry = fetch_free_file_slot();
 
 		if (entry != NULL) {
-			*entry = (struct vfile_description) {
-				.pool = NULL, .file = NULL,
-				.kernel_cwd_fd = fd,
-				.is_special_cwd_desc = true,
-				.ref_count = 1};
-
-			old_cwd_entry = cwd_entry;
-			cwd_entry = entry;
+			init_entry(entry, NULL, NULL, fd, true);
+
+			old_cwd_entry = replace_cwd_entry(entry);
 		} else {
 			result = -ENOMEM;
 		}
@@ -561,26 +937,324 @@ check_memfd_syscall(void)
 
 #endif
 
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 1U
+#endif
+
 /*
- * acquire_new_fd - grab a new file descriptor from the kernel
+ * create_placeholder_fd -- grab a new file descriptor from the kernel
  */
-int
-pmemfile_acquire_new_fd(const char *path)
+static int
+create_placeholder_fd(const char *name, bool cloexec)
 {
-	int fd;
+	long fd = -1;
 
 	if (is_memfd_syscall_available) {
-		fd = (int)syscall_no_intercept(SYS_memfd_create, path, 0);
-		/* memfd_create can fail for too long name */
-		if (fd < 0) {
-			fd = (int)syscall_no_intercept(SYS_open, "/dev/null",
-					O_RDONLY);
+		fd = syscall_no_intercept(SYS_memfd_create, name,
+				cloexec ? MFD_CLOEXEC : 0);
+	}
+
+	/* memfd_create can fail for too long name */
+	if (fd < 0) {
+		fd = syscall_no_intercept(SYS_open, "/dev/null",
+				O_RDONLY | (cloexec ? O_CLOEXEC : 0));
+	}
+
+	return (int)fd;
+}
+
+/*
+ * The fd pool holds placeholder fds created in advance by a background thread,
+ * so opening a pmemfile file doesn't have to wait for memfd_create. It is
+ * disabled by default, as the application can't rely on getting the lowest
+ * free fd number for pmemfile files then, and the placeholders are created
+ * with the close-on-exec flag, so they don't leak to executed programs.
+ *
+ * Placeholders are moved to numbers starting at fd_pool_base, close to the
+ * RLIMIT_NOFILE soft limit, so the pool doesn't keep low numbers the
+ * application expects the kernel to hand out, e.g. 0-2 after closing stdio.
+ *
+ * Fds in the pool are marked with fd_pool_entry in the vfd table, so the
+ * placeholders behave as closed fds when the application stumbles upon them,
+ * e.g. when closing all fds before an exec (close or close_range), or dup2-ing
+ * over them.
+ *
+ * In synchronous mode, meant for tests, there's no background thread - the
+ * pool is refilled right away by the thread which found it at most half full.
+ *
+ * The pool is protected by vfd_table_mutex.
+ */
+#define FD_POOL_MAX 4096
+
+static int fd_pool[FD_POOL_MAX];
+static unsigned fd_pool_count;
+static unsigned fd_pool_size; /* 0 if the pool is disabled */
+static int fd_pool_base;
+static bool fd_pool_thread_running;
+static bool fd_pool_sync;
+static pthread_cond_t fd_pool_cond = PTHREAD_COND_INITIALIZER;
+
+static void fd_pool_low(void);
+
+/*
+ * fd_pool_push -- adds a new placeholder fd to the pool, returns false if
+ * it can't be used.
+ * Must be called while holding vfd_table_mutex.
+ */
+static bool
+fd_pool_push(int fd)
+{
+	if (fd_pool_count == fd_pool_size)
+		return false;
+
+	struct vfile_description **slot = vfd_slot_alloc(fd);
+
+	/* the slot is not empty if the application raced with the kernel */
+	if (slot == NULL || *slot != NULL)
+		return false;
+
+	__atomic_store_n(slot, &fd_pool_entry, __ATOMIC_RELEASE);
+	fd_pool[fd_pool_count++] = fd;
+
+	return true;
+}
+
+/*
+ * fd_pool_forget -- removes an fd from the pool, after the application closed
+ * it, or replaced it using dup2.
+ * Must be called while holding vfd_table_mutex.
+ */
+static void
+fd_pool_forget(int fd)
+{
+	for (unsigned i = 0; i < fd_pool_count; ++i) {
+		if (fd_pool[i] == fd) {
+			fd_pool[i] = fd_pool[--fd_pool_count];
+			return;
 		}
-	} else {
-		fd = (int)syscall_no_intercept(SYS_open, "/dev/null", O_RDONLY);
 	}
 
-	if (fd >= (long)ARRAY_SIZE(vfd_table)) {
+	assert(0);
+}
+
+/*
+ * fd_pool_forget_range -- removes fds closed by close_range from the pool,
+ * and wakes up the refilling thread if needed.
+ * Must be called while holding vfd_table_mutex.
+ */
+static void
+fd_pool_forget_range(unsigned first, unsigned last)
+{
+	for (unsigned i = 0; i < fd_pool_count; ) {
+		unsigned fd = (unsigned)fd_pool[i];
+
+		if (fd >= first && fd <= last)
+			fd_pool[i] = fd_pool[--fd_pool_count];
+		else
+			++i;
+	}
+
+	if (fd_pool_size != 0 && fd_pool_count <= fd_pool_size / 2)
+		fd_pool_low();
+}
+
+/*
+ * fd_pool_move_high -- moves a new placeholder fd to fd_pool_base or above
+ */
+static int
+fd_pool_move_high(int fd)
+{
+	long high = syscall_no_intercept(SYS_fcntl, fd, F_DUPFD_CLOEXEC,
+			fd_pool_base);
+
+	syscall_no_intercept(SYS_close, fd);
+
+	return (int)high;
+}
+
+/*
+ * fd_pool_fill -- creates placeholders until the pool is full, returns false
+ * if it couldn't.
+ * Must be called while holding vfd_table_mutex, which is released while
+ * creating each placeholder.
+ */
+static bool
+fd_pool_fill(void)
+{
+	while (fd_pool_count < fd_pool_size) {
+		util_mutex_unlock(&vfd_table_mutex);
+		int fd = create_placeholder_fd("pmemfile", true);
+		if (fd >= 0)
+			fd = fd_pool_move_high(fd);
+		util_mutex_lock(&vfd_table_mutex);
+
+		if (fd < 0)
+			return false;
+
+		if (!fd_pool_push(fd)) {
+			syscall_no_intercept(SYS_close, fd);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * fd_pool_refill -- the background thread, which fills the pool whenever
+ * it is at most half full
+ */
+static void *
+fd_pool_refill(void *arg)
+{
+	(void) arg;
+	bool failed = false;
+
+	util_mutex_lock(&vfd_table_mutex);
+
+	for (;;) {
+		if (failed || fd_pool_count > fd_pool_size / 2) {
+			/* wait for the next fd to be taken from the pool */
+			pthread_cond_wait(&fd_pool_cond, &vfd_table_mutex);
+			failed = false;
+			continue;
+		}
+
+		failed = !fd_pool_fill();
+	}
+
+	return NULL;
+}
+
+/*
+ * fd_pool_low -- called when the pool is at most half full, wakes up the
+ * refilling thread, or refills the pool right away in synchronous mode.
+ * Must be called while holding vfd_table_mutex.
+ */
+static void
+fd_pool_low(void)
+{
+	if (fd_pool_sync)
+		fd_pool_fill();
+	else
+		pthread_cond_signal(&fd_pool_cond);
+}
+
+/*
+ * fd_pool_pop -- takes an fd from the pool, returns -1 if it's empty
+ */
+static int
+fd_pool_pop(void)
+{
+	int fd = -1;
+
+	util_mutex_lock(&vfd_table_mutex);
+
+	if (!fd_pool_thread_running && !fd_pool_sync) {
+		pthread_t thread;
+		pthread_attr_t attr;
+
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+		if (pthread_create(&thread, &attr, fd_pool_refill, NULL) == 0)
+			fd_pool_thread_running = true;
+		else
+			fd_pool_size = 0; /* no thread, no pool */
+
+		pthread_attr_destroy(&attr);
+	}
+
+	if (fd_pool_count > 0) {
+		fd = fd_pool[--fd_pool_count];
+		__atomic_store_n(vfd_slot(fd), NULL, __ATOMIC_RELEASE);
+	}
+
+	if (fd_pool_count <= fd_pool_size / 2)
+		fd_pool_low();
+
+	util_mutex_unlock(&vfd_table_mutex);
+
+	return fd;
+}
+
+static void
+fd_pool_atfork_prepare(void)
+{
+	util_mutex_lock(&vfd_table_mutex);
+}
+
+static void
+fd_pool_atfork_parent(void)
+{
+	util_mutex_unlock(&vfd_table_mutex);
+}
+
+/*
+ * fd_pool_atfork_child -- the child inherits the placeholders, but not the
+ * thread refilling the pool
+ */
+static void
+fd_pool_atfork_child(void)
+{
+	fd_pool_thread_running = false;
+	util_mutex_unlock(&vfd_table_mutex);
+}
+
+/*
+ * pmemfile_vfd_fd_pool_init -- enables the fd pool, if env holds a positive
+ * number of placeholder fds, sync_env set to 1 makes refilling synchronous
+ */
+void
+pmemfile_vfd_fd_pool_init(const char *env, const char *sync_env)
+{
+	if (env == NULL)
+		return;
+
+	unsigned long size = strtoul(env, NULL, 10);
+	if (size == 0)
+		return;
+
+	if (size > FD_POOL_MAX)
+		size = FD_POOL_MAX;
+
+	struct rlimit limit;
+	if (syscall_no_intercept(SYS_getrlimit, RLIMIT_NOFILE, &limit) != 0)
+		return;
+
+	rlim_t max = limit.rlim_cur;
+	if (max > vfd_table_size)
+		max = vfd_table_size;
+
+	/* leave the lower half of the fd space to the application */
+	if (size > max / 4)
+		size = max / 4;
+	if (size == 0)
+		return;
+
+	fd_pool_size = (unsigned)size;
+	fd_pool_base = (int)(max - 2 * size);
+	fd_pool_sync = sync_env != NULL && sync_env[0] == '1';
+
+	pthread_atfork(fd_pool_atfork_prepare, fd_pool_atfork_parent,
+			fd_pool_atfork_child);
+}
+
+/*
+ * acquire_new_fd - grab a new file descriptor from the kernel
+ */
+int
+pmemfile_acquire_new_fd(const char *path)
+{
+	int fd = -1;
+
+	if (__atomic_load_n(&fd_pool_size, __ATOMIC_RELAXED) != 0)
+		fd = fd_pool_pop();
+
+	if (fd < 0)
+		fd = create_placeholder_fd(path, false);
+
+	if (fd >= 0 && !is_in_vfd_table_range(fd)) {
 		syscall_no_intercept(SYS_close, fd);
 		return -ENFILE;
 	}
@@ -604,15 +1278,18 @@ pmemfile_vfd_assign(int vfd, struct pool_description *pool,
 	if (entry == NULL)
 		return -ENOMEM;
 
-	*entry = (struct vfile_description) {
-		.pool = pool, .file = file,
-		.kernel_cwd_fd = -1,
-		.is_special_cwd_desc = false,
-		.ref_count = 1};
-
 	util_mutex_lock(&vfd_table_mutex);
 
-	vfd_table[vfd] = entry;
+	struct vfile_description **slot = vfd_slot_alloc(vfd);
+
+	if (slot == NULL) {
+		util_mutex_unlock(&vfd_table_mutex);
+		mark_as_free_file_slot(entry);
+		return -ENOMEM;
+	}
+
+	init_entry(entry, pool, file, -1, false);
+	__atomic_store_n(slot, entry, __ATOMIC_RELEASE);
 
 	util_mutex_unlock(&vfd_table_mutex);
 
@@ -627,16 +1304,17 @@ pmemfile_vfd_fchdir(int vfd)
 
 	util_mutex_lock(&vfd_table_mutex);
 
-	if (is_in_vfd_table_range(vfd) && vfd_table[vfd] != NULL) {
-		struct vfile_description *cwd = vfd_table[vfd];
+	struct vfile_description *cwd = vfd_entry(vfd);
 
+	if (vfd_is_placeholder(vfd)) {
+		result = -EBADF;
+	} else if (cwd != NULL) {
 		pool_acquire(cwd->pool);
 		result = pmemfile_fchdir(cwd->pool->pool, cwd->file);
 		pool_release(cwd->pool);
 		if (result == 0) {
-			vf_ref_count_inc(vfd_table[vfd]);
-			old_cwd_entry = cwd_entry;
-			cwd_entry = vfd_table[vfd];
+			vf_ref_count_inc(cwd);
+			old_cwd_entry = replace_cwd_entry(cwd);
 		} else {
 			/*
 			 * Assuming pmemfile_fchdir can't set errno
@@ -662,14 +1340,10 @@ pmemfile_vfd_fchdir(int vfd)
 			struct vfile_description *entry;
 			if ((entry = fetch_free_file_slot()) != NULL) {
 				/* XXX Too many nested ifs! */
-				*entry = (struct vfile_description) {
-					.pool = NULL, .file = NULL,
-					.kernel_cwd_fd = (int)new_fd,
-					.is_special_cwd_desc = true,
-					.ref_count = 1};
-
-				old_cwd_entry = cwd_entry;
-				cwd_entry = entry;
+				init_entry(entry, NULL, NULL, (int)new_fd,
+						true);
+
+				old_cwd_entry = replace_cwd_entry(entry);
 				result = 0;
 			} else {
 				syscall_no_intercept(SYS_close, new_fd);
@@ -689,6 +1363,6 @@ void
 pmemfile_vfd_table_init(void)
 {
 	check_memfd_syscall();
-	setup_free_slots();
+	setup_vfd_table();
 	setup_cwd();
 }
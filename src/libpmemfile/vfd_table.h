@@ -55,9 +55,15 @@ int pmemfile_vfd_fcntl_dup(int vfd, int min_new_vfd);
 int pmemfile_vfd_dup2(int old_vfd, int new_vfd);
 int pmemfile_vfd_dup3(int old_vfd, int new_vfd, int flags);
 
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+
 long pmemfile_vfd_close(int vfd);
+long pmemfile_vfd_close_range(unsigned first, unsigned last, unsigned flags);
 
 void pmemfile_vfd_table_init(void);
+unsigned pmemfile_vfd_table_size(void);
 
 long pmemfile_vfd_chdir_pf(struct pool_description *pool,
 				struct pmemfile_file *file);
@@ -72,4 +78,6 @@ int pmemfile_vfd_assign(int vfd, struct pool_description *pool,
 
 int pmemfile_acquire_new_fd(const char *path);
 
+void pmemfile_vfd_fd_pool_init(const char *env, const char *sync_env);
+
 #endif
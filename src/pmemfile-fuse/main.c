@@ -30,605 +30,1157 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+
+/*
+ * pmemfile-fuse -- exposes a pmemfile pool through the FUSE low-level API.
+ *
+ * Every inode the kernel knows about is represented by a node, keyed by the
+ * pmemfile inode number and holding a long-lived handle that all requests
+ * for that inode go through, so no request has to resolve a path. The node
+ * address is the FUSE inode number.
+ *
+ * Permissions are checked by the kernel (default_permissions), pmemfile runs
+ * with CAP_CHOWN and CAP_FOWNER and only the ownership of newly created
+ * inodes is fixed up, so requests can be served by many threads at once
+ * without switching pmemfile credentials.
+ */
+
 #define _GNU_SOURCE
 
 #include "libpmemfile-posix.h"
 #include <assert.h>
 #include <err.h>
 #include <errno.h>
-#include <fuse.h>
+#include <fuse_lowlevel.h>
 #include <getopt.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
-#define PFP ((PMEMfilepool *)(fuse_get_context()->private_data))
-
 #ifdef DEBUG
 #define log(fmt, args...) fprintf(stderr, "%s " fmt, __func__, ## args)
 #else
 #define log(fmt, args...) do {} while (0)
 #endif
 
-static int
-update_ctx(PMEMfilepool *pfp)
-{
-	struct fuse_context *ctx = fuse_get_context();
+/*
+ * The pool is locked by this process, so nothing can change it behind
+ * the kernel's back - attributes and names can be cached for long.
+ */
+#define PMEMFILE_FUSE_TIMEOUT 3600.0
 
-	if (pmemfile_setreuid(pfp, ctx->uid, ctx->uid) < 0) {
-		log("pmemfile_setreuid failed: %d\n", errno);
-		return -errno;
-	}
-	if (pmemfile_setregid(pfp, ctx->gid, ctx->gid) < 0) {
-		log("pmemfile_setregid failed: %d\n", errno);
-		return -errno;
-	}
-	pmemfile_umask(pfp, ctx->umask);
+#define NODE_TABLE_MIN_SIZE 1024
 
-	return 0;
+struct node {
+	/* pmemfile inode number */
+	uint64_t ino;
+
+	/* handle used for all requests to this inode */
+	PMEMfile *file;
+
+	/* number of lookups the kernel did not forget yet */
+	uint64_t nlookup;
+
+	/* next node in the hash chain */
+	struct node *next;
+};
+
+struct dir_handle {
+	PMEMfile *file;
+
+	/* offset the handle is at, -1 if unknown */
+	off_t next;
+};
+
+static struct {
+	PMEMfilepool *pfp;
+	struct node *root;
+
+	/* owner of newly created inodes, unless the request says otherwise */
+	uid_t uid;
+	gid_t gid;
+
+	/* nodes, hashed by pmemfile inode number */
+	pthread_mutex_t lock;
+	struct node **buckets;
+	size_t nbuckets;
+	size_t nnodes;
+
+	/* per-thread buffer for read replies */
+	pthread_key_t read_buf;
+} fs = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+struct read_buf {
+	size_t size;
+	char data[];
+};
+
+/*
+ * node_hash -- returns bucket index for pmemfile inode number
+ */
+static size_t
+node_hash(uint64_t ino, size_t nbuckets)
+{
+	/* inode numbers are offsets in the pool, mix the low bits in */
+	ino ^= ino >> 17;
+	ino *= 0x9E3779B97F4A7C15ULL;
+
+	return (size_t)(ino >> 32) & (nbuckets - 1);
 }
 
-static int
-pmemfile_fuse_getattr(const char *path, struct stat *statbuf)
+/*
+ * node_find -- looks up node by pmemfile inode number, fs.lock must be held
+ */
+static struct node *
+node_find(uint64_t ino)
 {
-	log("%s\n", path);
+	struct node *n = fs.buckets[node_hash(ino, fs.nbuckets)];
 
-	int ret;
-	PMEMfilepool *pfp = PFP;
+	while (n && n->ino != ino)
+		n = n->next;
 
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
+	return n;
+}
 
-	if (pmemfile_lstat(pfp, path, statbuf) < 0) {
-		log("pmemfile_lstat %s failed: %d\n", path, errno);
-		return -errno;
+/*
+ * node_table_grow -- doubles the number of buckets, fs.lock must be held
+ *
+ * When memory can't be allocated the table stays as it is - it only gets
+ * slower.
+ */
+static void
+node_table_grow(void)
+{
+	size_t nbuckets = fs.nbuckets * 2;
+	struct node **buckets = calloc(nbuckets, sizeof(*buckets));
+	if (!buckets)
+		return;
+
+	for (size_t i = 0; i < fs.nbuckets; ++i) {
+		struct node *n = fs.buckets[i];
+		while (n) {
+			struct node *next = n->next;
+			size_t h = node_hash(n->ino, nbuckets);
+
+			n->next = buckets[h];
+			buckets[h] = n;
+			n = next;
+		}
 	}
 
-	return 0;
+	free(fs.buckets);
+	fs.buckets = buckets;
+	fs.nbuckets = nbuckets;
 }
 
-static int
-pmemfile_fuse_opendir(const char *path, struct fuse_file_info *fi)
+/*
+ * node_insert -- adds node to the table, fs.lock must be held
+ */
+static void
+node_insert(struct node *n)
 {
-	log("%s\n", path);
+	if (fs.nnodes >= fs.nbuckets)
+		node_table_grow();
 
-	int ret;
-	PMEMfilepool *pfp = PFP;
+	size_t h = node_hash(n->ino, fs.nbuckets);
+	n->next = fs.buckets[h];
+	fs.buckets[h] = n;
+	fs.nnodes++;
+}
 
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
+/*
+ * node_remove -- removes node from the table, fs.lock must be held
+ */
+static void
+node_remove(struct node *n)
+{
+	struct node **p = &fs.buckets[node_hash(n->ino, fs.nbuckets)];
 
-	PMEMfile *f = pmemfile_open(pfp, path, O_DIRECTORY);
-	if (f == NULL) {
-		log("pmemfile_open %s failed: %d\n", path, errno);
-		return -errno;
-	}
-	fi->fh = (uintptr_t)f;
+	while (*p != n)
+		p = &(*p)->next;
 
-	return 0;
+	*p = n->next;
+	fs.nnodes--;
 }
 
-static int
-pmemfile_fuse_releasedir(const char *path, struct fuse_file_info *fi)
+/*
+ * get_node -- translates FUSE inode number to node
+ */
+static struct node *
+get_node(fuse_ino_t ino)
 {
-	log("%s\n", path);
+	if (ino == FUSE_ROOT_ID)
+		return fs.root;
 
-	if (!fi->fh)
-		return -EBADF;
-
-	pmemfile_close(PFP, (PMEMfile *)fi->fh);
+	return (struct node *)(uintptr_t)ino;
+}
 
-	fi->fh = 0;
+/*
+ * node_id -- translates node to FUSE inode number
+ */
+static fuse_ino_t
+node_id(struct node *n)
+{
+	if (n == fs.root)
+		return FUSE_ROOT_ID;
 
-	return 0;
+	return (fuse_ino_t)(uintptr_t)n;
 }
 
+/*
+ * handle_flags -- returns flags the handle of a node of given type is
+ * opened with
+ */
 static int
-pmemfile_fuse_readdir(const char *path, void *buff, fuse_fill_dir_t fill,
-		off_t off, struct fuse_file_info *fi)
+handle_flags(mode_t mode)
 {
-	log("%s\n", path);
+	if (S_ISDIR(mode))
+		return O_DIRECTORY | O_RDONLY;
+	if (S_ISREG(mode))
+		return O_RDWR | O_NOFOLLOW;
 
-	PMEMfilepool *pfp = PFP;
-	PMEMfile *dir = (PMEMfile *)fi->fh;
+	return O_PATH | O_NOFOLLOW;
+}
 
-	if (!dir)
-		return -EBADF;
+/*
+ * node_get -- finds or creates the node for the handle and takes a lookup
+ * reference on it
+ *
+ * The handle is consumed - either stored in the new node or closed.
+ */
+static struct node *
+node_get(PMEMfile *file, const struct stat *st)
+{
+	pthread_mutex_lock(&fs.lock);
+
+	struct node *n = node_find(st->st_ino);
+	if (n) {
+		n->nlookup++;
+		pthread_mutex_unlock(&fs.lock);
+		pmemfile_close(fs.pfp, file);
+		return n;
+	}
 
-	if (pmemfile_lseek(pfp, dir, off, PMEMFILE_SEEK_SET) != off) {
-		log("pmemfile_lseek failed: %d\n", errno);
-		return -errno;
-	}
-
-	char dirp[32758];
-	struct stat statbuf;
-	while (1) {
-		int r = pmemfile_getdents64(pfp, dir,
-					    (struct linux_dirent64 *)dirp,
-					    sizeof(dirp));
-		if (r < 0)
-			return -errno;
-		if (r == 0)
-			break;
+	n = malloc(sizeof(*n));
+	if (!n) {
+		pthread_mutex_unlock(&fs.lock);
+		pmemfile_close(fs.pfp, file);
+		errno = ENOMEM;
+		return NULL;
+	}
 
-		for (unsigned i = 0; i < (unsigned)r; ) {
-			i += 8;
+	n->ino = st->st_ino;
+	n->file = file;
+	n->nlookup = 1;
+	node_insert(n);
 
-			unsigned long nextoff = *(unsigned long *)&dirp[i];
-			i += 8;
+	pthread_mutex_unlock(&fs.lock);
 
-			unsigned short reclen = *(unsigned short *)&dirp[i];
-			i += 2;
+	return n;
+}
 
-			i += 1;
+/*
+ * node_forget -- drops lookup references, frees the node if there are none
+ */
+static void
+node_forget(struct node *n, uint64_t nlookup)
+{
+	pthread_mutex_lock(&fs.lock);
 
-			int ret = pmemfile_fstatat(pfp, dir, dirp + i, &statbuf,
-					PMEMFILE_AT_SYMLINK_NOFOLLOW);
-			if (ret)
-				return -errno;
+	assert(n->nlookup >= nlookup);
+	n->nlookup -= nlookup;
+	if (n->nlookup > 0) {
+		pthread_mutex_unlock(&fs.lock);
+		return;
+	}
 
-			fill(buff, dirp + i, &statbuf, (off_t)nextoff);
+	node_remove(n);
 
-			i += reclen;
-			i -= 8 + 8 + 2 + 1;
-		}
-	}
+	pthread_mutex_unlock(&fs.lock);
 
+	pmemfile_close(fs.pfp, n->file);
+	free(n);
+}
 
-	return 0;
+/*
+ * entry_init -- initializes reply to lookup-like requests
+ */
+static void
+entry_init(struct fuse_entry_param *e)
+{
+	memset(e, 0, sizeof(*e));
+	e->attr_timeout = PMEMFILE_FUSE_TIMEOUT;
+	e->entry_timeout = PMEMFILE_FUSE_TIMEOUT;
 }
 
+/*
+ * node_lookup -- resolves name in parent to a node and fills the reply
+ *
+ * Returns 0 on success or error number.
+ */
 static int
-pmemfile_fuse_mkdir(const char *path, mode_t mode)
+node_lookup(struct node *parent, const char *name, struct fuse_entry_param *e)
 {
-	log("%s\n", path);
+	entry_init(e);
+
+	while (true) {
+		if (pmemfile_fstatat(fs.pfp, parent->file, name, &e->attr,
+				AT_SYMLINK_NOFOLLOW) < 0)
+			return errno;
+
+		/* fast path - the kernel already knows this inode */
+		pthread_mutex_lock(&fs.lock);
+		struct node *n = node_find(e->attr.st_ino);
+		if (n) {
+			n->nlookup++;
+			pthread_mutex_unlock(&fs.lock);
+			e->ino = node_id(n);
+			return 0;
+		}
+		pthread_mutex_unlock(&fs.lock);
+
+		PMEMfile *f = pmemfile_openat(fs.pfp, parent->file, name,
+				handle_flags(e->attr.st_mode));
+		if (!f) {
+			/* name was replaced in the meantime, try again */
+			if (errno == ENOENT || errno == ELOOP ||
+					errno == ENOTDIR)
+				continue;
+			return errno;
+		}
+
+		struct stat st;
+		if (pmemfile_fstat(fs.pfp, f, &st) < 0) {
+			int error = errno;
+			pmemfile_close(fs.pfp, f);
+			return error;
+		}
 
-	int ret;
-	PMEMfilepool *pfp = PFP;
+		if (st.st_ino != e->attr.st_ino) {
+			pmemfile_close(fs.pfp, f);
+			continue;
+		}
+
+		e->attr = st;
 
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
+		n = node_get(f, &st);
+		if (!n)
+			return errno;
 
-	if (pmemfile_mkdir(pfp, path, mode) < 0) {
-		log("pmemfile_mkdir %s failed: %d\n", path, errno);
-		return -errno;
+		e->ino = node_id(n);
+		return 0;
 	}
+}
 
-	return 0;
+/*
+ * reply_entry -- replies to lookup-like request, drops the lookup reference
+ * if the request was interrupted in the meantime
+ */
+static void
+reply_entry(fuse_req_t req, const struct fuse_entry_param *e)
+{
+	if (fuse_reply_entry(req, e) == -ENOENT && e->ino != 0)
+		node_forget(get_node(e->ino), 1);
 }
 
+/*
+ * set_owner -- gives newly created inode to the caller
+ *
+ * Fills st with the attributes of the inode.
+ */
 static int
-pmemfile_fuse_rmdir(const char *path)
+set_owner(fuse_req_t req, struct node *parent, PMEMfile *file,
+		struct stat *st)
 {
-	log("%s\n", path);
-
-	int ret;
-	PMEMfilepool *pfp = PFP;
-
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
+	const struct fuse_ctx *ctx = fuse_req_ctx(req);
+	uid_t uid = ctx->uid == fs.uid ? (uid_t)-1 : ctx->uid;
+	gid_t gid = ctx->gid == fs.gid ? (gid_t)-1 : ctx->gid;
+
+	if (gid != (gid_t)-1) {
+		struct stat pst;
+		if (pmemfile_fstat(fs.pfp, parent->file, &pst) < 0)
+			return errno;
+
+		/* inode already inherited group of the parent */
+		if (pst.st_mode & S_ISGID)
+			gid = (gid_t)-1;
+	}
 
-	if (pmemfile_rmdir(pfp, path) < 0) {
-		log("pmemfile_rmdir %s failed: %d\n", path, errno);
-		return -errno;
+	if (uid != (uid_t)-1 || gid != (gid_t)-1) {
+		if (pmemfile_fchownat(fs.pfp, file, "", uid, gid,
+				AT_EMPTY_PATH) < 0)
+			return errno;
 	}
 
+	if (pmemfile_fstat(fs.pfp, file, st) < 0)
+		return errno;
+
 	return 0;
 }
 
-static int
-pmemfile_fuse_chmod(const char *path, mode_t mode)
+/*
+ * reply_new_entry -- looks up just created inode, gives it to the caller
+ * and replies with it
+ */
+static void
+reply_new_entry(fuse_req_t req, struct node *parent, const char *name)
 {
-	log("%s\n", path);
-	int ret;
-	PMEMfilepool *pfp = PFP;
+	struct fuse_entry_param e;
+	int error = node_lookup(parent, name, &e);
+	if (error) {
+		fuse_reply_err(req, error);
+		return;
+	}
 
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
+	struct node *n = get_node(e.ino);
+	error = set_owner(req, parent, n->file, &e.attr);
+	if (error) {
+		node_forget(n, 1);
+		fuse_reply_err(req, error);
+		return;
+	}
+
+	reply_entry(req, &e);
+}
 
-	if (pmemfile_chmod(pfp, path, mode) < 0) {
-		log("pmemfile_chmod %s failed: %d\n", path, errno);
-		return -errno;
+static void
+pmemfile_fuse_lookup(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+	log("%s\n", name);
+
+	struct fuse_entry_param e;
+	int error = node_lookup(get_node(parent), name, &e);
+
+	if (error == ENOENT) {
+		/* let the kernel cache negative entry */
+		entry_init(&e);
+		fuse_reply_entry(req, &e);
+	} else if (error) {
+		fuse_reply_err(req, error);
+	} else {
+		reply_entry(req, &e);
 	}
+}
 
-	return 0;
+static void
+pmemfile_fuse_forget(fuse_req_t req, fuse_ino_t ino, unsigned long nlookup)
+{
+	log("\n");
+
+	node_forget(get_node(ino), nlookup);
+	fuse_reply_none(req);
 }
 
-static int
-pmemfile_fuse_chown(const char *path, uid_t uid, gid_t gid)
+static void
+pmemfile_fuse_forget_multi(fuse_req_t req, size_t count,
+		struct fuse_forget_data *forgets)
 {
-	log("%s\n", path);
+	log("%zu\n", count);
+
+	for (size_t i = 0; i < count; ++i)
+		node_forget(get_node(forgets[i].ino), forgets[i].nlookup);
 
-	int ret;
-	PMEMfilepool *pfp = PFP;
+	fuse_reply_none(req);
+}
+
+static void
+pmemfile_fuse_getattr(fuse_req_t req, fuse_ino_t ino,
+		struct fuse_file_info *fi)
+{
+	log("\n");
 
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
+	(void) fi;
 
-	if (pmemfile_chown(pfp, path, uid, gid) < 0) {
-		log("pmemfile_chown %s failed: %d\n", path, errno);
-		return -errno;
+	struct stat st;
+	if (pmemfile_fstat(fs.pfp, get_node(ino)->file, &st) < 0) {
+		log("pmemfile_fstat failed: %d\n", errno);
+		fuse_reply_err(req, errno);
+		return;
 	}
 
-	return 0;
+	fuse_reply_attr(req, &st, PMEMFILE_FUSE_TIMEOUT);
 }
 
-static PMEMfile *
-pmemfile_open_wrapper(PMEMfilepool *pfp, const char *path, int flags,
-		pmemfile_mode_t mode)
+/*
+ * to_timespec -- converts time from setattr request to pmemfile_futimens
+ * argument
+ */
+static struct timespec
+to_timespec(int to_set, int set, int set_now, struct timespec ts)
 {
-	/*
-	 * &~0x8000, because fuse passes flag pmemfile doesn't understand
-	 * (O_LARGEFILE, which userspace on x86_64 defines as 0)
-	 */
-	return pmemfile_open(pfp, path, flags & ~0x8000, mode);
+	if (to_set & set_now)
+		ts.tv_nsec = UTIME_NOW;
+	else if (!(to_set & set))
+		ts.tv_nsec = UTIME_OMIT;
+
+	return ts;
 }
 
-static int
-pmemfile_fuse_create(const char *path, mode_t mode, struct fuse_file_info *fi)
+static void
+pmemfile_fuse_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
+		int to_set, struct fuse_file_info *fi)
 {
-	log("%s\n", path);
+	log("%x\n", to_set);
 
-	PMEMfilepool *pfp = PFP;
-	int ret;
+	(void) fi;
 
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
+	PMEMfile *f = get_node(ino)->file;
 
-	PMEMfile *f = pmemfile_open_wrapper(pfp, path, fi->flags, mode);
-	if (!f) {
-		log("pmemfile_open %s failed: %d\n", path, errno);
-		return -errno;
+	if (to_set & FUSE_SET_ATTR_MODE) {
+		if (pmemfile_fchmod(fs.pfp, f, attr->st_mode) < 0) {
+			log("pmemfile_fchmod failed: %d\n", errno);
+			goto err;
+		}
 	}
-	fi->fh = (uintptr_t)f;
 
-	return 0;
-}
+	if (to_set & (FUSE_SET_ATTR_UID | FUSE_SET_ATTR_GID)) {
+		uid_t uid = (to_set & FUSE_SET_ATTR_UID) ?
+				attr->st_uid : (uid_t)-1;
+		gid_t gid = (to_set & FUSE_SET_ATTR_GID) ?
+				attr->st_gid : (gid_t)-1;
 
-static int
-pmemfile_fuse_utimens(const char *path, const struct timespec tv[2])
-{
-	log("%s\n", path);
+		if (pmemfile_fchownat(fs.pfp, f, "", uid, gid,
+				AT_EMPTY_PATH) < 0) {
+			log("pmemfile_fchownat failed: %d\n", errno);
+			goto err;
+		}
+	}
 
-	int ret;
-	PMEMfilepool *pfp = PFP;
+	if (to_set & FUSE_SET_ATTR_SIZE) {
+		if (pmemfile_ftruncate(fs.pfp, f, attr->st_size) < 0) {
+			log("pmemfile_ftruncate failed: %d\n", errno);
+			goto err;
+		}
+	}
 
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
+	if (to_set & (FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME |
+			FUSE_SET_ATTR_ATIME_NOW | FUSE_SET_ATTR_MTIME_NOW)) {
+		struct timespec tm[2];
 
-	if (pmemfile_utimensat(pfp, NULL, path, tv, 0) < 0) {
-		log("pmemfile_utimens %s failed: %d\n", path, errno);
-		return -errno;
+		tm[0] = to_timespec(to_set, FUSE_SET_ATTR_ATIME,
+				FUSE_SET_ATTR_ATIME_NOW, attr->st_atim);
+		tm[1] = to_timespec(to_set, FUSE_SET_ATTR_MTIME,
+				FUSE_SET_ATTR_MTIME_NOW, attr->st_mtim);
+
+		if (pmemfile_futimens(fs.pfp, f, tm) < 0) {
+			log("pmemfile_futimens failed: %d\n", errno);
+			goto err;
+		}
 	}
 
-	return 0;
-}
+	struct stat st;
+	if (pmemfile_fstat(fs.pfp, f, &st) < 0) {
+		log("pmemfile_fstat failed: %d\n", errno);
+		goto err;
+	}
 
-static int
-pmemfile_fuse_open(const char *path, struct fuse_file_info *fi)
-{
-	log("%s 0%o\n", path, fi->flags);
+	fuse_reply_attr(req, &st, PMEMFILE_FUSE_TIMEOUT);
+	return;
 
-	int ret;
-	PMEMfilepool *pfp = PFP;
+err:
+	fuse_reply_err(req, errno);
+}
 
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
+static void
+pmemfile_fuse_readlink(fuse_req_t req, fuse_ino_t ino)
+{
+	log("\n");
 
-	PMEMfile *f = pmemfile_open_wrapper(pfp, path, fi->flags, 0);
-	if (f == NULL) {
-		log("pmemfile_open %s failed: %d\n", path, errno);
-		return -errno;
+	char buf[PATH_MAX + 1];
+	pmemfile_ssize_t ret = pmemfile_readlinkat(fs.pfp, get_node(ino)->file,
+			"", buf, PATH_MAX);
+	if (ret < 0) {
+		log("pmemfile_readlinkat failed: %d\n", errno);
+		fuse_reply_err(req, errno);
+		return;
 	}
-	fi->fh = (uintptr_t)f;
 
-	return 0;
+	buf[ret] = 0;
+	fuse_reply_readlink(req, buf);
 }
 
-static int
-pmemfile_fuse_release(const char *path, struct fuse_file_info *fi)
+static void
+pmemfile_fuse_mknod(fuse_req_t req, fuse_ino_t parent, const char *name,
+		mode_t mode, dev_t rdev)
 {
-	log("%s\n", path);
-
-	if (!fi->fh)
-		return -EBADF;
+	log("%s\n", name);
 
-	pmemfile_close(PFP, (PMEMfile *)fi->fh);
+	struct node *p = get_node(parent);
 
-	fi->fh = 0;
+	if (pmemfile_mknodat(fs.pfp, p->file, name, mode, rdev) < 0) {
+		log("pmemfile_mknodat %s failed: %d\n", name, errno);
+		fuse_reply_err(req, errno);
+		return;
+	}
 
-	return 0;
+	reply_new_entry(req, p, name);
 }
 
-static int
-pmemfile_fuse_write(const char *path, const char *buff, size_t size,
-		off_t off, struct fuse_file_info *fi)
+static void
+pmemfile_fuse_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name,
+		mode_t mode)
 {
-	log("%s\n", path);
-	PMEMfile *f = (PMEMfile *)fi->fh;
-	if (!f)
-		return -EBADF;
+	log("%s\n", name);
 
-	if (size > INT32_MAX)
-		size = INT32_MAX;
+	struct node *p = get_node(parent);
 
-	int ret = (int)pmemfile_pwrite(PFP, f, buff, size, off);
-	if (ret < 0) {
-		log("pmemfile_pwrite %zd failed: %d\n", size, errno);
-		return -errno;
+	if (pmemfile_mkdirat(fs.pfp, p->file, name, mode) < 0) {
+		log("pmemfile_mkdirat %s failed: %d\n", name, errno);
+		fuse_reply_err(req, errno);
+		return;
 	}
 
-	return ret;
+	reply_new_entry(req, p, name);
 }
 
-static int
-pmemfile_fuse_read(const char *path, char *buff, size_t size, off_t off,
-		struct fuse_file_info *fi)
+static void
+pmemfile_fuse_symlink(fuse_req_t req, const char *link, fuse_ino_t parent,
+		const char *name)
 {
-	log("%s\n", path);
+	log("%s -> %s\n", name, link);
 
-	PMEMfile *f = (PMEMfile *)fi->fh;
-	if (!f)
-		return -EBADF;
+	struct node *p = get_node(parent);
 
-	if (size > INT32_MAX)
-		size = INT32_MAX;
-
-	int ret = (int)pmemfile_pread(PFP, f, buff, size, off);
-	if (ret < 0) {
-		log("pmemfile_pread %zd failed: %d\n", size, errno);
-		return -errno;
+	if (pmemfile_symlinkat(fs.pfp, link, p->file, name) < 0) {
+		log("pmemfile_symlinkat %s failed: %d\n", name, errno);
+		fuse_reply_err(req, errno);
+		return;
 	}
 
-	return ret;
+	reply_new_entry(req, p, name);
 }
 
-static int
-pmemfile_fuse_truncate(const char *path, off_t off)
+static void
+pmemfile_fuse_unlink(fuse_req_t req, fuse_ino_t parent, const char *name)
 {
-	log("%s\n", path);
-	int ret;
-	PMEMfilepool *pfp = PFP;
+	log("%s\n", name);
 
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
-
-	if (pmemfile_truncate(pfp, path, off) < 0) {
-		log("pmemfile_truncate %s failed: %d\n", path, errno);
-		return -errno;
+	if (pmemfile_unlinkat(fs.pfp, get_node(parent)->file, name, 0) < 0) {
+		log("pmemfile_unlinkat %s failed: %d\n", name, errno);
+		fuse_reply_err(req, errno);
+		return;
 	}
 
-	return 0;
+	fuse_reply_err(req, 0);
 }
 
-static int
-pmemfile_fuse_ftruncate(const char *path, off_t off, struct fuse_file_info *fi)
+static void
+pmemfile_fuse_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name)
 {
-	log("%s\n", path);
+	log("%s\n", name);
 
-	if (!fi->fh)
-		return -EBADF;
+	if (pmemfile_unlinkat(fs.pfp, get_node(parent)->file, name,
+			AT_REMOVEDIR) < 0) {
+		log("pmemfile_unlinkat %s failed: %d\n", name, errno);
+		fuse_reply_err(req, errno);
+		return;
+	}
 
-	int ret;
-	PMEMfilepool *pfp = PFP;
+	fuse_reply_err(req, 0);
+}
 
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
+static void
+pmemfile_fuse_rename(fuse_req_t req, fuse_ino_t parent, const char *name,
+		fuse_ino_t newparent, const char *newname)
+{
+	log("%s -> %s\n", name, newname);
 
-	if (pmemfile_ftruncate(pfp, (PMEMfile *)fi->fh, off) < 0) {
-		log("pmemfile_ftruncate %s failed: %d\n", path, errno);
-		return -errno;
+	if (pmemfile_renameat(fs.pfp, get_node(parent)->file, name,
+			get_node(newparent)->file, newname) < 0) {
+		log("pmemfile_renameat %s failed: %d\n", name, errno);
+		fuse_reply_err(req, errno);
+		return;
 	}
 
-	return 0;
+	fuse_reply_err(req, 0);
 }
 
-static int
-pmemfile_fuse_unlink(const char *path)
+static void
+pmemfile_fuse_link(fuse_req_t req, fuse_ino_t ino, fuse_ino_t newparent,
+		const char *newname)
 {
-	log("%s\n", path);
+	log("%s\n", newname);
 
-	int ret;
-	PMEMfilepool *pfp = PFP;
+	struct node *np = get_node(newparent);
 
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
+	if (pmemfile_linkat(fs.pfp, get_node(ino)->file, "", np->file,
+			newname, AT_EMPTY_PATH) < 0) {
+		log("pmemfile_linkat %s failed: %d\n", newname, errno);
+		fuse_reply_err(req, errno);
+		return;
+	}
 
-	if (pmemfile_unlink(pfp, path) < 0) {
-		log("pmemfile_unlink %s failed: %d\n", path, errno);
-		return -errno;
+	struct fuse_entry_param e;
+	int error = node_lookup(np, newname, &e);
+	if (error) {
+		fuse_reply_err(req, error);
+		return;
 	}
 
-	return 0;
+	reply_entry(req, &e);
 }
 
-static int
-pmemfile_fuse_link(const char *path1, const char *path2)
+static void
+pmemfile_fuse_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
 {
-	log("%s %s\n", path1, path2);
-
-	int ret;
-	PMEMfilepool *pfp = PFP;
+	log("\n");
 
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
+	(void) ino;
 
-	if (pmemfile_link(pfp, path1, path2) < 0) {
-		log("pmemfile_link %s %s failed: %d\n", path1, path2, errno);
-		return -errno;
-	}
+	/*
+	 * All I/O goes through the node handle. O_TRUNC comes as a separate
+	 * setattr and the kernel computes offsets for O_APPEND.
+	 */
+	fi->fh = 0;
+	fi->keep_cache = 1;
 
-	return 0;
+	fuse_reply_open(req, fi);
 }
 
-static int
-pmemfile_fuse_flush(const char *path, struct fuse_file_info *fi)
+static void
+pmemfile_fuse_create(fuse_req_t req, fuse_ino_t parent, const char *name,
+		mode_t mode, struct fuse_file_info *fi)
 {
-	log("%s\n", path);
-	return 0;
+	log("%s\n", name);
+
+	struct node *p = get_node(parent);
+
+	/*
+	 * The handle is shared by all openers of the node, so flags of this
+	 * open (O_APPEND, O_NOATIME, O_SYNC...) can't stick to it.
+	 */
+	PMEMfile *f = pmemfile_openat(fs.pfp, p->file, name,
+			O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW, mode);
+	if (!f) {
+		log("pmemfile_openat %s failed: %d\n", name, errno);
+
+		if (errno != EEXIST || (fi->flags & O_EXCL)) {
+			fuse_reply_err(req, errno);
+			return;
+		}
+	}
+
+	struct fuse_entry_param e;
+	if (f) {
+		entry_init(&e);
+
+		int error = set_owner(req, p, f, &e.attr);
+		if (error) {
+			pmemfile_close(fs.pfp, f);
+			fuse_reply_err(req, error);
+			return;
+		}
+
+		struct node *n = node_get(f, &e.attr);
+		if (!n) {
+			fuse_reply_err(req, errno);
+			return;
+		}
+
+		e.ino = node_id(n);
+	} else {
+		/* somebody created it first, open the existing file */
+		int error = node_lookup(p, name, &e);
+		if (error) {
+			fuse_reply_err(req, error);
+			return;
+		}
+
+		if (S_ISDIR(e.attr.st_mode))
+			error = EISDIR;
+		else if (!S_ISREG(e.attr.st_mode))
+			error = EEXIST;
+		else if ((fi->flags & O_TRUNC) && pmemfile_ftruncate(fs.pfp,
+				get_node(e.ino)->file, 0) < 0)
+			error = errno;
+		else if (pmemfile_fstat(fs.pfp, get_node(e.ino)->file,
+				&e.attr) < 0)
+			error = errno;
+
+		if (error) {
+			node_forget(get_node(e.ino), 1);
+			fuse_reply_err(req, error);
+			return;
+		}
+	}
+
+	fi->fh = 0;
+	fi->keep_cache = 1;
+
+	if (fuse_reply_create(req, &e, fi) == -ENOENT)
+		node_forget(get_node(e.ino), 1);
 }
 
-static int
-pmemfile_fuse_ioctl(const char *path, int cmd, void *arg,
-		struct fuse_file_info *fi, unsigned flags, void *data)
+/*
+ * get_read_buf -- returns this thread's buffer for read replies, at least
+ * size bytes long
+ */
+static char *
+get_read_buf(size_t size)
 {
-	log("%s\n", path);
-	return -ENOTSUP;
+	struct read_buf *buf = pthread_getspecific(fs.read_buf);
+	if (buf && buf->size >= size)
+		return buf->data;
+
+	free(buf);
+	buf = malloc(sizeof(*buf) + size);
+	pthread_setspecific(fs.read_buf, buf);
+	if (!buf)
+		return NULL;
+
+	buf->size = size;
+	return buf->data;
 }
 
-static int
-pmemfile_fuse_rename(const char *path, const char *dest)
+static void
+pmemfile_fuse_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+		struct fuse_file_info *fi)
 {
-	log("%s %s\n", path, dest);
+	log("%zu@%ld\n", size, (long)off);
 
-	int ret;
-	PMEMfilepool *pfp = PFP;
+	(void) fi;
 
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
+	char *buf = get_read_buf(size);
+	if (!buf) {
+		fuse_reply_err(req, ENOMEM);
+		return;
+	}
 
-	if (pmemfile_rename(pfp, path, dest) < 0) {
-		log("pmemfile_rename %s %s failed: %d\n", path, dest, errno);
-		return -errno;
+	pmemfile_ssize_t ret = pmemfile_pread(fs.pfp, get_node(ino)->file, buf,
+			size, off);
+	if (ret < 0) {
+		log("pmemfile_pread failed: %d\n", errno);
+		fuse_reply_err(req, errno);
+		return;
 	}
 
-	return 0;
+	fuse_reply_buf(req, buf, (size_t)ret);
 }
 
-static int
-pmemfile_fuse_symlink(const char *path, const char *link)
+static void
+pmemfile_fuse_write(fuse_req_t req, fuse_ino_t ino, const char *buf,
+		size_t size, off_t off, struct fuse_file_info *fi)
 {
-	log("%s %s\n", path, link);
-
-	int ret;
-	PMEMfilepool *pfp = PFP;
+	log("%zu@%ld\n", size, (long)off);
 
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
+	(void) fi;
 
-	if (pmemfile_symlink(pfp, path, link) < 0) {
-		log("pmemfile_symlink %s %s failed: %d\n", path, link, errno);
-		return -errno;
+	pmemfile_ssize_t ret = pmemfile_pwrite(fs.pfp, get_node(ino)->file,
+			buf, size, off);
+	if (ret < 0) {
+		log("pmemfile_pwrite failed: %d\n", errno);
+		fuse_reply_err(req, errno);
+		return;
 	}
 
-	return 0;
+	fuse_reply_write(req, (size_t)ret);
 }
 
-static int
-pmemfile_fuse_readlink(const char *path, char *buff, size_t size)
+/*
+ * pmemfile_fuse_sync -- flush, fsync and fsyncdir - pmemfile data is
+ * persistent as soon as the call that wrote it returns
+ */
+static void
+pmemfile_fuse_sync(fuse_req_t req, fuse_ino_t ino, int datasync,
+		struct fuse_file_info *fi)
+{
+	(void) ino;
+	(void) datasync;
+	(void) fi;
+
+	fuse_reply_err(req, 0);
+}
+
+static void
+pmemfile_fuse_flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+	pmemfile_fuse_sync(req, ino, 0, fi);
+}
+
+static void
+pmemfile_fuse_release(fuse_req_t req, fuse_ino_t ino,
+		struct fuse_file_info *fi)
 {
-	log("%s\n", path);
+	log("\n");
 
-	int ret;
-	PMEMfilepool *pfp = PFP;
+	(void) ino;
+	(void) fi;
 
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
+	fuse_reply_err(req, 0);
+}
 
-	ret = (int)pmemfile_readlink(pfp, path, buff, size - 1);
-	if (ret < 0) {
-		log("pmemfile_readlink %s failed: %d\n", path, errno);
-		return -errno;
+static void
+pmemfile_fuse_fallocate(fuse_req_t req, fuse_ino_t ino, int mode, off_t offset,
+		off_t length, struct fuse_file_info *fi)
+{
+	log("\n");
+
+	(void) fi;
+
+	if (pmemfile_fallocate(fs.pfp, get_node(ino)->file, mode, offset,
+			length) < 0) {
+		log("pmemfile_fallocate failed: %d\n", errno);
+		fuse_reply_err(req, errno);
+		return;
 	}
-	buff[ret] = 0;
 
-	return 0;
+	fuse_reply_err(req, 0);
 }
 
-static int
-pmemfile_fuse_mknod(const char *path, mode_t mode, dev_t dev)
+static void
+pmemfile_fuse_opendir(fuse_req_t req, fuse_ino_t ino,
+		struct fuse_file_info *fi)
 {
-	log("%s\n", path);
-	int ret;
-	PMEMfilepool *pfp = PFP;
+	log("\n");
 
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
+	struct dir_handle *d = malloc(sizeof(*d));
+	if (!d) {
+		fuse_reply_err(req, ENOMEM);
+		return;
+	}
 
-	if (pmemfile_mknodat(pfp, NULL, path, mode, dev) < 0) {
-		log("pmemfile_mknod %s failed: %d\n", path, errno);
-		return -errno;
+	/* readdir needs its own offset, so it can't use the node handle */
+	d->file = pmemfile_openat(fs.pfp, get_node(ino)->file, ".",
+			O_DIRECTORY | O_RDONLY);
+	if (!d->file) {
+		log("pmemfile_openat failed: %d\n", errno);
+		free(d);
+		fuse_reply_err(req, errno);
+		return;
 	}
+	d->next = 0;
 
-	return 0;
+	fi->fh = (uintptr_t)d;
+
+	if (fuse_reply_open(req, fi) == -ENOENT) {
+		pmemfile_close(fs.pfp, d->file);
+		free(d);
+	}
 }
 
-static int
-pmemfile_fuse_fallocate(const char *path, int mode, off_t offset, off_t size,
+/* the same layout as struct linux_dirent64 */
+struct pmemfile_fuse_dirent {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+static void
+pmemfile_fuse_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
 		struct fuse_file_info *fi)
 {
-	log("%s\n", path);
+	log("%zu@%ld\n", size, (long)off);
+
+	(void) ino;
 
-	PMEMfile *f = (PMEMfile *)fi->fh;
-	if (!f)
-		return -EBADF;
+	struct dir_handle *d = (struct dir_handle *)(uintptr_t)fi->fh;
+	uint64_t dirbuf[512];
+	char *dirp = (char *)dirbuf;
+	char *buf = malloc(size);
+	if (!buf) {
+		fuse_reply_err(req, ENOMEM);
+		return;
+	}
 
-	int ret;
-	PMEMfilepool *pfp = PFP;
+	if (d->next != off &&
+			pmemfile_lseek(fs.pfp, d->file, off, SEEK_SET) != off) {
+		log("pmemfile_lseek failed: %d\n", errno);
+		goto err;
+	}
 
-	if ((ret = update_ctx(pfp)) < 0)
-		return ret;
+	size_t pos = 0;
+	bool full = false;
 
-	if (pmemfile_fallocate(pfp, f, mode, offset, size) < 0) {
-		log("pmemfile_fallocate %s failed: %d\n", path, errno);
-		return -errno;
+	while (!full) {
+		int ret = pmemfile_getdents64(fs.pfp, d->file,
+				(struct linux_dirent64 *)dirp, sizeof(dirbuf));
+		if (ret < 0) {
+			log("pmemfile_getdents64 failed: %d\n", errno);
+			goto err;
+		}
+		if (ret == 0)
+			break;
+
+		for (int i = 0; i < ret; ) {
+			struct pmemfile_fuse_dirent *de =
+				(struct pmemfile_fuse_dirent *)(dirp + i);
+
+			/* the kernel needs only inode number and type */
+			struct stat st;
+			memset(&st, 0, sizeof(st));
+			st.st_ino = de->d_ino;
+			st.st_mode = (mode_t)de->d_type << 12;
+
+			size_t len = fuse_add_direntry(req, buf + pos,
+					size - pos, de->d_name, &st,
+					de->d_off);
+			if (len > size - pos) {
+				full = true;
+				break;
+			}
+
+			pos += len;
+			off = de->d_off;
+			i += de->d_reclen;
+		}
 	}
 
-	return 0;
+	/* if the reply is full, the handle went past the last sent entry */
+	d->next = full ? -1 : off;
+
+	fuse_reply_buf(req, buf, pos);
+	free(buf);
+	return;
+
+err:
+	d->next = -1;
+	fuse_reply_err(req, errno);
+	free(buf);
 }
 
-static void *
-pmemfile_fuse_init(struct fuse_conn_info *conn)
+static void
+pmemfile_fuse_releasedir(fuse_req_t req, fuse_ino_t ino,
+		struct fuse_file_info *fi)
 {
 	log("\n");
 
-	return PFP;
+	(void) ino;
+
+	struct dir_handle *d = (struct dir_handle *)(uintptr_t)fi->fh;
+
+	pmemfile_close(fs.pfp, d->file);
+	free(d);
+
+	fuse_reply_err(req, 0);
 }
 
-static int
-pmemfile_fuse_statvfs(const char *path, struct statvfs *vfs)
+static void
+pmemfile_fuse_statfs(fuse_req_t req, fuse_ino_t ino)
 {
-	memset(vfs, 0, sizeof(*vfs));
-	vfs->f_bsize = 4096;
-	vfs->f_namemax = 255;
+	(void) ino;
 
-	return 0;
+	struct statvfs vfs;
+	memset(&vfs, 0, sizeof(vfs));
+	vfs.f_bsize = 4096;
+	vfs.f_namemax = 255;
+
+	fuse_reply_statfs(req, &vfs);
 }
 
-static struct fuse_operations pmemfile_ops = {
-	.init		= pmemfile_fuse_init,
-	.statfs		= pmemfile_fuse_statvfs,
+static struct fuse_lowlevel_ops pmemfile_ops = {
+	.lookup		= pmemfile_fuse_lookup,
+	.forget		= pmemfile_fuse_forget,
+	.forget_multi	= pmemfile_fuse_forget_multi,
 	.getattr	= pmemfile_fuse_getattr,
-	.chmod		= pmemfile_fuse_chmod,
-	.chown		= pmemfile_fuse_chown,
-	.utimens	= pmemfile_fuse_utimens,
-	.ioctl		= pmemfile_fuse_ioctl,
-	.opendir	= pmemfile_fuse_opendir,
-	.releasedir	= pmemfile_fuse_releasedir,
-	.readdir	= pmemfile_fuse_readdir,
-	.mkdir		= pmemfile_fuse_mkdir,
-	.rmdir		= pmemfile_fuse_rmdir,
-	.rename		= pmemfile_fuse_rename,
+	.setattr	= pmemfile_fuse_setattr,
+	.readlink	= pmemfile_fuse_readlink,
 	.mknod		= pmemfile_fuse_mknod,
+	.mkdir		= pmemfile_fuse_mkdir,
 	.symlink	= pmemfile_fuse_symlink,
-	.create		= pmemfile_fuse_create,
 	.unlink		= pmemfile_fuse_unlink,
+	.rmdir		= pmemfile_fuse_rmdir,
+	.rename		= pmemfile_fuse_rename,
 	.link		= pmemfile_fuse_link,
 	.open		= pmemfile_fuse_open,
-	.release	= pmemfile_fuse_release,
-	.write		= pmemfile_fuse_write,
+	.create		= pmemfile_fuse_create,
 	.read		= pmemfile_fuse_read,
+	.write		= pmemfile_fuse_write,
 	.flush		= pmemfile_fuse_flush,
-	.truncate	= pmemfile_fuse_truncate,
-	.ftruncate	= pmemfile_fuse_ftruncate,
+	.release	= pmemfile_fuse_release,
+	.fsync		= pmemfile_fuse_sync,
 	.fallocate	= pmemfile_fuse_fallocate,
-	.readlink	= pmemfile_fuse_readlink,
-
-	.flag_nopath = 1,
+	.opendir	= pmemfile_fuse_opendir,
+	.readdir	= pmemfile_fuse_readdir,
+	.releasedir	= pmemfile_fuse_releasedir,
+	.fsyncdir	= pmemfile_fuse_sync,
+	.statfs		= pmemfile_fuse_statfs,
 };
 
+/*
+ * fs_init -- opens the pool and sets up state shared by all requests
+ */
+static int
+fs_init(const char *poolpath)
+{
+	fs.pfp = pmemfile_pool_open(poolpath);
+	if (!fs.pfp)
+		return -1;
+
+	/* the kernel checks permissions, pmemfile must not reject anything */
+	if (pmemfile_setcap(fs.pfp, PMEMFILE_CAP_CHOWN) < 0 ||
+			pmemfile_setcap(fs.pfp, PMEMFILE_CAP_FOWNER) < 0)
+		goto err;
+
+	/* the kernel already applied the caller's umask */
+	pmemfile_umask(fs.pfp, 0);
+
+	fs.uid = pmemfile_geteuid(fs.pfp);
+	fs.gid = pmemfile_getegid(fs.pfp);
+
+	fs.nbuckets = NODE_TABLE_MIN_SIZE;
+	fs.buckets = calloc(fs.nbuckets, sizeof(*fs.buckets));
+	if (!fs.buckets)
+		goto err;
+
+	if ((errno = pthread_key_create(&fs.read_buf, free)) != 0)
+		goto err_key;
+
+	PMEMfile *root = pmemfile_open(fs.pfp, "/", O_DIRECTORY | O_RDONLY);
+	if (!root)
+		goto err_root;
+
+	struct stat st;
+	if (pmemfile_fstat(fs.pfp, root, &st) < 0) {
+		pmemfile_close(fs.pfp, root);
+		goto err_root;
+	}
+
+	/* the kernel never forgets the root */
+	fs.root = node_get(root, &st);
+	if (!fs.root)
+		goto err_root;
+
+	return 0;
+
+err_root:
+	pthread_key_delete(fs.read_buf);
+err_key:
+	free(fs.buckets);
+err:
+	pmemfile_pool_close(fs.pfp);
+	return -1;
+}
+
+/*
+ * fs_fini -- releases all nodes and closes the pool
+ */
+static void
+fs_fini(void)
+{
+	for (size_t i = 0; i < fs.nbuckets; ++i) {
+		struct node *n = fs.buckets[i];
+		while (n) {
+			struct node *next = n->next;
+
+			pmemfile_close(fs.pfp, n->file);
+			free(n);
+			n = next;
+		}
+	}
+
+	free(fs.buckets);
+	pthread_key_delete(fs.read_buf);
+	pmemfile_pool_close(fs.pfp);
+}
+
 static void
 print_usage(FILE *stream, const char *progname)
 {
@@ -670,10 +1222,6 @@ main(int argc, char *argv[])
 	char *poolpath = argv[optind++];
 	char *mountpoint = argv[optind++];
 
-	PMEMfilepool *pool = pmemfile_pool_open(poolpath);
-	if (!pool)
-		err(2, "can't open pool '%s'", poolpath);
-
 	char resolved_path[PATH_MAX];
 	if (realpath(poolpath, resolved_path) == NULL)
 		err(3, "realpath");
@@ -690,18 +1238,59 @@ main(int argc, char *argv[])
 	fuse_args[idx++] = fsname;
 	fuse_args[idx++] = "-o";
 	fuse_args[idx++] = "subtype=pmemfile";
+	fuse_args[idx++] = "-o";
+	fuse_args[idx++] = "default_permissions,big_writes";
 
 	if (allow_other) {
 		fuse_args[idx++] = "-o";
 		fuse_args[idx++] = "allow_other";
 	}
 
-	if (foreground)
-		fuse_args[idx++] = "-f";
+	assert((unsigned)idx <= (sizeof(fuse_args) / sizeof(fuse_args[0])));
 
-	fuse_args[idx++] = mountpoint;
+	struct fuse_args args = FUSE_ARGS_INIT(idx, fuse_args);
+	int ret = 5;
 
-	assert((unsigned)idx <= (sizeof(fuse_args) / sizeof(fuse_args[0])));
+	struct fuse_chan *ch = fuse_mount(mountpoint, &args);
+	if (!ch)
+		errx(5, "can't mount '%s'", mountpoint);
+
+	struct fuse_session *se = fuse_lowlevel_new(&args, &pmemfile_ops,
+			sizeof(pmemfile_ops), NULL);
+	if (!se)
+		goto unmount;
 
-	return fuse_main(idx, fuse_args, &pmemfile_ops, pool);
+	if (fuse_set_signal_handlers(se) < 0)
+		goto destroy;
+
+	fuse_session_add_chan(se, ch);
+
+	if (fuse_daemonize(foreground) < 0)
+		goto remove_chan;
+
+	/*
+	 * Open the pool after daemonizing - fork would lose the threads
+	 * libpmemfile-posix starts.
+	 */
+	if (fs_init(poolpath)) {
+		warn("can't open pool '%s'", poolpath);
+		ret = 2;
+		goto remove_chan;
+	}
+
+	ret = fuse_session_loop_mt(se) ? 1 : 0;
+
+	fs_fini();
+
+remove_chan:
+	fuse_session_remove_chan(ch);
+	fuse_remove_signal_handlers(se);
+destroy:
+	fuse_session_destroy(se);
+unmount:
+	fuse_unmount(mountpoint, ch);
+	fuse_opt_free_args(&args);
+	free(fsname);
+
+	return ret;
 }
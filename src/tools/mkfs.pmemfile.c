@@ -44,6 +44,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "libpmemfile-posix.h"
 
@@ -59,10 +60,13 @@ static void
 print_usage(FILE *stream)
 {
 	fprintf(stream,
-	    "Usage: %s [-v] [-h] path fs-size\n"
+	    "Usage: %s [-v] [-h] [-i inode-size] [-b classes] path fs-size\n"
 	    "Options:\n"
 	    "  -v      print version\n"
-	    "  -h      print this help text\n",
+	    "  -h      print this help text\n"
+	    "  -i      inode size, 4096 (default) or 512\n"
+	    "  -b      data block classes, size[:units][,size[:units]...],\n"
+	    "          e.g. 16K:128,256K:16,2M:8\n",
 	    progname);
 }
 
@@ -131,17 +135,82 @@ parse_size(const char *str)
 	return (size_t)size;
 }
 
+static void
+invalid_classes(void)
+{
+	fputs("Invalid block classes\n", stderr);
+	print_usage(stderr);
+	exit(2);
+}
+
+/* units per block of classes given without them */
+#define DEFAULT_UNITS_PER_BLOCK 16
+
+/*
+ * parse_classes -- parses list of block classes, returns their number
+ */
+static unsigned
+parse_classes(char *str, struct pmemfile_block_class *classes)
+{
+	unsigned n = 0;
+	char *saveptr;
+
+	for (char *tok = strtok_r(str, ",", &saveptr); tok != NULL;
+			tok = strtok_r(NULL, ",", &saveptr)) {
+		if (n == PMEMFILE_MAX_BLOCK_CLASSES)
+			invalid_classes();
+
+		unsigned long units = DEFAULT_UNITS_PER_BLOCK;
+		char *colon = strchr(tok, ':');
+		if (colon) {
+			char *endptr;
+
+			*colon = '\0';
+			errno = 0;
+			units = strtoul(colon + 1, &endptr, 0);
+			if (errno != 0 || colon[1] == '\0' ||
+					*endptr != '\0' || units == 0 ||
+					units > UINT_MAX)
+				invalid_classes();
+		}
+
+		classes[n].size = parse_size(tok);
+		classes[n].units_per_block = (unsigned)units;
+		n++;
+	}
+
+	if (n == 0)
+		invalid_classes();
+
+	return n;
+}
+
 int
 main(int argc, char *argv[])
 {
 	int opt;
 	size_t size;
 	const char *path;
+	uint64_t flags = 0;
+	struct pmemfile_block_class classes[PMEMFILE_MAX_BLOCK_CLASSES];
+	unsigned nclasses = 0;
 
 	progname = argv[0];
 
-	while ((opt = getopt(argc, argv, "vh")) >= 0) {
+	while ((opt = getopt(argc, argv, "vhi:b:")) >= 0) {
 		switch (opt) {
+		case 'b':
+			nclasses = parse_classes(optarg, classes);
+			break;
+		case 'i':
+			if (strcmp(optarg, "512") == 0) {
+				flags |= PMEMFILE_POOL_COMPACT_INODES;
+			} else if (strcmp(optarg, "4096") != 0) {
+				fputs("Invalid inode size\n", stderr);
+				print_usage(stderr);
+				return 2;
+			}
+			break;
 		case 'v':
 		case 'V':
 			print_version();
@@ -165,8 +234,9 @@ main(int argc, char *argv[])
 
 	size = parse_size(argv[optind + 1]);
 
-	PMEMfilepool *pool = pmemfile_pool_create(path, size,
-			PMEMFILE_S_IWUSR | PMEMFILE_S_IRUSR);
+	PMEMfilepool *pool = pmemfile_pool_xcreate_classes(path, size,
+			PMEMFILE_S_IWUSR | PMEMFILE_S_IRUSR, flags,
+			nclasses ? classes : NULL, nclasses);
 	if (pool == NULL) {
 		perror("pmemfile_mkfs ");
 		return 1;
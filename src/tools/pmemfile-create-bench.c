@@ -0,0 +1,160 @@
+/*
+ * Copyright 2016-2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmemfile-create-bench.c -- measures average latency of create and unlink
+ *
+ * Run it once more with PMEMFILE_REDO_METADATA=0 to compare the redo log
+ * fast paths with transactions.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "libpmemfile-posix.h"
+
+#define BENCH_DIR "/pmemfile-create-bench"
+
+static void
+print_usage(FILE *stream, const char *progname)
+{
+	fprintf(stream, "Usage: %s [-n FILES] POOL\n", progname);
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return (uint64_t)t.tv_sec * 1000000000 + (uint64_t)t.tv_nsec;
+}
+
+static void
+create_files(PMEMfilepool *pool, unsigned files)
+{
+	char name[64];
+
+	for (unsigned i = 0; i < files; ++i) {
+		sprintf(name, BENCH_DIR "/file%u", i);
+
+		PMEMfile *f = pmemfile_open(pool, name,
+				PMEMFILE_O_CREAT | PMEMFILE_O_EXCL, 0644);
+		if (f == NULL) {
+			perror(name);
+			exit(1);
+		}
+
+		pmemfile_close(pool, f);
+	}
+}
+
+static void
+unlink_files(PMEMfilepool *pool, unsigned files)
+{
+	char name[64];
+
+	for (unsigned i = 0; i < files; ++i) {
+		sprintf(name, BENCH_DIR "/file%u", i);
+
+		if (pmemfile_unlink(pool, name)) {
+			perror(name);
+			exit(1);
+		}
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	int opt;
+	unsigned files = 1000;
+
+	while ((opt = getopt(argc, argv, "n:h")) >= 0) {
+		switch (opt) {
+		case 'n':
+			files = (unsigned)strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			print_usage(stdout, argv[0]);
+			return 0;
+		default:
+			print_usage(stderr, argv[0]);
+			return 2;
+		}
+	}
+
+	if (optind + 1 != argc || files == 0) {
+		print_usage(stderr, argv[0]);
+		return 2;
+	}
+
+	PMEMfilepool *pool = pmemfile_pool_open(argv[optind]);
+	if (pool == NULL) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	if (pmemfile_mkdir(pool, BENCH_DIR, 0755)) {
+		perror(BENCH_DIR);
+		return 1;
+	}
+
+	/* the first pass grows the directory, only the second one counts */
+	create_files(pool, files);
+	unlink_files(pool, files);
+
+	uint64_t start = now_ns();
+	create_files(pool, files);
+	uint64_t mid = now_ns();
+	unlink_files(pool, files);
+	uint64_t end = now_ns();
+
+	const char *env = getenv("PMEMFILE_REDO_METADATA");
+	printf("%s: create %llu ns, unlink %llu ns\n",
+			env && env[0] == '0' ? "transactions" : "redo log",
+			(unsigned long long)(mid - start) / files,
+			(unsigned long long)(end - mid) / files);
+
+	if (pmemfile_rmdir(pool, BENCH_DIR)) {
+		perror(BENCH_DIR);
+		return 1;
+	}
+
+	pmemfile_pool_close(pool);
+
+	return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright 2016-2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmemfile-stream-bench.c -- measures reading a file as 1 to 4 interleaved
+ * sequential streams over a single handle
+ *
+ * With per-handle block cursors all variants should take about the same
+ * time; without them every switch to another stream walks the block list.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "libpmemfile-posix.h"
+
+#define BENCH_FILE "/pmemfile-stream-bench"
+#define MAX_STREAMS 4
+
+static void
+print_usage(FILE *stream, const char *progname)
+{
+	fprintf(stream, "Usage: %s [-s FILE_SIZE] [-c CHUNK] POOL\n",
+			progname);
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return (uint64_t)t.tv_sec * 1000000000 + (uint64_t)t.tv_nsec;
+}
+
+static void
+read_streams(PMEMfilepool *pool, PMEMfile *f, size_t file_size,
+		size_t chunk, size_t streams, char *buf)
+{
+	size_t pos[MAX_STREAMS];
+
+	for (size_t s = 0; s < streams; ++s)
+		pos[s] = s * (file_size / streams);
+
+	for (size_t i = 0; i < file_size / streams / chunk; ++i) {
+		for (size_t s = 0; s < streams; ++s) {
+			pmemfile_ssize_t r = pmemfile_pread(pool, f, buf,
+					chunk, (pmemfile_off_t)pos[s]);
+			if (r != (pmemfile_ssize_t)chunk) {
+				perror("pmemfile_pread");
+				exit(1);
+			}
+
+			pos[s] += chunk;
+		}
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	int opt;
+	size_t file_size = 8 << 20;
+	size_t chunk = 512;
+
+	while ((opt = getopt(argc, argv, "s:c:h")) >= 0) {
+		switch (opt) {
+		case 's':
+			file_size = strtoull(optarg, NULL, 0);
+			break;
+		case 'c':
+			chunk = strtoull(optarg, NULL, 0);
+			break;
+		case 'h':
+			print_usage(stdout, argv[0]);
+			return 0;
+		default:
+			print_usage(stderr, argv[0]);
+			return 2;
+		}
+	}
+
+	if (optind + 1 != argc || chunk == 0 ||
+			file_size < chunk * MAX_STREAMS) {
+		print_usage(stderr, argv[0]);
+		return 2;
+	}
+
+	PMEMfilepool *pool = pmemfile_pool_open(argv[optind]);
+	if (pool == NULL) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	PMEMfile *f = pmemfile_open(pool, BENCH_FILE, PMEMFILE_O_RDWR |
+			PMEMFILE_O_CREAT | PMEMFILE_O_EXCL, 0644);
+	if (f == NULL) {
+		perror(BENCH_FILE);
+		return 1;
+	}
+
+	/* lots of small writes, to get lots of blocks */
+	char buf[0x1000];
+	memset(buf, 0, sizeof(buf));
+	for (size_t off = 0; off < file_size; off += sizeof(buf)) {
+		if (pmemfile_write(pool, f, buf, sizeof(buf)) !=
+				(pmemfile_ssize_t)sizeof(buf)) {
+			perror("pmemfile_write");
+			return 1;
+		}
+	}
+
+	char *rbuf = malloc(chunk);
+	if (rbuf == NULL) {
+		perror("malloc");
+		return 1;
+	}
+
+	for (size_t streams = 1; streams <= MAX_STREAMS; ++streams) {
+		uint64_t start = now_ns();
+		read_streams(pool, f, file_size, chunk, streams, rbuf);
+		uint64_t end = now_ns();
+
+		printf("%zu stream(s): %llu us\n", streams,
+				(unsigned long long)(end - start) / 1000);
+	}
+
+	free(rbuf);
+	pmemfile_close(pool, f);
+
+	if (pmemfile_unlink(pool, BENCH_FILE)) {
+		perror(BENCH_FILE);
+		return 1;
+	}
+
+	pmemfile_pool_close(pool);
+
+	return 0;
+}
@@ -241,6 +241,27 @@ pmemfile_pool_create(const char *pathname, size_t poolsize, mode_t mode)
 	return NULL;
 }
 
+PMEMfilepool *
+pmemfile_pool_xcreate(const char *pathname, size_t poolsize, mode_t mode,
+		uint64_t flags)
+{
+	(void) flags;
+
+	return pmemfile_pool_create(pathname, poolsize, mode);
+}
+
+PMEMfilepool *
+pmemfile_pool_xcreate_classes(const char *pathname, size_t poolsize,
+		mode_t mode, uint64_t flags,
+		const struct pmemfile_block_class *classes, unsigned nclasses)
+{
+	(void) flags;
+	(void) classes;
+	(void) nclasses;
+
+	return pmemfile_pool_create(pathname, poolsize, mode);
+}
+
 int
 pmemfile_getdents64(PMEMfilepool *pfp, PMEMfile *file,
 			struct linux_dirent64 *dirp, unsigned count)
@@ -354,6 +375,17 @@ pmemfile_stats(PMEMfilepool *pfp, struct pmemfile_stats *stats)
 	stats->inode_arrays = 0;
 }
 
+int
+pmemfile_runtime_stats(PMEMfilepool *pfp,
+		struct pmemfile_runtime_stats *stats, size_t size)
+{
+	(void) pfp;
+
+	memset(stats, 0, size);
+
+	return 0;
+}
+
 int
 pmemfile_mkdir(PMEMfilepool *pfp, const char *path, mode_t mode)
 {
@@ -497,6 +529,24 @@ pmemfile_posix_fallocate(PMEMfilepool *pfp, PMEMfile *file,
 	return posix_fallocate(file->fd, offset, length);
 }
 
+int
+pmemfile_fadvise(PMEMfilepool *pfp, PMEMfile *file, pmemfile_off_t offset,
+		pmemfile_off_t len, int advice)
+{
+	if (pfp == NULL || file == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	int error = posix_fadvise(file->fd, offset, len, advice);
+	if (error) {
+		errno = error;
+		return -1;
+	}
+
+	return 0;
+}
+
 pmemfile_ssize_t
 pmemfile_pwrite(PMEMfilepool *pfp, PMEMfile *file, const void *buf,
 		size_t count, pmemfile_off_t offset)
@@ -567,6 +617,23 @@ pmemfile_preadv(PMEMfilepool *pfp, PMEMfile *file, const pmemfile_iovec_t *iov,
 	return preadv(file->fd, iov, iovcnt, offset);
 }
 
+pmemfile_ssize_t
+pmemfile_preadv2(PMEMfilepool *pfp, PMEMfile *file,
+		const pmemfile_iovec_t *iov, int iovcnt, pmemfile_off_t offset,
+		int flags)
+{
+	if (pfp == NULL || file == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	/* Syscall param preadv2(vector) points to unaddressable byte(s) */
+	if (sanitize_pointer_arg(iov) != 0)
+		return -1;
+
+	return syscall(SYS_preadv2, file->fd, iov, iovcnt, offset, 0, flags);
+}
+
 pmemfile_ssize_t
 pmemfile_writev(PMEMfilepool *pfp, PMEMfile *file, const pmemfile_iovec_t *iov,
 		int iovcnt)
@@ -599,6 +666,23 @@ pmemfile_pwritev(PMEMfilepool *pfp, PMEMfile *file, const pmemfile_iovec_t *iov,
 	return pwritev(file->fd, iov, iovcnt, offset);
 }
 
+pmemfile_ssize_t
+pmemfile_pwritev2(PMEMfilepool *pfp, PMEMfile *file,
+		const pmemfile_iovec_t *iov, int iovcnt, pmemfile_off_t offset,
+		int flags)
+{
+	if (pfp == NULL || file == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	/* Syscall param pwritev2(vector) points to unaddressable byte(s) */
+	if (sanitize_pointer_arg(iov) != 0)
+		return -1;
+
+	return syscall(SYS_pwritev2, file->fd, iov, iovcnt, offset, 0, flags);
+}
+
 int
 pmemfile_stat(PMEMfilepool *pfp, const char *path, pmemfile_stat_t *buf)
 {
@@ -1573,6 +1657,12 @@ void _pmemfile_inject_fault_at(enum pf_allocation_type type, int nth,
 	printf("_pmemfile_inject_fault_at() - not implemented\n");
 }
 
+void
+_pmemfile_inject_crash_at(const char *at)
+{
+	printf("_pmemfile_inject_crash_at() - not implemented\n");
+}
+
 int
 _pmemfile_fault_injection_enabled(void)
 {
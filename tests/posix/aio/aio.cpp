@@ -0,0 +1,327 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * aio.cpp -- unit test for pmemfile_aio_*
+ */
+
+#include "pmemfile_test.hpp"
+
+#include <poll.h>
+#include <stdint.h>
+#include <unistd.h>
+
+class aio : public pmemfile_test {
+public:
+	aio() : pmemfile_test(64 * 1024 * 1024)
+	{
+	}
+
+protected:
+	static struct pmemfile_aio_sqe
+	sqe(uint32_t opcode, PMEMfile *f, void *buf, size_t len,
+	    pmemfile_off_t offset, uint64_t user_data)
+	{
+		struct pmemfile_aio_sqe s;
+		memset(&s, 0, sizeof(s));
+		s.opcode = opcode;
+		s.file = f;
+		s.buf = buf;
+		s.len = len;
+		s.offset = offset;
+		s.user_data = user_data;
+		return s;
+	}
+};
+
+TEST_F(aio, invalid_args)
+{
+	errno = 0;
+	ASSERT_EQ(pmemfile_aio_setup(NULL, 8), nullptr);
+	EXPECT_EQ(errno, EFAULT);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_aio_setup(pfp, 0), nullptr);
+	EXPECT_EQ(errno, EINVAL);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_aio_setup(pfp, 1 << 20), nullptr);
+	EXPECT_EQ(errno, EINVAL);
+
+	PMEMfileaioctx *ctx = pmemfile_aio_setup(pfp, 8);
+	ASSERT_NE(ctx, nullptr) << strerror(errno);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_aio_submit(NULL, NULL, 0), -1);
+	EXPECT_EQ(errno, EFAULT);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_aio_submit(ctx, NULL, 1), -1);
+	EXPECT_EQ(errno, EFAULT);
+
+	ASSERT_EQ(pmemfile_aio_submit(ctx, NULL, 0), 0);
+
+	struct pmemfile_aio_cqe cqe;
+	errno = 0;
+	ASSERT_EQ(pmemfile_aio_reap(ctx, &cqe, 2, 1), -1);
+	EXPECT_EQ(errno, EINVAL);
+
+	/* nothing in flight - must not block */
+	ASSERT_EQ(pmemfile_aio_reap(ctx, &cqe, 1, 1), 0);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_aio_eventfd(NULL), -1);
+	EXPECT_EQ(errno, EFAULT);
+
+	pmemfile_aio_destroy(ctx);
+	pmemfile_aio_destroy(NULL);
+}
+
+TEST_F(aio, write_read)
+{
+	PMEMfile *f = pmemfile_open(pfp, "/file", PMEMFILE_O_CREAT |
+					    PMEMFILE_O_EXCL | PMEMFILE_O_RDWR,
+				    0644);
+	ASSERT_NE(f, nullptr) << strerror(errno);
+
+	PMEMfileaioctx *ctx = pmemfile_aio_setup(pfp, 16);
+	ASSERT_NE(ctx, nullptr) << strerror(errno);
+
+	int efd = pmemfile_aio_eventfd(ctx);
+	ASSERT_GE(efd, 0);
+
+	static const size_t chunk = 64 * 1024;
+	static const unsigned chunks = 8;
+	std::vector<char> wbuf(chunk * chunks);
+	std::vector<char> rbuf(chunk * chunks);
+	for (size_t i = 0; i < wbuf.size(); ++i)
+		wbuf[i] = (char)(i % 251);
+
+	struct pmemfile_aio_sqe sqes[chunks + 1];
+	for (unsigned i = 0; i < chunks; ++i)
+		sqes[i] = sqe(PMEMFILE_AIO_OP_WRITE, f, &wbuf[i * chunk], chunk,
+			      (pmemfile_off_t)(i * chunk), i);
+	sqes[chunks] = sqe(PMEMFILE_AIO_OP_FSYNC, f, NULL, 0, 0, 100);
+
+	ASSERT_EQ(pmemfile_aio_submit(ctx, sqes, chunks + 1),
+		  (int)chunks + 1);
+
+	struct pollfd pfd;
+	pfd.fd = efd;
+	pfd.events = POLLIN;
+	ASSERT_EQ(poll(&pfd, 1, -1), 1);
+
+	struct pmemfile_aio_cqe cqes[chunks + 1];
+	ASSERT_EQ(pmemfile_aio_reap(ctx, cqes, chunks + 1, chunks + 1),
+		  (int)chunks + 1);
+
+	/* requests from one context complete in submission order */
+	for (unsigned i = 0; i < chunks; ++i) {
+		EXPECT_EQ(cqes[i].user_data, i);
+		EXPECT_EQ(cqes[i].res, (pmemfile_ssize_t)chunk);
+	}
+	EXPECT_EQ(cqes[chunks].user_data, 100u);
+	EXPECT_EQ(cqes[chunks].res, 0);
+
+	uint64_t cnt;
+	ASSERT_EQ(read(efd, &cnt, sizeof(cnt)), (ssize_t)sizeof(cnt));
+	EXPECT_GE(cnt, 1u);
+
+	EXPECT_EQ(test_pmemfile_file_size(pfp, f),
+		  (pmemfile_ssize_t)(chunk * chunks));
+
+	for (unsigned i = 0; i < chunks; ++i)
+		sqes[i] = sqe(PMEMFILE_AIO_OP_READ, f, &rbuf[i * chunk], chunk,
+			      (pmemfile_off_t)(i * chunk), i);
+
+	ASSERT_EQ(pmemfile_aio_submit(ctx, sqes, chunks), (int)chunks);
+	ASSERT_EQ(pmemfile_aio_reap(ctx, cqes, chunks, chunks + 1),
+		  (int)chunks);
+	for (unsigned i = 0; i < chunks; ++i)
+		EXPECT_EQ(cqes[i].res, (pmemfile_ssize_t)chunk);
+
+	EXPECT_EQ(memcmp(wbuf.data(), rbuf.data(), wbuf.size()), 0);
+
+	pmemfile_aio_destroy(ctx);
+	pmemfile_close(pfp, f);
+
+	ASSERT_EQ(pmemfile_unlink(pfp, "/file"), 0);
+}
+
+TEST_F(aio, fallocate_and_errors)
+{
+	PMEMfile *f = pmemfile_open(pfp, "/file", PMEMFILE_O_CREAT |
+					    PMEMFILE_O_EXCL | PMEMFILE_O_WRONLY,
+				    0644);
+	ASSERT_NE(f, nullptr) << strerror(errno);
+
+	PMEMfileaioctx *ctx = pmemfile_aio_setup(pfp, 4);
+	ASSERT_NE(ctx, nullptr) << strerror(errno);
+
+	char buf[16];
+	struct pmemfile_aio_sqe sqes[4];
+	sqes[0] = sqe(PMEMFILE_AIO_OP_FALLOCATE, f, NULL, 1 << 20, 0, 1);
+	sqes[1] = sqe(PMEMFILE_AIO_OP_READ, f, buf, sizeof(buf), 0, 2);
+	sqes[2] = sqe(0xff, f, NULL, 0, 0, 3);
+	sqes[3] = sqe(PMEMFILE_AIO_OP_FSYNC, NULL, NULL, 0, 0, 4);
+
+	ASSERT_EQ(pmemfile_aio_submit(ctx, sqes, 4), 4);
+
+	struct pmemfile_aio_cqe cqes[4];
+	ASSERT_EQ(pmemfile_aio_reap(ctx, cqes, 4, 4), 4);
+
+	EXPECT_EQ(cqes[0].user_data, 1u);
+	EXPECT_EQ(cqes[0].res, 0);
+	EXPECT_EQ(cqes[1].user_data, 2u);
+	EXPECT_EQ(cqes[1].res, -EBADF);
+	EXPECT_EQ(cqes[2].user_data, 3u);
+	EXPECT_EQ(cqes[2].res, -EINVAL);
+	EXPECT_EQ(cqes[3].user_data, 4u);
+	EXPECT_EQ(cqes[3].res, -EBADF);
+
+	EXPECT_EQ(test_pmemfile_file_size(pfp, f), 1 << 20);
+
+	pmemfile_aio_destroy(ctx);
+	pmemfile_close(pfp, f);
+
+	ASSERT_EQ(pmemfile_unlink(pfp, "/file"), 0);
+}
+
+TEST_F(aio, ring_full)
+{
+	PMEMfile *f = pmemfile_open(pfp, "/file", PMEMFILE_O_CREAT |
+					    PMEMFILE_O_EXCL | PMEMFILE_O_RDWR,
+				    0644);
+	ASSERT_NE(f, nullptr) << strerror(errno);
+
+	/* submission ring of 2 entries, completion ring of 4 */
+	PMEMfileaioctx *ctx = pmemfile_aio_setup(pfp, 2);
+	ASSERT_NE(ctx, nullptr) << strerror(errno);
+
+	char buf[16] = {0};
+	struct pmemfile_aio_sqe sqes[2];
+	sqes[0] = sqe(PMEMFILE_AIO_OP_WRITE, f, buf, sizeof(buf), 0, 0);
+	sqes[1] = sqe(PMEMFILE_AIO_OP_WRITE, f, buf, sizeof(buf), 16, 1);
+
+	unsigned submitted = 0;
+	while (submitted < 4) {
+		int ret = pmemfile_aio_submit(ctx, sqes, 1);
+		if (ret < 0) {
+			/* submission ring is full, wait for workers */
+			ASSERT_EQ(errno, EAGAIN);
+			usleep(1000);
+			continue;
+		}
+		submitted += (unsigned)ret;
+	}
+
+	/* completions can't overflow the completion ring */
+	errno = 0;
+	EXPECT_EQ(pmemfile_aio_submit(ctx, sqes, 1), -1);
+	EXPECT_EQ(errno, EAGAIN);
+
+	struct pmemfile_aio_cqe cqes[4];
+	ASSERT_EQ(pmemfile_aio_reap(ctx, cqes, 4, 4), 4);
+	for (unsigned i = 0; i < 4; ++i) {
+		EXPECT_EQ(cqes[i].user_data, 0u);
+		EXPECT_EQ(cqes[i].res, (pmemfile_ssize_t)sizeof(buf));
+	}
+
+	ASSERT_EQ(pmemfile_aio_submit(ctx, sqes, 2), 2);
+
+	/* not reaped completions are discarded */
+	pmemfile_aio_destroy(ctx);
+	pmemfile_close(pfp, f);
+
+	ASSERT_EQ(pmemfile_unlink(pfp, "/file"), 0);
+}
+
+TEST_F(aio, suspend_resume)
+{
+	if (is_pmemfile_pop)
+		return;
+
+	PMEMfile *f = pmemfile_open(pfp, "/file", PMEMFILE_O_CREAT |
+					    PMEMFILE_O_EXCL | PMEMFILE_O_RDWR,
+				    0644);
+	ASSERT_NE(f, nullptr) << strerror(errno);
+
+	PMEMfileaioctx *ctx = pmemfile_aio_setup(pfp, 16);
+	ASSERT_NE(ctx, nullptr) << strerror(errno);
+
+	char wbuf[4096], rbuf[4096];
+	memset(wbuf, 'x', sizeof(wbuf));
+	memset(rbuf, 0, sizeof(rbuf));
+
+	struct pmemfile_aio_sqe s[2];
+	s[0] = sqe(PMEMFILE_AIO_OP_WRITE, f, wbuf, sizeof(wbuf), 0, 1);
+	ASSERT_EQ(pmemfile_aio_submit(ctx, s, 1), 1);
+
+	/* pending requests are executed before the pool is closed */
+	ASSERT_EQ(pmemfile_pool_suspend(pfp), 0) << strerror(errno);
+
+	/* requests submitted now have to wait for resume */
+	s[1] = sqe(PMEMFILE_AIO_OP_READ, f, rbuf, sizeof(rbuf), 0, 2);
+	ASSERT_EQ(pmemfile_aio_submit(ctx, &s[1], 1), 1);
+
+	ASSERT_EQ(pmemfile_pool_resume(pfp, path.c_str()), 0)
+		<< strerror(errno);
+
+	struct pmemfile_aio_cqe cqes[2];
+	ASSERT_EQ(pmemfile_aio_reap(ctx, cqes, 2, 2), 2);
+	EXPECT_EQ(cqes[0].user_data, 1u);
+	EXPECT_EQ(cqes[0].res, (pmemfile_ssize_t)sizeof(wbuf));
+	EXPECT_EQ(cqes[1].user_data, 2u);
+	EXPECT_EQ(cqes[1].res, (pmemfile_ssize_t)sizeof(rbuf));
+	EXPECT_EQ(memcmp(wbuf, rbuf, sizeof(wbuf)), 0);
+
+	pmemfile_aio_destroy(ctx);
+	pmemfile_close(pfp, f);
+
+	ASSERT_EQ(pmemfile_unlink(pfp, "/file"), 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START();
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s global_path", argv[0]);
+		exit(1);
+	}
+
+	global_path = argv[1];
+
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -35,4 +35,14 @@ setup()
 
 execute(${TEST_EXECUTABLE})
 
+# once more without redo log fast paths of create and unlink
+set(ENV{PMEMFILE_REDO_METADATA} 0)
+execute(${TEST_EXECUTABLE})
+unset(ENV{PMEMFILE_REDO_METADATA})
+
+# allocations spread over arenas of the pool
+set(ENV{PMEMFILE_ARENAS} 2)
+execute(${TEST_EXECUTABLE} --gtest_filter=basic.arenas)
+unset(ENV{PMEMFILE_ARENAS})
+
 cleanup()
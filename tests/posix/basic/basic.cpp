@@ -35,6 +35,8 @@
  */
 #include "pmemfile_test.hpp"
 
+#include <set>
+
 class basic : public pmemfile_test {
 public:
 	basic() : pmemfile_test()
@@ -518,6 +520,572 @@ TEST_F(basic, tmpfile_not_in_root)
 	ASSERT_EQ(pmemfile_rmdir(pfp, "/dir"), 0);
 }
 
+/*
+ * Inodes come from reservations made ahead of time. Create more files than
+ * fit in one batch of reservations, make some of the creates fail after the
+ * inode was taken, and check none of them leaked or went missing after the
+ * pool is reopened.
+ */
+TEST_F(basic, create_many)
+{
+	if (is_pmemfile_pop)
+		return;
+
+	constexpr unsigned files = 200;
+	struct pmemfile_stats before, after;
+	char name[32];
+
+	pmemfile_stats(pfp, &before);
+
+	for (unsigned i = 0; i < files; ++i) {
+		sprintf(name, "/file%u", i);
+		ASSERT_TRUE(test_pmemfile_create(pfp, name,
+						 PMEMFILE_O_EXCL, 0644));
+	}
+
+	for (unsigned i = 0; i < files; i += 10) {
+		sprintf(name, "/file%u", i);
+
+		errno = 0;
+		ASSERT_EQ(pmemfile_symlink(pfp, "/file0", name), -1);
+		EXPECT_EQ(errno, EEXIST);
+	}
+
+	pmemfile_stats(pfp, &after);
+	EXPECT_EQ(after.inodes, before.inodes + files);
+
+	pmemfile_pool_close(pfp);
+
+	pfp = pmemfile_pool_open(path.c_str());
+	ASSERT_NE(pfp, nullptr) << strerror(errno);
+
+	pmemfile_stats(pfp, &after);
+	EXPECT_EQ(after.inodes, before.inodes + files);
+
+	for (unsigned i = 0; i < files; ++i) {
+		sprintf(name, "/file%u", i);
+		ASSERT_EQ(pmemfile_unlink(pfp, name), 0);
+	}
+
+	pmemfile_stats(pfp, &after);
+	EXPECT_EQ(after.inodes, before.inodes);
+}
+
+/*
+ * Creates and unlinks enough files for some of them to go through the redo
+ * log fast paths. basic.cmake runs this test a second time with
+ * PMEMFILE_REDO_METADATA=0, crash.cpp checks recovery of both paths.
+ */
+TEST_F(basic, create_unlink)
+{
+	constexpr unsigned files = 200;
+	char name[64];
+	pmemfile_stat_t st;
+
+	ASSERT_EQ(pmemfile_mkdir(pfp, "/dir", 0755), 0);
+
+	/* the second pass reuses dirent slots freed by the first one */
+	for (int pass = 0; pass < 2; ++pass) {
+		for (unsigned i = 0; i < files; ++i) {
+			/* names shorter and longer than 8 characters */
+			sprintf(name, i % 2 ? "/dir/f%u" : "/dir/long_name_%u",
+				i);
+			ASSERT_TRUE(test_pmemfile_create(
+				pfp, name, PMEMFILE_O_EXCL, 0644));
+		}
+
+		for (unsigned i = 0; i < files; ++i) {
+			sprintf(name, i % 2 ? "/dir/f%u" : "/dir/long_name_%u",
+				i);
+			ASSERT_EQ(pmemfile_stat(pfp, name, &st), 0) << name;
+			EXPECT_TRUE(PMEMFILE_S_ISREG(st.st_mode)) << name;
+			EXPECT_EQ(st.st_mode & PMEMFILE_ALLPERMS, 0644u)
+				<< name;
+			EXPECT_EQ(st.st_nlink, 1u) << name;
+			EXPECT_EQ(st.st_size, 0) << name;
+		}
+
+		for (unsigned i = 0; i < files; ++i) {
+			sprintf(name, i % 2 ? "/dir/f%u" : "/dir/long_name_%u",
+				i);
+			ASSERT_EQ(pmemfile_unlink(pfp, name), 0) << name;
+
+			errno = 0;
+			ASSERT_EQ(pmemfile_stat(pfp, name, &st), -1) << name;
+			EXPECT_EQ(errno, ENOENT) << name;
+		}
+
+		EXPECT_TRUE(test_empty_dir(pfp, "/dir"));
+	}
+
+	ASSERT_EQ(pmemfile_rmdir(pfp, "/dir"), 0);
+}
+
+TEST_F(basic, large_transactions)
+{
+	constexpr unsigned files = 300;
+	char name[32];
+
+	/* directory growth, rename over existing file and big truncate */
+	ASSERT_EQ(pmemfile_mkdir(pfp, "/big", 0755), 0);
+	for (unsigned i = 0; i < files; ++i) {
+		sprintf(name, "/big/file%u", i);
+		ASSERT_TRUE(test_pmemfile_create(pfp, name, PMEMFILE_O_EXCL,
+						 0644));
+	}
+
+	PMEMfile *f = pmemfile_open(pfp, "/big/file0", PMEMFILE_O_RDWR);
+	ASSERT_NE(f, nullptr);
+
+	static char buf[4096];
+	memset(buf, 0xaa, sizeof(buf));
+	for (int i = 0; i < 256; ++i)
+		ASSERT_EQ(pmemfile_write(pfp, f, buf, sizeof(buf)),
+			  (pmemfile_ssize_t)sizeof(buf));
+	pmemfile_close(pfp, f);
+
+	ASSERT_EQ(pmemfile_rename(pfp, "/big/file0", "/big/file1"), 0);
+	EXPECT_EQ(test_pmemfile_path_size(pfp, "/big/file1"), 256 * 4096);
+	ASSERT_EQ(pmemfile_truncate(pfp, "/big/file1", 0), 0);
+	EXPECT_EQ(test_pmemfile_path_size(pfp, "/big/file1"), 0);
+
+	struct pmemfile_runtime_stats stats;
+	ASSERT_EQ(pmemfile_runtime_stats(pfp, &stats, sizeof(stats)), 0);
+
+	/* buffers are not allocated without support in libpmemobj */
+	if (!is_pmemfile_pop && stats.tx_logs > 0)
+		EXPECT_GT(stats.tx_logs_attached, 0u);
+	EXPECT_EQ(stats.tx_logs_busy, 0u);
+	uint64_t attached = stats.tx_logs_attached;
+
+	/* replacing a non-empty directory aborts after taking a buffer */
+	ASSERT_EQ(pmemfile_mkdir(pfp, "/empty", 0755), 0);
+	errno = 0;
+	ASSERT_EQ(pmemfile_rename(pfp, "/empty", "/big"), -1);
+	EXPECT_EQ(errno, ENOTEMPTY);
+
+	ASSERT_EQ(pmemfile_runtime_stats(pfp, &stats, sizeof(stats)), 0);
+	if (!is_pmemfile_pop && stats.tx_logs > 0)
+		EXPECT_GT(stats.tx_logs_attached, attached);
+	EXPECT_EQ(stats.tx_logs_busy, 0u);
+
+	ASSERT_EQ(pmemfile_rmdir(pfp, "/empty"), 0);
+	for (unsigned i = 1; i < files; ++i) {
+		sprintf(name, "/big/file%u", i);
+		ASSERT_EQ(pmemfile_unlink(pfp, name), 0);
+	}
+	ASSERT_EQ(pmemfile_rmdir(pfp, "/big"), 0);
+
+	/* log buffers are not reported as pool objects */
+	EXPECT_TRUE(test_pmemfile_stats_match(pfp, 0, 0, 0, 0));
+}
+
+TEST_F(basic, arenas)
+{
+	const char *env = getenv("PMEMFILE_ARENAS");
+	unsigned requested = env ? (unsigned)atoi(env) : 0;
+	static char buf[4096];
+
+	ASSERT_TRUE(test_pmemfile_create(pfp, "/aaa", PMEMFILE_O_EXCL, 0644));
+	PMEMfile *f = pmemfile_open(pfp, "/aaa", PMEMFILE_O_WRONLY);
+	ASSERT_NE(f, nullptr) << strerror(errno);
+	ASSERT_EQ(pmemfile_write(pfp, f, buf, sizeof(buf)),
+		  (pmemfile_ssize_t)sizeof(buf));
+	pmemfile_close(pfp, f);
+
+	struct pmemfile_runtime_stats stats;
+	ASSERT_EQ(pmemfile_runtime_stats(pfp, &stats, sizeof(stats)), 0)
+		<< strerror(errno);
+
+	/* arenas are not created by libpmemobj older than 1.7 */
+	EXPECT_LE(stats.arenas, requested);
+	if (is_pmemfile_pop)
+		EXPECT_EQ(stats.arenas, 0u);
+
+	uint64_t total = 0;
+	for (unsigned i = 0; i < stats.arenas; ++i)
+		total += stats.arena_size[i];
+	if (stats.arenas > 0)
+		EXPECT_GT(total, 0u);
+
+	/* callers built with an older, shorter structure get only its part */
+	struct pmemfile_runtime_stats part;
+	memset(&part, 0xff, sizeof(part));
+	ASSERT_EQ(pmemfile_runtime_stats(pfp, &part, sizeof(part.arenas)), 0);
+	EXPECT_EQ(part.arenas, stats.arenas);
+	EXPECT_EQ(part.arena_size[0], UINT64_MAX);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_runtime_stats(NULL, &part, sizeof(part)), -1);
+	EXPECT_EQ(errno, EFAULT);
+
+	ASSERT_EQ(pmemfile_unlink(pfp, "/aaa"), 0);
+}
+
+TEST_F(basic, compact_inodes)
+{
+	if (is_pmemfile_pop)
+		return;
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_pool_xcreate(path.c_str(), poolsize,
+					PMEMFILE_S_IWUSR | PMEMFILE_S_IRUSR,
+					1 << 30),
+		  nullptr);
+	EXPECT_EQ(errno, EINVAL);
+
+	pmemfile_pool_close(pfp);
+	(void)std::remove(path.c_str());
+
+	pfp = pmemfile_pool_xcreate(path.c_str(), poolsize,
+				    PMEMFILE_S_IWUSR | PMEMFILE_S_IRUSR,
+				    PMEMFILE_POOL_COMPACT_INODES);
+	ASSERT_NE(pfp, nullptr) << strerror(errno);
+
+	constexpr unsigned files = 50;
+	char name[32];
+
+	ASSERT_EQ(pmemfile_mkdir(pfp, "/dir", 0755), 0);
+	for (unsigned i = 0; i < files; ++i) {
+		sprintf(name, "/dir/file%u", i);
+		ASSERT_TRUE(test_pmemfile_create(pfp, name, 0, 0644));
+	}
+
+	/* more blocks than fit in the inode */
+	std::vector<char> buf(0x100000);
+	for (size_t i = 0; i < buf.size(); ++i)
+		buf[i] = (char)(i / 13);
+
+	PMEMfile *f = pmemfile_open(pfp, "/data",
+				    PMEMFILE_O_CREAT | PMEMFILE_O_WRONLY, 0644);
+	ASSERT_NE(f, nullptr) << strerror(errno);
+	for (size_t off = 0; off < buf.size(); off += 0x4000) {
+		pmemfile_ssize_t r =
+			pmemfile_pwrite(pfp, f, buf.data() + off, 0x1000,
+					(pmemfile_off_t)off);
+		ASSERT_EQ(r, 0x1000) << COND_ERROR(r);
+	}
+	pmemfile_close(pfp, f);
+
+	/* short one fits in the inode, long one doesn't */
+	std::string short_target(100, 's');
+	std::string long_target(300, 'l');
+	ASSERT_EQ(pmemfile_symlink(pfp, short_target.c_str(), "/short"), 0);
+	ASSERT_EQ(pmemfile_symlink(pfp, long_target.c_str(), "/long"), 0);
+
+	struct pmemfile_stats stats;
+	pmemfile_stats(pfp, &stats);
+	EXPECT_EQ(stats.inodes, root_count() + 1 + files + 3);
+
+	pmemfile_pool_close(pfp);
+	pfp = pmemfile_pool_open(path.c_str());
+	ASSERT_NE(pfp, nullptr) << strerror(errno);
+
+	EXPECT_EQ(test_list_files(pfp, "/dir").size(), files + 2);
+
+	char link[400];
+	pmemfile_ssize_t len = pmemfile_readlink(pfp, "/short", link,
+						 sizeof(link));
+	ASSERT_EQ(len, (pmemfile_ssize_t)short_target.size());
+	EXPECT_EQ(std::string(link, (size_t)len), short_target);
+
+	len = pmemfile_readlink(pfp, "/long", link, sizeof(link));
+	ASSERT_EQ(len, (pmemfile_ssize_t)long_target.size());
+	EXPECT_EQ(std::string(link, (size_t)len), long_target);
+
+	f = pmemfile_open(pfp, "/data", PMEMFILE_O_RDONLY);
+	ASSERT_NE(f, nullptr) << strerror(errno);
+	std::vector<char> rbuf(0x1000);
+	for (size_t off = 0; off < buf.size(); off += 0x4000) {
+		pmemfile_ssize_t r = pmemfile_pread(pfp, f, rbuf.data(),
+						    rbuf.size(),
+						    (pmemfile_off_t)off);
+		ASSERT_EQ(r, 0x1000) << COND_ERROR(r);
+		ASSERT_EQ(memcmp(rbuf.data(), buf.data() + off, rbuf.size()),
+			  0);
+	}
+	pmemfile_close(pfp, f);
+
+	for (unsigned i = 0; i < files; ++i) {
+		sprintf(name, "/dir/file%u", i);
+		ASSERT_EQ(pmemfile_unlink(pfp, name), 0);
+	}
+	ASSERT_EQ(pmemfile_rmdir(pfp, "/dir"), 0);
+	ASSERT_EQ(pmemfile_unlink(pfp, "/data"), 0);
+	ASSERT_EQ(pmemfile_unlink(pfp, "/short"), 0);
+	ASSERT_EQ(pmemfile_unlink(pfp, "/long"), 0);
+
+	pmemfile_stats(pfp, &stats);
+	EXPECT_EQ(stats.inodes, root_count());
+}
+
+TEST_F(basic, block_classes)
+{
+	if (is_pmemfile_pop)
+		return;
+
+	pmemfile_pool_close(pfp);
+	pfp = nullptr;
+	(void)std::remove(path.c_str());
+
+	const struct pmemfile_block_class bad[][2] = {
+		{{0x4000, 16}, {0x4000, 16}},  /* not increasing */
+		{{0x4000, 16}, {0x6000, 16}},  /* not a multiple of smallest */
+		{{0x1000, 16}, {0x4000, 16}},  /* smallest too small */
+		{{0x4000, 16}, {0x8000, 0}},   /* no units */
+	};
+	for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+		errno = 0;
+		ASSERT_EQ(pmemfile_pool_xcreate_classes(
+				  path.c_str(), poolsize,
+				  PMEMFILE_S_IWUSR | PMEMFILE_S_IRUSR, 0,
+				  bad[i], 2),
+			  nullptr);
+		EXPECT_EQ(errno, EINVAL);
+	}
+
+	const struct pmemfile_block_class classes[] = {
+		{0x10000, 8}, {0x40000, 4},
+	};
+	pfp = pmemfile_pool_xcreate_classes(path.c_str(), poolsize,
+					    PMEMFILE_S_IWUSR | PMEMFILE_S_IRUSR,
+					    0, classes, 2);
+	ASSERT_NE(pfp, nullptr) << strerror(errno);
+
+	PMEMfile *f = pmemfile_open(pfp, "/data",
+				    PMEMFILE_O_CREAT | PMEMFILE_O_RDWR, 0644);
+	ASSERT_NE(f, nullptr) << strerror(errno);
+
+	/* one byte in the middle of the file takes one 64KiB aligned block */
+	ASSERT_EQ(pmemfile_fallocate(pfp, f, 0, 100000, 1), 0);
+
+	pmemfile_stat_t st;
+	ASSERT_EQ(pmemfile_fstat(pfp, f, &st), 0);
+	EXPECT_EQ(st.st_blocks, 0x10000 / 512);
+
+	/* bigger one takes the bigger class */
+	ASSERT_EQ(pmemfile_fallocate(pfp, f, 0, 0x100000, 0x30000), 0);
+	ASSERT_EQ(pmemfile_fstat(pfp, f, &st), 0);
+	EXPECT_EQ(st.st_blocks, (0x10000 + 0x40000) / 512);
+	pmemfile_close(pfp, f);
+
+	struct pmemfile_stats stats;
+	pmemfile_stats(pfp, &stats);
+	EXPECT_EQ(stats.blocks, 2u);
+
+	/* classes come from the pool, not from the process */
+	pmemfile_pool_close(pfp);
+	pfp = pmemfile_pool_open(path.c_str());
+	ASSERT_NE(pfp, nullptr) << strerror(errno);
+
+	f = pmemfile_open(pfp, "/data", PMEMFILE_O_RDWR);
+	ASSERT_NE(f, nullptr) << strerror(errno);
+	ASSERT_EQ(pmemfile_fallocate(pfp, f, 0, 0x200000, 1), 0);
+	ASSERT_EQ(pmemfile_fstat(pfp, f, &st), 0);
+	EXPECT_EQ(st.st_blocks, (0x10000 * 2 + 0x40000) / 512);
+	pmemfile_close(pfp, f);
+
+	ASSERT_EQ(pmemfile_unlink(pfp, "/data"), 0);
+
+	pmemfile_stats(pfp, &stats);
+	EXPECT_EQ(stats.blocks, 0u);
+}
+
+TEST_F(basic, suspend_resume)
+{
+	if (is_pmemfile_pop)
+		return;
+
+	static char buf[8192];
+
+	memset(buf, 'a', 4096);
+	ASSERT_TRUE(test_pmemfile_create(pfp, "/aaa", PMEMFILE_O_EXCL, 0644));
+	PMEMfile *f = pmemfile_open(pfp, "/aaa", PMEMFILE_O_RDWR);
+	ASSERT_NE(f, nullptr) << strerror(errno);
+	ASSERT_EQ(pmemfile_write(pfp, f, buf, 4096), 4096);
+
+	/* nobody else used the pool, runtime state is kept */
+	ASSERT_EQ(pmemfile_pool_suspend(pfp), 0) << strerror(errno);
+	ASSERT_EQ(pmemfile_pool_resume(pfp, path.c_str()), 0)
+		<< strerror(errno);
+
+	memset(buf, 0, sizeof(buf));
+	ASSERT_EQ(pmemfile_pread(pfp, f, buf, 4096, 0), 4096);
+	EXPECT_EQ(buf[0], 'a');
+	EXPECT_EQ(buf[4095], 'a');
+
+	/* another user replaces the blocks of the file */
+	ASSERT_EQ(pmemfile_pool_suspend(pfp), 0) << strerror(errno);
+
+	PMEMfilepool *other = pmemfile_pool_open(path.c_str());
+	ASSERT_NE(other, nullptr) << strerror(errno);
+	PMEMfile *g = pmemfile_open(other, "/aaa", PMEMFILE_O_RDWR);
+	ASSERT_NE(g, nullptr) << strerror(errno);
+	ASSERT_EQ(pmemfile_ftruncate(other, g, 0), 0);
+	memset(buf, 'b', sizeof(buf));
+	ASSERT_EQ(pmemfile_write(other, g, buf, sizeof(buf)),
+		  (pmemfile_ssize_t)sizeof(buf));
+	pmemfile_close(other, g);
+	pmemfile_pool_close(other);
+
+	ASSERT_EQ(pmemfile_pool_resume(pfp, path.c_str()), 0)
+		<< strerror(errno);
+
+	memset(buf, 0, sizeof(buf));
+	ASSERT_EQ(pmemfile_pread(pfp, f, buf, sizeof(buf), 0),
+		  (pmemfile_ssize_t)sizeof(buf));
+	EXPECT_EQ(buf[0], 'b');
+	EXPECT_EQ(buf[sizeof(buf) - 1], 'b');
+
+	/* allocations after resume can't reuse blocks of the other user */
+	memset(buf, 'c', 4096);
+	ASSERT_EQ(pmemfile_pwrite(pfp, f, buf, 4096, sizeof(buf)), 4096);
+
+	ASSERT_TRUE(test_pmemfile_create(pfp, "/bbb", PMEMFILE_O_EXCL, 0644));
+	g = pmemfile_open(pfp, "/bbb", PMEMFILE_O_RDWR);
+	ASSERT_NE(g, nullptr) << strerror(errno);
+	memset(buf, 'd', sizeof(buf));
+	ASSERT_EQ(pmemfile_write(pfp, g, buf, sizeof(buf)),
+		  (pmemfile_ssize_t)sizeof(buf));
+
+	memset(buf, 0, sizeof(buf));
+	ASSERT_EQ(pmemfile_pread(pfp, f, buf, sizeof(buf), 0),
+		  (pmemfile_ssize_t)sizeof(buf));
+	for (size_t i = 0; i < sizeof(buf); ++i)
+		ASSERT_EQ(buf[i], 'b') << i;
+	ASSERT_EQ(pmemfile_pread(pfp, f, buf, sizeof(buf), sizeof(buf)),
+		  4096);
+	for (size_t i = 0; i < 4096; ++i)
+		ASSERT_EQ(buf[i], 'c') << i;
+
+	memset(buf, 0, sizeof(buf));
+	ASSERT_EQ(pmemfile_pread(pfp, g, buf, sizeof(buf), 0),
+		  (pmemfile_ssize_t)sizeof(buf));
+	for (size_t i = 0; i < sizeof(buf); ++i)
+		ASSERT_EQ(buf[i], 'd') << i;
+
+	pmemfile_close(pfp, g);
+	pmemfile_close(pfp, f);
+	ASSERT_EQ(pmemfile_unlink(pfp, "/aaa"), 0);
+	ASSERT_EQ(pmemfile_unlink(pfp, "/bbb"), 0);
+}
+
+TEST_F(basic, suspend_resume_create)
+{
+	if (is_pmemfile_pop)
+		return;
+
+	static const int files = 64;
+	char name[32];
+	std::set<pmemfile_ino_t> inodes;
+
+	/* starts the inode reservation thread */
+	for (int i = 0; i < files; ++i) {
+		sprintf(name, "/a%d", i);
+		ASSERT_TRUE(test_pmemfile_create(pfp, name, PMEMFILE_O_EXCL,
+						 0644));
+	}
+
+	ASSERT_EQ(pmemfile_pool_suspend(pfp), 0) << strerror(errno);
+
+	/* another user allocates inodes, possibly the ones reserved before */
+	PMEMfilepool *other = pmemfile_pool_open(path.c_str());
+	ASSERT_NE(other, nullptr) << strerror(errno);
+	for (int i = 0; i < files; ++i) {
+		sprintf(name, "/b%d", i);
+		ASSERT_TRUE(test_pmemfile_create(other, name, PMEMFILE_O_EXCL,
+						 0644));
+	}
+	pmemfile_pool_close(other);
+
+	ASSERT_EQ(pmemfile_pool_resume(pfp, path.c_str()), 0)
+		<< strerror(errno);
+
+	for (int i = 0; i < files; ++i) {
+		sprintf(name, "/c%d", i);
+		ASSERT_TRUE(test_pmemfile_create(pfp, name, PMEMFILE_O_EXCL,
+						 0644));
+	}
+
+	/* every file must have its own inode */
+	for (char c = 'a'; c <= 'c'; ++c) {
+		for (int i = 0; i < files; ++i) {
+			pmemfile_stat_t st;
+
+			sprintf(name, "/%c%d", c, i);
+			ASSERT_EQ(pmemfile_stat(pfp, name, &st), 0) << name;
+			EXPECT_TRUE(inodes.insert(st.st_ino).second) << name;
+			ASSERT_EQ(pmemfile_unlink(pfp, name), 0) << name;
+		}
+	}
+}
+
+static void
+write_files(PMEMfilepool *pfp, char prefix, int files)
+{
+	char name[32];
+	char buf[4096];
+
+	for (int i = 0; i < files; ++i) {
+		sprintf(name, "/%c%d", prefix, i);
+		memset(buf, (prefix - 'a') * files + i + 1, sizeof(buf));
+
+		PMEMfile *f = pmemfile_open(pfp, name, PMEMFILE_O_CREAT |
+				PMEMFILE_O_EXCL | PMEMFILE_O_WRONLY, 0644);
+		ASSERT_NE(f, nullptr) << strerror(errno);
+		ASSERT_EQ(pmemfile_write(pfp, f, buf, sizeof(buf)),
+			  (pmemfile_ssize_t)sizeof(buf));
+		pmemfile_close(pfp, f);
+	}
+}
+
+TEST_F(basic, suspend_resume_write)
+{
+	if (is_pmemfile_pop)
+		return;
+
+	static const int files = 32;
+	char name[32];
+	char buf[4096];
+
+	/* fills extent caches */
+	write_files(pfp, 'a', files);
+
+	ASSERT_EQ(pmemfile_pool_suspend(pfp), 0) << strerror(errno);
+
+	/* another user allocates extents, possibly the ones cached before */
+	PMEMfilepool *other = pmemfile_pool_open(path.c_str());
+	ASSERT_NE(other, nullptr) << strerror(errno);
+	write_files(other, 'b', files);
+	pmemfile_pool_close(other);
+
+	ASSERT_EQ(pmemfile_pool_resume(pfp, path.c_str()), 0)
+		<< strerror(errno);
+
+	write_files(pfp, 'c', files);
+
+	/* no file can share data with another one */
+	for (char c = 'a'; c <= 'c'; ++c) {
+		for (int i = 0; i < files; ++i) {
+			sprintf(name, "/%c%d", c, i);
+
+			PMEMfile *f = pmemfile_open(pfp, name,
+					PMEMFILE_O_RDONLY);
+			ASSERT_NE(f, nullptr) << name;
+			memset(buf, 0, sizeof(buf));
+			ASSERT_EQ(pmemfile_read(pfp, f, buf, sizeof(buf)),
+				  (pmemfile_ssize_t)sizeof(buf));
+			pmemfile_close(pfp, f);
+
+			char expected = (char)((c - 'a') * files + i + 1);
+			for (size_t j = 0; j < sizeof(buf); ++j)
+				ASSERT_EQ(buf[j], expected) << name;
+
+			ASSERT_EQ(pmemfile_unlink(pfp, name), 0) << name;
+		}
+	}
+}
+
 TEST_F(basic, random_stuff)
 {
 	pmemfile_statfs_t st;
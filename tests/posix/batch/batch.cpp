@@ -0,0 +1,418 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * batch.cpp -- unit test for pmemfile_batch_*
+ */
+
+#include "pmemfile_test.hpp"
+
+#include <thread>
+
+class batch : public pmemfile_test {
+public:
+	batch() : pmemfile_test(64 * 1024 * 1024)
+	{
+	}
+};
+
+static bool
+exists(PMEMfilepool *pfp, const char *path)
+{
+	pmemfile_stat_t st;
+	return pmemfile_stat(pfp, path, &st) == 0;
+}
+
+TEST_F(batch, invalid_args)
+{
+	errno = 0;
+	ASSERT_EQ(pmemfile_batch_begin(NULL), nullptr);
+	EXPECT_EQ(errno, EFAULT);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_batch_create(NULL, "/a", 0644), -1);
+	EXPECT_EQ(errno, EFAULT);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_batch_commit(NULL, NULL), -1);
+	EXPECT_EQ(errno, EFAULT);
+
+	PMEMfilebatch *b = pmemfile_batch_begin(pfp);
+	ASSERT_NE(b, nullptr) << strerror(errno);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_batch_mkdir(b, NULL, 0755), -1);
+	EXPECT_EQ(errno, ENOENT);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_batch_rename(b, "/a", NULL), -1);
+	EXPECT_EQ(errno, ENOENT);
+
+	/* empty batch */
+	ASSERT_EQ(pmemfile_batch_commit(b, NULL), 0);
+
+	pmemfile_batch_abort(NULL);
+}
+
+TEST_F(batch, create_tree)
+{
+	PMEMfilebatch *b = pmemfile_batch_begin(pfp);
+	ASSERT_NE(b, nullptr) << strerror(errno);
+
+	ASSERT_EQ(pmemfile_batch_mkdir(b, "/dir", 0755), 0);
+	ASSERT_EQ(pmemfile_batch_create(b, "/dir/a", 0644), 0);
+	ASSERT_EQ(pmemfile_batch_mkdir(b, "/dir/sub/", 0755), 0);
+	ASSERT_EQ(pmemfile_batch_create(b, "/dir/sub/b", 0600), 0);
+	ASSERT_EQ(pmemfile_batch_create(b, "/c", 0644), 0);
+
+	int errors[5];
+	memset(errors, 0xff, sizeof(errors));
+	ASSERT_EQ(pmemfile_batch_commit(b, errors), 0) << strerror(errno);
+	for (int e : errors)
+		EXPECT_EQ(e, 0);
+
+	EXPECT_TRUE(test_compare_dirs(pfp, "/", std::vector<pmemfile_ls>{
+							{040777, 3, 8192, "."},
+							{040777, 3, 8192, ".."},
+							{040755, 3, 8192, "dir"},
+							{0100644, 1, 0, "c"},
+						}));
+	EXPECT_TRUE(test_compare_dirs(pfp, "/dir", std::vector<pmemfile_ls>{
+							   {040755, 3, 8192, "."},
+							   {040777, 3, 8192, ".."},
+							   {0100644, 1, 0, "a"},
+							   {040755, 2, 8192, "sub"},
+						   }));
+	EXPECT_TRUE(test_compare_dirs(pfp, "/dir/sub",
+				      std::vector<pmemfile_ls>{
+					      {040755, 2, 8192, "."},
+					      {040755, 3, 8192, ".."},
+					      {0100600, 1, 0, "b"},
+				      }));
+
+	EXPECT_TRUE(test_pmemfile_stats_match(pfp, 5, 0, 0, 0));
+
+	ASSERT_EQ(pmemfile_unlink(pfp, "/dir/sub/b"), 0);
+	ASSERT_EQ(pmemfile_rmdir(pfp, "/dir/sub"), 0);
+	ASSERT_EQ(pmemfile_unlink(pfp, "/dir/a"), 0);
+	ASSERT_EQ(pmemfile_rmdir(pfp, "/dir"), 0);
+	ASSERT_EQ(pmemfile_unlink(pfp, "/c"), 0);
+}
+
+TEST_F(batch, failure_is_atomic)
+{
+	ASSERT_TRUE(test_pmemfile_create(pfp, "/existing", 0, 0644));
+	ASSERT_TRUE(test_pmemfile_create(pfp, "/victim", 0, 0644));
+
+	PMEMfilebatch *b = pmemfile_batch_begin(pfp);
+	ASSERT_NE(b, nullptr) << strerror(errno);
+
+	ASSERT_EQ(pmemfile_batch_mkdir(b, "/dir", 0755), 0);
+	ASSERT_EQ(pmemfile_batch_create(b, "/dir/a", 0644), 0);
+	ASSERT_EQ(pmemfile_batch_unlink(b, "/victim"), 0);
+	ASSERT_EQ(pmemfile_batch_create(b, "/existing", 0644), 0);
+	ASSERT_EQ(pmemfile_batch_create(b, "/b", 0644), 0);
+
+	int errors[5];
+	errno = 0;
+	ASSERT_EQ(pmemfile_batch_commit(b, errors), -1);
+	EXPECT_EQ(errno, EEXIST);
+
+	EXPECT_EQ(errors[0], ECANCELED);
+	EXPECT_EQ(errors[1], ECANCELED);
+	EXPECT_EQ(errors[2], ECANCELED);
+	EXPECT_EQ(errors[3], EEXIST);
+	EXPECT_EQ(errors[4], ECANCELED);
+
+	EXPECT_FALSE(exists(pfp, "/dir"));
+	EXPECT_FALSE(exists(pfp, "/b"));
+	EXPECT_TRUE(exists(pfp, "/victim"));
+	EXPECT_TRUE(test_pmemfile_stats_match(pfp, 2, 0, 0, 0));
+
+	/* failure during path resolution */
+	b = pmemfile_batch_begin(pfp);
+	ASSERT_NE(b, nullptr) << strerror(errno);
+
+	ASSERT_EQ(pmemfile_batch_create(b, "/a", 0644), 0);
+	ASSERT_EQ(pmemfile_batch_create(b, "/nonexistent/a", 0644), 0);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_batch_commit(b, errors), -1);
+	EXPECT_EQ(errno, ENOENT);
+	EXPECT_EQ(errors[0], ECANCELED);
+	EXPECT_EQ(errors[1], ENOENT);
+	EXPECT_FALSE(exists(pfp, "/a"));
+
+	ASSERT_EQ(pmemfile_unlink(pfp, "/existing"), 0);
+	ASSERT_EQ(pmemfile_unlink(pfp, "/victim"), 0);
+}
+
+TEST_F(batch, unlink_rename)
+{
+	ASSERT_EQ(pmemfile_mkdir(pfp, "/dir", 0755), 0);
+	ASSERT_TRUE(test_pmemfile_create(pfp, "/a", 0, 0644));
+	ASSERT_TRUE(test_pmemfile_create(pfp, "/b", 0, 0644));
+	ASSERT_TRUE(test_pmemfile_create(pfp, "/c", 0, 0644));
+	ASSERT_TRUE(test_pmemfile_create(pfp, "/dir/d", 0, 0644));
+
+	PMEMfile *f = pmemfile_open(pfp, "/b", PMEMFILE_O_RDONLY);
+	ASSERT_NE(f, nullptr) << strerror(errno);
+
+	PMEMfilebatch *b = pmemfile_batch_begin(pfp);
+	ASSERT_NE(b, nullptr) << strerror(errno);
+
+	/* same directory */
+	ASSERT_EQ(pmemfile_batch_rename(b, "/a", "/a2"), 0);
+	/* unlink of an open file */
+	ASSERT_EQ(pmemfile_batch_unlink(b, "/b"), 0);
+	/* cross directory, replaces existing file */
+	ASSERT_EQ(pmemfile_batch_rename(b, "/c", "/dir/d"), 0);
+	/* name freed by an earlier operation */
+	ASSERT_EQ(pmemfile_batch_create(b, "/a", 0600), 0);
+
+	ASSERT_EQ(pmemfile_batch_commit(b, NULL), 0) << strerror(errno);
+
+	EXPECT_TRUE(test_compare_dirs(pfp, "/", std::vector<pmemfile_ls>{
+							{040777, 3, 8192, "."},
+							{040777, 3, 8192, ".."},
+							{040755, 2, 8192, "dir"},
+							{0100644, 1, 0, "a2"},
+							{0100600, 1, 0, "a"},
+						}));
+	EXPECT_TRUE(test_compare_dirs(pfp, "/dir", std::vector<pmemfile_ls>{
+							   {040755, 2, 8192, "."},
+							   {040777, 3, 8192, ".."},
+							   {0100644, 1, 0, "d"},
+						   }));
+
+	/* unlinked file is still open */
+	EXPECT_TRUE(test_pmemfile_stats_match(pfp, 5, 0, 0, 0));
+	pmemfile_close(pfp, f);
+	EXPECT_TRUE(test_pmemfile_stats_match(pfp, 4, 0, 0, 0));
+
+	ASSERT_EQ(pmemfile_unlink(pfp, "/a"), 0);
+	ASSERT_EQ(pmemfile_unlink(pfp, "/a2"), 0);
+	ASSERT_EQ(pmemfile_unlink(pfp, "/dir/d"), 0);
+	ASSERT_EQ(pmemfile_rmdir(pfp, "/dir"), 0);
+}
+
+TEST_F(batch, restrictions)
+{
+	ASSERT_EQ(pmemfile_mkdir(pfp, "/dir", 0755), 0);
+	ASSERT_TRUE(test_pmemfile_create(pfp, "/a", 0, 0644));
+
+	struct {
+		const char *old_path;
+		const char *new_path;
+		int error;
+	} cases[] = {
+		/* directories can't be renamed or unlinked */
+		{"/dir", "/dir2", EISDIR},
+		{"/a", "/dir", EISDIR},
+		{"/dir", NULL, EISDIR},
+		/* files must exist before the batch */
+		{"/nonexistent", NULL, ENOENT},
+		{"/a", "/.", EINVAL},
+	};
+
+	for (auto &c : cases) {
+		PMEMfilebatch *b = pmemfile_batch_begin(pfp);
+		ASSERT_NE(b, nullptr) << strerror(errno);
+
+		if (c.new_path)
+			ASSERT_EQ(pmemfile_batch_rename(b, c.old_path,
+							c.new_path),
+				  0);
+		else
+			ASSERT_EQ(pmemfile_batch_unlink(b, c.old_path), 0);
+
+		errno = 0;
+		EXPECT_EQ(pmemfile_batch_commit(b, NULL), -1);
+		EXPECT_EQ(errno, c.error) << c.old_path;
+	}
+
+	/* file created by the batch can't be unlinked by it */
+	PMEMfilebatch *b = pmemfile_batch_begin(pfp);
+	ASSERT_NE(b, nullptr) << strerror(errno);
+	ASSERT_EQ(pmemfile_batch_unlink(b, "/a"), 0);
+	ASSERT_EQ(pmemfile_batch_create(b, "/a", 0644), 0);
+	ASSERT_EQ(pmemfile_batch_unlink(b, "/a"), 0);
+
+	int errors[3];
+	errno = 0;
+	EXPECT_EQ(pmemfile_batch_commit(b, errors), -1);
+	EXPECT_EQ(errno, EINVAL);
+	EXPECT_EQ(errors[2], EINVAL);
+
+	/* aborted batch doesn't change anything */
+	b = pmemfile_batch_begin(pfp);
+	ASSERT_NE(b, nullptr) << strerror(errno);
+	ASSERT_EQ(pmemfile_batch_unlink(b, "/a"), 0);
+	ASSERT_EQ(pmemfile_batch_create(b, "/b", 0644), 0);
+	pmemfile_batch_abort(b);
+
+	EXPECT_TRUE(exists(pfp, "/a"));
+	EXPECT_FALSE(exists(pfp, "/b"));
+	EXPECT_TRUE(test_pmemfile_stats_match(pfp, 2, 0, 0, 0));
+
+	ASSERT_EQ(pmemfile_unlink(pfp, "/a"), 0);
+	ASSERT_EQ(pmemfile_rmdir(pfp, "/dir"), 0);
+}
+
+TEST_F(batch, many_files)
+{
+	static const unsigned files = 2000;
+	char path[64];
+
+	PMEMfilebatch *b = pmemfile_batch_begin(pfp);
+	ASSERT_NE(b, nullptr) << strerror(errno);
+
+	ASSERT_EQ(pmemfile_batch_mkdir(b, "/dir", 0755), 0);
+	for (unsigned i = 0; i < files; ++i) {
+		sprintf(path, "/dir/file%u", i);
+		ASSERT_EQ(pmemfile_batch_create(b, path, 0644), 0);
+	}
+
+	ASSERT_EQ(pmemfile_batch_commit(b, NULL), 0) << strerror(errno);
+
+	struct pmemfile_stats stats;
+	pmemfile_stats(pfp, &stats);
+	EXPECT_EQ(stats.inodes, root_count() + 1 + files);
+
+	b = pmemfile_batch_begin(pfp);
+	ASSERT_NE(b, nullptr) << strerror(errno);
+
+	for (unsigned i = 0; i < files; ++i) {
+		sprintf(path, "/dir/file%u", i);
+		ASSERT_EQ(pmemfile_batch_unlink(b, path), 0);
+	}
+
+	ASSERT_EQ(pmemfile_batch_commit(b, NULL), 0) << strerror(errno);
+
+	EXPECT_TRUE(test_empty_dir(pfp, "/dir"));
+	ASSERT_EQ(pmemfile_rmdir(pfp, "/dir"), 0);
+}
+
+static void
+batch_worker(PMEMfilepool *pfp, unsigned id)
+{
+	char path[64];
+	char path2[64];
+
+	for (unsigned i = 0; i < 50; ++i) {
+		PMEMfilebatch *b = pmemfile_batch_begin(pfp);
+		if (!b)
+			abort();
+
+		for (unsigned j = 0; j < 8; ++j) {
+			sprintf(path, "/%s/t%u_%u", j % 2 ? "d1" : "d2", id, j);
+			if (pmemfile_batch_create(b, path, 0644))
+				abort();
+		}
+
+		if (pmemfile_batch_commit(b, NULL)) {
+			ADD_FAILURE() << strerror(errno);
+			return;
+		}
+
+		b = pmemfile_batch_begin(pfp);
+		if (!b)
+			abort();
+
+		for (unsigned j = 0; j < 8; ++j) {
+			sprintf(path, "/%s/t%u_%u", j % 2 ? "d1" : "d2", id, j);
+			sprintf(path2, "/%s/t%u_%u", j % 2 ? "d2" : "d1", id,
+				j);
+			if (pmemfile_batch_rename(b, path, path2))
+				abort();
+		}
+
+		if (pmemfile_batch_commit(b, NULL)) {
+			ADD_FAILURE() << strerror(errno);
+			return;
+		}
+
+		b = pmemfile_batch_begin(pfp);
+		if (!b)
+			abort();
+
+		for (unsigned j = 0; j < 8; ++j) {
+			sprintf(path, "/%s/t%u_%u", j % 2 ? "d2" : "d1", id, j);
+			if (pmemfile_batch_unlink(b, path))
+				abort();
+		}
+
+		if (pmemfile_batch_commit(b, NULL)) {
+			ADD_FAILURE() << strerror(errno);
+			return;
+		}
+	}
+}
+
+TEST_F(batch, concurrent)
+{
+	ASSERT_EQ(pmemfile_mkdir(pfp, "/d1", 0755), 0);
+	ASSERT_EQ(pmemfile_mkdir(pfp, "/d2", 0755), 0);
+
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < 4; ++i)
+		threads.emplace_back(batch_worker, pfp, i);
+
+	for (auto &t : threads)
+		t.join();
+
+	EXPECT_TRUE(test_empty_dir(pfp, "/d1"));
+	EXPECT_TRUE(test_empty_dir(pfp, "/d2"));
+
+	struct pmemfile_stats stats;
+	pmemfile_stats(pfp, &stats);
+	EXPECT_EQ(stats.inodes, root_count() + 2);
+
+	ASSERT_EQ(pmemfile_rmdir(pfp, "/d1"), 0);
+	ASSERT_EQ(pmemfile_rmdir(pfp, "/d2"), 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START();
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s global_path", argv[0]);
+		exit(1);
+	}
+
+	global_path = argv[1];
+
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
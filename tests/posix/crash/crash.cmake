@@ -45,5 +45,18 @@ exec_stage(crash1)
 exec_stage(openclose2)
 exec_stage(crash2)
 exec_stage(openclose3)
+exec_stage(crash3)
+exec_stage(openclose4)
+exec_stage(crash4)
+exec_stage(openclose5)
+exec_stage(crash5)
+exec_stage(openclose6)
+exec_stage(crash6)
+exec_stage(openclose7)
+exec_stage(crash7)
+exec_stage(openclose8)
+exec_stage(openclose9)
+exec_stage(crash8)
+exec_stage(openclose10)
 
 cleanup()
@@ -36,26 +36,151 @@
 
 #include "pmemfile_test.hpp"
 
+/*
+ * env_size -- returns value of environment variable, or def if it's not set
+ */
+static size_t
+env_size(const char *name, size_t def)
+{
+	const char *env = std::getenv(name);
+	if (!env)
+		return def;
+
+	return (size_t)strtoull(env, nullptr, 0);
+}
+
 static PMEMfilepool *
 create_pool(const char *path)
 {
 	char tmp[PMEMFILE_PATH_MAX];
 	sprintf(tmp, "%s/pool", path);
-	return pmemfile_pool_create(tmp, 8 * 1024 * 1024,
+	return pmemfile_pool_create(tmp, env_size("CRASH_POOL_SIZE",
+						  8 * 1024 * 1024),
 				    PMEMFILE_S_IWUSR | PMEMFILE_S_IRUSR);
 }
 
+/*
+ * wait_for_orphans -- waits until files orphaned by previous runs are freed
+ */
+static void
+wait_for_orphans(PMEMfilepool *pfp)
+{
+	struct pmemfile_runtime_stats stats;
+
+	for (int i = 0; i < 60000; ++i) {
+		ASSERT_EQ(pmemfile_runtime_stats(pfp, &stats, sizeof(stats)),
+			  0);
+		if (stats.orphans == 0)
+			return;
+
+		usleep(1000);
+	}
+
+	ADD_FAILURE() << "orphans were not freed: " << stats.orphans;
+}
+
 static PMEMfilepool *
-open_pool(const char *path)
+open_pool_nowait(const char *path)
 {
 	char tmp[PMEMFILE_PATH_MAX];
 	sprintf(tmp, "%s/pool", path);
 	return pmemfile_pool_open(tmp);
 }
 
+/*
+ * open_pool -- opens pool, and waits until it's back in the state which
+ * a synchronous cleanup of orphans would leave
+ */
+static PMEMfilepool *
+open_pool(const char *path)
+{
+	PMEMfilepool *pfp = open_pool_nowait(path);
+	if (pfp)
+		wait_for_orphans(pfp);
+
+	return pfp;
+}
+
 static const char *path;
 static const char *op;
 
+/* longer than 8 characters, to cover names written in two steps */
+static const char *long_name = "/ccc_long_file_name";
+
+/*
+ * crash_in_create -- creates files until one is created by the redo log
+ * fast path, which will crash just before it publishes its changes
+ *
+ * Fast path needs an inode reservation, which is refilled in background,
+ * so the first few creates can go through the transactional path.
+ */
+static void
+crash_in_create(PMEMfilepool *pfp)
+{
+	if (!_pmemfile_fault_injection_enabled())
+		exit(0);
+
+	_pmemfile_inject_crash_at("inode_create_redo");
+
+	for (int i = 0; i < 100; ++i) {
+		PMEMfile *f = pmemfile_open(pfp, long_name,
+					    PMEMFILE_O_CREAT | PMEMFILE_O_EXCL,
+					    0644);
+		ASSERT_NE(f, nullptr) << strerror(errno);
+		pmemfile_close(pfp, f);
+		ASSERT_EQ(pmemfile_unlink(pfp, long_name), 0);
+
+		usleep(10000);
+	}
+
+	ASSERT_TRUE(0) << "redo log fast path was never taken";
+}
+
+/*
+ * write_chunks -- writes chunks filled with their numbers, slowly enough for
+ * new extent regions to appear in the meantime
+ */
+static void
+write_chunks(PMEMfilepool *pfp, const char *name, int chunks)
+{
+	static char buf[16384];
+
+	PMEMfile *f = pmemfile_open(pfp, name, PMEMFILE_O_WRONLY);
+	ASSERT_NE(f, nullptr) << strerror(errno);
+
+	for (int i = 0; i < chunks; ++i) {
+		memset(buf, i, sizeof(buf));
+		ASSERT_EQ(pmemfile_write(pfp, f, buf, sizeof(buf)),
+			  (pmemfile_ssize_t)sizeof(buf));
+
+		usleep(10000);
+	}
+
+	pmemfile_close(pfp, f);
+}
+
+/*
+ * check_chunks -- verifies data written by write_chunks
+ */
+static void
+check_chunks(PMEMfilepool *pfp, const char *name, int chunks)
+{
+	static char buf[16384];
+
+	PMEMfile *f = pmemfile_open(pfp, name, PMEMFILE_O_RDONLY);
+	ASSERT_NE(f, nullptr) << strerror(errno);
+
+	for (int i = 0; i < chunks; ++i) {
+		ASSERT_EQ(pmemfile_read(pfp, f, buf, sizeof(buf)),
+			  (pmemfile_ssize_t)sizeof(buf));
+
+		for (size_t j = 0; j < sizeof(buf); ++j)
+			ASSERT_EQ(buf[j], (char)i) << "chunk " << i;
+	}
+
+	pmemfile_close(pfp, f);
+}
+
 TEST(crash, 0)
 {
 	if (strcmp(op, "prep") == 0) {
@@ -82,6 +207,72 @@ TEST(crash, 0)
 		ASSERT_NE(pmemfile_open(pfp, "/aaa", 0), nullptr);
 		ASSERT_EQ(pmemfile_unlink(pfp, "/aaa"), 0);
 
+		exit(0);
+	} else if (strcmp(op, "crash3") == 0) {
+		PMEMfilepool *pfp = open_pool(path);
+		ASSERT_NE(pfp, nullptr) << strerror(errno);
+
+		crash_in_create(pfp);
+	} else if (strcmp(op, "crash4") == 0) {
+		PMEMfilepool *pfp = open_pool(path);
+		ASSERT_NE(pfp, nullptr) << strerror(errno);
+
+		ASSERT_TRUE(test_pmemfile_create(pfp, long_name,
+						 PMEMFILE_O_EXCL, 0644));
+
+		exit(0);
+	} else if (strcmp(op, "crash5") == 0) {
+		PMEMfilepool *pfp = open_pool(path);
+		ASSERT_NE(pfp, nullptr) << strerror(errno);
+
+		if (!_pmemfile_fault_injection_enabled())
+			exit(0);
+
+		ASSERT_NE(pmemfile_open(pfp, long_name, 0), nullptr);
+
+		_pmemfile_inject_crash_at("vinode_unlink_redo");
+		pmemfile_unlink(pfp, long_name);
+
+		ASSERT_TRUE(0) << "redo log fast path was not taken";
+	} else if (strcmp(op, "crash7") == 0) {
+		PMEMfilepool *pfp = open_pool(path);
+		ASSERT_NE(pfp, nullptr) << strerror(errno);
+
+		/* without clean close extent bitmaps must be rebuilt */
+		write_chunks(pfp, "/bbb", 32);
+
+		exit(0);
+	} else if (strcmp(op, "crash8") == 0) {
+		PMEMfilepool *pfp = open_pool(path);
+		ASSERT_NE(pfp, nullptr) << strerror(errno);
+
+		/* CRASH_ORPHANS=1000000 (with big enough pool) for benchmark */
+		size_t orphans = env_size("CRASH_ORPHANS", 200);
+		char name[32];
+
+		/* removed at the end, so that its dirents go away */
+		ASSERT_EQ(pmemfile_mkdir(pfp, "/orphans", 0755), 0);
+
+		for (size_t i = 0; i < orphans; ++i) {
+			sprintf(name, "/orphans/%zu", i);
+			PMEMfile *f = pmemfile_open(pfp, name,
+						    PMEMFILE_O_CREAT |
+							    PMEMFILE_O_EXCL,
+						    0644);
+			ASSERT_NE(f, nullptr) << strerror(errno);
+			ASSERT_EQ(pmemfile_unlink(pfp, name), 0);
+		}
+
+		ASSERT_EQ(pmemfile_rmdir(pfp, "/orphans"), 0);
+
+		exit(0);
+	} else if (strcmp(op, "crash6") == 0) {
+		PMEMfilepool *pfp = open_pool(path);
+		ASSERT_NE(pfp, nullptr) << strerror(errno);
+
+		ASSERT_NE(pmemfile_open(pfp, long_name, 0), nullptr);
+		ASSERT_EQ(pmemfile_unlink(pfp, long_name), 0);
+
 		exit(0);
 	} else if (strcmp(op, "openclose1") == 0 ||
 		   strcmp(op, "openclose2") == 0) {
@@ -99,7 +290,79 @@ TEST(crash, 0)
 		EXPECT_TRUE(test_pmemfile_stats_match(pfp, 2, 1, 0, 0));
 
 		pmemfile_pool_close(pfp);
-	} else if (strcmp(op, "openclose3") == 0) {
+	} else if (strcmp(op, "openclose5") == 0 ||
+		   strcmp(op, "openclose6") == 0) {
+		PMEMfilepool *pfp = open_pool(path);
+		ASSERT_NE(pfp, nullptr) << strerror(errno);
+
+		EXPECT_TRUE(test_compare_dirs(pfp, "/",
+					      std::vector<pmemfile_ls>{
+						      {040777, 2, 8192, "."},
+						      {040777, 2, 8192, ".."},
+						      {0100644, 1, 0, "bbb"},
+						      {0100644, 1, 0,
+						       "ccc_long_file_name"},
+					      }));
+
+		EXPECT_TRUE(test_pmemfile_stats_match(pfp, 2, 1, 0, 0));
+
+		pmemfile_pool_close(pfp);
+	} else if (strcmp(op, "openclose8") == 0) {
+		PMEMfilepool *pfp = open_pool(path);
+		ASSERT_NE(pfp, nullptr) << strerror(errno);
+
+		check_chunks(pfp, "/bbb", 32);
+
+		/* must not get any of the blocks of /bbb */
+		ASSERT_TRUE(test_pmemfile_create(pfp, "/ddd", PMEMFILE_O_EXCL,
+						 0644));
+		write_chunks(pfp, "/ddd", 32);
+		check_chunks(pfp, "/bbb", 32);
+
+		ASSERT_EQ(pmemfile_unlink(pfp, "/ddd"), 0);
+		ASSERT_EQ(pmemfile_truncate(pfp, "/bbb", 0), 0);
+
+		pmemfile_pool_close(pfp);
+	} else if (strcmp(op, "openclose10") == 0) {
+		PMEMfilepool *pfp = open_pool_nowait(path);
+		ASSERT_NE(pfp, nullptr) << strerror(errno);
+
+		struct pmemfile_runtime_stats stats;
+		ASSERT_EQ(pmemfile_runtime_stats(pfp, &stats, sizeof(stats)),
+			  0);
+		printf("open took %llu ns, %u orphans left\n",
+		       (unsigned long long)stats.open_ns, stats.orphans);
+
+		if (!is_pmemfile_pop)
+			EXPECT_GT(stats.open_ns, 0u);
+
+		/* pool is usable while orphans are being freed */
+		ASSERT_TRUE(test_pmemfile_create(pfp, "/ddd", PMEMFILE_O_EXCL,
+						 0644));
+		PMEMfile *f = pmemfile_open(pfp, "/ddd", PMEMFILE_O_RDWR);
+		ASSERT_NE(f, nullptr) << strerror(errno);
+		ASSERT_EQ(pmemfile_unlink(pfp, "/ddd"), 0);
+
+		wait_for_orphans(pfp);
+
+		/* still open, so it's not one of the orphans freed on open */
+		ASSERT_EQ(pmemfile_write(pfp, f, "x", 1), 1);
+		pmemfile_close(pfp, f);
+
+		EXPECT_TRUE(test_compare_dirs(pfp, "/",
+					      std::vector<pmemfile_ls>{
+						      {040777, 2, 8192, "."},
+						      {040777, 2, 8192, ".."},
+						      {0100644, 1, 0, "bbb"},
+					      }));
+
+		EXPECT_TRUE(test_pmemfile_stats_match(pfp, 1, 1, 0, 0));
+
+		pmemfile_pool_close(pfp);
+	} else if (strcmp(op, "openclose3") == 0 ||
+		   strcmp(op, "openclose4") == 0 ||
+		   strcmp(op, "openclose7") == 0 ||
+		   strcmp(op, "openclose9") == 0) {
 		PMEMfilepool *pfp = open_pool(path);
 		ASSERT_NE(pfp, nullptr) << strerror(errno);
 
@@ -130,6 +130,59 @@ TEST_F(mt, open_close_create_unlink)
 		t.join();
 }
 
+static void
+unlink_open_worker(unsigned id)
+{
+	char path[32];
+	PMEMfile *files[16];
+
+	for (int i = 0; i < ops / 16 + 1; ++i) {
+		for (unsigned j = 0; j < 16; ++j) {
+			sprintf(path, "/orphan%u_%u", id, j);
+			files[j] = pmemfile_open(global_pfp, path,
+						 PMEMFILE_O_CREAT |
+							 PMEMFILE_O_EXCL,
+						 0644);
+			if (!files[j]) {
+				ADD_FAILURE() << errno;
+				abort();
+			}
+			if (pmemfile_unlink(global_pfp, path)) {
+				ADD_FAILURE() << errno;
+				abort();
+			}
+		}
+
+		for (unsigned j = 0; j < 16; ++j)
+			pmemfile_close(global_pfp, files[j]);
+	}
+}
+
+TEST_F(mt, unlink_open_files)
+{
+	struct pmemfile_stats before, after;
+	pmemfile_stats(pfp, &before);
+
+	for (unsigned j = 0; j < ncpus; ++j)
+		threads.emplace_back(unlink_open_worker, j);
+
+	for (auto &t : threads)
+		t.join();
+
+	pmemfile_stats(pfp, &after);
+	EXPECT_EQ(after.inodes, before.inodes);
+	EXPECT_EQ(after.inode_arrays, before.inode_arrays);
+
+	pmemfile_pool_close(pfp);
+
+	pfp = pmemfile_pool_open(path.c_str());
+	ASSERT_NE(pfp, nullptr) << strerror(errno);
+	global_pfp = pfp;
+
+	pmemfile_stats(pfp, &after);
+	EXPECT_EQ(after.inodes, before.inodes);
+}
+
 static void
 pread_worker(PMEMfile *file)
 {
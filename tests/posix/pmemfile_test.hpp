@@ -146,4 +146,11 @@ root_count()
 	return 4;
 }
 
+/* 8 lists of orphaned inodes and 1 list of suspended inodes */
+static constexpr unsigned
+inode_array_count()
+{
+	return 8 + 1;
+}
+
 #endif
@@ -111,6 +111,245 @@ TEST_F(pointer_caching, open_write_read_two_file_refs)
 	ASSERT_EQ(pmemfile_unlink(pfp, path), 0);
 }
 
+/*
+ * fill_pattern -- fills the file with data derived from the offset, so any
+ * read can be verified without keeping a copy of the whole file around
+ */
+static void
+fill_pattern(PMEMfilepool *pfp, PMEMfile *f, size_t size, unsigned seed = 0)
+{
+	std::vector<unsigned char> buf(0x10000);
+
+	for (size_t off = 0; off < size; off += buf.size()) {
+		for (size_t i = 0; i < buf.size(); ++i)
+			buf[i] = (unsigned char)((off + i) / 7 + seed);
+
+		pmemfile_ssize_t r =
+			pmemfile_pwrite(pfp, f, buf.data(), buf.size(),
+					(pmemfile_off_t)off);
+		ASSERT_EQ(r, (pmemfile_ssize_t)buf.size()) << COND_ERROR(r);
+	}
+}
+
+static bool
+check_pattern(const std::vector<unsigned char> &buf, size_t off,
+	      unsigned seed = 0)
+{
+	for (size_t i = 0; i < buf.size(); ++i)
+		if (buf[i] != (unsigned char)((off + i) / 7 + seed))
+			return false;
+
+	return true;
+}
+
+/*
+ * Several sequential streams interleaved on a single file handle, e.g.
+ * a merge of sorted runs. Every stream should keep reading correct data,
+ * while the handle caches block pointers for each of them.
+ */
+TEST_F(pointer_caching, interleaved_streams)
+{
+	constexpr const char path[] = "/aaa";
+	constexpr size_t file_size = 0x400000;
+	constexpr size_t streams = 3;
+	constexpr size_t chunk = 0x1000;
+
+	PMEMfile *f = pmemfile_open(pfp, path, PMEMFILE_O_RDWR |
+					       PMEMFILE_O_CREAT |
+					       PMEMFILE_O_EXCL,
+				    0644);
+	ASSERT_NE(f, nullptr) << strerror(errno);
+
+	fill_pattern(pfp, f, file_size);
+
+	std::vector<unsigned char> buf(chunk);
+	size_t pos[streams];
+	for (size_t s = 0; s < streams; ++s)
+		pos[s] = s * (file_size / streams);
+
+	for (size_t i = 0; i < file_size / streams / chunk; ++i) {
+		for (size_t s = 0; s < streams; ++s) {
+			pmemfile_ssize_t r =
+				pmemfile_pread(pfp, f, buf.data(), chunk,
+					       (pmemfile_off_t)pos[s]);
+			ASSERT_EQ(r, (pmemfile_ssize_t)chunk) << COND_ERROR(r);
+			ASSERT_TRUE(check_pattern(buf, pos[s]));
+			pos[s] += chunk;
+		}
+	}
+
+	/* the same via lseek + read, using the file offset */
+	for (size_t s = 0; s < streams; ++s)
+		pos[s] = s * (file_size / streams);
+
+	for (size_t i = 0; i < 0x40; ++i) {
+		for (size_t s = 0; s < streams; ++s) {
+			ASSERT_EQ(pmemfile_lseek(pfp, f, (pmemfile_off_t)pos[s],
+						 PMEMFILE_SEEK_SET),
+				  (pmemfile_off_t)pos[s]);
+			pmemfile_ssize_t r =
+				pmemfile_read(pfp, f, buf.data(), chunk);
+			ASSERT_EQ(r, (pmemfile_ssize_t)chunk) << COND_ERROR(r);
+			ASSERT_TRUE(check_pattern(buf, pos[s]));
+			pos[s] += chunk;
+		}
+	}
+
+	pmemfile_close(pfp, f);
+	ASSERT_EQ(pmemfile_unlink(pfp, path), 0);
+}
+
+/*
+ * Interleaved streams on one handle, while another handle punches a hole
+ * into the range of just one of the streams. The stream inside the hole
+ * must see zeros, the others must keep seeing the original data.
+ */
+TEST_F(pointer_caching, interleaved_streams_punch_hole)
+{
+	constexpr const char path[] = "/aaa";
+	constexpr size_t file_size = 0x300000;
+	constexpr size_t chunk = 0x1000;
+	constexpr size_t hole_start = 0x100000 + 0x10000;
+	constexpr size_t hole_len = 0x80000;
+
+	PMEMfile *f1 = pmemfile_open(pfp, path, PMEMFILE_O_RDWR |
+						PMEMFILE_O_CREAT |
+						PMEMFILE_O_EXCL,
+				     0644);
+	ASSERT_NE(f1, nullptr) << strerror(errno);
+
+	PMEMfile *f2 = pmemfile_open(pfp, path, PMEMFILE_O_RDWR);
+	ASSERT_NE(f2, nullptr) << strerror(errno);
+
+	fill_pattern(pfp, f1, file_size);
+
+	std::vector<unsigned char> buf(chunk);
+	size_t pos[3] = {0, 0x100000, 0x200000};
+
+	for (size_t i = 0; i < 0x10; ++i) {
+		for (size_t s = 0; s < 3; ++s) {
+			pmemfile_ssize_t r =
+				pmemfile_pread(pfp, f2, buf.data(), chunk,
+					       (pmemfile_off_t)pos[s]);
+			ASSERT_EQ(r, (pmemfile_ssize_t)chunk) << COND_ERROR(r);
+			ASSERT_TRUE(check_pattern(buf, pos[s]));
+			pos[s] += chunk;
+		}
+	}
+
+	/* the second stream is now at the start of the hole */
+	ASSERT_EQ(pos[1], hole_start);
+
+	int r = pmemfile_fallocate(pfp, f1, PMEMFILE_FALLOC_FL_PUNCH_HOLE |
+						PMEMFILE_FALLOC_FL_KEEP_SIZE,
+				   (pmemfile_off_t)hole_start,
+				   (pmemfile_off_t)hole_len);
+	ASSERT_EQ(r, 0) << COND_ERROR(r);
+
+	for (size_t i = 0; i < hole_len / chunk; ++i) {
+		for (size_t s = 0; s < 3; ++s) {
+			pmemfile_ssize_t rr =
+				pmemfile_pread(pfp, f2, buf.data(), chunk,
+					       (pmemfile_off_t)pos[s]);
+			ASSERT_EQ(rr, (pmemfile_ssize_t)chunk)
+				<< COND_ERROR(rr);
+			if (s == 1)
+				ASSERT_TRUE(is_zeroed(buf.data(), chunk));
+			else
+				ASSERT_TRUE(check_pattern(buf, pos[s]));
+			pos[s] += chunk;
+		}
+	}
+
+	pmemfile_close(pfp, f1);
+	pmemfile_close(pfp, f2);
+	ASSERT_EQ(pmemfile_unlink(pfp, path), 0);
+}
+
+/*
+ * Interleaved streams on one handle, seeking back and forth, while another
+ * handle truncates the file and then rewrites it with new blocks. Every
+ * stream must see the end of file after the truncation and the new data
+ * after the rewrite, never data from blocks which are already gone.
+ */
+TEST_F(pointer_caching, interleaved_streams_truncate)
+{
+	constexpr const char path[] = "/aaa";
+	constexpr size_t file_size = 0x300000;
+	constexpr size_t chunk = 0x1000;
+	constexpr size_t streams = 3;
+	constexpr size_t new_size = 0x180000;
+
+	PMEMfile *f1 = pmemfile_open(pfp, path, PMEMFILE_O_RDWR |
+						PMEMFILE_O_CREAT |
+						PMEMFILE_O_EXCL,
+				     0644);
+	ASSERT_NE(f1, nullptr) << strerror(errno);
+
+	PMEMfile *f2 = pmemfile_open(pfp, path, PMEMFILE_O_RDWR);
+	ASSERT_NE(f2, nullptr) << strerror(errno);
+
+	fill_pattern(pfp, f1, file_size);
+
+	std::vector<unsigned char> buf(chunk);
+	size_t pos[streams] = {0, 0x100000, 0x200000};
+
+	/* forward, then back over the same range */
+	for (size_t i = 0; i < 0x20; ++i) {
+		for (size_t s = 0; s < streams; ++s) {
+			if (i == 0x10)
+				pos[s] -= 0x10 * chunk;
+
+			ASSERT_EQ(pmemfile_lseek(pfp, f2, (pmemfile_off_t)pos[s],
+						 PMEMFILE_SEEK_SET),
+				  (pmemfile_off_t)pos[s]);
+			pmemfile_ssize_t r =
+				pmemfile_read(pfp, f2, buf.data(), chunk);
+			ASSERT_EQ(r, (pmemfile_ssize_t)chunk) << COND_ERROR(r);
+			ASSERT_TRUE(check_pattern(buf, pos[s]));
+			pos[s] += chunk;
+		}
+	}
+
+	/* cut the file in the middle of the second stream */
+	ASSERT_EQ(pmemfile_ftruncate(pfp, f1, (pmemfile_off_t)new_size), 0);
+
+	for (size_t i = 0; i < 0x10; ++i) {
+		for (size_t s = 0; s < streams; ++s) {
+			pmemfile_ssize_t r =
+				pmemfile_pread(pfp, f2, buf.data(), chunk,
+					       (pmemfile_off_t)pos[s]);
+			if (pos[s] >= new_size) {
+				ASSERT_EQ(r, 0) << COND_ERROR(r);
+				continue;
+			}
+
+			ASSERT_EQ(r, (pmemfile_ssize_t)chunk) << COND_ERROR(r);
+			ASSERT_TRUE(check_pattern(buf, pos[s]));
+			pos[s] += chunk;
+		}
+	}
+
+	/* drop all blocks and write the file again, with different data */
+	ASSERT_EQ(pmemfile_ftruncate(pfp, f1, 0), 0);
+	fill_pattern(pfp, f1, file_size, 1);
+
+	for (size_t i = 0; i < 0x10; ++i) {
+		for (size_t s = 0; s < streams; ++s) {
+			pmemfile_ssize_t r =
+				pmemfile_pread(pfp, f2, buf.data(), chunk,
+					       (pmemfile_off_t)pos[s]);
+			ASSERT_EQ(r, (pmemfile_ssize_t)chunk) << COND_ERROR(r);
+			ASSERT_TRUE(check_pattern(buf, pos[s], 1));
+			pos[s] -= chunk;
+		}
+	}
+
+	pmemfile_close(pfp, f1);
+	pmemfile_close(pfp, f2);
+	ASSERT_EQ(pmemfile_unlink(pfp, path), 0);
+}
+
 int
 main(int argc, char *argv[])
 {
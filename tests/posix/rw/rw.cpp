@@ -1131,6 +1131,182 @@ TEST_F(rw, fallocate_errors)
 	ASSERT_EQ(pmemfile_unlink(pfp, "/file1"), 0);
 }
 
+TEST_F(rw, fadvise)
+{
+	char buf[16384];
+	char buf2[16384];
+
+	PMEMfile *f = pmemfile_open(pfp, "/file1", PMEMFILE_O_CREAT |
+					    PMEMFILE_O_EXCL | PMEMFILE_O_RDWR,
+				    0644);
+	ASSERT_NE(f, nullptr) << strerror(errno);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_fadvise(NULL, f, 0, 0, PMEMFILE_POSIX_FADV_NORMAL),
+		  -1);
+	EXPECT_EQ(errno, EFAULT);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_fadvise(pfp, NULL, 0, 0,
+				   PMEMFILE_POSIX_FADV_NORMAL),
+		  -1);
+	EXPECT_EQ(errno, EFAULT);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_fadvise(pfp, f, 0, -1, PMEMFILE_POSIX_FADV_NORMAL),
+		  -1);
+	EXPECT_EQ(errno, EINVAL);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_fadvise(pfp, f, 0, 0, 1000), -1);
+	EXPECT_EQ(errno, EINVAL);
+
+	/* only regular files can be advised, just like in readahead(2) */
+	ASSERT_EQ(pmemfile_mkdir(pfp, "/dir1", 0755), 0);
+	PMEMfile *d = pmemfile_open(pfp, "/dir1",
+				    PMEMFILE_O_DIRECTORY | PMEMFILE_O_RDONLY);
+	ASSERT_NE(d, nullptr) << strerror(errno);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_fadvise(pfp, d, 0, 0, PMEMFILE_POSIX_FADV_WILLNEED),
+		  -1);
+	EXPECT_EQ(errno, EINVAL);
+
+	pmemfile_close(pfp, d);
+	ASSERT_EQ(pmemfile_rmdir(pfp, "/dir1"), 0);
+
+	memset(buf, 0xab, sizeof(buf));
+
+	ASSERT_EQ(pmemfile_fadvise(pfp, f, 0, 0,
+				   PMEMFILE_POSIX_FADV_SEQUENTIAL),
+		  0);
+	ASSERT_EQ(pmemfile_fadvise(pfp, f, 0, 0, PMEMFILE_POSIX_FADV_NOREUSE),
+		  0);
+	for (int i = 0; i < 8; ++i)
+		ASSERT_EQ(pmemfile_write(pfp, f, buf, sizeof(buf)),
+			  (pmemfile_ssize_t)sizeof(buf));
+
+	/* WILLNEED past the end of file is not an error */
+	ASSERT_EQ(pmemfile_fadvise(pfp, f, 0, 0, PMEMFILE_POSIX_FADV_WILLNEED),
+		  0);
+	ASSERT_EQ(pmemfile_fadvise(pfp, f, 1 << 30, 4096,
+				   PMEMFILE_POSIX_FADV_WILLNEED),
+		  0);
+
+	ASSERT_EQ(pmemfile_pread(pfp, f, buf2, sizeof(buf2), 5 * 16384),
+		  (pmemfile_ssize_t)sizeof(buf2));
+	ASSERT_EQ(memcmp(buf, buf2, sizeof(buf)), 0);
+
+	/* file must be readable and writable after its state is dropped */
+	ASSERT_EQ(pmemfile_fadvise(pfp, f, 0, 0, PMEMFILE_POSIX_FADV_DONTNEED),
+		  0);
+
+	memset(buf2, 0, sizeof(buf2));
+	ASSERT_EQ(pmemfile_pread(pfp, f, buf2, sizeof(buf2), 16384),
+		  (pmemfile_ssize_t)sizeof(buf2));
+	ASSERT_EQ(memcmp(buf, buf2, sizeof(buf)), 0);
+
+	ASSERT_EQ(pmemfile_fadvise(pfp, f, 0, 0, PMEMFILE_POSIX_FADV_DONTNEED),
+		  0);
+	ASSERT_EQ(pmemfile_fadvise(pfp, f, 0, 0, PMEMFILE_POSIX_FADV_RANDOM),
+		  0);
+	ASSERT_EQ(pmemfile_pwrite(pfp, f, buf, 100, 8 * 16384 + 1000), 100);
+	ASSERT_EQ(pmemfile_fadvise(pfp, f, 0, 0, PMEMFILE_POSIX_FADV_NORMAL),
+		  0);
+
+	memset(buf2, 0xff, sizeof(buf2));
+	ASSERT_EQ(pmemfile_pread(pfp, f, buf2, 1100, 8 * 16384),
+		  (pmemfile_ssize_t)1100);
+	for (int i = 0; i < 1000; ++i)
+		ASSERT_EQ(buf2[i], 0);
+	ASSERT_EQ(memcmp(buf, buf2 + 1000, 100), 0);
+
+	pmemfile_close(pfp, f);
+
+	ASSERT_EQ(pmemfile_unlink(pfp, "/file1"), 0);
+}
+
+TEST_F(rw, preadv2_pwritev2)
+{
+	char buf[100];
+	char buf2[300];
+	pmemfile_iovec_t iov = {buf, sizeof(buf)};
+	pmemfile_iovec_t iov2 = {buf2, sizeof(buf2)};
+
+	PMEMfile *f = pmemfile_open(pfp, "/file1", PMEMFILE_O_CREAT |
+					    PMEMFILE_O_EXCL | PMEMFILE_O_RDWR,
+				    0644);
+	ASSERT_NE(f, nullptr) << strerror(errno);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_pwritev2(pfp, f, &iov, 1, 0, 0x1000), -1);
+	EXPECT_EQ(errno, EOPNOTSUPP);
+
+	errno = 0;
+	ASSERT_EQ(pmemfile_pwritev2(pfp, f, &iov, 1, -2, 0), -1);
+	EXPECT_EQ(errno, EINVAL);
+
+	if (!is_pmemfile_pop) {
+		/* writing to unallocated space requires allocation */
+		errno = 0;
+		ASSERT_EQ(pmemfile_pwritev2(pfp, f, &iov, 1, 0,
+					    PMEMFILE_RWF_NOWAIT),
+			  -1);
+		EXPECT_EQ(errno, EAGAIN);
+
+		ASSERT_EQ(pmemfile_fallocate(pfp, f,
+					     PMEMFILE_FALLOC_FL_KEEP_SIZE, 0,
+					     65536),
+			  0);
+
+		memset(buf, 0x11, sizeof(buf));
+		ASSERT_EQ(pmemfile_pwritev2(pfp, f, &iov, 1, 0,
+					    PMEMFILE_RWF_NOWAIT),
+			  (pmemfile_ssize_t)sizeof(buf));
+	}
+
+	/* offset -1 means current position */
+	memset(buf, 0x22, sizeof(buf));
+	ASSERT_EQ(pmemfile_pwritev2(pfp, f, &iov, 1, -1, PMEMFILE_RWF_DSYNC),
+		  (pmemfile_ssize_t)sizeof(buf));
+	ASSERT_EQ(pmemfile_lseek(pfp, f, 0, PMEMFILE_SEEK_CUR),
+		  (pmemfile_off_t)sizeof(buf));
+
+	memset(buf, 0x33, sizeof(buf));
+	ASSERT_EQ(pmemfile_pwritev2(pfp, f, &iov, 1, -1, 0),
+		  (pmemfile_ssize_t)sizeof(buf));
+
+	/* append ignores the offset */
+	memset(buf, 0x44, sizeof(buf));
+	ASSERT_EQ(pmemfile_pwritev2(pfp, f, &iov, 1, 0, PMEMFILE_RWF_APPEND),
+		  (pmemfile_ssize_t)sizeof(buf));
+	ASSERT_EQ(pmemfile_lseek(pfp, f, 0, PMEMFILE_SEEK_CUR),
+		  (pmemfile_off_t)(2 * sizeof(buf)));
+
+	memset(buf2, 0, sizeof(buf2));
+	ASSERT_EQ(pmemfile_preadv2(pfp, f, &iov2, 1, 0, 0),
+		  (pmemfile_ssize_t)sizeof(buf2));
+	for (size_t i = 0; i < sizeof(buf2); ++i)
+		ASSERT_EQ(buf2[i], (char)(0x22 + 0x11 * (i / sizeof(buf))));
+
+	ASSERT_EQ(pmemfile_lseek(pfp, f, 100, PMEMFILE_SEEK_SET), 100);
+	memset(buf2, 0, sizeof(buf2));
+	ASSERT_EQ(pmemfile_preadv2(pfp, f, &iov2, 1, -1, PMEMFILE_RWF_HIPRI),
+		  (pmemfile_ssize_t)(2 * sizeof(buf)));
+	ASSERT_EQ(buf2[0], 0x33);
+	ASSERT_EQ(buf2[sizeof(buf)], 0x44);
+	ASSERT_EQ(pmemfile_lseek(pfp, f, 0, PMEMFILE_SEEK_CUR), 300);
+
+	if (!is_pmemfile_pop)
+		ASSERT_EQ(pmemfile_preadv2(pfp, f, &iov, 1, 0,
+					   PMEMFILE_RWF_NOWAIT),
+			  (pmemfile_ssize_t)sizeof(buf));
+
+	pmemfile_close(pfp, f);
+
+	ASSERT_EQ(pmemfile_unlink(pfp, "/file1"), 0);
+}
+
 TEST_F(rw, o_append)
 {
 	/* check that O_APPEND works */
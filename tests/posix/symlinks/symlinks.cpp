@@ -344,20 +344,29 @@ test_symlink_to_dir_valid(PMEMfilepool *pfp, const char *path)
 	if (errno != ELOOP)
 		return false;
 
-#if 0
-	char buf[1];
+	char buf[PMEMFILE_PATH_MAX];
 	file = pmemfile_open(pfp, path, PMEMFILE_O_RDONLY |
 			PMEMFILE_O_NOFOLLOW | PMEMFILE_O_PATH);
 	EXPECT_NE(file, nullptr) << strerror(errno);
 	if (!file)
 		return false;
-	pmemfile_ssize_t r = pmemfile_read(pfp, file, buf, sizeof(buf), -1, EBADF);
-	if (r != -1)
-		return false;
-	if (errno != EBADF)
-		return false;
+
+	errno = 0;
+	pmemfile_ssize_t r = pmemfile_read(pfp, file, buf, sizeof(buf));
+	EXPECT_EQ(r, -1);
+	EXPECT_EQ(errno, EBADF);
+
+	pmemfile_stat_t st;
+	EXPECT_EQ(pmemfile_fstat(pfp, file, &st), 0) << strerror(errno);
+	EXPECT_TRUE(PMEMFILE_S_ISLNK(st.st_mode));
+
+	r = pmemfile_readlinkat(pfp, file, "", buf, sizeof(buf));
+	EXPECT_GT(r, 0) << strerror(errno);
+
 	pmemfile_close(pfp, file);
-#endif
+
+	if (r <= 0 || !PMEMFILE_S_ISLNK(st.st_mode))
+		return false;
 
 	return true;
 }
@@ -43,6 +43,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <limits.h>
 
 int
 main(int argc, char **argv)
@@ -240,5 +241,57 @@ main(int argc, char **argv)
 	if (close(fd) != 0)
 		err(1, "close \"%s\"", dir_to_list_path);
 
+	/*
+	 * Replace kernel directories, which were already walked through, with
+	 * symlinks to the mount point, and check the pmemfile resident file
+	 * "a" is visible through them.
+	 */
+	char dir_path[PATH_MAX];
+	char file_path[PATH_MAX];
+	char old_path[PATH_MAX];
+
+	snprintf(dir_path, sizeof(dir_path), "%s/cache_dir", chdir_path);
+	snprintf(file_path, sizeof(file_path), "%s/cache_dir/a", chdir_path);
+	snprintf(old_path, sizeof(old_path), "%s/cache_dir_old", chdir_path);
+
+	if (mkdir(dir_path, 0755) != 0)
+		err(1, "mkdir \"%s\"", dir_path);
+
+	if (stat(file_path, &stat_buf) == 0 || errno != ENOENT)
+		errx(1, "stat \"%s\" before rename", file_path);
+
+	if (rename(dir_path, old_path) != 0)
+		err(1, "rename \"%s\"", dir_path);
+
+	if (symlink("mount_point", dir_path) != 0)
+		err(1, "symlink \"%s\"", dir_path);
+
+	if (stat(file_path, &stat_buf) != 0)
+		err(1, "stat \"%s\" after rename", file_path);
+
+	if (unlink(dir_path) != 0)
+		err(1, "unlink \"%s\"", dir_path);
+
+	if (stat(old_path, &stat_buf) != 0)
+		err(1, "stat \"%s\"", old_path);
+
+	snprintf(file_path, sizeof(file_path), "%s/cache_dir_old/a",
+			chdir_path);
+
+	if (stat(file_path, &stat_buf) == 0 || errno != ENOENT)
+		errx(1, "stat \"%s\" before rmdir", file_path);
+
+	if (rmdir(old_path) != 0)
+		err(1, "rmdir \"%s\"", old_path);
+
+	if (symlink("mount_point", old_path) != 0)
+		err(1, "symlink \"%s\"", old_path);
+
+	if (stat(file_path, &stat_buf) != 0)
+		err(1, "stat \"%s\" after rmdir", file_path);
+
+	if (unlink(old_path) != 0)
+		err(1, "unlink \"%s\"", old_path);
+
 	return 0;
 }
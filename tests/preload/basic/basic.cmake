@@ -45,6 +45,10 @@ set(ENV{PMEMFILE_PRELOAD_LOG} ${BIN_DIR}/pmemfile_preload.log)
 set(ENV{INTERCEPT_LOG} ${BIN_DIR}/intercept.log)
 set(ENV{PMEMFILE_EXIT_ON_NOT_SUPPORTED} 1)
 
+if(DEFINED PATH_CACHE)
+        set(ENV{PMEMFILE_PRELOAD_PATH_CACHE} ${PATH_CACHE})
+endif()
+
 execute_process(COMMAND ${MAIN_EXECUTABLE} ${DIR}/some_dir/some_link/a ${DIR} mount_point/b mount_point b
                 OUTPUT_FILE ${DIR}/root_dir.log
                 RESULT_VARIABLE res)
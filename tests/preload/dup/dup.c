@@ -42,15 +42,25 @@
 #define _GNU_SOURCE
 
 #include <assert.h>
+#include <dirent.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 #include "compiler_utils.h"
 
+#ifndef SYS_close_range
+#define SYS_close_range 436
+#endif
+
 static int
 xcreate(const char *path)
 {
@@ -248,6 +258,241 @@ test_fcntl_dup(const char *path)
 	seek_and_destroy(fd, fd2);
 }
 
+/*
+ * test_high_fd -- dup2 to an fd number above the size of the fd table used
+ * by older versions of libpmemfile, if the fd limit allows that
+ */
+static void
+test_high_fd(const char *path)
+{
+	const int high_fd = 0x8000 + 0x100;
+	struct rlimit limit;
+
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+		err(1, "getrlimit");
+
+	if (limit.rlim_max <= (rlim_t)high_fd) {
+		fputs("fd limit too low, skipping\n", stderr);
+		return;
+	}
+
+	limit.rlim_cur = limit.rlim_max;
+	if (setrlimit(RLIMIT_NOFILE, &limit) != 0)
+		err(1, "setrlimit");
+
+	int fd = xcreate(path);
+	xdup2(fd, high_fd);
+	seek_and_destroy(fd, high_fd);
+}
+
+/*
+ * count_fds_from -- returns the number of open fds not lower than min_fd
+ */
+static unsigned
+count_fds_from(int min_fd)
+{
+	DIR *dir = opendir("/proc/self/fd");
+	if (dir == NULL)
+		err(1, "opendir(\"/proc/self/fd\")");
+
+	unsigned count = 0;
+	struct dirent *d;
+	while ((d = readdir(dir)) != NULL) {
+		if (d->d_name[0] != '.' && atoi(d->d_name) >= min_fd)
+			++count;
+	}
+
+	closedir(dir);
+
+	return count;
+}
+
+/*
+ * test_low_fds -- the kernel hands out the lowest free fd, which must not be
+ * taken by a placeholder of the fd pool
+ */
+static void
+test_low_fds(const char *path)
+{
+	int fd[8];
+	int saved_stdin = xdup(0);
+
+	/* placeholders are far above the fds of this test */
+	unsigned placeholders = count_fds_from(64);
+
+	xclose(0);
+
+	/* takes fds out of the pool, so it's refilled */
+	for (size_t i = 0; i < ARRAY_SIZE(fd); ++i)
+		fd[i] = xcreate(path);
+	for (size_t i = 0; i < ARRAY_SIZE(fd); ++i)
+		xclose(fd[i]);
+
+	/*
+	 * The pool (of 16 fds, see dup.cmake) is more than half full between
+	 * opens, as nothing above closed its placeholders, so taking 8 fds out
+	 * of it makes it drop to half exactly once.
+	 * With synchronous refilling it's refilled right then, and it ends up
+	 * with as many placeholders as it had before.
+	 */
+	const char *sync = getenv("PMEMFILE_PRELOAD_FD_POOL_SYNC");
+	if (sync && sync[0] == '1')
+		assert(count_fds_from(64) == placeholders);
+
+	int null_fd = open("/dev/null", O_RDONLY);
+	if (null_fd < 0)
+		err(1, "open(\"/dev/null\")");
+	assert(null_fd == 0);
+
+	xdup2(saved_stdin, 0);
+	xclose(saved_stdin);
+}
+
+/*
+ * test_close_range -- files closed by close_range can't be used anymore
+ */
+static void
+test_close_range(const char *path)
+{
+	int fd[8];
+	int first = -1;
+	int last = -1;
+
+	for (size_t i = 0; i < ARRAY_SIZE(fd); ++i) {
+		fd[i] = xcreate(path);
+
+		if (first < 0 || fd[i] < first)
+			first = fd[i];
+		if (fd[i] > last)
+			last = fd[i];
+	}
+
+	/* other open fds can't be in the range, placeholders can */
+	for (int n = first; n <= last; ++n) {
+		bool ours = false;
+		for (size_t i = 0; i < ARRAY_SIZE(fd); ++i)
+			ours = ours || fd[i] == n;
+
+		if (!ours && fcntl(n, F_GETFD) >= 0) {
+			fputs("other fds in the range, skipping\n", stderr);
+			for (size_t i = 0; i < ARRAY_SIZE(fd); ++i)
+				xclose(fd[i]);
+			return;
+		}
+	}
+
+	if (syscall(SYS_close_range, first, last, 0) != 0) {
+		if (errno != ENOSYS)
+			err(1, "close_range");
+
+		fputs("close_range not supported, skipping\n", stderr);
+		for (size_t i = 0; i < ARRAY_SIZE(fd); ++i)
+			xclose(fd[i]);
+		return;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(fd); ++i) {
+		errno = 0;
+		assert(lseek(fd[i], 0, SEEK_SET) == -1);
+		assert(errno == EBADF);
+	}
+
+	/* numbers can be reused */
+	fd[0] = xcreate(path);
+	fd[1] = xdup(fd[0]);
+	seek_and_destroy(fd[0], fd[1]);
+}
+
+#define STRESS_THREADS 8
+#define STRESS_ITERATIONS 20000
+#define STRESS_SIZE 64
+
+static int stress_fd;
+static int stress_done;
+
+/*
+ * stress_reader -- reads from stress_fd, while the main thread keeps
+ * replacing the file behind it via dup2. Every read must see one of the
+ * files in full, dup2 is atomic.
+ */
+static void *
+stress_reader(void *arg)
+{
+	(void) arg;
+	char buf[STRESS_SIZE];
+
+	while (!__atomic_load_n(&stress_done, __ATOMIC_ACQUIRE)) {
+		if (pread(stress_fd, buf, sizeof(buf), 0) != sizeof(buf))
+			err(1, "pread");
+
+		for (size_t i = 1; i < sizeof(buf); ++i) {
+			if (buf[i] != buf[0])
+				errx(1, "torn read");
+		}
+
+		if (buf[0] != 'a' && buf[0] != 'b' && buf[0] != 'k')
+			errx(1, "unexpected content: %c", buf[0]);
+	}
+
+	return NULL;
+}
+
+static int
+create_filled(const char *path, const char *suffix, char c)
+{
+	char name[0x1000];
+	char buf[STRESS_SIZE];
+
+	snprintf(name, sizeof(name), "%s%s", path, suffix);
+	memset(buf, c, sizeof(buf));
+
+	int fd = xcreate(name);
+	xwrite(fd, buf, sizeof(buf));
+
+	return fd;
+}
+
+/*
+ * test_stress -- dup2 files from both domains over an fd, which other threads
+ * are reading from
+ */
+static void
+test_stress(const char *path_in_kernel, const char *path_in_pmemf)
+{
+	pthread_t threads[STRESS_THREADS];
+
+	int fd_a = create_filled(path_in_pmemf, "_stress_a", 'a');
+	int fd_b = create_filled(path_in_pmemf, "_stress_b", 'b');
+	int fd_k = create_filled(path_in_kernel, "_stress_k", 'k');
+
+	stress_fd = xdup(fd_a);
+
+	for (unsigned i = 0; i < STRESS_THREADS; ++i) {
+		errno = pthread_create(&threads[i], NULL, stress_reader, NULL);
+		if (errno)
+			err(1, "pthread_create");
+	}
+
+	for (unsigned i = 0; i < STRESS_ITERATIONS; ++i) {
+		xdup2(fd_b, stress_fd);
+		xdup2(fd_k, stress_fd);
+		xdup2(fd_a, stress_fd);
+	}
+
+	__atomic_store_n(&stress_done, 1, __ATOMIC_RELEASE);
+
+	for (unsigned i = 0; i < STRESS_THREADS; ++i) {
+		errno = pthread_join(threads[i], NULL);
+		if (errno)
+			err(1, "pthread_join");
+	}
+
+	xclose(stress_fd);
+	xclose(fd_a);
+	xclose(fd_b);
+	xclose(fd_k);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -274,5 +519,23 @@ main(int argc, char **argv)
 	fputs("Testing fcntl with cmd=F_DUPFD, with pmemfile\n", stderr);
 	test_fcntl_dup(path_in_pmemf);
 
+	fputs("Testing high fd numbers, with kernel\n", stderr);
+	test_high_fd(path_in_kernel);
+
+	fputs("Testing high fd numbers, with pmemfile\n", stderr);
+	test_high_fd(path_in_pmemf);
+
+	fputs("Testing low fd numbers\n", stderr);
+	test_low_fds(path_in_pmemf);
+
+	fputs("Testing close_range, with kernel\n", stderr);
+	test_close_range(path_in_kernel);
+
+	fputs("Testing close_range, with pmemfile\n", stderr);
+	test_close_range(path_in_pmemf);
+
+	fputs("Testing dup2 racing with reads\n", stderr);
+	test_stress(path_in_kernel, path_in_pmemf);
+
 	return 0;
 }
@@ -44,6 +44,11 @@ set(ENV{PMEMFILE_PRELOAD_LOG} ${BIN_DIR}/pmemfile_preload.log)
 set(ENV{INTERCEPT_LOG} ${BIN_DIR}/intercept.log)
 set(ENV{PMEMFILE_EXIT_ON_NOT_SUPPORTED} 1)
 
+if(DEFINED FD_POOL)
+        set(ENV{PMEMFILE_PRELOAD_FD_POOL} ${FD_POOL})
+        set(ENV{PMEMFILE_PRELOAD_FD_POOL_SYNC} 1)
+endif()
+
 execute_process(COMMAND ${MAIN_EXECUTABLE} ${DIR}/some_dir/filename ${DIR}/mount_point/filename
                 OUTPUT_FILE ${DIR}/root_dir.log
                 RESULT_VARIABLE res)
@@ -86,6 +86,23 @@ mkdir(${DIR}/mount_point/test_dir/a/b/c/d/e/f/g/h/i/j/k/l/m/n)
 
 # XXX add VERY deep rm -r test
 
+# deep paths, going in and out of the pool through ".." and symlinks
+execute_process(COMMAND ${CMAKE_COMMAND} -E make_directory
+	${DIR}/k/1/2/3/4/5/6/7/8/9/10)
+execute_process(COMMAND ln -s ../../../../../../../../../../../mount_point
+	${DIR}/k/1/2/3/4/5/6/7/8/9/10/mp)
+
+execute(cp ${DIR}/k/1/2/3/4/5/6/7/8/9/10/mp/test_dir/file_a ${DIR}/file_a.log)
+cmp(${DIR}/file_a.log ${DIR}/dummy_file_a)
+
+execute(cp ${DIR}/mount_point/test_dir/a/b/c/d/e/f/g/h/i/j/../../../../../../../../../../../../dummy_file_b
+	${DIR}/file_b.log)
+cmp(${DIR}/file_b.log ${DIR}/dummy_file_b)
+
+execute(cp ${DIR}/k/1/2/3/4/5/6/7/8/9/10/mp/test_dir/a/b/c/d/e/f/g/h/../../../../../../../../../test_dir/test_subdir/file_b
+	${DIR}/file_b.log)
+cmp(${DIR}/file_b.log ${DIR}/dummy_file_b)
+
 foreach(dir_index RANGE 0 64)
         mkdir(${DIR}/mount_point/test_dir/a/b/c/d/e/f/g/x${dir_index})
 endforeach()
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * process_switching.c -- many threads entering and leaving the pool
+ *
+ * With process switching every syscall in the pool takes a reference on
+ * the pool, and the last thread leaving it suspends the pool, which closes
+ * the pool file. After all threads are done the pool file must not be
+ * locked anymore, and the pool must still work after that.
+ */
+
+#include <err.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define THREADS 8
+#define ROUNDS 10
+#define LOOPS 2000
+
+static const char *pool_path;
+static const char *filename;
+
+static void *
+worker(void *arg)
+{
+	(void) arg;
+
+	for (int i = 0; i < LOOPS; i++) {
+		struct stat st;
+
+		if (stat(filename, &st))
+			err(1, "stat(\"%s\")", filename);
+
+		int fd = open(filename, O_RDONLY);
+		if (fd < 0)
+			err(1, "open(\"%s\")", filename);
+
+		if (fstat(fd, &st))
+			err(1, "fstat");
+
+		if (close(fd))
+			err(1, "close");
+	}
+
+	return NULL;
+}
+
+/*
+ * check_suspended -- checks nobody holds the pool open
+ */
+static void
+check_suspended(void)
+{
+	int fd = open(pool_path, O_RDONLY);
+	if (fd < 0)
+		err(1, "open(\"%s\")", pool_path);
+
+	/* pmemobj keeps the lock for as long as the pool is open */
+	if (flock(fd, LOCK_EX | LOCK_NB))
+		err(1, "pool is not suspended, flock(\"%s\")", pool_path);
+
+	if (flock(fd, LOCK_UN))
+		err(1, "flock(LOCK_UN)");
+
+	close(fd);
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 3)
+		return 1;
+
+	pool_path = argv[1];
+	filename = argv[2];
+
+	int fd = open(filename, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		err(1, "open(\"%s\")", filename);
+	close(fd);
+
+	check_suspended();
+
+	for (int r = 0; r < ROUNDS; r++) {
+		pthread_t threads[THREADS];
+
+		for (int i = 0; i < THREADS; i++) {
+			if (pthread_create(&threads[i], NULL, worker, NULL))
+				errx(1, "pthread_create");
+		}
+
+		for (int i = 0; i < THREADS; i++) {
+			if (pthread_join(threads[i], NULL))
+				errx(1, "pthread_join");
+		}
+
+		check_suspended();
+	}
+
+	if (unlink(filename))
+		err(1, "unlink(\"%s\")", filename);
+
+	check_suspended();
+
+	return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * validate.c -- checks of PMEMFILE_PRELOAD_VALIDATE_POINTERS
+ *
+ * Passing "pipe" as the second argument makes process_vm_readv fail with
+ * EPERM (using seccomp), so libpmemfile has to fall back to probing memory
+ * by writing it to a pipe.
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+/* more than PROBE_BATCH pages of libpmemfile */
+#define BIG_PAGES 100
+
+static size_t page_size;
+
+static void *
+xmmap(size_t len)
+{
+	void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		err(1, "mmap");
+
+	return p;
+}
+
+static void
+xmprotect(void *addr, size_t len, int prot)
+{
+	if (mprotect(addr, len, prot))
+		err(1, "mprotect");
+}
+
+/*
+ * deny_process_vm_readv -- makes process_vm_readv fail with EPERM
+ */
+static void
+deny_process_vm_readv(void)
+{
+	struct sock_filter filter[] = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+				offsetof(struct seccomp_data, nr)),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_process_vm_readv,
+				0, 1),
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | EPERM),
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+	};
+	struct sock_fprog prog = {
+		.len = sizeof(filter) / sizeof(filter[0]),
+		.filter = filter,
+	};
+
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0))
+		err(1, "prctl(PR_SET_NO_NEW_PRIVS)");
+	if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog))
+		err(1, "prctl(PR_SET_SECCOMP)");
+}
+
+static void
+expect_efault(ssize_t r, const char *what)
+{
+	if (r != -1 || errno != EFAULT)
+		errx(1, "%s: expected EFAULT, got %zd (%d)", what, r, errno);
+}
+
+/*
+ * test_prot_none -- buffer crossing from a readable page into a PROT_NONE one
+ */
+static void
+test_prot_none(int fd)
+{
+	char *p = xmmap(2 * page_size);
+	xmprotect(p + page_size, page_size, PROT_NONE);
+
+	char *buf = p + page_size - 16;
+	memset(buf, 'x', 16);
+
+	errno = 0;
+	expect_efault(write(fd, buf, 32), "write crossing into PROT_NONE");
+	errno = 0;
+	expect_efault(read(fd, buf, 32), "read crossing into PROT_NONE");
+
+	assert(write(fd, buf, 16) == 16);
+
+	munmap(p, 2 * page_size);
+}
+
+/*
+ * test_unterminated -- path without terminator, followed by an unmapped page
+ */
+static void
+test_unterminated(const char *dir)
+{
+	char *p = xmmap(2 * page_size);
+	if (munmap(p + page_size, page_size))
+		err(1, "munmap");
+
+	/* points into the pool, so it's not only the kernel checking it */
+	size_t len = strlen(dir);
+	char *path = p + page_size - len - 32;
+	memcpy(path, dir, len);
+	memset(path + len, 'a', 32);
+	path[len] = '/';
+
+	errno = 0;
+	expect_efault(open(path, O_RDONLY), "open of unterminated path");
+
+	/* the same path, terminated right before the unmapped page */
+	p[page_size - 1] = '\0';
+	errno = 0;
+	assert(open(path, O_RDONLY) == -1);
+	assert(errno == ENOENT);
+
+	munmap(p, page_size);
+}
+
+/*
+ * test_big -- buffers longer than one batch of probed pages, with a hole in
+ * the first batch, in the second batch, and without holes
+ */
+static void
+test_big(int fd)
+{
+	size_t len = BIG_PAGES * page_size;
+	char *p = xmmap(len);
+	memset(p, 'y', len);
+
+	size_t holes[] = {10, 70, BIG_PAGES - 1};
+
+	for (size_t i = 0; i < sizeof(holes) / sizeof(holes[0]); ++i) {
+		char *hole = p + holes[i] * page_size;
+
+		xmprotect(hole, page_size, PROT_NONE);
+
+		errno = 0;
+		expect_efault(write(fd, p, len), "write with a hole");
+
+		xmprotect(hole, page_size, PROT_READ | PROT_WRITE);
+	}
+
+	if (lseek(fd, 0, SEEK_SET) != 0)
+		err(1, "lseek");
+	assert(write(fd, p, len) == (ssize_t)len);
+
+	memset(p, 0, len);
+	if (lseek(fd, 0, SEEK_SET) != 0)
+		err(1, "lseek");
+	assert(read(fd, p, len) == (ssize_t)len);
+	assert(p[0] == 'y' && p[len - 1] == 'y');
+
+	munmap(p, len);
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 2)
+		errx(1, "usage: %s dir_in_pool [pipe]", argv[0]);
+
+	page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+	if (argc > 2 && strcmp(argv[2], "pipe") == 0)
+		deny_process_vm_readv();
+
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/file", argv[1]);
+
+	int fd = open(path, O_CREAT | O_RDWR, 0644);
+	if (fd < 0)
+		err(1, "open %s", path);
+
+	test_prot_none(fd);
+	test_unterminated(argv[1]);
+	test_big(fd);
+
+	close(fd);
+	unlink(path);
+
+	return 0;
+}
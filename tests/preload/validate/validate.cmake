@@ -0,0 +1,67 @@
+#
+# Copyright 2017, Intel Corporation
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in
+#       the documentation and/or other materials provided with the
+#       distribution.
+#
+#     * Neither the name of the copyright holder nor the names of its
+#       contributors may be used to endorse or promote products derived
+#       from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+include(${SRC_DIR}/../preload-helpers.cmake)
+
+setup()
+
+mkfs(${DIR}/fs 16m)
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E make_directory ${DIR}/mount_point)
+
+set(ENV{LD_PRELOAD} ${PRELOAD_LIB})
+set(ENV{PMEMFILE_POOLS} ${DIR}/mount_point:${DIR}/fs)
+set(ENV{PMEMFILE_PRELOAD_VALIDATE_POINTERS} 1)
+set(ENV{INTERCEPT_LOG} ${BIN_DIR}/intercept.log)
+
+set(ENV{PMEMFILE_PRELOAD_LOG} ${BIN_DIR}/pmemfile_preload.log)
+execute(${MAIN_EXECUTABLE} ${DIR}/mount_point)
+
+# process_vm_readv denied, memory is probed using a pipe
+set(ENV{PMEMFILE_PRELOAD_LOG} ${BIN_DIR}/pmemfile_preload_pipe.log)
+execute(${MAIN_EXECUTABLE} ${DIR}/mount_point pipe)
+
+unset(ENV{LD_PRELOAD})
+unset(ENV{PMEMFILE_PRELOAD_VALIDATE_POINTERS})
+
+file(READ ${BIN_DIR}/pmemfile_preload.log log)
+string(FIND "${log}" "process_vm_readv failure" pos)
+if(NOT pos EQUAL -1)
+	message(FATAL_ERROR "process_vm_readv failed without seccomp filter")
+endif()
+
+file(READ ${BIN_DIR}/pmemfile_preload_pipe.log log)
+string(FIND "${log}" "process_vm_readv failure" pos)
+if(pos EQUAL -1)
+	message(FATAL_ERROR "pipe fallback was not used")
+endif()
+
+cleanup()